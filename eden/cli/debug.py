@@ -11,6 +11,7 @@ import argparse
 import binascii
 import collections
 import os
+import sqlite3
 import stat
 import sys
 from typing import List, IO, Tuple
@@ -307,10 +308,22 @@ def _load_overlay_tree(overlay_dir: str, inode_number: int) -> OverlayDir:
     from thrift.util import Serializer
     from thrift.protocol import TCompactProtocol
 
-    dir_name = '{:02x}'.format(inode_number % 256)
-    overlay_file_path = os.path.join(overlay_dir, dir_name, str(inode_number))
-    with open(overlay_file_path, 'rb') as f:
-        data = f.read()
+    db_path = os.path.join(overlay_dir, 'dirs.db')
+    if os.path.exists(db_path):
+        # This overlay stores its directories in a sqlite database
+        with sqlite3.connect(db_path) as db:
+            row = db.execute(
+                'SELECT value FROM dirs WHERE inode = ?', (inode_number,)
+            ).fetchone()
+        if row is None:
+            raise Exception(f'no overlay data for inode {inode_number}')
+        data = row[0]
+    else:
+        dir_name = '{:02x}'.format(inode_number % 256)
+        overlay_file_path = os.path.join(
+            overlay_dir, dir_name, str(inode_number))
+        with open(overlay_file_path, 'rb') as f:
+            data = f.read()
 
     assert data[0:4] == b'OVDR'
 
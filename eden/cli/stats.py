@@ -69,6 +69,15 @@ def do_stats_general(
                         Trees: {info.loadedTreeCount}
                     Unloaded inodes in memory: {info.unloadedInodeCount}
                     Materialized inodes in memory: {info.materializedInodeCount}
+                    Startup overlay scan needed: {info.startupScannedOverlay}
+                    Startup inode number init: {info.startupInodeNumberInitMicros}us
+                    Startup total init time: {info.startupTotalInitMicros}us
+                    Overlay file cache hits: {info.overlayFileCacheHits}
+                    Overlay file cache misses: {info.overlayFileCacheMisses}
+                    Overlay file cache evictions: {info.overlayFileCacheEvictions}
+                    Journal entries: {info.journalEntryCount}
+                    Journal memory usage: {info.journalMemoryUsage} bytes
+                    Journal entries discarded: {info.journalTruncatedEntries}
                 '''))
 
 
@@ -32,11 +32,14 @@ constexpr folly::StringPiece kBindMountsSection{"bind-mounts"};
 constexpr folly::StringPiece kRepoSection{"repository"};
 constexpr folly::StringPiece kRepoSourceKey{"path"};
 constexpr folly::StringPiece kRepoTypeKey{"type"};
+constexpr folly::StringPiece kOverlaySection{"overlay"};
+constexpr folly::StringPiece kOverlayDirStorageKey{"dir-storage"};
 
 // Files of interest in the client directory.
 const facebook::eden::RelativePathPiece kSnapshotFile{"SNAPSHOT"};
 const facebook::eden::RelativePathPiece kBindMountsDir{"bind-mounts"};
 const facebook::eden::RelativePathPiece kOverlayDir{"local"};
+const facebook::eden::RelativePathPiece kJournalFile{"journal"};
 
 // File holding mapping of client directories.
 const facebook::eden::RelativePathPiece kClientDirectoryMap{"config.json"};
@@ -158,6 +161,10 @@ AbsolutePath ClientConfig::getOverlayPath() const {
   return clientDirectory_ + kOverlayDir;
 }
 
+AbsolutePath ClientConfig::getJournalPath() const {
+  return clientDirectory_ + kJournalFile;
+}
+
 std::unique_ptr<ClientConfig> ClientConfig::loadFromClientDirectory(
     AbsolutePathPiece mountPath,
     AbsolutePathPiece clientDirectory) {
@@ -173,6 +180,25 @@ std::unique_ptr<ClientConfig> ClientConfig::loadFromClientDirectory(
   config->repoType_ = *repository->get_as<std::string>(kRepoTypeKey.str());
   config->repoSource_ = *repository->get_as<std::string>(kRepoSourceKey.str());
 
+  // Load overlay settings
+  auto overlay = configRoot->get_table(kOverlaySection.str());
+  if (overlay != nullptr) {
+    auto dirStorage = overlay->get_as<std::string>(kOverlayDirStorageKey.str());
+    if (dirStorage) {
+      if (*dirStorage == "sqlite") {
+        config->overlayDirStorage_ = OverlayDirStorage::Sqlite;
+      } else if (*dirStorage == "files") {
+        config->overlayDirStorage_ = OverlayDirStorage::Files;
+      } else {
+        throw std::runtime_error(folly::to<std::string>(
+            "unsupported overlay dir-storage setting \"",
+            *dirStorage,
+            "\" in ",
+            configPath));
+      }
+    }
+  }
+
   // Extract the bind mounts
   AbsolutePath bindMountsPath = clientDirectory + kBindMountsDir;
   auto bindMounts = configRoot->get_table(kBindMountsSection.str());
@@ -36,6 +36,16 @@ inline void operator<<(std::ostream& out, const BindMount& bindMount) {
       << "; pathInMountDir=" << bindMount.pathInMountDir << "}";
 }
 
+/**
+ * How the overlay should store the contents of materialized directories.
+ */
+enum class OverlayDirStorage {
+  /** One file per directory inode, sharded across 256 subdirectories. */
+  Files,
+  /** A single sqlite database holding all directory records. */
+  Sqlite,
+};
+
 class ClientConfig {
  public:
   /**
@@ -86,6 +96,18 @@ class ClientConfig {
     return bindMounts_;
   }
 
+  /**
+   * Get the storage format to use for directories in a newly created overlay.
+   *
+   * This is controlled by the "dir-storage" key in the "overlay" section of
+   * the client config, and defaults to OverlayDirStorage::Files.  Existing
+   * overlays keep using the format they were created with until they are
+   * migrated.
+   */
+  OverlayDirStorage getOverlayDirStorage() const {
+    return overlayDirStorage_;
+  }
+
   /**
    * Get the repository type.
    *
@@ -109,6 +131,9 @@ class ClientConfig {
   /** Path to the file where the current commit ID is stored */
   AbsolutePath getSnapshotPath() const;
 
+  /** Path to the file where the journal is saved across restarts */
+  AbsolutePath getJournalPath() const;
+
   /** Path to the client directory */
   const AbsolutePath& getClientDirectory() const;
 
@@ -123,6 +148,7 @@ class ClientConfig {
   std::vector<BindMount> bindMounts_;
   std::string repoType_;
   std::string repoSource_;
+  OverlayDirStorage overlayDirStorage_{OverlayDirStorage::Files};
 };
 } // namespace eden
 } // namespace facebook
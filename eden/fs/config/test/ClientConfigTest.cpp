@@ -20,6 +20,7 @@ using facebook::eden::AbsolutePath;
 using facebook::eden::BindMount;
 using facebook::eden::ClientConfig;
 using facebook::eden::Hash;
+using facebook::eden::OverlayDirStorage;
 using facebook::eden::RelativePath;
 using folly::Optional;
 using folly::StringPiece;
@@ -222,3 +223,22 @@ TEST_F(ClientConfigTest, testBadSnapshot) {
                   48},
       "should have size 40");
 }
+
+TEST_F(ClientConfigTest, testOverlayDirStorage) {
+  {
+    auto config = ClientConfig::loadFromClientDirectory(
+        AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
+    EXPECT_EQ(OverlayDirStorage::Files, config->getOverlayDirStorage());
+  }
+
+  auto data =
+      "[repository]\n"
+      "path = \"/data/users/carenthomas/fbsource\"\n"
+      "type = \"git\"\n"
+      "[overlay]\n"
+      "dir-storage = \"sqlite\"\n";
+  folly::writeFile(folly::StringPiece{data}, configDotToml_.c_str());
+  auto config = ClientConfig::loadFromClientDirectory(
+      AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
+  EXPECT_EQ(OverlayDirStorage::Sqlite, config->getOverlayDirStorage());
+}
@@ -103,6 +103,12 @@ class EdenStats
   Histogram poll{createHistogram("fuse.poll_us")};
   Histogram forgetmulti{createHistogram("fuse.forgetmulti_us")};
 
+  // The latency of the cache invalidation notifications we send the kernel.
+  Histogram invalidateEntry{createHistogram("fuse.invalidate_entry_us")};
+
+  // The latency of entire getSHA1() thrift calls, which may hash many files.
+  Histogram getSha1Batch{createHistogram("thrift.getSHA1_batch_us")};
+
   // Since we can potentially finish a request in a different
   // thread from the one used to initiate it, we use HistogramPtr
   // as a helper for referencing the pointer-to-member that we
@@ -186,30 +186,47 @@ Future<Unit> CheckoutAction::run(
     refcount->error("error preparing to load data for checkout action", ew);
   }
 
-  return promise_.getFuture();
+  return promise_.getFuture().ensure([this] { entryUpdated(); });
+}
+
+Future<Unit> CheckoutAction::getEntryUpdatedFuture() {
+  return entryUpdatedPromise_.getFuture();
+}
+
+void CheckoutAction::entryUpdated() {
+  // This is called a second time when the action completes if it has already
+  // been called for a subdirectory.  The two calls never race, since the
+  // action cannot complete before doAction() has returned.
+  if (!entryUpdatedPromise_.isFulfilled()) {
+    entryUpdatedPromise_.setValue();
+  }
 }
 
 void CheckoutAction::setOldTree(std::shared_ptr<const Tree> tree) {
   CHECK(!oldTree_);
   CHECK(!oldBlob_);
+  ctx_->treeLoaded();
   oldTree_ = std::move(tree);
 }
 
 void CheckoutAction::setOldBlob(std::shared_ptr<const Blob> blob) {
   CHECK(!oldTree_);
   CHECK(!oldBlob_);
+  ctx_->blobLoaded(blob->getContents().computeChainDataLength());
   oldBlob_ = std::move(blob);
 }
 
 void CheckoutAction::setNewTree(std::shared_ptr<const Tree> tree) {
   CHECK(!newTree_);
   CHECK(!newBlob_);
+  ctx_->treeLoaded();
   newTree_ = std::move(tree);
 }
 
 void CheckoutAction::setNewBlob(std::shared_ptr<const Blob> blob) {
   CHECK(!newTree_);
   CHECK(!newBlob_);
+  ctx_->blobLoaded(blob->getContents().computeChainDataLength());
   newBlob_ = std::move(blob);
 }
 
@@ -282,37 +299,52 @@ bool CheckoutAction::ensureDataReady() noexcept {
 Future<Unit> CheckoutAction::doAction() {
   // All the data is ready and we're ready to go!
 
-  // Check for conflicts first.
-  auto conflictWasAddedToCtx = hasConflict();
-  // Note that even if we know we are not going to apply the changes, we must
-  // still run hasConflict() first because we rely on its side-effects.
-  if (conflictWasAddedToCtx && !ctx_->forceUpdate()) {
-    // We only report conflicts for files, not directories. The only possible
-    // conflict that can occur here if this inode is a TreeInode is that the old
-    // source control state was for a file. There aren't really any other
-    // conflicts than this to report, even if we recurse. Anything inside this
-    // directory is basically just untracked (or possibly ignored) files.
-    return makeFuture();
-  }
+  // Check for conflicts first.  This may have to hash a modified file, so it
+  // can complete asynchronously.
+  return hasConflict().then([this](bool conflictWasAddedToCtx) {
+    // Note that even if we know we are not going to apply the changes, we
+    // must still run hasConflict() first because we rely on its side-effects.
+    if (conflictWasAddedToCtx && !ctx_->forceUpdate()) {
+      // We only report conflicts for files, not directories. The only
+      // possible conflict that can occur here if this inode is a TreeInode is
+      // that the old source control state was for a file. There aren't really
+      // any other conflicts than this to report, even if we recurse. Anything
+      // inside this directory is basically just untracked (or possibly
+      // ignored) files.
+      return makeFuture();
+    }
 
-  // Call TreeInode::checkoutUpdateEntry() to actually do the work.
-  //
-  // Note that we are moving most of our state into the checkoutUpdateEntry()
-  // arguments.  We have to be slightly careful here: getEntryName() returns a
-  // PathComponentPiece that is pointing into a PathComponent owned either by
-  // oldScmEntry_ or newScmEntry_.  Therefore don't move these scm entries,
-  // to make sure we don't invalidate the PathComponentPiece data.
-  auto parent = inode_->getParent(ctx_->renameLock());
-  return parent->checkoutUpdateEntry(
-      ctx_,
-      getEntryName(),
-      std::move(inode_),
-      std::move(oldTree_),
-      std::move(newTree_),
-      newScmEntry_);
+    // Call TreeInode::checkoutUpdateEntry() to actually do the work.
+    //
+    // Note that we are moving most of our state into the
+    // checkoutUpdateEntry() arguments.  We have to be slightly careful here:
+    // getEntryName() returns a PathComponentPiece that is pointing into a
+    // PathComponent owned either by oldScmEntry_ or newScmEntry_.  Therefore
+    // don't move these scm entries, to make sure we don't invalidate the
+    // PathComponentPiece data.
+    TreeInodePtr parent;
+    {
+      // Our parent is busy with this checkout, so it cannot change.  We only
+      // need the lock to satisfy getParent().
+      auto renameLock = inode_->getMount()->acquireRenameLock();
+      parent = inode_->getParent(renameLock);
+    }
+    if (newTree_ && inode_.asTreePtrOrNull()) {
+      // Updating a directory in place does not change its entry in our
+      // parent, so the parent does not have to wait for the whole subtree.
+      entryUpdated();
+    }
+    return parent->checkoutUpdateEntry(
+        ctx_,
+        getEntryName(),
+        std::move(inode_),
+        std::move(oldTree_),
+        std::move(newTree_),
+        newScmEntry_);
+  });
 }
 
-bool CheckoutAction::hasConflict() {
+Future<bool> CheckoutAction::hasConflict() {
   if (oldTree_) {
     auto treeInode = inode_.asTreePtrOrNull();
     if (!treeInode) {
@@ -337,20 +369,24 @@ bool CheckoutAction::hasConflict() {
     }
 
     // Check that the file contents are the same as the old source control entry
-    if (!fileInode->isSameAs(*oldBlob_, oldScmEntry_.value().getType())) {
-      // The file contents or mode bits are different:
-      // - If the file exists in the new tree but differs from what is currently
-      //   in the working copy, then this is a MODIFIED_MODIFIED conflict.
-      // - If the file does not exist in the new tree, then this is a
-      //   MODIFIED_REMOVED conflict.
-      auto conflictType = newScmEntry_ ? ConflictType::MODIFIED_MODIFIED
-                                       : ConflictType::MODIFIED_REMOVED;
-      ctx_->addConflict(conflictType, inode_.get());
-      return true;
-    }
-
-    // This file is the same as the old source control state.
-    return false;
+    return fileInode->isSameAs(*oldBlob_, oldScmEntry_.value().getType())
+        .then([this](bool isSame) {
+          if (isSame) {
+            // This file is the same as the old source control state.
+            return false;
+          }
+
+          // The file contents or mode bits are different:
+          // - If the file exists in the new tree but differs from what is
+          //   currently in the working copy, then this is a MODIFIED_MODIFIED
+          //   conflict.
+          // - If the file does not exist in the new tree, then this is a
+          //   MODIFIED_REMOVED conflict.
+          auto conflictType = newScmEntry_ ? ConflictType::MODIFIED_MODIFIED
+                                           : ConflictType::MODIFIED_REMOVED;
+          ctx_->addConflict(conflictType, inode_.get());
+          return true;
+        });
   }
 
   DCHECK(!oldScmEntry_) << "Both oldTree_ and oldBlob_ are nullptr, "
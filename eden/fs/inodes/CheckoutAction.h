@@ -92,6 +92,18 @@ class CheckoutAction {
 
   folly::Future<folly::Unit> run(CheckoutContext* ctx, ObjectStore* store);
 
+  /**
+   * Returns a Future that completes once this action is done changing its
+   * entry in the parent directory.
+   *
+   * This is usually when the action itself completes.  When the action updates
+   * a subdirectory in place, the parent's entry is left alone, so this
+   * completes as soon as the checkout of the subdirectory starts.
+   *
+   * This must be called before run().
+   */
+  folly::Future<folly::Unit> getEntryUpdatedFuture();
+
  private:
   class LoadingRefcount;
 
@@ -114,8 +126,9 @@ class CheckoutAction {
 
   void allLoadsComplete() noexcept;
   bool ensureDataReady() noexcept;
-  bool hasConflict();
+  folly::Future<bool> hasConflict();
   folly::Future<folly::Unit> doAction();
+  void entryUpdated();
 
   /**
    * The context for the in-progress checkout operation.
@@ -179,6 +192,11 @@ class CheckoutAction {
    * The promise that we will fulfil when the CheckoutAction is complete.
    */
   folly::Promise<folly::Unit> promise_;
+
+  /**
+   * The promise behind getEntryUpdatedFuture().
+   */
+  folly::Promise<folly::Unit> entryUpdatedPromise_;
 };
 } // namespace eden
 } // namespace facebook
@@ -9,9 +9,21 @@
  */
 #include "eden/fs/inodes/CheckoutContext.h"
 
+#include <folly/experimental/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodePtr.h"
+#include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/service/ThriftUtil.h"
+
+DEFINE_uint64(
+    checkout_invalidation_batch_size,
+    256,
+    "The number of FUSE cache invalidations that a checkout queues up before "
+    "handing them to the invalidation thread to send to the kernel");
 
 using folly::Future;
 using folly::Unit;
@@ -21,28 +33,148 @@ namespace facebook {
 namespace eden {
 
 CheckoutContext::CheckoutContext(
+    EdenMount* mount,
     folly::Synchronized<EdenMount::ParentInfo>::LockedPtr&& parentsLock,
-    CheckoutMode checkoutMode)
-    : checkoutMode_{checkoutMode}, parentsLock_(std::move(parentsLock)) {}
+    CheckoutMode checkoutMode,
+    const Hash& toSnapshot)
+    : mount_{mount},
+      checkoutMode_{checkoutMode},
+      parentsLock_(std::move(parentsLock)),
+      fromSnapshot_(parentsLock_->parents.parent1()),
+      toSnapshot_(toSnapshot),
+      createTime_(std::chrono::steady_clock::now()) {}
+
+CheckoutContext::~CheckoutContext() {
+  // finish() normally writes out the deferred overlay data, but make sure it
+  // still happens if the checkout failed before reaching that point.
+  try {
+    flushDeferredOverlayDirs();
+  } catch (const std::exception& ex) {
+    XLOG(ERR) << "error saving overlay data after checkout: "
+              << folly::exceptionStr(ex);
+  }
+
+  // EdenMount::checkout() waits for the invalidations whether or not the
+  // checkout succeeded, so none can be left by now.
+  auto invalidations = invalidations_.rlock();
+  DCHECK(invalidations->pending.empty());
+  DCHECK(invalidations->inFlight.empty());
+}
+
+void CheckoutContext::prefetchFinished(
+    std::chrono::steady_clock::duration elapsed,
+    uint64_t treesFetched,
+    uint64_t blobsFetched) {
+  prefetchTime_ = elapsed;
+  treesPrefetched_.store(treesFetched, std::memory_order_relaxed);
+  blobsPrefetched_.store(blobsFetched, std::memory_order_relaxed);
+}
+
+void CheckoutContext::start() {
+  startTime_ = std::chrono::steady_clock::now();
+  applying_.store(true, std::memory_order_relaxed);
+  if (!isDryRun()) {
+    auto renameLock = mount_->acquireRenameLock();
+    mount_->setDeferringCheckout(this, renameLock);
+  }
+}
+
+CheckoutProgress CheckoutContext::getProgress() const {
+  auto load = [](const std::atomic<uint64_t>& counter) {
+    return static_cast<int64_t>(counter.load(std::memory_order_relaxed));
+  };
+
+  CheckoutProgress progress;
+  progress.phase = applying_.load(std::memory_order_relaxed)
+      ? CheckoutPhase::APPLYING
+      : CheckoutPhase::PREPARING;
+  progress.fromSnapshot = thriftHash(fromSnapshot_);
+  progress.toSnapshot = thriftHash(toSnapshot_);
+  progress.checkoutMode = checkoutMode_;
+  progress.elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - createTime_)
+                           .count();
+  progress.treesPrefetched = load(treesPrefetched_);
+  progress.blobsPrefetched = load(blobsPrefetched_);
+  progress.treesProcessed = load(treesProcessed_);
+  progress.treesLoaded = load(treesLoaded_);
+  progress.blobsLoaded = load(blobsLoaded_);
+  progress.blobBytesLoaded = load(blobBytesLoaded_);
+  progress.inodesInvalidated = load(inodesInvalidated_);
+  progress.conflicts = conflicts_.rlock()->size();
+  progress.cancelRequested = isCancelled();
+  progress.overlayDirsWritten = getOverlayDirsWritten();
+  progress.overlayWritesCoalesced = getOverlayWritesCoalesced();
+  return progress;
+}
+
+void CheckoutContext::invalidateEntry(
+    fusell::InodeNumber parent,
+    PathComponentPiece name) {
+  inodesInvalidated_.fetch_add(1, std::memory_order_relaxed);
+  auto state = invalidations_.wlock();
+  state->pending.emplace_back(parent, PathComponent{name});
+  if (state->pending.size() >= FLAGS_checkout_invalidation_batch_size) {
+    sendPendingInvalidations(*state);
+  }
+}
+
+void CheckoutContext::sendPendingInvalidations(InvalidationState& state) {
+  if (state.pending.empty()) {
+    return;
+  }
+  state.inFlight.push_back(
+      mount_->invalidateEntries(std::move(state.pending)));
+  state.pending.clear();
+}
 
-CheckoutContext::~CheckoutContext() {}
+Future<Unit> CheckoutContext::flushInvalidations() {
+  vector<Future<Unit>> inFlight;
+  {
+    auto state = invalidations_.wlock();
+    sendPendingInvalidations(*state);
+    inFlight.swap(state->inFlight);
+  }
 
-void CheckoutContext::start(RenameLock&& renameLock) {
-  renameLock_ = std::move(renameLock);
+  auto waitStart = std::chrono::steady_clock::now();
+  return folly::collectAll(inFlight).then(
+      [this, waitStart](vector<folly::Try<Unit>>&&) {
+        invalidationWaitTime_ = std::chrono::steady_clock::now() - waitStart;
+      });
 }
 
 vector<CheckoutConflict> CheckoutContext::finish(Hash newSnapshot) {
   // Only update the parents if it is not a dry run.
   if (!isDryRun()) {
-    // Update the in-memory snapshot ID
-    parentsLock_->parents.setParents(newSnapshot);
+    // Write out the overlay data for all directories modified by the
+    // checkout before releasing the parents lock.
+    flushDeferredOverlayDirs();
+
+    // Update the in-memory snapshot ID, unless a cancel left some
+    // directories at the old one.
+    if (!isIncomplete()) {
+      parentsLock_->parents.setParents(newSnapshot);
+    }
   }
 
-  // Release our locks.
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  auto applyTime = std::chrono::steady_clock::now() - startTime_;
+  XLOG(DBG1) << "checkout to " << newSnapshot << ": prefetched "
+             << treesPrefetched_ << " trees and " << blobsPrefetched_
+             << " blobs in "
+             << duration_cast<milliseconds>(prefetchTime_).count()
+             << "ms, applied changes in "
+             << duration_cast<milliseconds>(applyTime).count() << "ms ("
+             << treesProcessed_.load() << " trees processed, "
+             << inodesInvalidated_.load() << " invalidations, waited "
+             << duration_cast<milliseconds>(invalidationWaitTime_).count()
+             << "ms for invalidations to finish)";
+
+  // Release our lock.
   // This would release automatically when the CheckoutContext is destroyed,
-  // but go ahead and explicitly unlock them just to make sure that we are
+  // but go ahead and explicitly unlock it just to make sure that we are
   // really completely finished when we fulfill the checkout futures.
-  renameLock_.unlock();
   parentsLock_.unlock();
 
   // Return conflicts_ via a move operation.  We don't need them any more, and
@@ -65,22 +197,29 @@ void CheckoutContext::addConflict(
     ConflictType type,
     TreeInode* parent,
     PathComponentPiece name) {
-  // addConflict() should never be called with an unlinked TreeInode.
-  //
-  // We are holding the RenameLock for the duration of the checkout operation,
-  // and we only operate on TreeInode's that still exist in the file system
-  // namespace.  Therefore parent->getPath() must always return non-none value
-  // here.
+  // The parent is marked busy while the checkout updates its entries, so the
+  // entry itself cannot go away.  However the parent's own parent may
+  // already be done with this checkout, so if the parent was empty it may
+  // have been removed since.  There is nowhere to report the conflict then.
   auto parentPath = parent->getPath();
-  CHECK(parentPath.hasValue());
+  if (!parentPath.hasValue()) {
+    XLOG(DBG3) << "dropping checkout conflict in removed directory "
+               << parent->getLogPath() << ": " << name;
+    return;
+  }
 
   addConflict(type, parentPath.value() + name);
 }
 
 void CheckoutContext::addConflict(ConflictType type, InodeBase* inode) {
-  // As above, the inode in question must have a path here.
+  // As above, the inode in question may only be unlinked if it was removed
+  // after our checkout finished updating its parent.
   auto path = inode->getPath();
-  CHECK(path.hasValue());
+  if (!path.hasValue()) {
+    XLOG(DBG3) << "dropping checkout conflict for removed inode "
+               << inode->getLogPath();
+    return;
+  }
   addConflict(type, path.value());
 }
 
@@ -88,9 +227,15 @@ void CheckoutContext::addError(
     TreeInode* parent,
     PathComponentPiece name,
     const folly::exception_wrapper& ew) {
-  // As above in addConflict(), the parent tree must have a valid path here.
+  // As above in addConflict(), the parent tree has no path only if it was
+  // removed after the checkout finished updating its own parent.
   auto parentPath = parent->getPath();
-  CHECK(parentPath.hasValue());
+  if (!parentPath.hasValue()) {
+    XLOG(DBG3) << "dropping checkout error in removed directory "
+               << parent->getLogPath() << ": " << name << ": "
+               << folly::exceptionStr(ew);
+    return;
+  }
 
   auto path = parentPath.value() + name;
   CheckoutConflict conflict;
@@ -99,5 +244,124 @@ void CheckoutContext::addError(
   conflict.message = folly::exceptionStr(ew).toStdString();
   conflicts_.wlock()->push_back(std::move(conflict));
 }
+
+CheckoutContext::DeferredOverlayDir* CheckoutContext::deferOverlayDir(
+    DeferredOverlayState& state,
+    TreeInodePtr tree) {
+  DCHECK(!isDryRun());
+  if (state.flushed) {
+    return nullptr;
+  }
+  if (!state.overlay) {
+    state.overlay = tree->getOverlay();
+    state.overlay->beginCheckout();
+  }
+
+  auto inodeNumber = tree->getNodeId();
+  auto ret = state.dirs.emplace(
+      inodeNumber, DeferredOverlayDir{std::move(tree), false});
+  if (!ret.second) {
+    overlayWritesCoalesced_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return &ret.first->second;
+}
+
+bool CheckoutContext::deferOverlayDirWrite(TreeInodePtr tree) {
+  auto state = deferredOverlayDirs_.wlock();
+  return deferOverlayDir(*state, std::move(tree)) != nullptr;
+}
+
+bool CheckoutContext::deferOverlayDirRemoval(TreeInodePtr tree) {
+  auto state = deferredOverlayDirs_.wlock();
+  auto* dir = deferOverlayDir(*state, std::move(tree));
+  if (!dir) {
+    return false;
+  }
+  dir->removeIfDematerialized = true;
+  return true;
+}
+
+bool CheckoutContext::isOverlayDirWriteDeferred(
+    fusell::InodeNumber number) const {
+  auto state = deferredOverlayDirs_.rlock();
+  return state->dirs.find(number) != state->dirs.end();
+}
+
+void CheckoutContext::flushDeferredOverlayDirs() {
+  if (isDryRun() || deferredOverlayDirs_.rlock()->flushed) {
+    return;
+  }
+
+  // Hold the rename lock in exclusive mode while writing the data out.
+  // Directories that the checkout has finished with may be renamed or removed
+  // by now, and this keeps them from being removed while we write them out,
+  // which would leave orphaned overlay data behind.  It also keeps other
+  // operations from writing out a directory of their own before its children
+  // have been written here, since they only write directory data while
+  // holding the rename lock.
+  auto renameLock = mount_->acquireRenameLock();
+  if (mount_->getDeferringCheckout() == this) {
+    mount_->setDeferringCheckout(nullptr, renameLock);
+  }
+
+  DeferredOverlayState state;
+  {
+    auto lockedState = deferredOverlayDirs_.wlock();
+    std::swap(state, *lockedState);
+    lockedState->flushed = true;
+  }
+  if (!state.overlay) {
+    return;
+  }
+
+  // Write out children before their parents.  A directory must always have
+  // overlay data on disk before its parent's overlay data says that it is
+  // materialized, so a crash part way through never leaves a parent
+  // referring to missing data.  Directories that were unlinked by the
+  // checkout have no path, and do not need to be written at all.
+  std::vector<std::pair<size_t, TreeInode*>> toWrite;
+  toWrite.reserve(state.dirs.size());
+  for (const auto& entry : state.dirs) {
+    auto path = entry.second.tree->getPath();
+    if (!path.hasValue()) {
+      continue;
+    }
+    auto pathStr = path.value().stringPiece();
+    auto depth = pathStr.empty()
+        ? 0
+        : 1 + std::count(pathStr.begin(), pathStr.end(), '/');
+    toWrite.emplace_back(depth, entry.second.tree.get());
+  }
+  std::sort(toWrite.begin(), toWrite.end(), [](const auto& a, const auto& b) {
+    return a.first > b.first;
+  });
+
+  // With sqlite directory storage this writes every directory in a single
+  // transaction, so the order above only matters for file-per-inode overlays.
+  auto batch = state.overlay->beginDirWrite();
+  size_t numWritten = 0;
+  for (const auto& entry : toWrite) {
+    if (entry.second->saveOverlayDirPostCheckout(batch)) {
+      ++numWritten;
+    }
+  }
+  batch.flush();
+  overlayDirsWritten_.store(numWritten, std::memory_order_relaxed);
+
+  // Only remove data for dematerialized directories once every parent has
+  // been updated to stop referring to it.
+  size_t numRemoved = 0;
+  for (const auto& entry : state.dirs) {
+    if (entry.second.removeIfDematerialized &&
+        entry.second.tree->removeOverlayDirPostCheckout()) {
+      ++numRemoved;
+    }
+  }
+
+  state.overlay->endCheckout();
+  XLOG(DBG2) << "checkout wrote overlay data for " << numWritten
+             << " directories and removed " << numRemoved << " ("
+             << getOverlayWritesCoalesced() << " redundant writes avoided)";
+}
 } // namespace eden
 } // namespace facebook
@@ -10,9 +10,12 @@
 #pragma once
 
 #include <folly/Synchronized.h>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 #include <vector>
 #include "eden/fs/inodes/EdenMount.h"
-#include "eden/fs/inodes/InodePtrFwd.h"
+#include "eden/fs/inodes/InodePtr.h"
 #include "eden/fs/service/gen-cpp2/eden_types.h"
 #include "eden/fs/utils/PathFuncs.h"
 
@@ -27,6 +30,7 @@ namespace facebook {
 namespace eden {
 
 class CheckoutConflict;
+class Overlay;
 class TreeInode;
 class Tree;
 
@@ -36,8 +40,10 @@ class Tree;
 class CheckoutContext {
  public:
   CheckoutContext(
+      EdenMount* mount,
       folly::Synchronized<EdenMount::ParentInfo>::LockedPtr&& parentsLock,
-      CheckoutMode checkoutMode);
+      CheckoutMode checkoutMode,
+      const Hash& toSnapshot);
   ~CheckoutContext();
 
   /**
@@ -65,13 +71,40 @@ class CheckoutContext {
     return checkoutMode_ == CheckoutMode::FORCE;
   }
 
+  /**
+   * Record the results of the prefetch phase, which fetches source control
+   * data before start() is called.
+   */
+  void prefetchFinished(
+      std::chrono::steady_clock::duration elapsed,
+      uint64_t treesFetched,
+      uint64_t blobsFetched);
+
   /**
    * Start the checkout operation.
+   *
+   * The checkout does not hold the mount's rename lock while it runs.
+   * Instead TreeInode::checkout() marks each directory busy with
+   * EdenMount::startCheckoutDir() while it updates that directory's entries,
+   * and only renames and unlinks that touch a busy directory wait for it.
+   *
+   * Unless this is a dry run, start() also registers this checkout with
+   * EdenMount::setDeferringCheckout(), so that overlay writes made by other
+   * operations to directories with deferred writes are deferred as well.
+   */
+  void start();
+
+  /**
+   * Send any queued FUSE cache invalidations to the kernel, and wait until
+   * all of them have been sent.  This must be done before finish(), so that
+   * the checkout does not complete while the kernel still has stale data,
+   * and before the CheckoutContext is destroyed even if the checkout failed.
    */
-  void start(RenameLock&& renameLock);
+  folly::Future<folly::Unit> flushInvalidations();
 
   /**
-   * Complete the checkout operation
+   * Complete the checkout operation, moving the parent commit to
+   * newSnapshot unless this is a dry run or isIncomplete() is true.
    *
    * Returns the list of conflicts and errors that were encountered during the
    * operation.
@@ -89,24 +122,190 @@ class CheckoutContext {
       const folly::exception_wrapper& ew);
 
   /**
-   * Get a reference to the rename lock.
+   * Record that a TreeInode's overlay data needs to be written out.
    *
-   * This is mostly used for APIs that require proof that we are currently
-   * holding the lock.
+   * During a checkout a directory's overlay data would otherwise be rewritten
+   * each time one of its children changes materialization state, and then once
+   * more when the directory itself finishes.  Instead TreeInodes register
+   * themselves here and their data is written exactly once, when finish() is
+   * called.
+   *
+   * The rename lock must be held in exclusive mode.  Returns false if the
+   * deferred data has already been written out, in which case the caller must
+   * write the data itself.
+   */
+  bool deferOverlayDirWrite(TreeInodePtr tree);
+
+  /**
+   * Record that a TreeInode was dematerialized by the checkout, and that its
+   * overlay data should be removed once all deferred writes are complete.
+   *
+   * As with deferOverlayDirWrite(), returns false if the caller must remove
+   * the data itself.
+   */
+  bool deferOverlayDirRemoval(TreeInodePtr tree);
+
+  /**
+   * Returns true if a write of the given directory's overlay data is still
+   * deferred until the end of the checkout.
+   *
+   * Operations other than the checkout must not write out the data of such a
+   * directory themselves: it may refer to materialized children whose own
+   * data is also still deferred.  The rename lock must be held, in either
+   * mode.
+   */
+  bool isOverlayDirWriteDeferred(fusell::InodeNumber number) const;
+
+  /**
+   * Queue a FUSE cache invalidation for a directory entry changed by the
+   * checkout.
+   *
+   * This is usually called while holding the directory's contents lock, so
+   * rather than writing to the FUSE device here the invalidations are handed
+   * to EdenMount::invalidateEntries() in batches, and sent to the kernel on
+   * the mount's invalidation thread.
+   */
+  void invalidateEntry(fusell::InodeNumber parent, PathComponentPiece name);
+
+  /**
+   * Ask the checkout to stop.
+   *
+   * Before start() is called this makes the checkout fail without changing
+   * anything.  After that, TreeInode::checkout() stops descending into
+   * directories, and reports each one it skips as an error.  Directories that
+   * have already started are finished, so every directory is left either
+   * fully updated or untouched.  If any directory was skipped, finish()
+   * leaves the parent commit unchanged.
+   */
+  void requestCancel() {
+    cancelRequested_.store(true, std::memory_order_relaxed);
+  }
+
+  bool isCancelled() const {
+    return cancelRequested_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Record that TreeInode::checkout() left a directory untouched because
+   * the checkout was cancelled.
+   */
+  void dirSkipped() {
+    incomplete_.store(true, std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns true if the checkout was cancelled after it started, and left
+   * some directories untouched.
    */
-  const RenameLock& renameLock() const {
-    return renameLock_;
+  bool isIncomplete() const {
+    return incomplete_.load(std::memory_order_relaxed);
   }
 
+  /**
+   * Progress counters, updated from many threads as the checkout runs and
+   * reported by getProgress().
+   */
+  void treeProcessed() {
+    treesProcessed_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void treeLoaded() {
+    treesLoaded_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void blobLoaded(uint64_t size) {
+    blobsLoaded_.fetch_add(1, std::memory_order_relaxed);
+    blobBytesLoaded_.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  /**
+   * The number of directories whose overlay data was written out at the end
+   * of the checkout.  This is 0 until the deferred data has been flushed.
+   */
+  uint64_t getOverlayDirsWritten() const {
+    return overlayDirsWritten_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * The number of overlay writes avoided so far because the directory's
+   * write had already been deferred.
+   */
+  uint64_t getOverlayWritesCoalesced() const {
+    return overlayWritesCoalesced_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Get a snapshot of the checkout's progress.  This may be called from any
+   * thread at any time.
+   */
+  CheckoutProgress getProgress() const;
+
  private:
+  struct DeferredOverlayDir {
+    TreeInodePtr tree;
+    bool removeIfDematerialized{false};
+  };
+  struct InvalidationState {
+    std::vector<std::pair<fusell::InodeNumber, PathComponent>> pending;
+    std::vector<folly::Future<folly::Unit>> inFlight;
+  };
+  struct DeferredOverlayState {
+    /**
+     * The overlay the deferred directories belong to.  This is only set once
+     * the first write has been deferred, at which point the overlay has been
+     * told that a checkout is in progress.
+     */
+    std::shared_ptr<Overlay> overlay;
+    std::unordered_map<fusell::InodeNumber, DeferredOverlayDir> dirs;
+    /** Set once the deferred data has been written out. */
+    bool flushed{false};
+  };
+
+  DeferredOverlayDir* deferOverlayDir(
+      DeferredOverlayState& state,
+      TreeInodePtr tree);
+  void flushDeferredOverlayDirs();
+  void sendPendingInvalidations(InvalidationState& state);
+
+  EdenMount* const mount_;
   CheckoutMode checkoutMode_;
   folly::Synchronized<EdenMount::ParentInfo>::LockedPtr parentsLock_;
-  RenameLock renameLock_;
+  const Hash fromSnapshot_;
+  const Hash toSnapshot_;
+
+  // How long each phase of the checkout took, for logging.  The prefetch
+  // phase is separate from applying the changes so that time spent waiting
+  // on the backing store can be told apart from time spent updating inodes.
+  const std::chrono::steady_clock::time_point createTime_;
+  std::chrono::steady_clock::duration prefetchTime_{0};
+  std::chrono::steady_clock::time_point startTime_;
+  std::chrono::steady_clock::duration invalidationWaitTime_{0};
+
+  // Progress counters.  These are read by getProgress() on other threads.
+  std::atomic<bool> cancelRequested_{false};
+  std::atomic<bool> incomplete_{false};
+  std::atomic<bool> applying_{false};
+  std::atomic<uint64_t> treesPrefetched_{0};
+  std::atomic<uint64_t> blobsPrefetched_{0};
+  std::atomic<uint64_t> treesProcessed_{0};
+  std::atomic<uint64_t> treesLoaded_{0};
+  std::atomic<uint64_t> blobsLoaded_{0};
+  std::atomic<uint64_t> blobBytesLoaded_{0};
+  std::atomic<uint64_t> inodesInvalidated_{0};
+  std::atomic<uint64_t> overlayDirsWritten_{0};
+  std::atomic<uint64_t> overlayWritesCoalesced_{0};
 
   // The checkout processing may occur across many threads,
   // if some data load operations complete asynchronously on other threads.
   // Therefore access to the conflicts list must be synchronized.
   folly::Synchronized<std::vector<CheckoutConflict>> conflicts_;
+
+  // TreeInodes whose overlay data will be written out at the end of the
+  // checkout.  These are also updated from multiple threads, and are only
+  // written out with the mount's rename lock held in exclusive mode.
+  folly::Synchronized<DeferredOverlayState> deferredOverlayDirs_;
+
+  // FUSE cache invalidations waiting to be sent, and the batches that have
+  // been handed to the mount's invalidation thread.
+  folly::Synchronized<InvalidationState> invalidations_;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,203 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/CheckoutPrefetcher.h"
+
+#include <folly/experimental/logging/xlog.h>
+#include <folly/futures/Future.h>
+#include <gflags/gflags.h>
+#include <vector>
+
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+
+DEFINE_uint64(
+    checkout_prefetch_concurrency,
+    32,
+    "The maximum number of trees and blobs that a checkout will fetch from "
+    "the backing store at once before it starts updating inodes.  "
+    "0 disables the prefetch.");
+
+using folly::Future;
+using folly::makeFuture;
+using folly::Unit;
+using std::shared_ptr;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+CheckoutPrefetcher::CheckoutPrefetcher(
+    const ObjectStore* store,
+    size_t maxConcurrentFetches)
+    : store_(store), fetchQueue_(maxConcurrentFetches) {
+  DCHECK_GT(maxConcurrentFetches, 0);
+}
+
+CheckoutPrefetcher::~CheckoutPrefetcher() {}
+
+size_t CheckoutPrefetcher::getDefaultMaxConcurrentFetches() {
+  return FLAGS_checkout_prefetch_concurrency;
+}
+
+Future<Unit> CheckoutPrefetcher::prefetch(
+    TreeInodePtr root,
+    shared_ptr<const Tree> fromTree,
+    shared_ptr<const Tree> toTree) {
+  return folly::makeFutureWith([&] {
+           return prefetchDir(
+               std::move(root), std::move(fromTree), std::move(toTree));
+         })
+      .onError([](const folly::exception_wrapper& ew) {
+        XLOG(WARN) << "error prefetching data for checkout: " << ew.what();
+      });
+}
+
+Future<Unit> CheckoutPrefetcher::prefetchDir(
+    TreeInodePtr inode,
+    shared_ptr<const Tree> fromTree,
+    shared_ptr<const Tree> toTree) {
+  struct EntryFetch {
+    Hash hash;
+    bool isTree;
+  };
+  struct ChildDir {
+    TreeInodePtr inode;
+    Hash oldHash;
+    Hash newHash;
+  };
+  vector<EntryFetch> entries;
+  vector<ChildDir> childDirs;
+
+  // This mirrors the entries that TreeInode::processCheckoutEntry() creates
+  // CheckoutActions for.
+  auto processEntry = [&](const TreeInode::Dir& contents,
+                          const TreeEntry* oldEntry,
+                          const TreeEntry* newEntry) {
+    if (oldEntry && newEntry && oldEntry->getType() == newEntry->getType() &&
+        oldEntry->getHash() == newEntry->getHash()) {
+      return;
+    }
+
+    const auto& name = oldEntry ? oldEntry->getName() : newEntry->getName();
+    auto it = contents.entries.find(name);
+    if (it == contents.entries.end() || !it->second.hasInodeNumber()) {
+      // The checkout only needs to replace this entry's hash.
+      return;
+    }
+
+    auto childTree = it->second.asTreePtrOrNull();
+    if (childTree && oldEntry && newEntry && oldEntry->isTree() &&
+        newEntry->isTree()) {
+      // The checkout will recurse into this directory, so we need to as well.
+      childDirs.push_back(ChildDir{
+          std::move(childTree), oldEntry->getHash(), newEntry->getHash()});
+      return;
+    }
+
+    if (oldEntry) {
+      entries.push_back(EntryFetch{oldEntry->getHash(), oldEntry->isTree()});
+    }
+    if (newEntry) {
+      entries.push_back(EntryFetch{newEntry->getHash(), newEntry->isTree()});
+    }
+  };
+
+  // Only decide what to fetch while holding the contents lock.  The
+  // LocalStore lookups in fetchTree() and fetchBlob() read from disk, and
+  // other operations on this directory should not have to wait for them.
+  {
+    auto contents = inode->getContents().rlock();
+    vector<TreeEntry> emptyEntries;
+    const auto& oldEntries =
+        fromTree ? fromTree->getTreeEntries() : emptyEntries;
+    const auto& newEntries = toTree ? toTree->getTreeEntries() : emptyEntries;
+    size_t oldIdx = 0;
+    size_t newIdx = 0;
+    while (oldIdx < oldEntries.size() || newIdx < newEntries.size()) {
+      if (newIdx >= newEntries.size() ||
+          (oldIdx < oldEntries.size() &&
+           oldEntries[oldIdx].getName() < newEntries[newIdx].getName())) {
+        processEntry(*contents, &oldEntries[oldIdx++], nullptr);
+      } else if (
+          oldIdx >= oldEntries.size() ||
+          newEntries[newIdx].getName() < oldEntries[oldIdx].getName()) {
+        processEntry(*contents, nullptr, &newEntries[newIdx++]);
+      } else {
+        processEntry(
+            *contents, &oldEntries[oldIdx++], &newEntries[newIdx++]);
+      }
+    }
+  }
+
+  vector<Future<Unit>> futures;
+  futures.reserve(entries.size() + childDirs.size());
+  for (const auto& entry : entries) {
+    if (entry.isTree) {
+      futures.emplace_back(fetchTree(entry.hash).unit());
+    } else {
+      futures.emplace_back(fetchBlob(entry.hash));
+    }
+  }
+  for (auto& child : childDirs) {
+    // Wait for both trees even if one of them fails, since the fetches
+    // refer to us and we may be destroyed once the prefetch completes.
+    auto oldFuture = fetchTree(child.oldHash);
+    auto newFuture = fetchTree(child.newHash);
+    futures.emplace_back(
+        folly::collectAll(oldFuture, newFuture)
+            .then([this, childTree = std::move(child.inode)](
+                      std::tuple<
+                          folly::Try<shared_ptr<const Tree>>,
+                          folly::Try<shared_ptr<const Tree>>>&& trees) {
+              return prefetchDir(
+                  childTree,
+                  std::move(std::get<0>(trees).value()),
+                  std::move(std::get<1>(trees).value()));
+            }));
+  }
+
+  // Let every fetch finish even if some of them fail, so that one missing
+  // object does not cut the rest of the prefetch short.
+  return folly::collectAll(futures).then(
+      [](vector<folly::Try<Unit>>&& results) {
+        for (const auto& result : results) {
+          if (result.hasException()) {
+            XLOG(DBG2) << "error prefetching data for checkout: "
+                       << result.exception().what();
+          }
+        }
+      });
+}
+
+Future<shared_ptr<const Tree>> CheckoutPrefetcher::fetchTree(const Hash& id) {
+  shared_ptr<const Tree> tree = store_->getLocalStore()->getTree(id);
+  if (tree) {
+    return makeFuture(std::move(tree));
+  }
+  return fetchQueue_.schedule<shared_ptr<const Tree>>(0, [this, id] {
+    ++treesFetched_;
+    return store_->getTree(id);
+  });
+}
+
+Future<Unit> CheckoutPrefetcher::fetchBlob(const Hash& id) {
+  if (store_->getLocalStore()->hasKey(LocalStore::BlobFamily, id)) {
+    return makeFuture();
+  }
+  return fetchQueue_.schedule<Unit>(0, [this, id] {
+    ++blobsFetched_;
+    return store_->getBlob(id).unit();
+  });
+}
+
+} // namespace eden
+} // namespace facebook
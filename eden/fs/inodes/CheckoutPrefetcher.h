@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "eden/fs/inodes/InodePtr.h"
+#include "eden/fs/utils/BoundedFetchQueue.h"
+
+namespace facebook {
+namespace eden {
+
+class Hash;
+class ObjectStore;
+class Tree;
+
+/**
+ * CheckoutPrefetcher fetches the source control data that a checkout is going
+ * to need before the checkout starts applying changes.
+ *
+ * TreeInode::checkout() only reads Trees and Blobs for the entries that
+ * differ between the two commits and that have inodes: every other entry is
+ * updated by just replacing its hash.  Without a prefetch those objects are
+ * fetched one CheckoutAction at a time, as the checkout walk reaches them,
+ * and a large update spends most of its time waiting on them in turn.
+ *
+ * The prefetcher walks the same entries ahead of time, starting at most
+ * maxConcurrentFetches fetches from the BackingStore at once and skipping
+ * objects that are already in the LocalStore.  The fetched objects are saved
+ * in the LocalStore by the ObjectStore, so the checkout itself then finds
+ * them locally.
+ *
+ * Prefetching is purely an optimization: the inode state may change before
+ * the checkout starts, and fetch errors are logged and otherwise ignored,
+ * since the checkout will simply fetch anything that is still missing.
+ */
+class CheckoutPrefetcher {
+ public:
+  CheckoutPrefetcher(const ObjectStore* store, size_t maxConcurrentFetches);
+  ~CheckoutPrefetcher();
+
+  /**
+   * Fetch the data needed to check out the given TreeInode from fromTree to
+   * toTree.
+   *
+   * The returned Future always succeeds.  The CheckoutPrefetcher must remain
+   * valid until it completes.
+   */
+  folly::Future<folly::Unit> prefetch(
+      TreeInodePtr root,
+      std::shared_ptr<const Tree> fromTree,
+      std::shared_ptr<const Tree> toTree);
+
+  /** The number of Trees fetched from the BackingStore. */
+  uint64_t getTreesFetched() const {
+    return treesFetched_.load(std::memory_order_relaxed);
+  }
+
+  /** The number of Blobs fetched from the BackingStore. */
+  uint64_t getBlobsFetched() const {
+    return blobsFetched_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Get the default maxConcurrentFetches, from the
+   * --checkout_prefetch_concurrency flag.  Checkouts skip the prefetch phase
+   * entirely if this is 0.
+   */
+  static size_t getDefaultMaxConcurrentFetches();
+
+ private:
+  folly::Future<folly::Unit> prefetchDir(
+      TreeInodePtr inode,
+      std::shared_ptr<const Tree> fromTree,
+      std::shared_ptr<const Tree> toTree);
+  folly::Future<std::shared_ptr<const Tree>> fetchTree(const Hash& id);
+  folly::Future<folly::Unit> fetchBlob(const Hash& id);
+
+  const ObjectStore* const store_;
+  /** Fetches are started in the order they are requested. */
+  BoundedFetchQueue fetchQueue_;
+  std::atomic<uint64_t> treesFetched_{0};
+  std::atomic<uint64_t> blobsFetched_{0};
+};
+} // namespace eden
+} // namespace facebook
@@ -122,7 +122,8 @@ folly::Future<folly::Unit> diffRemovedTree(
     RelativePath currentPath,
     const TreeEntry& entry) {
   DCHECK(entry.isTree());
-  return context->store->getTree(entry.getHash())
+  auto treeFuture = context->getTree(entry.getHash(), currentPath);
+  return std::move(treeFuture)
       .then([context, currentPath = RelativePath{std::move(currentPath)}](
                 shared_ptr<const Tree>&& tree) {
         return diffRemovedTree(context, std::move(currentPath), tree.get());
@@ -267,7 +268,7 @@ class ModifiedDiffEntry : public DeferredDiffEntry {
     }
 
     // Possibly modified directory.  Load the Tree in question.
-    return context_->store->getTree(scmEntry_.getHash())
+    return context_->getTree(scmEntry_.getHash(), getPath())
         .then([this, treeInode = std::move(treeInode)](
                   shared_ptr<const Tree>&& tree) {
           return treeInode->diff(
@@ -291,8 +292,7 @@ class ModifiedDiffEntry : public DeferredDiffEntry {
       return treeInode->diff(context_, getPath(), nullptr, ignore_, isIgnored_);
     }
 
-    return fileInode->isSameAs(scmEntry_.getHash(), scmEntry_.getType())
-        .then([this](bool isSame) {
+    return fileInode->isSameAs(scmEntry_).then([this](bool isSame) {
           if (!isSame) {
             XLOG(DBG5) << "modified file: " << getPath();
             context_->callback->modifiedFile(getPath(), scmEntry_);
@@ -320,11 +320,28 @@ class ModifiedBlobDiffEntry : public DeferredDiffEntry {
         currentBlobHash_{currentBlobHash} {}
 
   folly::Future<folly::Unit> run() override {
-    auto f1 = context_->store->getBlobMetadata(scmEntry_.getHash());
-    auto f2 = context_->store->getBlobMetadata(currentBlobHash_);
-    return folly::collect(f1, f2).then(
-        [this](const std::tuple<BlobMetadata, BlobMetadata>& info) {
-          if (std::get<0>(info).sha1 != std::get<1>(info).sha1) {
+    // If the source control tree told us the SHA-1 of the contents, we
+    // only need the metadata for the current blob.
+    if (scmEntry_.getContentSha1().hasValue()) {
+      return context_->getBlobMetadata(currentBlobHash_, getPath())
+          .then([this](const BlobMetadata& current) {
+            if (current.sha1 != scmEntry_.getContentSha1().value()) {
+              XLOG(DBG5) << "modified file: " << getPath();
+              context_->callback->modifiedFile(getPath(), scmEntry_);
+            }
+          });
+    }
+
+    // Wait for both fetches even if one of them fails: the DiffContext that
+    // runs them may be destroyed as soon as this entry completes.
+    auto f1 = context_->getBlobMetadata(scmEntry_.getHash(), getPath());
+    auto f2 = context_->getBlobMetadata(currentBlobHash_, getPath());
+    return folly::collectAll(f1, f2).then(
+        [this](const std::tuple<
+               folly::Try<BlobMetadata>,
+               folly::Try<BlobMetadata>>& info) {
+          if (std::get<0>(info).value().sha1 !=
+              std::get<1>(info).value().sha1) {
             XLOG(DBG5) << "modified file: " << getPath();
             context_->callback->modifiedFile(getPath(), scmEntry_);
           }
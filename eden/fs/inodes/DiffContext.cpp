@@ -11,16 +11,38 @@
 #include <folly/File.h>
 #include <folly/FileUtil.h>
 #include <folly/experimental/logging/xlog.h>
+#include <folly/futures/Future.h>
+#include <gflags/gflags.h>
+#include <algorithm>
 
 #include "eden/fs/fuse/privhelper/PrivHelper.h"
 #include "eden/fs/fuse/privhelper/UserInfo.h"
 #include "eden/fs/inodes/DiffContext.h"
 #include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
 
+DEFINE_uint64(
+    diff_max_concurrent_fetches,
+    64,
+    "The maximum number of trees and blobs that a single diff or status "
+    "operation fetches from the backing store at once");
+
+using folly::Future;
+using folly::makeFuture;
+using std::shared_ptr;
+
 namespace facebook {
 namespace eden {
 
+namespace {
+size_t pathDepth(RelativePathPiece path) {
+  auto str = path.stringPiece();
+  return str.empty() ? 0 : 1 + std::count(str.begin(), str.end(), '/');
+}
+} // namespace
+
 constexpr folly::StringPiece DiffContext::kSystemWideIgnoreFileName;
 
 DiffContext::DiffContext(
@@ -28,7 +50,10 @@ DiffContext::DiffContext(
     bool listIgnored,
     const ObjectStore* os,
     const UserInfo& userInfo)
-    : callback{cb}, store{os}, listIgnored{listIgnored} {
+    : callback{cb},
+      store{os},
+      listIgnored{listIgnored},
+      fetchQueue_{getDefaultMaxConcurrentFetches()} {
   initOwnedIgnores(
       tryIngestFile(AbsolutePathPiece{kSystemWideIgnoreFileName}),
       tryIngestFile(constructUserIgnoreFileName(userInfo)));
@@ -39,13 +64,96 @@ DiffContext::DiffContext(
     bool listIgnored,
     const ObjectStore* os,
     folly::StringPiece systemWideIgnoreFileContents,
-    folly::StringPiece userIgnoreFileContents)
-    : callback{cb}, store{os}, listIgnored{listIgnored} {
+    folly::StringPiece userIgnoreFileContents,
+    size_t maxConcurrentFetches)
+    : callback{cb},
+      store{os},
+      listIgnored{listIgnored},
+      fetchQueue_{maxConcurrentFetches} {
   // Load the system-wide ignore settings and user-specific
   // ignore settings into rootIgnore_.
   initOwnedIgnores(systemWideIgnoreFileContents, userIgnoreFileContents);
 }
 
+// Fetches refer to us without owning a reference, so the diff must wait for
+// every fetch it starts before completing, even when another part of it has
+// already failed.  This is why diff code fans out with collectAll() rather
+// than collect().  ~BoundedFetchQueue checks that nothing is left running.
+DiffContext::~DiffContext() {}
+
+size_t DiffContext::getDefaultMaxConcurrentFetches() {
+  return std::max<uint64_t>(FLAGS_diff_max_concurrent_fetches, 1);
+}
+
+Future<shared_ptr<const Tree>> DiffContext::getTree(
+    const Hash& id,
+    RelativePathPiece path) const {
+  shared_ptr<const Tree> tree = store->getLocalStore()->getTree(id);
+  if (tree) {
+    ++localLookups_;
+    return makeFuture(std::move(tree));
+  }
+  return fetchQueue_.schedule<shared_ptr<const Tree>>(
+      pathDepth(path), [this, id] {
+        ++treesFetched_;
+        return store->getTree(id);
+      });
+}
+
+Future<BlobMetadata> DiffContext::getBlobMetadata(
+    const Hash& id,
+    RelativePathPiece path) const {
+  auto metadata = store->getLocalStore()->getBlobMetadata(id);
+  if (metadata.hasValue()) {
+    ++localLookups_;
+    return makeFuture(metadata.value());
+  }
+  return fetchQueue_.schedule<BlobMetadata>(pathDepth(path), [this, id] {
+    ++blobMetadataFetched_;
+    return store->getBlobMetadata(id);
+  });
+}
+
+void DiffContext::restrictToPaths(std::vector<RelativePath> paths) {
+  restrictedToPaths_ = true;
+  includedPathStorage_ = std::move(paths);
+  for (const auto& path : includedPathStorage_) {
+    includedPaths_.insert(RelativePathPiece{path});
+    // allPaths() also yields the path itself, which includes() checks
+    // separately anyway.
+    for (auto parent : path.allPaths()) {
+      includedParents_.insert(parent);
+    }
+  }
+}
+
+bool DiffContext::includesAllOf(RelativePathPiece dir) const {
+  if (!restrictedToPaths_) {
+    return true;
+  }
+  for (auto path : dir.rallPaths()) {
+    if (includedPaths_.count(path)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DiffContext::includes(RelativePathPiece path) const {
+  return includedParents_.count(path) || includesAllOf(path);
+}
+
+DiffProgress DiffContext::getProgress() const {
+  DiffProgress progress;
+  progress.directoriesCompared = directoriesCompared_.load();
+  progress.localLookups = localLookups_.load();
+  progress.treesFetched = treesFetched_.load();
+  progress.blobMetadataFetched = blobMetadataFetched_.load();
+  progress.fetchesQueued = fetchQueue_.getQueued();
+  progress.fetchesInFlight = fetchQueue_.getInFlight();
+  return progress;
+}
+
 AbsolutePath DiffContext::constructUserIgnoreFileName(
     const UserInfo& userInfo) {
   return userInfo.getHomeDirectory() + PathComponentPiece{".gitignore"};
@@ -10,16 +10,45 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <unordered_set>
+#include <vector>
 #include "eden/fs/model/git/GitIgnoreStack.h"
+#include "eden/fs/utils/BoundedFetchQueue.h"
 #include "eden/fs/utils/PathFuncs.h"
 
+namespace folly {
+template <typename T>
+class Future;
+} // namespace folly
+
 namespace facebook {
 namespace eden {
 
+class Hash;
 class InodeDiffCallback;
 class ObjectStore;
+class Tree;
 class UserInfo;
+struct BlobMetadata;
+
+/**
+ * A snapshot of the progress of a diff operation.
+ */
+struct DiffProgress {
+  /** The number of directories whose entries have been compared. */
+  uint64_t directoriesCompared{0};
+  /** Trees and blob metadata that were found in the LocalStore. */
+  uint64_t localLookups{0};
+  /** Trees and blob metadata that had to be fetched from the BackingStore. */
+  uint64_t treesFetched{0};
+  uint64_t blobMetadataFetched{0};
+  /** Fetches currently waiting for one of the in-flight fetches to finish. */
+  uint64_t fetchesQueued{0};
+  uint64_t fetchesInFlight{0};
+};
 
 /**
  * A small helper class to store parameters for a TreeInode::diff() operation.
@@ -45,12 +74,74 @@ class DiffContext {
       bool listIgnored,
       const ObjectStore* os,
       folly::StringPiece systemWideIgnoreFileContents,
-      folly::StringPiece userIgnoreFileContents);
+      folly::StringPiece userIgnoreFileContents,
+      size_t maxConcurrentFetches = getDefaultMaxConcurrentFetches());
+
+  ~DiffContext();
 
   const GitIgnoreStack* getToplevelIgnore() const {
     return ownedIgnores_.empty() ? nullptr : ownedIgnores_.back().get();
   }
 
+  /**
+   * Get the source control Tree or blob metadata needed to diff the entry at
+   * the given path.
+   *
+   * Objects already in the LocalStore are returned immediately.  Otherwise at
+   * most maxConcurrentFetches requests are sent to the BackingStore at once,
+   * and the rest wait in a queue ordered by path depth.  This keeps the diff
+   * of a large, heavily modified tree from issuing an unbounded number of
+   * fetches at once, and means that the diff proceeds breadth first: each
+   * directory that is fetched exposes more work for the next level, while
+   * comparisons that only need local data are never held up behind the
+   * queue.
+   *
+   * Diff operations should use these rather than calling the ObjectStore
+   * directly.  They must wait for every future returned here to complete
+   * before the DiffContext is destroyed, even if some other part of the
+   * diff fails.
+   */
+  folly::Future<std::shared_ptr<const Tree>> getTree(
+      const Hash& id,
+      RelativePathPiece path) const;
+  folly::Future<BlobMetadata> getBlobMetadata(
+      const Hash& id,
+      RelativePathPiece path) const;
+
+  /**
+   * Record that the entries of a directory have been compared.
+   */
+  void directoryCompared() const {
+    ++directoriesCompared_;
+  }
+
+  DiffProgress getProgress() const;
+
+  /**
+   * Only report differences for the given paths and anything below them.
+   * Directories that do not contain any of these paths are not examined.
+   *
+   * This is used to update a previous diff result after the journal reports
+   * that only a few paths have changed.  It must be called before the diff
+   * starts.
+   */
+  void restrictToPaths(std::vector<RelativePath> paths);
+
+  /**
+   * Return true if every entry in the given directory should be examined,
+   * because the diff is not restricted to specific paths or because the
+   * directory is at or below one of them.
+   */
+  bool includesAllOf(RelativePathPiece dir) const;
+
+  /**
+   * Return true if the given path should be examined: it is at or below one
+   * of the requested paths, or is a parent directory of one.
+   */
+  bool includes(RelativePathPiece path) const;
+
+  static size_t getDefaultMaxConcurrentFetches();
+
   InodeDiffCallback* const callback;
   const ObjectStore* const store;
   /**
@@ -72,6 +163,22 @@ class DiffContext {
   static constexpr folly::StringPiece kSystemWideIgnoreFileName =
       "/etc/eden/ignore";
   std::vector<std::unique_ptr<GitIgnoreStack>> ownedIgnores_;
+
+  bool restrictedToPaths_{false};
+  std::vector<RelativePath> includedPathStorage_;
+  // These point into includedPathStorage_.
+  std::unordered_set<RelativePathPiece> includedPaths_;
+  std::unordered_set<RelativePathPiece> includedParents_;
+
+  /**
+   * Fetches from the BackingStore, prioritized by path depth so that
+   * shallower paths are fetched first.
+   */
+  mutable BoundedFetchQueue fetchQueue_;
+  mutable std::atomic<uint64_t> directoriesCompared_{0};
+  mutable std::atomic<uint64_t> localLookups_{0};
+  mutable std::atomic<uint64_t> treesFetched_{0};
+  mutable std::atomic<uint64_t> blobMetadataFetched_{0};
 };
 } // namespace eden
 } // namespace facebook
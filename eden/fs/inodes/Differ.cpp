@@ -12,13 +12,26 @@
 #include <folly/Synchronized.h>
 #include <folly/experimental/logging/xlog.h>
 #include <folly/futures/Future.h>
+#include <gflags/gflags.h>
+#include <unordered_set>
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/journal/Journal.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/TreeEntry.h"
 #include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/utils/PathFuncs.h"
 
+DEFINE_uint64(
+    status_cache_max_paths,
+    10000,
+    "The maximum number of changed paths for which a status request updates "
+    "the previous result rather than recomputing the status from scratch");
+
+using folly::Optional;
+using folly::Try;
+using folly::Unit;
+
 namespace facebook {
 namespace eden {
 namespace {
@@ -73,6 +86,99 @@ class ThriftStatusCallback : public InodeDiffCallback {
  private:
   folly::Synchronized<std::map<std::string, ScmFileStatus>> data_;
 };
+/**
+ * Return every path that the journal reports has changed after the given
+ * sequence number, or folly::none if the status must be recomputed from
+ * scratch instead.
+ */
+Optional<std::vector<RelativePath>> getChangedPathsSince(
+    const Journal& journal,
+    uint64_t sequence) {
+  static const PathComponentPiece kIgnoreFilename{".gitignore"};
+
+  auto range = journal.accumulateRange(sequence + 1);
+  if (!range) {
+    return std::vector<RelativePath>{};
+  }
+  if (range->isTruncated) {
+    return folly::none;
+  }
+
+  std::vector<RelativePath> paths;
+  for (const auto* pathSet : {&range->changedFilesInOverlay,
+                              &range->createdFilesInOverlay,
+                              &range->removedFilesInOverlay,
+                              &range->uncleanPaths}) {
+    if (paths.size() + pathSet->size() > FLAGS_status_cache_max_paths) {
+      return folly::none;
+    }
+    for (const auto& path : *pathSet) {
+      // A change to an ignore file can change the status of anything in its
+      // directory.
+      if (path.basename() == kIgnoreFilename) {
+        return folly::none;
+      }
+      paths.push_back(path);
+    }
+  }
+  return paths;
+}
+
+bool isAtOrBelowAny(
+    RelativePathPiece path,
+    const std::unordered_set<RelativePathPiece>& paths) {
+  for (auto parent : path.rpaths()) {
+    if (paths.count(parent)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Recompute the status of the given paths, and combine it with the
+ * previously cached status for everything else.
+ */
+folly::Future<std::unique_ptr<ScmStatus>> updateStatus(
+    EdenMount* mount,
+    std::shared_ptr<const CachedScmStatus> cached,
+    std::vector<RelativePath> changedPaths,
+    CachedScmStatus key) {
+  auto callback = std::make_unique<ThriftStatusCallback>();
+  auto callbackPtr = callback.get();
+  auto diffFuture =
+      mount->diff(callbackPtr, key.parent, key.listIgnored, changedPaths);
+  return std::move(diffFuture)
+      .then([mount,
+             callback = std::move(callback),
+             cached = std::move(cached),
+             changedPaths = std::move(changedPaths),
+             key = std::move(key)](Try<Unit>&& result) mutable {
+        result.throwIfFailed();
+
+        // Drop the old results for anything that was re-examined, then add
+        // the new ones.
+        std::unordered_set<RelativePathPiece> changed{changedPaths.begin(),
+                                                      changedPaths.end()};
+        for (const auto& entry : cached->status.entries) {
+          RelativePathPiece path{entry.first, detail::SkipPathSanityCheck{}};
+          if (!isAtOrBelowAny(path, changed)) {
+            key.status.entries.emplace(entry.first, entry.second);
+          }
+        }
+        for (auto& entry : callback->extractStatus().entries) {
+          key.status.entries[entry.first] = entry.second;
+        }
+
+        XLOG(DBG3) << "updated cached status for " << mount->getPath()
+                   << " from sequence " << cached->journalSequence << " to "
+                   << key.journalSequence << " by checking "
+                   << changedPaths.size() << " paths";
+        auto newCache = std::make_shared<CachedScmStatus>(std::move(key));
+        mount->setCachedStatus(newCache);
+        return std::make_unique<ScmStatus>(newCache->status);
+      });
+}
 } // unnamed namespace
 
 char scmStatusCodeChar(ScmFileStatus code) {
@@ -101,16 +207,82 @@ std::ostream& operator<<(std::ostream& os, const ScmStatus& status) {
 }
 
 folly::Future<std::unique_ptr<ScmStatus>> diffMountForStatus(
-    const EdenMount* mount,
+    EdenMount* mount,
     bool listIgnored) {
+  // Read the journal position before starting, so that anything that
+  // changes while the diff runs is checked again next time.  The parent is
+  // only read once: the diff runs against this commit, so the cached result
+  // always describes the commit it is stored under, even if a checkout or
+  // reset races with us.
+  auto parent = mount->getParentCommits().parent1();
+  auto latest = mount->getJournal().getLatest();
+  uint64_t sequence = latest ? latest->toSequence : 0;
+
+  auto cached = mount->getCachedStatus();
+  if (cached && cached->parent == parent &&
+      cached->listIgnored == listIgnored) {
+    if (cached->journalSequence == sequence) {
+      return std::make_unique<ScmStatus>(cached->status);
+    }
+    auto changedPaths =
+        getChangedPathsSince(mount->getJournal(), cached->journalSequence);
+    if (changedPaths.hasValue()) {
+      return updateStatus(
+          mount,
+          std::move(cached),
+          std::move(changedPaths.value()),
+          CachedScmStatus{parent, sequence, listIgnored, ScmStatus{}});
+    }
+  }
+
   auto callback = std::make_unique<ThriftStatusCallback>();
   auto callbackPtr = callback.get();
-  return mount->diff(callbackPtr, listIgnored)
-      .then([callback = std::move(callback)]() {
-        return std::make_unique<ScmStatus>(callback->extractStatus());
+  return mount->diff(callbackPtr, parent, listIgnored)
+      .then([mount,
+             callback = std::move(callback),
+             key = CachedScmStatus{parent, sequence, listIgnored, ScmStatus{}}](
+                Try<Unit>&& result) mutable {
+        result.throwIfFailed();
+        key.status = callback->extractStatus();
+        auto newCache = std::make_shared<CachedScmStatus>(std::move(key));
+        mount->setCachedStatus(newCache);
+        return std::make_unique<ScmStatus>(newCache->status);
       });
 }
 
+Optional<std::vector<RelativePath>> getCachedUncleanPaths(
+    EdenMount* mount,
+    const Hash& parent,
+    std::vector<RelativePath>& changedPaths) {
+  // The cached result is for the working directory as of its journal
+  // sequence number, whether or not it listed ignored files.
+  auto cached = mount->getCachedStatus();
+  if (!cached || cached->parent != parent) {
+    return folly::none;
+  }
+  auto changed = getChangedPathsSince(
+      mount->getJournal(), cached->journalSequence);
+  if (!changed.hasValue()) {
+    return folly::none;
+  }
+
+  std::unordered_set<RelativePathPiece> changedSet{changed->begin(),
+                                                    changed->end()};
+  std::vector<RelativePath> uncleanPaths;
+  for (const auto& entry : cached->status.entries) {
+    if (entry.second != ScmFileStatus::MODIFIED &&
+        entry.second != ScmFileStatus::REMOVED) {
+      continue;
+    }
+    RelativePathPiece path{entry.first, detail::SkipPathSanityCheck{}};
+    if (!isAtOrBelowAny(path, changedSet)) {
+      uncleanPaths.emplace_back(path);
+    }
+  }
+  changedPaths = std::move(changed.value());
+  return uncleanPaths;
+}
+
 folly::Future<std::unique_ptr<ScmStatus>>
 diffRevisions(EdenMount* mount, const Hash& fromHash, const Hash& toHash) {
   auto callback = std::make_unique<ThriftStatusCallback>();
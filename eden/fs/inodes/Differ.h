@@ -8,9 +8,12 @@
  *
  */
 #pragma once
+#include <folly/Optional.h>
 #include <iosfwd>
+#include <vector>
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/service/gen-cpp2/EdenService.h"
+#include "eden/fs/utils/PathFuncs.h"
 
 namespace folly {
 template <typename T>
@@ -22,6 +25,18 @@ namespace eden {
 
 class EdenMount;
 
+/**
+ * The result of a status request, along with the state it was computed
+ * against.  See EdenMount::getCachedStatus().
+ */
+struct CachedScmStatus {
+  Hash parent;
+  /** The journal's latest sequence number when the diff started. */
+  uint64_t journalSequence;
+  bool listIgnored;
+  ScmStatus status;
+};
+
 /**
  * Returns the single-char representation for the ScmFileStatus used by
  * SCMs such as Git and Mercurial.
@@ -30,10 +45,37 @@ char scmStatusCodeChar(ScmFileStatus code);
 
 std::ostream& operator<<(std::ostream& os, const ScmStatus& status);
 
+/**
+ * Compute the status of the working directory relative to its parent
+ * commit.
+ *
+ * The result is cached in the mount.  If the parent commit and listIgnored
+ * match the cached result, only the paths that the journal reports have
+ * changed since it was computed are diffed again.  A full diff is done if the
+ * journal no longer covers that range, or if the changes touch a .gitignore
+ * file or too many paths.
+ */
 folly::Future<std::unique_ptr<ScmStatus>> diffMountForStatus(
-    const EdenMount* mount,
+    EdenMount* mount,
     bool listIgnored);
 
+/**
+ * Use the status result cached in the mount to find the files that differ
+ * from the given parent commit, without diffing the whole working directory.
+ *
+ * Returns the paths that the cached result reports as modified or removed,
+ * and sets changedPaths to the paths that the journal reports have changed
+ * since the result was computed.  The returned paths exclude anything at or
+ * below changedPaths: the caller still needs to diff those itself.
+ *
+ * Returns folly::none if there is no cached result for the parent commit, or
+ * if the journal cannot say what has changed since it was computed.
+ */
+folly::Optional<std::vector<RelativePath>> getCachedUncleanPaths(
+    EdenMount* mount,
+    const Hash& parent,
+    std::vector<RelativePath>& changedPaths);
+
 folly::Future<std::unique_ptr<ScmStatus>>
 diffRevisions(EdenMount* mount, const Hash& fromHash, const Hash& toHash);
 
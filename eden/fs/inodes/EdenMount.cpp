@@ -14,20 +14,26 @@
 #include <folly/ExceptionWrapper.h>
 #include <folly/FBString.h>
 #include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
 #include <folly/Subprocess.h>
 #include <folly/chrono/Conv.h>
 #include <folly/experimental/logging/Logger.h>
 #include <folly/experimental/logging/xlog.h>
 #include <folly/futures/Future.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/stop_watch.h>
 #include <folly/system/ThreadName.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
 
 #include "eden/fs/config/ClientConfig.h"
 #include "eden/fs/fuse/DirHandle.h"
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/fuse/privhelper/PrivHelper.h"
 #include "eden/fs/inodes/CheckoutContext.h"
+#include "eden/fs/inodes/CheckoutPrefetcher.h"
 #include "eden/fs/inodes/DiffContext.h"
+#include "eden/fs/inodes/Differ.h"
 #include "eden/fs/inodes/EdenDispatcher.h"
 #include "eden/fs/inodes/FileInode.h"
 #include "eden/fs/inodes/InodeDiffCallback.h"
@@ -35,6 +41,7 @@
 #include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/ServerState.h"
+#include "eden/fs/inodes/TreeDiffer.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/Tree.h"
@@ -44,6 +51,7 @@
 #include "eden/fs/utils/Clock.h"
 #include "eden/fs/utils/UnboundedQueueThreadPool.h"
 
+using apache::thrift::CompactSerializer;
 using facebook::eden::fusell::FuseChannelData;
 using folly::Future;
 using folly::makeFuture;
@@ -56,9 +64,22 @@ using std::make_unique;
 using std::shared_ptr;
 using std::unique_ptr;
 using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
 using std::chrono::system_clock;
 
 DEFINE_int32(fuseNumThreads, 16, "how many fuse dispatcher threads to spawn");
+DEFINE_uint64(
+    journal_memory_limit,
+    facebook::eden::Journal::kDefaultMemoryLimit,
+    "The approximate maximum memory, in bytes, used by each mount's journal. "
+    "Older history is discarded once this is exceeded.");
+DEFINE_uint64(
+    journal_save_limit,
+    100000,
+    "The maximum number of each mount's most recent journal entries to carry "
+    "over when edenfs is restarted.");
 
 namespace facebook {
 namespace eden {
@@ -72,8 +93,7 @@ namespace eden {
  */
 class EdenMount::JournalDiffCallback : public InodeDiffCallback {
  public:
-  explicit JournalDiffCallback()
-      : data_{folly::in_place, make_unique<JournalDelta>()} {}
+  JournalDiffCallback() = default;
 
   void ignoredFile(RelativePathPiece) override {}
 
@@ -82,13 +102,13 @@ class EdenMount::JournalDiffCallback : public InodeDiffCallback {
   void removedFile(
       RelativePathPiece path,
       const TreeEntry& /* sourceControlEntry */) override {
-    data_.wlock()->journalDelta->uncleanPaths.insert(path.copy());
+    addUncleanPath(path);
   }
 
   void modifiedFile(
       RelativePathPiece path,
       const TreeEntry& /* sourceControlEntry */) override {
-    data_.wlock()->journalDelta->uncleanPaths.insert(path.copy());
+    addUncleanPath(path);
   }
 
   void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
@@ -102,10 +122,61 @@ class EdenMount::JournalDiffCallback : public InodeDiffCallback {
   FOLLY_NODISCARD Future<folly::Unit> performDiff(
       EdenMount* mount,
       TreeInodePtr rootInode,
-      std::shared_ptr<const Tree> rootTree) {
+      std::shared_ptr<const Tree> rootTree,
+      const Hash& parent) {
     auto diffContext = mount->createDiffContext(this, /* listIgnored */ false);
-    auto rawContext = diffContext.get();
 
+    // A status request usually comes right before a checkout.  If its
+    // result is still cached, only the paths that have changed since then
+    // need to be diffed.
+    std::vector<RelativePath> changedPaths;
+    auto cachedPaths = getCachedUncleanPaths(mount, parent, changedPaths);
+    if (cachedPaths.hasValue()) {
+      XLOG(DBG3) << "journal diff for " << mount->getPath() << " reused "
+                 << cachedPaths->size() << " cached paths, checking "
+                 << changedPaths.size() << " changed paths";
+      for (const auto& path : cachedPaths.value()) {
+        addUncleanPath(path);
+      }
+      if (changedPaths.empty()) {
+        return makeFuture();
+      }
+      diffContext->restrictToPaths(std::move(changedPaths));
+    }
+
+    return runDiff(
+        std::move(diffContext), std::move(rootInode), std::move(rootTree));
+  }
+
+  /**
+   * Like performDiff(), but always diff the whole working directory.  This
+   * is used once a checkout has started changing inodes, since the cached
+   * status does not know about those changes.
+   */
+  FOLLY_NODISCARD Future<folly::Unit> performFullDiff(
+      EdenMount* mount,
+      TreeInodePtr rootInode,
+      std::shared_ptr<const Tree> rootTree) {
+    return runDiff(
+        mount->createDiffContext(this, /* listIgnored */ false),
+        std::move(rootInode),
+        std::move(rootTree));
+  }
+
+  /** moves the JournalDelta information out of this diff callback instance,
+   * rendering it invalid */
+  std::unique_ptr<JournalDelta> stealJournalDelta() {
+    auto result = make_unique<JournalDelta>();
+    result->uncleanPaths = std::move(*uncleanPaths_.wlock());
+    return result;
+  }
+
+ private:
+  static Future<folly::Unit> runDiff(
+      std::unique_ptr<DiffContext> diffContext,
+      TreeInodePtr rootInode,
+      std::shared_ptr<const Tree> rootTree) {
+    auto rawContext = diffContext.get();
     return rootInode
         ->diff(
             rawContext,
@@ -116,33 +187,21 @@ class EdenMount::JournalDiffCallback : public InodeDiffCallback {
         .ensure([diffContext = std::move(diffContext)]() {});
   }
 
-  /** moves the JournalDelta information out of this diff callback instance,
-   * rendering it invalid */
-  std::unique_ptr<JournalDelta> stealJournalDelta() {
-    std::unique_ptr<JournalDelta> result;
-    std::swap(result, data_.wlock()->journalDelta);
-
-    return result;
+  void addUncleanPath(RelativePathPiece path) {
+    uncleanPaths_.wlock()->emplace(path);
   }
 
- private:
-  struct Data {
-    explicit Data(unique_ptr<JournalDelta>&& journalDelta)
-        : journalDelta(std::move(journalDelta)) {}
-
-    unique_ptr<JournalDelta> journalDelta;
-  };
-  folly::Synchronized<Data> data_;
+  folly::Synchronized<std::unordered_set<RelativePath>> uncleanPaths_;
 };
 
 constexpr int EdenMount::kMaxSymlinkChainDepth;
 static constexpr folly::StringPiece kEdenStracePrefix = "eden.strace.";
 
 // We compute this when the process is initialized, but stash a copy
-// in each EdenMount.  We may in the future manage to propagate enough
-// state across upgrades or restarts that we can preserve this, but
-// as implemented today, a process restart will invalidate any cached
-// mountGeneration that a client may be holding on to.
+// in each EdenMount.  When the journal is carried over from a previous
+// process the mount keeps the mountGeneration it had there instead;
+// otherwise a process restart invalidates any cached mountGeneration
+// that a client may be holding on to.
 // We take the bottom 16-bits of the pid and 32-bits of the current
 // time and shift them up, leaving 16 bits for a mount point generation
 // number.
@@ -175,7 +234,9 @@ EdenMount::EdenMount(
       inodeMap_{new InodeMap(this)},
       dispatcher_{new EdenDispatcher(this)},
       objectStore_(std::move(objectStore)),
-      overlay_(std::make_shared<Overlay>(config_->getOverlayPath())),
+      overlay_(std::make_shared<Overlay>(
+          config_->getOverlayPath(),
+          config_->getOverlayDirStorage())),
       bindMounts_(config_->getBindMounts()),
       mountGeneration_(globalProcessGeneration | ++mountGeneration),
       straceLogger_{kEdenStracePrefix.str() + config_->getMountPath().value()},
@@ -183,37 +244,131 @@ EdenMount::EdenMount(
       path_(config_->getMountPath()),
       uid_(getuid()),
       gid_(getgid()),
-      clock_(clock) {}
+      clock_(clock) {
+  journal_.setMemoryLimit(FLAGS_journal_memory_limit);
+}
 
 folly::Future<folly::Unit> EdenMount::initialize(bool shouldSetMaxInodeNumber) {
+  auto initStart = steady_clock::now();
   auto parents = std::make_shared<ParentCommits>(config_->getParentCommits());
   parentInfo_.wlock()->parents.setParents(*parents);
 
   // Do this before the root TreeInode is allocated in case it needs to allocate
   // any inode numbers.
   if (shouldSetMaxInodeNumber) {
+    auto scannedOverlay = !overlay_->hadCleanShutdown();
     auto maxInodeNumber = overlay_->getMaxRecordedInode();
+    auto inodeNumberInitTime =
+        duration_cast<microseconds>(steady_clock::now() - initStart);
     XLOG(DBG2) << "Initializing eden mount " << getPath()
-               << "; max existing inode number is " << maxInodeNumber;
+               << "; max existing inode number is " << maxInodeNumber
+               << (scannedOverlay ? " (found by scanning the overlay in "
+                                  : " (recorded at clean shutdown, took ")
+               << inodeNumberInitTime.count() << "us)";
     inodeMap_->setMaximumExistingInodeNumber(maxInodeNumber);
+
+    auto stats = startupStats_.wlock();
+    stats->scannedOverlay = scannedOverlay;
+    stats->inodeNumberInitTime = inodeNumberInitTime;
   } else {
     XLOG(DBG2) << "Initializing eden mount " << getPath() << " from takeover";
   }
 
   return createRootInode(*parents).then(
-      [this, parents](TreeInodePtr initTreeNode) {
+      [this, parents, initStart](TreeInodePtr initTreeNode) {
         inodeMap_->initialize(std::move(initTreeNode));
 
-        // Record the transition from no snapshot to the current snapshot in
-        // the journal.  This also sets things up so that we can carry the
+        // Record the transition from no snapshot (or from the snapshot at
+        // the end of a restored journal) to the current snapshot in the
+        // journal.  This also sets things up so that we can carry the
         // snapshot id forward through subsequent journal entries.
-        auto delta = std::make_unique<JournalDelta>();
-        delta->toHash = parents->parent1();
-        journal_.addDelta(std::move(delta));
-        return setupDotEden(getRootInode());
+        auto latest = journal_.getLatest();
+        if (!latest.hasValue() || latest->toHash != parents->parent1()) {
+          auto delta = std::make_unique<JournalDelta>();
+          if (latest.hasValue()) {
+            delta->fromHash = latest->toHash;
+          }
+          delta->toHash = parents->parent1();
+          journal_.addDelta(std::move(delta));
+        }
+        return setupDotEden(getRootInode()).then([this, initStart] {
+          startupStats_.wlock()->totalInitTime =
+              duration_cast<microseconds>(steady_clock::now() - initStart);
+        });
       });
 }
 
+bool EdenMount::restoreJournal(const SerializedJournal& journal) {
+  if (journal.nextSequence == 0) {
+    // Nothing was saved.
+    return false;
+  }
+
+  try {
+    journal_.load(journal);
+  } catch (const std::exception& ex) {
+    XLOG(ERR) << "unable to restore the journal for " << getPath()
+              << "; clients will have to recrawl it: "
+              << folly::exceptionStr(ex);
+    return false;
+  }
+  mountGeneration_ = journal.mountGeneration;
+  XLOG(DBG2) << "restored " << journal.entries.size() << " journal entries "
+             << "for " << getPath() << " at sequence number "
+             << journal.nextSequence - 1;
+  return true;
+}
+
+bool EdenMount::restoreSavedJournal() {
+  auto journalPath = config_->getJournalPath();
+  std::string contents;
+  if (!folly::readFile(journalPath.c_str(), contents)) {
+    auto errnum = errno;
+    if (errnum != ENOENT) {
+      XLOG(WARNING) << "error reading saved journal " << journalPath << ": "
+                    << folly::errnoStr(errnum);
+    }
+    return false;
+  }
+
+  // Remove the file before using it, so that if we crash it is not picked up
+  // again by the next edenfs process.
+  if (unlink(journalPath.c_str()) != 0) {
+    auto errnum = errno;
+    XLOG(WARNING) << "error removing saved journal " << journalPath << ": "
+                  << folly::errnoStr(errnum);
+    return false;
+  }
+
+  SerializedJournal journal;
+  try {
+    journal = CompactSerializer::deserialize<SerializedJournal>(contents);
+  } catch (const std::exception& ex) {
+    XLOG(ERR) << "error parsing saved journal " << journalPath << ": "
+              << folly::exceptionStr(ex);
+    return false;
+  }
+  return restoreJournal(journal);
+}
+
+SerializedJournal EdenMount::serializeJournal() const {
+  auto journal = journal_.serialize(FLAGS_journal_save_limit);
+  journal.mountGeneration = mountGeneration_;
+  return journal;
+}
+
+void EdenMount::saveJournal() {
+  try {
+    folly::writeFileAtomic(
+        config_->getJournalPath().stringPiece(),
+        CompactSerializer::serialize<std::string>(serializeJournal()));
+  } catch (const std::exception& ex) {
+    // This is not fatal: clients will simply have to recrawl the mount.
+    XLOG(ERR) << "error saving the journal for " << getPath() << ": "
+              << folly::exceptionStr(ex);
+  }
+}
+
 folly::Future<TreeInodePtr> EdenMount::createRootInode(
     const ParentCommits& parentCommits) {
   // Load the overlay, if present.
@@ -343,21 +498,73 @@ Future<SerializedFileHandleMap> EdenMount::shutdownImpl(bool doTakeover) {
       : SerializedFileHandleMap{};
 
   return inodeMap_->shutdown().then(
-      [this, fileHandleMap = std::move(fileHandleMap)] {
+      [this, doTakeover, fileHandleMap = std::move(fileHandleMap)] {
+        // All inodes have been unloaded, so no more inode numbers can be
+        // allocated.  Record the next inode number in the overlay so the next
+        // mount does not need to scan the overlay to find it.
+        try {
+          overlay_->saveNextInodeNumber(inodeMap_->getNextInodeNumber());
+        } catch (const std::exception& ex) {
+          // This is not fatal: the next mount will simply have to scan the
+          // overlay.
+          XLOG(ERR) << "error recording next inode number for " << getPath()
+                    << ": " << folly::exceptionStr(ex);
+        }
+        // During a graceful restart the journal is handed to the new process
+        // along with the rest of the TakeoverData instead.
+        if (!doTakeover) {
+          saveJournal();
+        }
         XLOG(DBG1) << "shutdown complete for EdenMount " << getPath();
         state_.store(State::SHUT_DOWN);
         return fileHandleMap;
       });
 }
 
-fusell::FuseChannel* EdenMount::getFuseChannel() const {
-  return channel_.get();
-}
-
 const AbsolutePath& EdenMount::getPath() const {
   return path_;
 }
 
+void EdenMount::invalidateEntry(
+    fusell::InodeNumber parent,
+    PathComponentPiece name) {
+  withFuseChannel([&](fusell::FuseChannel* fuseChannel) {
+    if (!fuseChannel) {
+      return;
+    }
+
+    folly::stop_watch<std::chrono::microseconds> timer;
+    fuseChannel->invalidateEntry(parent, name);
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch());
+    getStats()->get()->recordLatency(
+        &fusell::EdenStats::invalidateEntry, timer.elapsed(), now);
+  });
+}
+
+Future<Unit> EdenMount::invalidateEntries(
+    std::vector<std::pair<fusell::InodeNumber, PathComponent>> entries) {
+  auto invalidationThread = invalidationThread_.rlock();
+  if (!*invalidationThread) {
+    // FUSE has not been started, or the session has ended, so there is
+    // nothing to invalidate.
+    return makeFuture();
+  }
+
+  return folly::via(invalidationThread->get())
+      .then([this, entries = std::move(entries)] {
+        for (const auto& entry : entries) {
+          try {
+            invalidateEntry(entry.first, entry.second);
+          } catch (const std::exception& ex) {
+            XLOG(ERR) << "error invalidating FUSE entry " << entry.second
+                      << " in directory inode " << entry.first << ": "
+                      << folly::exceptionStr(ex);
+          }
+        }
+      });
+}
+
 fusell::ThreadLocalEdenStats* EdenMount::getStats() const {
   return &serverState_->getStats();
 }
@@ -462,8 +669,9 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
   // This prevents multiple checkout operations from running in parallel.
   auto parentsLock = parentInfo_.wlock();
   auto oldParents = parentsLock->parents;
-  auto ctx =
-      std::make_shared<CheckoutContext>(std::move(parentsLock), checkoutMode);
+  auto ctx = std::make_shared<CheckoutContext>(
+      this, std::move(parentsLock), checkoutMode, snapshotHash);
+  *currentCheckout_.wlock() = ctx;
   XLOG(DBG1) << "starting checkout for " << this->getPath() << ": "
              << oldParents << " to " << snapshotHash;
 
@@ -479,7 +687,7 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
   auto journalDiffCallback = std::make_shared<JournalDiffCallback>();
 
   return folly::collect(fromTreeFuture, toTreeFuture)
-      .then([this, ctx, journalDiffCallback](
+      .then([this, ctx, oldParents, journalDiffCallback](
                 std::tuple<shared_ptr<const Tree>, shared_ptr<const Tree>>
                     treeResults) {
         auto& fromTree = std::get<0>(treeResults);
@@ -491,22 +699,72 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
         //
         // If we are doing a dry-run update we aren't going to create a journal
         // entry, so we can skip this step entirely.
+        //
+        // This has to finish before the checkout starts modifying inodes: a
+        // forced checkout can revert local modifications to files that do
+        // not differ between the two trees, and those files still need to be
+        // reported in the journal.  It normally only needs to look at the
+        // paths changed since the last status request, though.
         auto journalDiffFuture = Future<Unit>::makeEmpty();
         if (ctx->isDryRun()) {
           journalDiffFuture = makeFuture();
         } else {
-          journalDiffFuture =
-              journalDiffCallback->performDiff(this, getRootInode(), fromTree);
+          journalDiffFuture = journalDiffCallback->performDiff(
+              this, getRootInode(), fromTree, oldParents.parent1());
+        }
+
+        // Meanwhile, fetch the trees and blobs that the checkout will need,
+        // so that applying the changes does not have to wait on them one at
+        // a time.
+        auto prefetchFuture = makeFuture();
+        auto maxFetches = CheckoutPrefetcher::getDefaultMaxConcurrentFetches();
+        if (maxFetches > 0) {
+          auto prefetcher = std::make_shared<CheckoutPrefetcher>(
+              objectStore_.get(), maxFetches);
+          auto prefetchStart = std::chrono::steady_clock::now();
+          prefetchFuture =
+              prefetcher->prefetch(getRootInode(), fromTree, toTree)
+                  .then([ctx, prefetcher, prefetchStart] {
+                    ctx->prefetchFinished(
+                        std::chrono::steady_clock::now() - prefetchStart,
+                        prefetcher->getTreesFetched(),
+                        prefetcher->getBlobsFetched());
+                  });
         }
 
         // Perform the requested checkout operation after the journal diff
-        // completes.
-        return journalDiffFuture.then([this, ctx, fromTree, toTree]() {
-          ctx->start(this->acquireRenameLock());
-          return this->getRootInode()
-              ->checkout(ctx.get(), fromTree, toTree)
-              .then([toTree]() mutable { return toTree; });
-        });
+        // and the prefetch complete.
+        return folly::collect(journalDiffFuture, prefetchFuture)
+            .then([this, ctx, fromTree, toTree, journalDiffCallback](
+                      std::tuple<Unit, Unit>&&) {
+              if (ctx->isCancelled()) {
+                throw std::system_error(
+                    ECANCELED, std::generic_category(), "checkout cancelled");
+              }
+              ctx->start();
+              return this->getRootInode()
+                  ->checkout(ctx.get(), fromTree, toTree)
+                  .then([ctx](folly::Try<Unit>&& result) {
+                    // Wait for the invalidations even if the checkout
+                    // failed, since some entries may have changed anyway.
+                    return ctx->flushInvalidations().then(
+                        [result = std::move(result)]() mutable {
+                          return makeFuture(std::move(result));
+                        });
+                  })
+                  .then([this, ctx, fromTree, journalDiffCallback] {
+                    if (ctx->isDryRun() || !ctx->isIncomplete()) {
+                      return makeFuture();
+                    }
+                    // The checkout was cancelled part way through, so the
+                    // parent stays at fromTree's commit.  Diff against it
+                    // again to find the files that the checkout did update,
+                    // so that they are recorded in the journal.
+                    return journalDiffCallback->performFullDiff(
+                        this, getRootInode(), fromTree);
+                  })
+                  .then([toTree]() mutable { return toTree; });
+            });
       })
       .then([this, ctx, oldParents, snapshotHash, journalDiffCallback](
                 std::shared_ptr<const Tree> toTree) {
@@ -519,6 +777,19 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
           return conflicts;
         }
 
+        if (ctx->isIncomplete()) {
+          // finish() left the parent alone, since only some directories
+          // were updated.  Record the files that differ from it now.
+          XLOG(WARN) << "checkout of " << this->getPath() << " to "
+                     << snapshotHash << " was cancelled after it started "
+                     << "updating files; the parent is still " << oldParents;
+          auto journalDelta = journalDiffCallback->stealJournalDelta();
+          journalDelta->fromHash = oldParents.parent1();
+          journalDelta->toHash = oldParents.parent1();
+          journal_.addDelta(std::move(journalDelta));
+          return conflicts;
+        }
+
         this->config_->setParentCommits(snapshotHash);
         XLOG(DBG1) << "updated snapshot for " << this->getPath() << " from "
                    << oldParents << " to " << snapshotHash;
@@ -540,9 +811,39 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
         journal_.addDelta(std::move(journalDelta));
 
         return conflicts;
+      })
+      .ensure([this, ctx] {
+        auto progress = ctx->getProgress();
+        progress.phase = CheckoutPhase::NONE;
+        *lastCheckoutProgress_.wlock() = std::move(progress);
+        currentCheckout_.wlock()->reset();
       });
 }
 
+CheckoutProgress EdenMount::getCheckoutProgress() const {
+  auto ctx = currentCheckout_.rlock()->lock();
+  if (!ctx) {
+    CheckoutProgress progress;
+    progress.phase = CheckoutPhase::NONE;
+    return progress;
+  }
+  return ctx->getProgress();
+}
+
+CheckoutProgress EdenMount::getLastCheckoutProgress() const {
+  return *lastCheckoutProgress_.rlock();
+}
+
+bool EdenMount::cancelCheckout() {
+  auto ctx = currentCheckout_.rlock()->lock();
+  if (!ctx) {
+    return false;
+  }
+  XLOG(INFO) << "cancelling checkout of " << getPath();
+  ctx->requestCancel();
+  return true;
+}
+
 std::unique_ptr<DiffContext> EdenMount::createDiffContext(
     InodeDiffCallback* callback,
     bool listIgnored) const {
@@ -551,29 +852,65 @@ std::unique_ptr<DiffContext> EdenMount::createDiffContext(
 }
 
 Future<Unit> EdenMount::diff(const DiffContext* ctxPtr) const {
+  return diff(ctxPtr, getParentCommits().parent1());
+}
+
+Future<Unit> EdenMount::diff(
+    const DiffContext* ctxPtr,
+    const Hash& commitHash) const {
   auto rootInode = getRootInode();
-  return getRootTreeFuture().then([ctxPtr, rootInode = std::move(rootInode)](
-                                      std::shared_ptr<const Tree>&& rootTree) {
-    return rootInode->diff(
-        ctxPtr,
-        RelativePathPiece{},
-        std::move(rootTree),
-        ctxPtr->getToplevelIgnore(),
-        false);
-  });
+  return objectStore_->getTreeForCommit(commitHash)
+      .then([ctxPtr, rootInode = std::move(rootInode)](
+                std::shared_ptr<const Tree>&& rootTree) {
+        return rootInode->diff(
+            ctxPtr,
+            RelativePathPiece{},
+            std::move(rootTree),
+            ctxPtr->getToplevelIgnore(),
+            false);
+      });
 }
 
 Future<Unit> EdenMount::diff(InodeDiffCallback* callback, bool listIgnored)
     const {
-  // Create a DiffContext object for this diff operation.
+  return diff(
+      createDiffContext(callback, listIgnored), getParentCommits().parent1());
+}
+
+Future<Unit> EdenMount::diff(
+    InodeDiffCallback* callback,
+    const Hash& commitHash,
+    bool listIgnored) const {
+  return diff(createDiffContext(callback, listIgnored), commitHash);
+}
+
+Future<Unit> EdenMount::diff(
+    InodeDiffCallback* callback,
+    const Hash& commitHash,
+    bool listIgnored,
+    std::vector<RelativePath> paths) const {
   auto context = createDiffContext(callback, listIgnored);
+  context->restrictToPaths(std::move(paths));
+  return diff(std::move(context), commitHash);
+}
+
+Future<Unit> EdenMount::diff(
+    std::unique_ptr<DiffContext> context,
+    const Hash& commitHash) const {
   const DiffContext* ctxPtr = context.get();
 
   // stateHolder() exists to ensure that the DiffContext and GitIgnoreStack
   // exists until the diff completes.
-  auto stateHolder = [ctx = std::move(context)]() {};
+  auto stateHolder = [ctx = std::move(context), path = getPath()]() {
+    auto progress = ctx->getProgress();
+    XLOG(DBG2) << "diff of " << path << " compared "
+               << progress.directoriesCompared << " directories, found "
+               << progress.localLookups << " objects locally, and fetched "
+               << progress.treesFetched << " trees and "
+               << progress.blobMetadataFetched << " blobs";
+  };
 
-  return diff(ctxPtr).ensure(std::move(stateHolder));
+  return diff(ctxPtr, commitHash).ensure(std::move(stateHolder));
 }
 
 folly::Future<folly::Unit> EdenMount::diffRevisions(
@@ -590,19 +927,19 @@ folly::Future<folly::Unit> EdenMount::diffRevisions(
   auto stateHolder = [ctx = std::move(context)]() {};
 
   return collectAll(fromTreeFuture, toTreeFuture)
-      .then([this, ctxPtr](std::tuple<
-                           folly::Try<std::shared_ptr<const Tree>>,
-                           folly::Try<std::shared_ptr<const Tree>>>& tup) {
+      .then([ctxPtr](std::tuple<
+                     folly::Try<std::shared_ptr<const Tree>>,
+                     folly::Try<std::shared_ptr<const Tree>>>& tup) {
         auto fromTree = std::get<0>(tup).value();
         auto toTree = std::get<1>(tup).value();
-        auto rootInode = TreeInodePtr::makeNew(this, std::move(fromTree));
 
-        return rootInode->diff(
+        // Neither commit is the working copy, so walk the trees directly
+        // rather than creating unlinked inodes for them.
+        return diffTrees(
             ctxPtr,
             RelativePathPiece{},
-            std::move(toTree),
-            ctxPtr->getToplevelIgnore(),
-            false);
+            std::move(fromTree),
+            std::move(toTree));
       })
       .ensure(std::move(stateHolder));
 }
@@ -643,10 +980,56 @@ RenameLock EdenMount::acquireRenameLock() {
   return RenameLock{this};
 }
 
+Future<RenameLock> EdenMount::acquireRenameLockForDirs(
+    fusell::InodeNumber srcDir,
+    fusell::InodeNumber destDir) {
+  RenameLock renameLock{this};
+  if (checkoutDirs_.count(srcDir) == 0 && checkoutDirs_.count(destDir) == 0) {
+    return makeFuture(std::move(renameLock));
+  }
+
+  // Try again once the checkout has finished with some directory.  It may
+  // not be one of ours, or another checkout may have started on ours by
+  // then, so we have to check again.
+  checkoutDirWaiters_.emplace_back();
+  auto finished = checkoutDirWaiters_.back().getFuture();
+  renameLock.unlock();
+  return finished.then([this, srcDir, destDir] {
+    return acquireRenameLockForDirs(srcDir, destDir);
+  });
+}
+
 SharedRenameLock EdenMount::acquireSharedRenameLock() {
   return SharedRenameLock{this};
 }
 
+void EdenMount::startCheckoutDir(fusell::InodeNumber dir) {
+  auto renameLock = acquireRenameLock();
+  auto inserted = checkoutDirs_.insert(dir).second;
+  DCHECK(inserted) << "directory " << dir << " checked out twice at once";
+}
+
+void EdenMount::finishCheckoutDir(fusell::InodeNumber dir) {
+  std::vector<folly::Promise<Unit>> waiters;
+  {
+    auto renameLock = acquireRenameLock();
+    checkoutDirs_.erase(dir);
+    waiters.swap(checkoutDirWaiters_);
+  }
+  // Wake the waiters with the rename lock released, since they need it.
+  for (auto& waiter : waiters) {
+    waiter.setValue();
+  }
+}
+
+void EdenMount::setDeferringCheckout(
+    CheckoutContext* ctx,
+    const RenameLock& renameLock) {
+  DCHECK(renameLock.isHeld(this));
+  DCHECK(!ctx || !deferringCheckout_ || deferringCheckout_ == ctx);
+  deferringCheckout_ = ctx;
+}
+
 std::string EdenMount::getCounterName(CounterName name) {
   const auto prefix = getPath().stringPiece().str();
   switch (name) {
@@ -691,19 +1074,34 @@ folly::Future<folly::Unit> EdenMount::startFuse(
               serverState_->getPrivHelper()->fuseMount(path_.stringPiece());
         }
 
-        channel_ = std::make_unique<fusell::FuseChannel>(
+        auto channel = std::make_unique<fusell::FuseChannel>(
             std::move(fuseDevice),
             path_,
             eventBase_,
             FLAGS_fuseNumThreads,
             dispatcher_.get());
+        auto* rawChannel = channel.get();
+        *channel_.wlock() = std::move(channel);
+        *invalidationThread_.wlock() =
+            std::make_unique<UnboundedQueueThreadPool>(1, "FuseInvalidate");
 
-        channel_->getSessionCompleteFuture()
+        rawChannel->getSessionCompleteFuture()
             .then([this] {
+              // Stop accepting invalidations, and wait for the invalidation
+              // thread to send the ones it already has before the channel
+              // goes away.  Checkouts waiting for them can then finish.
+              std::unique_ptr<UnboundedQueueThreadPool> invalidationThread;
+              invalidationThread_.wlock()->swap(invalidationThread);
+              invalidationThread->join();
+
               // In case we are performing a graceful restart,
               // extract the fuse device now.
-              auto channelData = channel_->stealFuseDevice();
-              channel_.reset();
+              FuseChannelData channelData;
+              {
+                auto channel = channel_.wlock();
+                channelData = (*channel)->stealFuseDevice();
+                channel->reset();
+              }
 
               std::vector<AbsolutePath> bindMounts;
               for (const auto& entry : bindMounts_) {
@@ -725,7 +1123,7 @@ folly::Future<folly::Unit> EdenMount::startFuse(
               fuseCompletionPromise_.setException(std::move(ew));
             });
 
-        return channel_->initialize(connInfo, threadPool.get())
+        return rawChannel->initialize(connInfo, threadPool.get())
             .then([this](folly::Unit&&) {
               doStateTransition(State::STARTING, State::RUNNING);
             })
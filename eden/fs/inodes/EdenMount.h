@@ -20,6 +20,7 @@
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <unordered_set>
 #include "eden/fs/fuse/EdenStats.h"
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/fuse/gen-cpp2/handlemap_types.h"
@@ -46,7 +47,9 @@ class MountPoint;
 } // namespace fusell
 
 class BindMount;
+struct CachedScmStatus;
 class CheckoutConflict;
+class CheckoutContext;
 class ClientConfig;
 class Clock;
 class DiffContext;
@@ -77,6 +80,29 @@ enum class CounterName {
   UNLOADED
 };
 
+/**
+ * Timing information about how long it took to initialize an EdenMount.
+ */
+struct MountStartupStats {
+  /**
+   * True if we had to scan the overlay to find the maximum inode number,
+   * because the overlay was not shut down cleanly the last time it was used.
+   */
+  bool scannedOverlay{false};
+
+  /**
+   * How long it took to initialize the InodeMap's inode number allocator.
+   * This is the time spent scanning the overlay when scannedOverlay is true.
+   */
+  std::chrono::microseconds inodeNumberInitTime{0};
+
+  /**
+   * The total time spent in EdenMount::initialize(), including loading the
+   * root inode and setting up the .eden directory.
+   */
+  std::chrono::microseconds totalInitTime{0};
+};
+
 /**
  * EdenMount contains all of the data about a specific eden mount point.
  *
@@ -113,6 +139,34 @@ class EdenMount {
   FOLLY_NODISCARD folly::Future<folly::Unit> initialize(
       bool shouldSetMaxInodeNumber);
 
+  /**
+   * Restore a journal saved by serializeJournal(), usually by a previous
+   * edenfs process, along with its mountGeneration.  Journal positions that
+   * clients obtained from the previous process remain valid, so they do not
+   * need to recrawl the mount.
+   *
+   * Like InodeMap::load(), this must be called before initialize().
+   * Returns false, leaving this mount with a fresh journal and
+   * mountGeneration, if no journal was saved or it could not be restored.
+   */
+  bool restoreJournal(const SerializedJournal& journal);
+
+  /**
+   * Restore the journal that was saved in the client directory when this
+   * mount was last cleanly unmounted, if any.
+   *
+   * The saved journal is removed once it has been read, so that it is never
+   * restored after an unclean shutdown, when it would be missing changes.
+   * Must be called before initialize().
+   */
+  bool restoreSavedJournal();
+
+  /**
+   * Return the newest journal entries and the mountGeneration, to be passed
+   * to restoreJournal() in a new edenfs process.
+   */
+  SerializedJournal serializeJournal() const;
+
   /**
    * Destroy the EdenMount.
    *
@@ -148,14 +202,35 @@ class EdenMount {
   folly::Future<SerializedFileHandleMap> shutdown(bool doTakeover);
 
   /**
-   * Get the FUSE channel for this mount point.
+   * Call fn with the FUSE channel for this mount point, and return its result.
    *
-   * This should only be called after the mount point has been successfully
-   * started.  (It is the caller's responsibility to perform proper
-   * synchronization here with the mount start operation.  This method provides
-   * no internal synchronization of its own.)
+   * The channel lock is held while fn runs, so the channel cannot be
+   * destroyed out from under it when the FUSE session ends.  fn is passed
+   * nullptr if FUSE has not been started or the session has already ended.
    */
-  fusell::FuseChannel* getFuseChannel() const;
+  template <typename Fn>
+  auto withFuseChannel(Fn&& fn) const {
+    auto channel = channel_.rlock();
+    return fn(channel->get());
+  }
+
+  /**
+   * Tell the kernel to drop any cached lookup result for the given directory
+   * entry.  This does nothing if FUSE has not been started.
+   *
+   * The latency of each invalidation is recorded in EdenStats.
+   */
+  void invalidateEntry(fusell::InodeNumber parent, PathComponentPiece name);
+
+  /**
+   * Invalidate a batch of directory entries, in order, on this mount's
+   * invalidation thread.
+   *
+   * This lets callers that hold inode locks avoid writing to the FUSE device
+   * themselves.  Errors are logged, and the returned Future always succeeds.
+   */
+  folly::Future<folly::Unit> invalidateEntries(
+      std::vector<std::pair<fusell::InodeNumber, PathComponent>> entries);
 
   /**
    * Return the path to the mount point.
@@ -207,6 +282,21 @@ class EdenMount {
     return journal_;
   }
 
+  /**
+   * Get the status result saved by the last call to setCachedStatus(), or
+   * nullptr if there is none.
+   *
+   * These are used by diffMountForStatus(), which keeps the result of the
+   * last status request so that later requests only need to re-examine the
+   * paths that the journal reports have changed since.
+   */
+  std::shared_ptr<const CachedScmStatus> getCachedStatus() const {
+    return *cachedStatus_.rlock();
+  }
+  void setCachedStatus(std::shared_ptr<const CachedScmStatus> status) {
+    *cachedStatus_.wlock() = std::move(status);
+  }
+
   uint64_t getMountGeneration() const {
     return mountGeneration_;
   }
@@ -309,6 +399,26 @@ class EdenMount {
       Hash snapshotHash,
       CheckoutMode checkoutMode = CheckoutMode::NORMAL);
 
+  /**
+   * Get the progress of the checkout currently running on this mount.
+   * The phase is CheckoutPhase::NONE if there is none.
+   */
+  CheckoutProgress getCheckoutProgress() const;
+
+  /**
+   * Get the final progress counters of the most recent checkout on this
+   * mount, once it has completed.  The phase is always CheckoutPhase::NONE.
+   */
+  CheckoutProgress getLastCheckoutProgress() const;
+
+  /**
+   * Ask the checkout currently running on this mount to stop, as described
+   * in CheckoutContext::requestCancel().
+   *
+   * Returns false if there is no checkout in progress.
+   */
+  bool cancelCheckout();
+
   /**
    * This version of diff is primarily intended for testing.
    * Use diff(InodeDiffCallback* callback, bool listIgnored) instead.
@@ -337,6 +447,32 @@ class EdenMount {
       InodeDiffCallback* callback,
       bool listIgnored = false) const;
 
+  /**
+   * Compute differences between the specified commit and the working
+   * directory state.
+   *
+   * Callers that need to know which commit the differences are relative to
+   * should read the parent commit once and pass it here, rather than using
+   * the diff() above, which reads the parent again when it starts.
+   */
+  FOLLY_NODISCARD folly::Future<folly::Unit> diff(
+      InodeDiffCallback* callback,
+      const Hash& commitHash,
+      bool listIgnored) const;
+
+  /**
+   * Compute differences between the specified commit and the working
+   * directory state, but only at or below the specified paths.
+   *
+   * Directories that do not contain any of the paths are skipped, so this is
+   * much cheaper than a full diff when only a few paths need to be checked.
+   */
+  FOLLY_NODISCARD folly::Future<folly::Unit> diff(
+      InodeDiffCallback* callback,
+      const Hash& commitHash,
+      bool listIgnored,
+      std::vector<RelativePath> paths) const;
+
   /**
    * Compute the differences between the trees in the specified commits.
    * This does not care about the working copy aside from using it as the
@@ -375,11 +511,66 @@ class EdenMount {
    */
   RenameLock acquireRenameLock();
 
+  /**
+   * Acquire the rename lock in exclusive mode in order to rename or remove
+   * entries in the given directories.
+   *
+   * The returned Future is not ready until a running checkout is no longer
+   * updating either directory, since a checkout relies on the entries of the
+   * directories it is working on staying put.  In that case the caller
+   * continues on the thread that finished the last of those directories.
+   * Renames and unlinks everywhere else in the mount proceed while a
+   * checkout is in progress.
+   */
+  folly::Future<RenameLock> acquireRenameLockForDirs(
+      fusell::InodeNumber srcDir,
+      fusell::InodeNumber destDir);
+
   /**
    * Acquire the rename lock in shared mode.
    */
   SharedRenameLock acquireSharedRenameLock();
 
+  /**
+   * Mark a directory as busy because a checkout is updating its entries, or
+   * mark it as no longer busy.
+   *
+   * The checkout marks a directory busy before processing any of its
+   * children, and marks it no longer busy once it is done changing the
+   * directory's entries, even if some subdirectories are still being updated.
+   * The entries of a busy directory therefore never change underneath the
+   * checkout, but the directory itself may be renamed (or removed, if it is
+   * empty) once its parent is no longer busy.
+   *
+   * Dry-run checkouts do not change anything, and do not mark directories
+   * busy.
+   */
+  void startCheckoutDir(fusell::InodeNumber dir);
+  void finishCheckoutDir(fusell::InodeNumber dir);
+
+  /**
+   * Record the checkout whose directory overlay writes are currently deferred
+   * until it finishes, or clear it by passing nullptr.
+   *
+   * The rename lock must be held in exclusive mode.
+   */
+  void setDeferringCheckout(
+      CheckoutContext* ctx,
+      const RenameLock& renameLock);
+
+  /**
+   * Get the checkout recorded by setDeferringCheckout(), or nullptr if no
+   * checkout has deferred overlay writes outstanding.
+   *
+   * The caller must hold the rename lock, in either mode, for as long as it
+   * uses the returned CheckoutContext.  The checkout only writes out its
+   * deferred data and clears this with the rename lock held in exclusive
+   * mode.
+   */
+  CheckoutContext* getDeferringCheckout() const {
+    return deferringCheckout_;
+  }
+
   /**
    * Returns a pointer to a stats instance associated with this mountpoint.
    * Today this is the global stats instance, but in the future it will be
@@ -408,6 +599,15 @@ class EdenMount {
    */
   std::string getCounterName(CounterName name);
 
+  /**
+   * Returns timing information about the initialization of this mount.
+   *
+   * The totalInitTime field is only populated once initialize() completes.
+   */
+  MountStartupStats getStartupStats() const {
+    return *startupStats_.rlock();
+  }
+
   struct ParentInfo {
     ParentCommits parents;
   };
@@ -546,10 +746,28 @@ class EdenMount {
   folly::Future<folly::Unit> setupDotEden(TreeInodePtr root);
   folly::Future<SerializedFileHandleMap> shutdownImpl(bool doTakeover);
 
+  /**
+   * Save the journal in the client directory for restoreSavedJournal().
+   * Errors are logged rather than thrown.
+   */
+  void saveJournal();
+
   std::unique_ptr<DiffContext> createDiffContext(
       InodeDiffCallback* callback,
       bool listIgnored) const;
 
+  /**
+   * Diff the working directory against the specified commit with the given
+   * context, keeping the context alive until the diff completes.
+   */
+  folly::Future<folly::Unit> diff(
+      std::unique_ptr<DiffContext> context,
+      const Hash& commitHash) const;
+
+  folly::Future<folly::Unit> diff(
+      const DiffContext* ctxPtr,
+      const Hash& commitHash) const;
+
   /**
    * Private destructor.
    *
@@ -576,6 +794,11 @@ class EdenMount {
   std::shared_ptr<Overlay> overlay_;
   fusell::InodeNumber dotEdenInodeNumber_{};
 
+  /**
+   * Timing information recorded by initialize().
+   */
+  folly::Synchronized<MountStartupStats> startupStats_;
+
   /**
    * A mutex around all name-changing operations in this mount point.
    *
@@ -585,6 +808,25 @@ class EdenMount {
    */
   folly::SharedMutex renameMutex_;
 
+  /**
+   * The directories that a checkout is currently updating.
+   *
+   * This is protected by renameMutex_, as are the promises of the renames
+   * and unlinks waiting for one of these directories.  Every waiter is
+   * woken whenever a directory is removed from checkoutDirs_, and checks
+   * again whether it can go ahead.
+   */
+  std::unordered_set<fusell::InodeNumber> checkoutDirs_;
+  std::vector<folly::Promise<folly::Unit>> checkoutDirWaiters_;
+
+  /**
+   * The checkout with deferred directory overlay writes outstanding, if any.
+   *
+   * This is protected by renameMutex_: it is only modified with the lock held
+   * in exclusive mode, and may be read with it held in either mode.
+   */
+  CheckoutContext* deferringCheckout_{nullptr};
+
   /**
    * The IDs of the parent commit(s) of the working directory.
    *
@@ -602,11 +844,29 @@ class EdenMount {
 
   Journal journal_;
 
+  folly::Synchronized<std::shared_ptr<const CachedScmStatus>> cachedStatus_;
+
+  /**
+   * The checkout in progress, if any, so that other threads can report its
+   * progress or cancel it.  This does not use parentInfo_, since the
+   * checkout holds that lock for its entire duration.
+   */
+  folly::Synchronized<std::weak_ptr<CheckoutContext>> currentCheckout_;
+
+  /**
+   * The counters of the last checkout to complete on this mount.
+   */
+  folly::Synchronized<CheckoutProgress> lastCheckoutProgress_;
+
   /**
    * A number to uniquely identify this particular incarnation of this mount.
    * We use bits from the process id and the time at which we were mounted.
+   *
+   * If the journal is carried over from a previous edenfs process then so is
+   * this, by restoreJournal().  It is not modified once initialize() has been
+   * called.
    */
-  const uint64_t mountGeneration_;
+  uint64_t mountGeneration_;
 
   /**
    * The path to the unix socket that can be used to address us via thrift
@@ -666,8 +926,19 @@ class EdenMount {
 
   /**
    * The associated fuse channel to the kernel.
+   *
+   * This is reset when the FUSE session ends, so invalidateEntry() holds the
+   * lock while it uses the channel.
+   */
+  folly::Synchronized<std::unique_ptr<fusell::FuseChannel>> channel_;
+
+  /**
+   * A single thread that sends the kernel the cache invalidations queued by
+   * invalidateEntries().  This is created along with channel_, and stopped
+   * and drained before channel_ is reset.
    */
-  std::unique_ptr<fusell::FuseChannel> channel_;
+  folly::Synchronized<std::unique_ptr<UnboundedQueueThreadPool>>
+      invalidationThread_;
 
   /**
    * The main eventBase of the program; this is used to join and dispatch
@@ -64,6 +64,15 @@ folly::Future<fusell::BufVec> FileHandle::read(size_t size, off_t off) {
   return inode_->read(size, off);
 }
 
+namespace {
+void recordWrite(const FileInodePtr& inode) {
+  // Consecutive writes to the same file are coalesced into a single journal
+  // entry, in which case we don't need to compute the file's path at all.
+  inode->getMount()->getJournal().recordChangedFile(
+      inode->getNodeId(), [&] { return inode->getPath(); });
+}
+} // namespace
+
 folly::Future<size_t> FileHandle::write(fusell::BufVec&& buf, off_t off) {
   FB_LOGF(
       inode_->getMount()->getStraceLogger(),
@@ -73,11 +82,7 @@ folly::Future<size_t> FileHandle::write(fusell::BufVec&& buf, off_t off) {
       off,
       buf.size());
   return inode_->write(std::move(buf), off).then([inode = inode_](size_t size) {
-    auto myname = inode->getPath();
-    if (myname.hasValue()) {
-      inode->getMount()->getJournal().addDelta(
-          std::make_unique<JournalDelta>(JournalDelta{myname.value()}));
-    }
+    recordWrite(inode);
     return size;
   });
 }
@@ -91,11 +96,7 @@ folly::Future<size_t> FileHandle::write(folly::StringPiece str, off_t off) {
       off,
       str.size());
   return inode_->write(str, off).then([inode = inode_](size_t size) {
-    auto myname = inode->getPath();
-    if (myname.hasValue()) {
-      inode->getMount()->getJournal().addDelta(
-          std::make_unique<JournalDelta>(JournalDelta{myname.value()}));
-    }
+    recordWrite(inode);
     return size;
   });
 }
@@ -43,6 +43,68 @@ using std::vector;
 namespace facebook {
 namespace eden {
 
+namespace {
+/**
+ * If no more than this many bytes of a materialized file still need to be
+ * hashed, getSha1() hashes them immediately with the state lock held rather
+ * than deferring the work to a background thread.
+ */
+constexpr uint64_t kInlineSha1Limit = 256 * 1024;
+
+/**
+ * The read size used when hashing materialized file contents.
+ */
+constexpr size_t kSha1BufferSize = 1024 * 1024;
+} // namespace
+
+struct FileInode::Sha1Progress {
+  Sha1Progress() {
+    SHA1_Init(&ctx);
+  }
+
+  /**
+   * Hash the file contents from the end of the current prefix through to the
+   * end of the file.
+   */
+  void hashRemainingContents(int fd) {
+    auto buf = std::make_unique<uint8_t[]>(kSha1BufferSize);
+    while (true) {
+      // Using pread here so that we don't move the file position;
+      // the file descriptor is shared between multiple file handles.
+      auto len = folly::preadNoInt(
+          fd, buf.get(), kSha1BufferSize, length + Overlay::kHeaderLength);
+      if (len == 0) {
+        break;
+      }
+      if (len == -1) {
+        folly::throwSystemError();
+      }
+      SHA1_Update(&ctx, buf.get(), len);
+      length += len;
+    }
+  }
+
+  /**
+   * Get the SHA-1 of the prefix hashed so far.
+   */
+  Hash finish() const {
+    // SHA1_Final() destroys the context, so finalize a copy.  This allows us
+    // to keep extending the hash if data is appended later.
+    SHA_CTX finalCtx = ctx;
+    uint8_t digest[SHA_DIGEST_LENGTH];
+    SHA1_Final(digest, &finalCtx);
+    return Hash(folly::ByteRange(digest, sizeof(digest)));
+  }
+
+  SHA_CTX ctx;
+
+  /**
+   * The number of bytes at the start of the file contents (not including
+   * the overlay header) covered by ctx.
+   */
+  uint64_t length{0};
+};
+
 FileInode::State::State(
     FileInode* inode,
     mode_t m,
@@ -79,21 +141,24 @@ void FileInode::State::State::checkInvariants() {
       CHECK(!blobLoadingPromise);
       CHECK(!blob);
       CHECK(!file);
-      CHECK(!sha1Valid);
+      CHECK(!sha1);
+      CHECK(!sha1Progress);
       return;
     case BLOB_LOADING:
       CHECK(hash);
       CHECK(blobLoadingPromise);
       CHECK(!blob);
       CHECK(!file);
-      CHECK(!sha1Valid);
+      CHECK(!sha1);
+      CHECK(!sha1Progress);
       return;
     case BLOB_LOADED:
       CHECK(hash);
       CHECK(!blobLoadingPromise);
       CHECK(blob);
       CHECK(!file);
-      CHECK(!sha1Valid);
+      CHECK(!sha1);
+      CHECK(!sha1Progress);
       DCHECK_EQ(blob->getHash(), hash.value());
       return;
     case MATERIALIZED_IN_OVERLAY:
@@ -119,7 +184,15 @@ void FileInode::State::closeFile() {
   file.close();
 }
 
-folly::File FileInode::getFile(FileInode::State& state) const {
+void FileInode::State::contentsModified(uint64_t offset) {
+  sha1.clear();
+  ++contentsVersion;
+  if (sha1Progress && offset < sha1Progress->length) {
+    sha1Progress.reset();
+  }
+}
+
+std::shared_ptr<folly::File> FileInode::getFile(FileInode::State& state) const {
   DCHECK(state.isMaterialized())
       << "must only be called for materialized files";
 
@@ -132,12 +205,13 @@ folly::File FileInode::getFile(FileInode::State& state) const {
 
   if (state.isFileOpen()) {
     // Return a non-owning copy of the file object that we already have
-    return folly::File(state.file.fd(), /*ownsFd=*/false);
+    return std::make_shared<folly::File>(state.file.fd(), /*ownsFd=*/false);
   }
 
-  // We don't have and shouldn't keep a file around, so we return
-  // a File temporary instead.
-  return folly::File(getLocalPath().c_str(), O_RDWR);
+  // We shouldn't keep a file around in our own state, but the overlay keeps
+  // recently used files open so that we don't have to reopen the file every
+  // time it is stat'ed.
+  return getMount()->getOverlay()->getCachedFile(getNodeId());
 }
 
 /*
@@ -223,7 +297,9 @@ folly::Future<fusell::Dispatcher::Attr> FileInode::setInodeAttr(
 
     // Set the size of the file when FATTR_SIZE is set
     if (attr.valid & FATTR_SIZE) {
-      checkUnixError(ftruncate(file.fd(), attr.size + Overlay::kHeaderLength));
+      state->contentsModified(attr.size);
+      checkUnixError(
+          ftruncate(file->fd(), attr.size + Overlay::kHeaderLength));
     }
 
     if (attr.valid & FATTR_MODE) {
@@ -244,7 +320,7 @@ folly::Future<fusell::Dispatcher::Attr> FileInode::setInodeAttr(
     // have to return the correct size of the file even if some size is sent
     // in attr.st.st_size.
     struct stat overlayStat;
-    checkUnixError(fstat(file.fd(), &overlayStat));
+    checkUnixError(fstat(file->fd(), &overlayStat));
     result.st.st_ino = self->getNodeId().get();
     result.st.st_size = overlayStat.st_size - Overlay::kHeaderLength;
     result.st.st_atim = state->timeStamps.atime.toTimespec();
@@ -319,13 +395,18 @@ folly::Optional<bool> FileInode::isSameAsFast(
   return folly::none;
 }
 
-bool FileInode::isSameAs(const Blob& blob, TreeEntryType entryType) {
+folly::Future<bool> FileInode::isSameAs(
+    const Blob& blob,
+    TreeEntryType entryType) {
   auto result = isSameAsFast(blob.getHash(), entryType);
   if (result.hasValue()) {
-    return result.value();
+    return makeFuture(result.value());
   }
 
-  return getSha1().value() == Hash::sha1(&blob.getContents());
+  // getSha1() may hash a large file on the thread pool, so the blob's hash
+  // is computed now rather than keeping a reference to the blob.
+  return getSha1().then([blobSha1 = Hash::sha1(&blob.getContents())](
+                            Hash sha1) { return sha1 == blobSha1; });
 }
 
 folly::Future<bool> FileInode::isSameAs(
@@ -338,10 +419,37 @@ folly::Future<bool> FileInode::isSameAs(
 
   return getMount()->getObjectStore()->getBlobMetadata(blobID).then(
       [self = inodePtrFromThis()](const BlobMetadata& metadata) {
-        return self->getSha1().value() == metadata.sha1;
+        return self->getSha1().then(
+            [expected = metadata.sha1](Hash sha1) { return sha1 == expected; });
       });
 }
 
+folly::Future<bool> FileInode::isSameAs(const TreeEntry& entry) {
+  auto result = isSameAsFast(entry.getHash(), entry.getType());
+  if (result.hasValue()) {
+    return makeFuture(result.value());
+  }
+
+  if (entry.getSize().hasValue()) {
+    auto state = state_.wlock();
+    if (state->tag == State::MATERIALIZED_IN_OVERLAY) {
+      auto file = getFile(*state);
+      struct stat overlayStat;
+      checkUnixError(fstat(file->fd(), &overlayStat));
+      uint64_t contentsSize = overlayStat.st_size - Overlay::kHeaderLength;
+      if (contentsSize != entry.getSize().value()) {
+        return makeFuture(false);
+      }
+    }
+  }
+
+  if (entry.getContentSha1().hasValue()) {
+    return getSha1().then([expected = entry.getContentSha1().value()](
+                              Hash sha1) { return sha1 == expected; });
+  }
+  return isSameAs(entry.getHash(), entry.getType());
+}
+
 mode_t FileInode::getMode() const {
   return state_.rlock()->mode;
 }
@@ -427,14 +535,25 @@ Future<Hash> FileInode::getSha1() {
           ->getBlobMetadata(state->hash.value())
           .then([](const BlobMetadata& metadata) { return metadata.sha1; });
     case State::MATERIALIZED_IN_OVERLAY:
+      if (state->sha1) {
+        return state->sha1.value();
+      }
+
       auto file = getFile(*state);
-      if (state->sha1Valid) {
-        auto shaStr = fgetxattr(file.fd(), kXattrSha1);
-        if (!shaStr.empty()) {
-          return Hash(shaStr);
-        }
+      struct stat overlayStat;
+      checkUnixError(fstat(file->fd(), &overlayStat));
+      uint64_t contentsSize = overlayStat.st_size - Overlay::kHeaderLength;
+      uint64_t alreadyHashed =
+          state->sha1Progress ? state->sha1Progress->length : 0;
+      if (contentsSize <= alreadyHashed + kInlineSha1Limit ||
+          !getMount()->getThreadPool()) {
+        // Only a small amount of data was written since we last computed the
+        // hash (typically because the file was appended to), so just catch
+        // up now.  (The thread pool is only available once the mount has
+        // been started.)
+        return recomputeAndStoreSha1(state, *file);
       }
-      return recomputeAndStoreSha1(state, file);
+      return recomputeSha1InBackground(std::move(state), std::move(file));
   }
 
   XLOG(FATAL) << "FileInode in illegal state: " << state->tag;
@@ -452,7 +571,7 @@ folly::Future<struct stat> FileInode::stat() {
       auto file = self->getFile(*state);
       // We are calling fstat only to get the size of the file.
       struct stat overlayStat;
-      checkUnixError(fstat(file.fd(), &overlayStat));
+      checkUnixError(fstat(file->fd(), &overlayStat));
 
       if (overlayStat.st_size < Overlay::kHeaderLength) {
         auto filePath = self->getLocalPath();
@@ -498,13 +617,10 @@ void FileInode::updateBlockCount(struct stat& st) {
 void FileInode::flush(uint64_t /* lock_owner */) {
   // This is called by FUSE when a file handle is closed.
   // https://github.com/libfuse/libfuse/wiki/FAQ#which-method-is-called-on-the-close-system-call
-  // We have no write buffers, so there is nothing for us to flush,
-  // but let's take this opportunity to update the sha1 attribute.
-  auto state = state_.wlock();
-  if (state->isFileOpen() && !state->sha1Valid) {
-    recomputeAndStoreSha1(state, state->file);
-  }
-  state->checkInvariants();
+  // We have no write buffers, so there is nothing for us to flush.
+  //
+  // We intentionally do not compute the SHA-1 here: it is computed on demand
+  // by getSha1(), which only has to hash data written since the last call.
 }
 
 void FileInode::fsync(bool datasync) {
@@ -520,15 +636,6 @@ void FileInode::fsync(bool datasync) {
 #endif
                ::fsync(state->file.fd());
   checkUnixError(res);
-
-  // let's take this opportunity to update the sha1 attribute.
-  // TODO: A program that issues a series of write() and fsync() syscalls (for
-  // example, when logging to a file), would exhibit quadratic behavior here.
-  // This should either not recompute SHA-1 here or instead remember if the
-  // prior SHA-1 was actually used.
-  if (!state->sha1Valid) {
-    recomputeAndStoreSha1(state, state->file);
-  }
 }
 
 folly::Future<std::string> FileInode::readAll() {
@@ -540,9 +647,9 @@ folly::Future<std::string> FileInode::readAll() {
     switch (state->tag) {
       case State::MATERIALIZED_IN_OVERLAY: {
         auto file = self->getFile(*state);
-        auto rc = lseek(file.fd(), Overlay::kHeaderLength, SEEK_SET);
+        auto rc = lseek(file->fd(), Overlay::kHeaderLength, SEEK_SET);
         folly::checkUnixError(rc, "unable to seek in materialized FileInode");
-        folly::readFile(file.fd(), result);
+        folly::readFile(file->fd(), result);
         break;
       }
       case State::BLOB_LOADED: {
@@ -578,7 +685,7 @@ fusell::BufVec FileInode::read(size_t size, off_t off) {
     auto file = getFile(*state);
     auto buf = folly::IOBuf::createCombined(size);
     auto res = ::pread(
-        file.fd(), buf->writableBuffer(), size, off + Overlay::kHeaderLength);
+        file->fd(), buf->writableBuffer(), size, off + Overlay::kHeaderLength);
 
     checkUnixError(res);
     buf->append(res);
@@ -617,10 +724,10 @@ folly::Future<size_t> FileInode::write(fusell::BufVec&& buf, off_t off) {
 
   auto file = getFile(*state);
 
-  state->sha1Valid = false;
+  state->contentsModified(off);
   auto vec = buf.getIov();
   auto xfer = ::pwritev(
-      file.fd(), vec.data(), vec.size(), off + Overlay::kHeaderLength);
+      file->fd(), vec.data(), vec.size(), off + Overlay::kHeaderLength);
   checkUnixError(xfer);
 
   // Update mtime and ctime on write systemcall.
@@ -643,9 +750,9 @@ folly::Future<size_t> FileInode::write(folly::StringPiece data, off_t off) {
   }
   auto file = getFile(*state);
 
-  state->sha1Valid = false;
+  state->contentsModified(off);
   auto xfer = ::pwrite(
-      file.fd(), data.data(), data.size(), off + Overlay::kHeaderLength);
+      file->fd(), data.data(), data.size(), off + Overlay::kHeaderLength);
   checkUnixError(xfer);
 
   // Update mtime and ctime on write systemcall.
@@ -824,19 +931,19 @@ Future<Unit> FileInode::materializeForWrite() {
 
       folly::writeFileAtomic(
           filePath.stringPiece(), iov.data(), iov.size(), 0600);
+      self->getMount()->getOverlay()->invalidateCachedFile(self->getNodeId());
       InodeTimestamps timeStamps;
 
       auto file = Overlay::openFile(
           filePath.stringPiece(), Overlay::kHeaderIdentifierFile, timeStamps);
-      state->sha1Valid = false;
 
-      // If we have a SHA-1 from the metadata, apply it to the new file.  This
-      // saves us from recomputing it again in the case that something opens the
-      // file read/write and closes it without changing it.
+      // If we have a SHA-1 from the metadata, remember it for the new file.
+      // This saves us from recomputing it again in the case that something
+      // opens the file read/write and closes it without changing it.
       auto metadata =
           self->getObjectStore()->getBlobMetadata(state->hash.value());
       if (metadata.isReady()) {
-        self->storeSha1(state, file, metadata.value().sha1);
+        self->storeSha1(state, metadata.value().sha1);
       } else {
         // Leave the SHA-1 attribute dirty - it is not very likely that a file
         // will be opened for writing, closed without changing, and then have
@@ -874,11 +981,10 @@ void FileInode::materializeAndTruncate() {
       state->checkInvariants();
     };
 
-    folly::File file;
     if (state->isMaterialized()) { // Materialized already.
-      file = getFile(*state);
-      state->sha1Valid = false;
-      checkUnixError(ftruncate(file.fd(), Overlay::kHeaderLength));
+      auto file = getFile(*state);
+      state->contentsModified(0);
+      checkUnixError(ftruncate(file->fd(), Overlay::kHeaderLength));
       // The timestamps in the overlay header will get updated when the inode is
       // unloaded.
     } else {
@@ -889,11 +995,12 @@ void FileInode::materializeAndTruncate() {
       auto filePath = getLocalPath();
 
       folly::writeFileAtomic(filePath.stringPiece(), iov.data(), iov.size());
+      getMount()->getOverlay()->invalidateCachedFile(getNodeId());
       // We don't want to set the in-memory timestamps to the timestamps
       // returned by the below openFile function as we just wrote these
       // timestamps in to overlay using writeFileAtomic.
       InodeTimestamps timeStamps;
-      file = Overlay::openFile(
+      auto file = Overlay::openFile(
           filePath.stringPiece(), Overlay::kHeaderIdentifierFile, timeStamps);
 
       // Everything below here in the scope should be noexcept to ensure that
@@ -914,11 +1021,13 @@ void FileInode::materializeAndTruncate() {
       if (state->openCount) {
         state->file = std::move(file);
       }
-      state->sha1Valid = false;
       state->tag = State::MATERIALIZED_IN_OVERLAY;
       didMaterialize = true;
     }
-    storeSha1(state, file, Hash::sha1(ByteRange{}));
+    // The file is now empty.  Start a fresh incremental hash, so that if the
+    // file is then only appended to we never need to reread it.
+    state->sha1Progress = std::make_unique<Sha1Progress>();
+    storeSha1(state, Hash::sha1(ByteRange{}));
 
     return std::make_shared<FileHandle>(
         inodePtrFromThis(), [&state] { fileHandleDidOpen(*state); });
@@ -939,49 +1048,56 @@ ObjectStore* FileInode::getObjectStore() const {
 Hash FileInode::recomputeAndStoreSha1(
     const folly::Synchronized<FileInode::State>::LockedPtr& state,
     const folly::File& file) {
-  uint8_t buf[8192];
-  off_t off = Overlay::kHeaderLength;
-  SHA_CTX ctx;
-  SHA1_Init(&ctx);
+  if (!state->sha1Progress) {
+    state->sha1Progress = std::make_unique<Sha1Progress>();
+  }
+  state->sha1Progress->hashRemainingContents(file.fd());
+  auto sha1 = state->sha1Progress->finish();
+  storeSha1(state, sha1);
+  return sha1;
+}
 
-  while (true) {
-    // Using pread here so that we don't move the file position;
-    // the file descriptor is shared between multiple file handles
-    // and while we serialize the requests to FileData, it seems
-    // like a good property of this function to avoid changing that
-    // state.
-    auto len = folly::preadNoInt(file.fd(), buf, sizeof(buf), off);
-    if (len == 0) {
-      break;
-    }
-    if (len == -1) {
-      folly::throwSystemError();
-    }
-    SHA1_Update(&ctx, buf, len);
-    off += len;
+Future<Hash> FileInode::recomputeSha1InBackground(
+    folly::Synchronized<FileInode::State>::LockedPtr state,
+    std::shared_ptr<folly::File> file) {
+  auto progress = state->sha1Progress
+      ? std::make_unique<Sha1Progress>(*state->sha1Progress)
+      : std::make_unique<Sha1Progress>();
+  auto contentsVersion = state->contentsVersion;
+  // If file is a non-owning reference to state->file we need our own
+  // descriptor, since state->file may be closed once we release the lock.
+  // (A descriptor from the overlay file cache stays open for as long as we
+  // hold a reference to it.)
+  if (state->isFileOpen()) {
+    file = std::make_shared<folly::File>(file->dup());
   }
+  state.unlock();
 
-  uint8_t digest[SHA_DIGEST_LENGTH];
-  SHA1_Final(digest, &ctx);
-  auto sha1 = Hash(folly::ByteRange(digest, sizeof(digest)));
-  storeSha1(state, file, sha1);
-  return sha1;
+  return folly::via(getMount()->getThreadPool().get())
+      .then([self = inodePtrFromThis(),
+             progress = std::move(progress),
+             file = std::move(file),
+             contentsVersion]() mutable {
+        progress->hashRemainingContents(file->fd());
+
+        auto state = self->state_.wlock();
+        if (state->contentsVersion != contentsVersion) {
+          // The file was modified while we were reading it, so we may have
+          // hashed a mix of old and new data.  Catch up with the lock held.
+          return self->recomputeAndStoreSha1(state, *self->getFile(*state));
+        }
+
+        auto sha1 = progress->finish();
+        state->sha1Progress = std::move(progress);
+        storeSha1(state, sha1);
+        return sha1;
+      });
 }
 
 void FileInode::storeSha1(
     const folly::Synchronized<FileInode::State>::LockedPtr& state,
-    const folly::File& file,
     Hash sha1) {
-  try {
-    fsetxattr(file.fd(), kXattrSha1, sha1.toString());
-    state->sha1Valid = true;
-  } catch (const std::exception& ex) {
-    // If something goes wrong storing the attribute just log a warning
-    // and leave sha1Valid as false.  We'll have to recompute the value
-    // next time we need it.
-    XLOG(WARNING) << "error setting SHA1 attribute in the overlay: "
-                  << folly::exceptionStr(ex);
-  }
+  state->sha1 = sha1;
 }
 
 // Gets the in-memory timestamps of the inode.
@@ -1001,18 +1117,8 @@ folly::Future<folly::Unit> FileInode::prefetch() {
 void FileInode::updateOverlayHeader() const {
   auto state = state_.wlock();
   if (state->isMaterialized()) {
-    int fd;
-    folly::File temporaryHandle;
-    if (state->isFileOpen()) {
-      fd = state->file.fd();
-    } else {
-      // We don't have and shouldn't keep a file around, so we return
-      // a temporary file instead.
-      temporaryHandle = folly::File(getLocalPath().c_str(), O_RDWR);
-      fd = temporaryHandle.fd();
-    }
-
-    Overlay::updateTimestampToHeader(fd, state->timeStamps);
+    auto file = getFile(*state);
+    Overlay::updateTimestampToHeader(file->fd(), state->timeStamps);
   }
 }
 } // namespace eden
@@ -107,9 +107,18 @@ class FileInode : public InodeBase {
    * This is more efficient than manually comparing the contents, as it can
    * perform a simple hash check if the file is not materialized.
    */
-  bool isSameAs(const Blob& blob, TreeEntryType entryType);
+  folly::Future<bool> isSameAs(const Blob& blob, TreeEntryType entryType);
   folly::Future<bool> isSameAs(const Hash& blobID, TreeEntryType entryType);
 
+  /**
+   * Check to see if the file matches the given source control entry.
+   *
+   * When the entry carries the blob's size and content SHA-1, a materialized
+   * file whose size differs is reported as different without hashing it, and
+   * the SHA-1 is compared without fetching the blob's metadata.
+   */
+  folly::Future<bool> isSameAs(const TreeEntry& entry);
+
   /**
    * Get the file mode_t value.
    */
@@ -179,6 +188,12 @@ class FileInode : public InodeBase {
    */
   void materializeAndTruncate();
 
+  /**
+   * A running SHA-1 computation over a prefix of a materialized file's
+   * contents.  Defined in FileInode.cpp.
+   */
+  struct Sha1Progress;
+
   /**
    * The contents of a FileInode.
    *
@@ -240,6 +255,12 @@ class FileInode : public InodeBase {
      */
     void closeFile();
 
+    /**
+     * Update the cached SHA-1 state after the materialized contents were
+     * modified at or after the specified offset.
+     */
+    void contentsModified(uint64_t offset);
+
     Tag tag;
 
     mode_t mode;
@@ -261,9 +282,26 @@ class FileInode : public InodeBase {
     std::shared_ptr<const Blob> blob;
 
     /**
-     * If backed by an overlay file, whether the sha1 xattr is valid
+     * If materialized, the SHA-1 of the current file contents, if known.
      */
-    bool sha1Valid{false};
+    folly::Optional<Hash> sha1;
+
+    /**
+     * If materialized, a SHA-1 computation over a prefix of the file contents
+     * that has not been modified since it was hashed.
+     *
+     * Writes after the end of this prefix (such as appends) do not invalidate
+     * it, so getSha1() only needs to hash the newly written data.  This is
+     * null if nothing has been hashed yet.
+     */
+    std::unique_ptr<Sha1Progress> sha1Progress;
+
+    /**
+     * Incremented each time the materialized contents are modified.  This
+     * allows SHA-1 computations done without the lock held to detect that
+     * the file changed underneath them.
+     */
+    uint64_t contentsVersion{0};
 
     /**
      * Set if 'materialized', holds the open file descriptor backed by an
@@ -312,13 +350,13 @@ class FileInode : public InodeBase {
 
   /**
    * Returns a file handle on the materialized file.
-   * The file handle may be a transient handle or may be our own
-   * local file instance, depending on whether we consider the
-   * file to be open or not.  Since the caller can not easily
-   * tell which is the case, the file should only be accessed
-   * while the caller holds the lock on the state.
+   * The file handle may be a reference to our own local file instance, if
+   * we consider the file to be open, or otherwise a descriptor from the
+   * overlay's file cache.  Since the caller can not easily tell which is the
+   * case, the file should only be accessed while the caller holds the lock on
+   * the state.
    */
-  folly::File getFile(FileInode::State& state) const;
+  std::shared_ptr<folly::File> getFile(FileInode::State& state) const;
 
   /**
    * Helper function for isSameAs().
@@ -333,16 +371,29 @@ class FileInode : public InodeBase {
       TreeEntryType entryType);
 
   /**
-   * Recompute the SHA1 content hash of the open file.
+   * Compute the SHA1 content hash of the materialized file while holding the
+   * state lock.
+   *
+   * Only the data not already covered by state->sha1Progress is read.
    */
   Hash recomputeAndStoreSha1(
       const folly::Synchronized<FileInode::State>::LockedPtr& state,
       const folly::File& file);
 
+  /**
+   * Compute the SHA1 content hash of the materialized file on the mount's
+   * thread pool, without holding the state lock while reading the file.
+   *
+   * The result is only cached if the file was not modified in the meantime;
+   * otherwise the hash is recomputed with the lock held.
+   */
+  folly::Future<Hash> recomputeSha1InBackground(
+      folly::Synchronized<FileInode::State>::LockedPtr state,
+      std::shared_ptr<folly::File> file);
+
   ObjectStore* getObjectStore() const;
   static void storeSha1(
       const folly::Synchronized<FileInode::State>::LockedPtr& state,
-      const folly::File& file,
       Hash sha1);
 
   /**
@@ -203,10 +203,10 @@ std::unique_ptr<InodeBase> InodeBase::markUnlinked(
     loc->unlinked = true;
   }
 
-  // Grab the inode map lock, and check if we should unload
-  // ourself immediately.
+  // Grab the inode map lock for our inode number, and check if we should
+  // unload ourself immediately.
   auto* inodeMap = getMount()->getInodeMap();
-  auto inodeMapLock = inodeMap->lockForUnload();
+  auto inodeMapLock = inodeMap->lockForUnload(getNodeId());
   if (isPtrAcquireCountZero() && getFuseRefcount() == 0) {
     inodeMap->unloadInode(this, parent, name, true, inodeMapLock);
     // We have to delete ourself now.
@@ -342,11 +342,8 @@ const Clock& InodeBase::getClock() const {
 
 // Helper function to update Journal used by FileInode and TreeInode.
 void InodeBase::updateJournal() {
-  auto path = getPath();
-  if (path.hasValue()) {
-    getMount()->getJournal().addDelta(
-        std::make_unique<JournalDelta>(JournalDelta{path.value()}));
-  }
+  getMount()->getJournal().recordChangedFile(
+      getNodeId(), [this] { return getPath(); });
 }
 } // namespace eden
 } // namespace facebook
@@ -30,6 +30,8 @@ using std::string;
 namespace facebook {
 namespace eden {
 
+constexpr size_t InodeMap::kNumShards;
+
 InodeMap::InodeMap(EdenMount* mount) : mount_{mount} {}
 
 InodeMap::~InodeMap() {
@@ -56,27 +58,51 @@ void InodeMap::setMaximumExistingInodeNumber(fusell::InodeNumber max) {
 }
 
 void InodeMap::initialize(TreeInodePtr root) {
-  auto data = data_.wlock();
+  auto data = getShard(kRootNodeId).wlock();
   CHECK(!root_);
   root_ = std::move(root);
   auto ret = data->loadedInodes_.emplace(kRootNodeId, root_.get());
   CHECK(ret.second);
 }
 
+InodeMap::ShardLocks InodeMap::lockAllShards() {
+  ShardLocks locks;
+  locks.reserve(kNumShards);
+  for (auto& shard : shards_) {
+    locks.push_back(shard.wlock());
+  }
+  return locks;
+}
+
 Future<InodePtr> InodeMap::lookupInode(fusell::InodeNumber number) {
+  auto& shard = getShard(number);
+
+  // Check to see if this Inode is already loaded.  This code path should be
+  // quite common, so only acquire the shard lock in shared mode for it.
+  {
+    auto data = shard.rlock();
+    auto loadedIter = data->loadedInodes_.find(number);
+    if (loadedIter != data->loadedInodes_.end()) {
+      // Make a copy of the InodePtr with the lock held, then release the lock
+      // before calling makeFuture().
+      //
+      // It's better to perform makeFuture()'s memory allocation without the
+      // lock held.
+      auto result = loadedIter->second.getPtr();
+      data.unlock();
+      return folly::makeFuture<InodePtr>(std::move(result));
+    }
+  }
+
   // Lock the data.
   // We hold it while doing most of our work below, but explicitly unlock it
   // before triggering inode loading or before fulfilling any Promises.
-  auto data = data_.wlock();
+  auto data = shard.wlock();
 
-  // Check to see if this Inode is already loaded
+  // Check again, since the inode may have finished loading after we released
+  // the shared lock.
   auto loadedIter = data->loadedInodes_.find(number);
   if (loadedIter != data->loadedInodes_.end()) {
-    // Make a copy of the InodePtr with the lock held, then release the lock
-    // before calling makeFuture().
-    //
-    // This code path should be quite common, so it's better to perform
-    // makeFuture()'s memory allocation without the lock held.
     auto result = loadedIter->second.getPtr();
     data.unlock();
     return folly::makeFuture<InodePtr>(std::move(result));
@@ -115,28 +141,32 @@ Future<InodePtr> InodeMap::lookupInode(fusell::InodeNumber number) {
   // For parents we don't find, add a promise that will trigger the lookup on
   // its necessary child.
   //
-  // (It might have been simpler to recursively call lookupInode() to get the
-  // parent, but that would require releasing and re-acquiring the lock more
-  // than necessary.)
+  // The parent is usually in a different shard than its child, and we never
+  // hold two shard locks at once, so grab copies of the child data we need
+  // before releasing the child's shard lock and locking the parent's.  Our
+  // promise on the child keeps anyone else from starting to load it in the
+  // meantime.
   auto childInodeNumber = number;
+  auto parentNumber = unloadedData->parent;
+  PathComponent childName = unloadedData->name;
+  bool isUnlinked = unloadedData->isUnlinked;
+  auto optionalHash = unloadedData->hash;
+  auto mode = unloadedData->mode;
+  data.unlock();
   while (true) {
+    auto parentData = getShard(parentNumber).wlock();
+
     // Check to see if this parent is loaded
-    loadedIter = data->loadedInodes_.find(unloadedData->parent);
-    if (loadedIter != data->loadedInodes_.end()) {
+    loadedIter = parentData->loadedInodes_.find(parentNumber);
+    if (loadedIter != parentData->loadedInodes_.end()) {
       // We found a loaded parent.
-      // Grab copies of the arguments we need for startChildLookup(),
-      // with the lock still held.
       InodePtr firstLoadedParent = loadedIter->second.getPtr();
-      PathComponent requiredChildName = unloadedData->name;
-      bool isUnlinked = unloadedData->isUnlinked;
-      auto optionalHash = unloadedData->hash;
-      auto mode = unloadedData->mode;
       // Unlock the data before starting the child lookup
-      data.unlock();
+      parentData.unlock();
       // Trigger the lookup, then return to our caller.
       startChildLookup(
           firstLoadedParent,
-          requiredChildName,
+          childName,
           isUnlinked,
           childInodeNumber,
           optionalHash,
@@ -145,32 +175,32 @@ Future<InodePtr> InodeMap::lookupInode(fusell::InodeNumber number) {
     }
 
     // Look up the parent in unloadedInodes_
-    unloadedIter = data->unloadedInodes_.find(unloadedData->parent);
-    if (UNLIKELY(unloadedIter == data->unloadedInodes_.end())) {
+    unloadedIter = parentData->unloadedInodes_.find(parentNumber);
+    if (UNLIKELY(unloadedIter == parentData->unloadedInodes_.end())) {
       // This shouldn't happen.  We must know about the parent inode number if
       // we knew about the child.
-      auto bug = EDEN_BUG() << "unknown parent inode " << unloadedData->parent
-                            << " (of " << unloadedData->name << ")";
+      auto bug = EDEN_BUG() << "unknown parent inode " << parentNumber
+                            << " (of " << childName << ")";
       // Unlock our data before calling inodeLoadFailed()
-      data.unlock();
+      parentData.unlock();
       inodeLoadFailed(childInodeNumber, bug.toException());
       return result;
     }
 
-    auto* parentData = &unloadedIter->second;
-    alreadyLoading = !parentData->promises.empty();
+    auto* parentEntry = &unloadedIter->second;
+    alreadyLoading = !parentEntry->promises.empty();
 
     // Add a new entry to the promises list.
     // It should kick off loading of the current child inode when
     // it is fulfilled.
-    parentData->promises.emplace_back();
+    parentEntry->promises.emplace_back();
     setupParentLookupPromise(
-        parentData->promises.back(),
-        unloadedData->name,
-        unloadedData->isUnlinked,
+        parentEntry->promises.back(),
+        childName,
+        isUnlinked,
         childInodeNumber,
-        unloadedData->hash,
-        unloadedData->mode);
+        optionalHash,
+        mode);
 
     if (alreadyLoading) {
       // This parent is already being loaded.
@@ -179,8 +209,12 @@ Future<InodePtr> InodeMap::lookupInode(fusell::InodeNumber number) {
     }
 
     // Continue around the loop to look up our parent's parent
-    childInodeNumber = unloadedData->parent;
-    unloadedData = parentData;
+    childInodeNumber = parentNumber;
+    parentNumber = parentEntry->parent;
+    childName = parentEntry->name;
+    isUnlinked = parentEntry->isUnlinked;
+    optionalHash = parentEntry->hash;
+    mode = parentEntry->mode;
   }
 }
 
@@ -246,7 +280,7 @@ InodeMap::PromiseVector InodeMap::inodeLoadComplete(InodeBase* inode) {
 
   PromiseVector promises;
   try {
-    auto data = data_.wlock();
+    auto data = getShard(number).wlock();
     auto it = data->unloadedInodes_.find(number);
     CHECK(it != data->unloadedInodes_.end())
         << "failed to find unloaded inode data when finishing load of inode "
@@ -285,7 +319,7 @@ InodeMap::PromiseVector InodeMap::extractPendingPromises(
     fusell::InodeNumber number) {
   PromiseVector promises;
   {
-    auto data = data_.wlock();
+    auto data = getShard(number).wlock();
     auto it = data->unloadedInodes_.find(number);
     CHECK(it != data->unloadedInodes_.end())
         << "failed to find unloaded inode data when finishing load of inode "
@@ -306,7 +340,7 @@ Future<FileInodePtr> InodeMap::lookupFileInode(fusell::InodeNumber number) {
 }
 
 InodePtr InodeMap::lookupLoadedInode(fusell::InodeNumber number) {
-  auto data = data_.rlock();
+  auto data = getShard(number).rlock();
   auto it = data->loadedInodes_.find(number);
   if (it == data->loadedInodes_.end()) {
     return nullptr;
@@ -331,7 +365,7 @@ FileInodePtr InodeMap::lookupLoadedFile(fusell::InodeNumber number) {
 }
 
 UnloadedInodeData InodeMap::lookupUnloadedInode(fusell::InodeNumber number) {
-  auto data = data_.rlock();
+  auto data = getShard(number).rlock();
   auto it = data->unloadedInodes_.find(number);
   if (it == data->unloadedInodes_.end()) {
     // This generally shouldn't happen.  If a fusell::InodeNumber has been
@@ -346,13 +380,7 @@ UnloadedInodeData InodeMap::lookupUnloadedInode(fusell::InodeNumber number) {
 
 folly::Optional<RelativePath> InodeMap::getPathForInode(
     fusell::InodeNumber inodeNumber) {
-  auto data = data_.rlock();
-  return getPathForInodeHelper(inodeNumber, data);
-}
-
-folly::Optional<RelativePath> InodeMap::getPathForInodeHelper(
-    fusell::InodeNumber inodeNumber,
-    const folly::Synchronized<Members>::ConstLockedPtr& data) {
+  auto data = getShard(inodeNumber).rlock();
   auto loadedIt = data->loadedInodes_.find(inodeNumber);
   if (loadedIt != data->loadedInodes_.cend()) {
     // If the inode is loaded, return its RelativePath
@@ -370,12 +398,16 @@ folly::Optional<RelativePath> InodeMap::getPathForInodeHelper(
         // The parent is the Eden mount root, just return its name (base case)
         return RelativePath(unloadedIt->second.name);
       }
-      auto dir = getPathForInodeHelper(parent, data);
+      // The parent is most likely in a different shard, so release our lock
+      // before looking it up.
+      PathComponent name = unloadedIt->second.name;
+      data.unlock();
+      auto dir = getPathForInode(parent);
       if (!dir) {
         EDEN_BUG() << "unlinked parent inode " << parent
                    << "appears to contain non-unlinked child " << inodeNumber;
       }
-      return *dir + unloadedIt->second.name;
+      return *dir + name;
     } else {
       throwSystemErrorExplicit(EINVAL, "unknown inode number ", inodeNumber);
     }
@@ -383,7 +415,7 @@ folly::Optional<RelativePath> InodeMap::getPathForInodeHelper(
 }
 
 void InodeMap::decFuseRefcount(fusell::InodeNumber number, uint32_t count) {
-  auto data = data_.wlock();
+  auto data = getShard(number).wlock();
 
   // First check in the loaded inode map
   auto loadedIter = data->loadedInodes_.find(number);
@@ -422,9 +454,15 @@ void InodeMap::decFuseRefcount(fusell::InodeNumber number, uint32_t count) {
 }
 
 SerializedInodeMap InodeMap::save() {
-  auto data = data_.wlock();
-  if (data->loadedInodes_.size() != 1) {
-    EDEN_BUG() << "InodeMap::save() called with " << data->loadedInodes_.size()
+  auto shards = lockAllShards();
+  size_t numLoaded = 0;
+  size_t numUnloaded = 0;
+  for (const auto& data : shards) {
+    numLoaded += data->loadedInodes_.size();
+    numUnloaded += data->unloadedInodes_.size();
+  }
+  if (numLoaded != 1) {
+    EDEN_BUG() << "InodeMap::save() called with " << numLoaded
                << " inodes still loaded; they must all (except the root) "
                << "have been unloaded for this to succeed!";
   }
@@ -432,31 +470,35 @@ SerializedInodeMap InodeMap::save() {
   SerializedInodeMap result;
   // Therefore, at this point, nobody is calling allocateInodeNumber().
   result.nextInodeNumber = nextInodeNumber_.load();
-  result.unloadedInodes.reserve(data->unloadedInodes_.size());
-  for (const auto& it : data->unloadedInodes_) {
-    const auto& entry = it.second;
-    SerializedInodeMapEntry serializedEntry;
-
-    serializedEntry.inodeNumber = entry.number.get();
-    serializedEntry.parentInode = entry.parent.get();
-    serializedEntry.name = entry.name.stringPiece().str();
-    serializedEntry.isUnlinked = entry.isUnlinked;
-    serializedEntry.numFuseReferences = entry.numFuseReferences;
-    serializedEntry.hash = thriftHash(entry.hash);
-    serializedEntry.mode = entry.mode;
-
-    result.unloadedInodes.emplace_back(std::move(serializedEntry));
+  result.unloadedInodes.reserve(numUnloaded);
+  for (const auto& data : shards) {
+    for (const auto& it : data->unloadedInodes_) {
+      const auto& entry = it.second;
+      SerializedInodeMapEntry serializedEntry;
+
+      serializedEntry.inodeNumber = entry.number.get();
+      serializedEntry.parentInode = entry.parent.get();
+      serializedEntry.name = entry.name.stringPiece().str();
+      serializedEntry.isUnlinked = entry.isUnlinked;
+      serializedEntry.numFuseReferences = entry.numFuseReferences;
+      serializedEntry.hash = thriftHash(entry.hash);
+      serializedEntry.mode = entry.mode;
+
+      result.unloadedInodes.emplace_back(std::move(serializedEntry));
+    }
   }
 
   return result;
 }
 
 void InodeMap::load(const SerializedInodeMap& takeover) {
-  auto data = data_.wlock();
-  CHECK_EQ(data->loadedInodes_.size(), 0)
-      << "cannot load InodeMap data over a populated instance";
-  CHECK_EQ(data->unloadedInodes_.size(), 0)
-      << "cannot load InodeMap data over a populated instance";
+  auto shards = lockAllShards();
+  for (const auto& data : shards) {
+    CHECK_EQ(data->loadedInodes_.size(), 0)
+        << "cannot load InodeMap data over a populated instance";
+    CHECK_EQ(data->unloadedInodes_.size(), 0)
+        << "cannot load InodeMap data over a populated instance";
+  }
   CHECK_EQ(nextInodeNumber_.load(), 0)
       << "cannot load InodeMap data over a populated instance";
   nextInodeNumber_.store(takeover.nextInodeNumber);
@@ -480,9 +522,9 @@ void InodeMap::load(const SerializedInodeMap& takeover) {
     }
     unloadedEntry.mode = entry.mode;
 
-    auto result = data->unloadedInodes_.emplace(
-        fusell::InodeNumber::fromThrift(entry.inodeNumber),
-        std::move(unloadedEntry));
+    auto number = fusell::InodeNumber::fromThrift(entry.inodeNumber);
+    auto result = shards[getShardIndex(number)]->unloadedInodes_.emplace(
+        number, std::move(unloadedEntry));
     if (!result.second) {
       auto message = folly::to<std::string>(
           "failed to emplace inode number ",
@@ -496,14 +538,17 @@ void InodeMap::load(const SerializedInodeMap& takeover) {
 
 Future<Unit> InodeMap::shutdown() {
   // Record that we are in the process of shutting down.
+  //
+  // shutdownPromise_ may be read while holding any single shard lock, so it
+  // can only be changed while holding all of them.
   auto future = Future<Unit>::makeEmpty();
   {
-    auto data = data_.wlock();
-    CHECK(!data->shutdownPromise.hasValue())
+    auto shards = lockAllShards();
+    CHECK(!shutdownPromise_.hasValue())
         << "shutdown() invoked more than once on InodeMap for "
         << mount_->getPath();
-    data->shutdownPromise.assign(Promise<Unit>{});
-    future = data->shutdownPromise->getFuture();
+    shutdownPromise_.assign(Promise<Unit>{});
+    future = shutdownPromise_->getFuture();
   }
 
   // Walk from the root of the tree down, finding all unreferenced inodes,
@@ -528,12 +573,13 @@ Future<Unit> InodeMap::shutdown() {
   // can't find unlinked inodes that way.  For unlinked inodes we don't need to
   // hold the parent's contents lock, so scanning loadedInodes_ for them is
   // straightforward.
-  {
-    // The simplest way to unload the inodes is to simply acquire InodePtrs
-    // to them, then let the normal pointer release process be responsible for
-    // unloading them.
+  //
+  // The simplest way to unload the inodes is to simply acquire InodePtrs
+  // to them, then let the normal pointer release process be responsible for
+  // unloading them.
+  for (auto& shard : shards_) {
     std::vector<InodePtr> inodesToUnload;
-    auto data = data_.wlock();
+    auto data = shard.wlock();
     for (const auto& entry : data->loadedInodes_) {
       if (!entry.second->isPtrAcquireCountZero()) {
         continue;
@@ -558,8 +604,7 @@ Future<Unit> InodeMap::shutdown() {
   return future;
 }
 
-void InodeMap::shutdownComplete(
-    folly::Synchronized<Members>::LockedPtr&& data) {
+void InodeMap::shutdownComplete(Shard::LockedPtr&& data) {
   // We manually dropped our reference count to the root inode in
   // beginShutdown().  Destroy it now, and call resetNoDecRef() on our pointer
   // to make sure it doesn't try to decrement the reference count again when
@@ -567,10 +612,10 @@ void InodeMap::shutdownComplete(
   delete root_.get();
   root_.resetNoDecRef();
 
-  // Unlock data_ before fulfilling the shutdown promise, just in case the
+  // Unlock the shard before fulfilling the shutdown promise, just in case the
   // promise invokes a callback that calls some of our other methods that
   // may need to acquire this lock.
-  auto* shutdownPromise = &data->shutdownPromise.value();
+  auto* shutdownPromise = &shutdownPromise_.value();
   data.unlock();
   shutdownPromise->setValue();
 }
@@ -580,8 +625,8 @@ void InodeMap::onInodeUnreferenced(
     ParentInodeInfo&& parentInfo) {
   XLOG(DBG5) << "inode " << inode->getNodeId()
              << " unreferenced: " << inode->getLogPath();
-  // Acquire our lock.
-  auto data = data_.wlock();
+  // Acquire the lock on this inode's shard.
+  auto data = getShard(inode->getNodeId()).wlock();
 
   // Decrement the Inode's acquire count
   auto acquireCount = inode->decPtrAcquireCount();
@@ -593,7 +638,7 @@ void InodeMap::onInodeUnreferenced(
 
   // Decide if we should unload the inode now, or wait until later.
   bool unloadNow = false;
-  bool shuttingDown = data->shutdownPromise.hasValue();
+  bool shuttingDown = shutdownPromise_.hasValue();
   DCHECK(shuttingDown || inode != root_.get());
   if (shuttingDown) {
     // Check to see if this was the root inode that got unloaded.
@@ -645,7 +690,13 @@ void InodeMap::onInodeUnreferenced(
 }
 
 InodeMapLock InodeMap::lockForUnload() {
-  return InodeMapLock{data_.wlock()};
+  return InodeMapLock{lockAllShards()};
+}
+
+InodeMapLock InodeMap::lockForUnload(fusell::InodeNumber number) {
+  ShardLocks locks(kNumShards);
+  locks[getShardIndex(number)] = getShard(number).wlock();
+  return InodeMapLock{std::move(locks)};
 }
 
 void InodeMap::unloadInode(
@@ -654,7 +705,10 @@ void InodeMap::unloadInode(
     PathComponentPiece name,
     bool isUnlinked,
     const InodeMapLock& lock) {
-  return unloadInode(inode, parent, name, isUnlinked, lock.data_);
+  const auto& data = lock.shards_[getShardIndex(inode->getNodeId())];
+  CHECK(!data.isNull()) << "InodeMapLock does not cover the shard for inode "
+                        << inode->getNodeId();
+  return unloadInode(inode, parent, name, isUnlinked, data);
 }
 
 void InodeMap::unloadInode(
@@ -662,7 +716,7 @@ void InodeMap::unloadInode(
     TreeInode* parent,
     PathComponentPiece name,
     bool isUnlinked,
-    const folly::Synchronized<Members>::LockedPtr& data) {
+    const Shard::LockedPtr& data) {
   // Update timestamps to overlay header on unloadInode
   inode->updateOverlayHeader();
 
@@ -720,7 +774,7 @@ bool InodeMap::shouldLoadChild(
     PathComponentPiece name,
     fusell::InodeNumber childInode,
     folly::Promise<InodePtr> promise) {
-  auto data = data_.wlock();
+  auto data = getShard(childInode).wlock();
   // This is a sanity check - no big deal if we race with allocateInodeNumber.
   CHECK_LT(childInode.get(), nextInodeNumber_.load());
   auto iter = data->unloadedInodes_.find(childInode);
@@ -771,21 +825,39 @@ fusell::InodeNumber InodeMap::allocateInodeNumber() {
 void InodeMap::inodeCreated(const InodePtr& inode) {
   XLOG(DBG4) << "created new inode " << inode->getNodeId() << ": "
              << inode->getLogPath();
-  auto data = data_.wlock();
+  auto data = getShard(inode->getNodeId()).wlock();
   data->loadedInodes_.emplace(inode->getNodeId(), inode.get());
 }
 
 InodeMap::LoadedInodeCounts InodeMap::getLoadedInodeCounts() const {
   LoadedInodeCounts counts;
-  auto data = data_.rlock();
-  for (const auto& entry : data->loadedInodes_) {
-    if (entry.second->getType() == dtype_t::Dir) {
-      ++counts.treeCount;
-    } else {
-      ++counts.fileCount;
+  for (const auto& shard : shards_) {
+    auto data = shard.rlock();
+    for (const auto& entry : data->loadedInodes_) {
+      if (entry.second->getType() == dtype_t::Dir) {
+        ++counts.treeCount;
+      } else {
+        ++counts.fileCount;
+      }
     }
   }
   return counts;
 }
+
+size_t InodeMap::getLoadedInodeCount() const {
+  size_t count = 0;
+  for (const auto& shard : shards_) {
+    count += shard.rlock()->loadedInodes_.size();
+  }
+  return count;
+}
+
+size_t InodeMap::getUnloadedInodeCount() const {
+  size_t count = 0;
+  for (const auto& shard : shards_) {
+    count += shard.rlock()->unloadedInodes_.size();
+  }
+  return count;
+}
 } // namespace eden
 } // namespace facebook
@@ -11,9 +11,11 @@
 
 #include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
+#include <array>
 #include <list>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/inodes/InodePtr.h"
@@ -100,6 +102,17 @@ class InodeMapLock;
  *
  *   We currently always allocate a fusell::InodeNumber value for any new Inode
  * object even if it is not needed yet by the FUSE APIs.
+ *
+ * Locking:
+ * - Both maps are split into kNumShards shards by inode number, each with its
+ *   own lock.  The loaded and unloaded entries for an inode number always
+ *   live in the same shard, so loading, unloading, or looking up a single
+ *   inode only locks that one shard, and FUSE requests for different inodes
+ *   rarely contend with each other.  Looking up an already loaded inode only
+ *   needs the shard lock in shared mode.
+ * - A shard lock is never held while acquiring another shard's lock, except
+ *   by operations that lock every shard (lockForUnload(), shutdown(), save()
+ *   and load()), which always acquire them in index order.
  */
 class InodeMap {
  public:
@@ -286,10 +299,21 @@ class InodeMap {
    * unloading.  It should only be called *after* acquring the TreeInode
    * contents lock.
    *
+   * This locks every shard of the InodeMap, so that any of the TreeInode's
+   * children can be unloaded.
+   *
    * This is an internal API that should not be used by most callers.
    */
   InodeMapLock lockForUnload();
 
+  /**
+   * Acquire only the part of the InodeMap lock needed to unload the specified
+   * inode.
+   *
+   * This is an internal API that should not be used by most callers.
+   */
+  InodeMapLock lockForUnload(fusell::InodeNumber number);
+
   /**
    * unloadedInode() should be called to unload an unreferenced inode.
    *
@@ -391,6 +415,16 @@ class InodeMap {
    */
   fusell::InodeNumber allocateInodeNumber();
 
+  /**
+   * Get the next inode number that allocateInodeNumber() will return.
+   *
+   * This is primarily intended for recording the inode number state during
+   * shutdown, once no more inode numbers can be allocated.
+   */
+  fusell::InodeNumber getNextInodeNumber() const {
+    return fusell::InodeNumber{nextInodeNumber_.load()};
+  }
+
   void inodeCreated(const InodePtr& inode);
 
   struct LoadedInodeCounts {
@@ -404,12 +438,13 @@ class InodeMap {
    */
   LoadedInodeCounts getLoadedInodeCounts() const;
 
-  size_t getLoadedInodeCount() const {
-    return data_.rlock()->loadedInodes_.size();
-  }
-  size_t getUnloadedInodeCount() const {
-    return data_.rlock()->unloadedInodes_.size();
-  }
+  size_t getLoadedInodeCount() const;
+  size_t getUnloadedInodeCount() const;
+
+  /**
+   * The number of shards that the inode maps are split into.
+   */
+  static constexpr size_t kNumShards = 32;
 
  private:
   friend class InodeMapLock;
@@ -461,7 +496,7 @@ class InodeMap {
      *
      * (We could use folly::SharedPromise here instead, but it has extra
      * overhead that we don't really need.  It performs its own locking, but we
-     * are already protected by the data_ lock.)
+     * are already protected by the shard lock.)
      */
     PromiseVector promises;
     /**
@@ -486,7 +521,7 @@ class InodeMap {
 
     InodePtr getPtr() const {
       // Calling InodePtr::newPtrLocked is safe because interacting with
-      // LoadedInode implies the data_ lock is held.
+      // LoadedInode implies its shard lock is held.
       return InodePtr::newPtrLocked(inode_);
     }
 
@@ -505,6 +540,9 @@ class InodeMap {
     InodeBase* inode_{nullptr};
   };
 
+  /**
+   * The contents of a single shard.
+   */
   struct Members {
     /**
      * The map of loaded inodes
@@ -520,25 +558,31 @@ class InodeMap {
      * The map of currently unloaded inodes
      */
     std::unordered_map<fusell::InodeNumber, UnloadedInode> unloadedInodes_;
-
-    /**
-     * A promise to fulfill once shutdown() completes.
-     *
-     * This is only initialized when shutdown() is called, and will be
-     * folly::none until we are shutting down.
-     *
-     * In the future we could update this to just use an empty promise to
-     * indicate that we are not shutting down yet.  However, currently
-     * folly::Promise does not have a simple API to check if it is empty or not,
-     * so we have to wrap it in a folly::Optional.
-     */
-    folly::Optional<folly::Promise<folly::Unit>> shutdownPromise;
   };
+  using Shard = folly::Synchronized<Members>;
+
+  /**
+   * Locks on the shards, indexed by shard number.  Shards that are not locked
+   * have a null LockedPtr.
+   */
+  using ShardLocks = std::vector<Shard::LockedPtr>;
 
   InodeMap(InodeMap const&) = delete;
   InodeMap& operator=(InodeMap const&) = delete;
 
-  void shutdownComplete(folly::Synchronized<Members>::LockedPtr&& data);
+  static size_t getShardIndex(fusell::InodeNumber number) {
+    return number.get() % kNumShards;
+  }
+  Shard& getShard(fusell::InodeNumber number) {
+    return shards_[getShardIndex(number)];
+  }
+
+  /**
+   * Acquire the lock on every shard, in index order.
+   */
+  ShardLocks lockAllShards();
+
+  void shutdownComplete(Shard::LockedPtr&& data);
 
   void setupParentLookupPromise(
       folly::Promise<InodePtr>& promise,
@@ -559,30 +603,26 @@ class InodeMap {
    * Extract the list of promises waiting on the specified inode number to be
    * loaded.
    *
-   * This method acquires the data_ lock internally.
-   * It should never be called while already holding the lock.
+   * This method acquires the shard lock internally.
+   * It should never be called while already holding a shard lock.
    */
   PromiseVector extractPendingPromises(fusell::InodeNumber number);
 
-  folly::Optional<RelativePath> getPathForInodeHelper(
-      fusell::InodeNumber inodeNumber,
-      const folly::Synchronized<Members>::ConstLockedPtr& data);
-
   /**
    * Unload an inode
    *
    * This simply removes it from the loadedInodes_ map and, if it is still
    * referenced by FUSE, adds it to the unloadedInodes_ map.
    *
-   * The caller is responsible for actually deleting the Inode object after
-   * releasing the InodeMap lock.
+   * The caller must hold the lock on the inode's shard, and is responsible
+   * for actually deleting the Inode object after releasing the InodeMap lock.
    */
   void unloadInode(
       const InodeBase* inode,
       TreeInode* parent,
       PathComponentPiece name,
       bool isUnlinked,
-      const folly::Synchronized<Members>::LockedPtr& lock);
+      const Shard::LockedPtr& data);
 
   /**
    * The EdenMount that owns this InodeMap.
@@ -598,16 +638,31 @@ class InodeMap {
   TreeInodePtr root_;
 
   /**
-   * The locked data.
+   * The locked data, split into shards by inode number.
+   *
+   * Note: be very careful to hold these locks only when necessary.  No other
+   * locks should be acquired when holding a shard lock.  In particular this
+   * means that we should never access any InodeBase objects while holding the
+   * lock, since we should not hold our lock while an InodeBase acquires its
+   * own internal lock.  (This makes it safe for InodeBase to perform
+   * operations on the InodeMap while holding their own lock.)
+   */
+  std::array<Shard, kNumShards> shards_;
+
+  /**
+   * A promise to fulfill once shutdown() completes.
    *
-   * Note: be very careful to hold this lock only when necessary.  No other
-   * locks should be acquired when holding this lock.  In particular this means
-   * that we should never access any InodeBase objects while holding the lock,
-   * since we should not hold our lock while an InodeBase acquires its own
-   * internal lock.  (This makes it safe for InodeBase to perform operations on
-   * the InodeMap while holding their own lock.)
+   * This is only initialized when shutdown() is called, and will be
+   * folly::none until we are shutting down.  It is only modified while
+   * holding every shard lock, so holding any one shard lock is enough to read
+   * it.
+   *
+   * In the future we could update this to just use an empty promise to
+   * indicate that we are not shutting down yet.  However, currently
+   * folly::Promise does not have a simple API to check if it is empty or not,
+   * so we have to wrap it in a folly::Optional.
    */
-  folly::Synchronized<Members> data_;
+  folly::Optional<folly::Promise<folly::Unit>> shutdownPromise_;
 
   /**
    * The next inode number to allocate.  Zero indicates that
@@ -625,17 +680,20 @@ class InodeMap {
  */
 class InodeMapLock {
  public:
-  explicit InodeMapLock(
-      folly::Synchronized<InodeMap::Members>::LockedPtr&& data)
-      : data_(std::move(data)) {}
+  explicit InodeMapLock(InodeMap::ShardLocks&& shards)
+      : shards_(std::move(shards)) {}
 
   void unlock() {
-    data_.unlock();
+    for (auto& shard : shards_) {
+      if (!shard.isNull()) {
+        shard.unlock();
+      }
+    }
   }
 
  private:
   friend class InodeMap;
-  folly::Synchronized<InodeMap::Members>::LockedPtr data_;
+  InodeMap::ShardLocks shards_;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <sysexits.h>
+
+#include <folly/experimental/logging/Init.h>
+#include <folly/experimental/logging/xlog.h>
+#include <folly/init/Init.h>
+#include "eden/fs/inodes/Overlay.h"
+
+DEFINE_string(
+    overlay,
+    "",
+    "The path to the overlay directory to migrate (CLIENT_DIR/local)");
+DEFINE_string(logging, ".=WARNING,eden=DBG2", "Logging configuration");
+
+/*
+ * This is a small tool for converting an existing file-per-inode overlay to
+ * store its directories in a single sqlite database.
+ *
+ * The mount using this overlay must not be running: the overlay lock is held
+ * for the duration of the migration, so this will fail if the overlay is
+ * currently in use.  After migrating, set "dir-storage = \"sqlite\"" in the
+ * [overlay] section of the client's config.toml so that the setting is
+ * reflected in the client configuration as well.
+ */
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::initLogging(FLAGS_logging);
+
+  if (FLAGS_overlay.empty()) {
+    fprintf(stderr, "error: the --overlay argument is required\n");
+    return EX_USAGE;
+  }
+
+  auto overlayPath = facebook::eden::canonicalPath(FLAGS_overlay);
+  facebook::eden::Overlay overlay{overlayPath};
+  if (overlay.getDirStorage() == facebook::eden::OverlayDirStorage::Sqlite) {
+    XLOG(INFO) << "overlay " << overlayPath
+               << " already uses sqlite directory storage";
+    return EX_OK;
+  }
+
+  auto count = overlay.migrateDirsToSqlite();
+
+  // Opening the overlay consumed the next inode number recorded at the last
+  // clean shutdown.  Put it back so the next mount can still skip its scan.
+  if (overlay.hadCleanShutdown()) {
+    auto maxInode = overlay.getMaxRecordedInode();
+    overlay.saveNextInodeNumber(
+        facebook::eden::fusell::InodeNumber{maxInode.get() + 1});
+  }
+
+  XLOG(INFO) << "migrated " << count << " directories in " << overlayPath;
+  return EX_OK;
+}
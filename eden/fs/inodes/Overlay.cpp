@@ -12,13 +12,22 @@
 #include <folly/Exception.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
+#include <folly/experimental/logging/xlog.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
+#include <gflags/gflags.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 #include "eden/fs/inodes/InodeMap.h"
+#include "eden/fs/inodes/SqliteOverlayDirStore.h"
 #include "eden/fs/inodes/gen-cpp2/overlay_types.h"
 #include "eden/fs/utils/PathFuncs.h"
 
+DEFINE_uint64(
+    overlay_file_cache_size,
+    1000,
+    "The maximum number of overlay files to keep open for materialized "
+    "files that do not have an open file handle");
+
 namespace facebook {
 namespace eden {
 
@@ -57,6 +66,30 @@ constexpr uint32_t kOverlayVersion = 1;
 constexpr size_t kInfoHeaderSize =
     kInfoHeaderMagic.size() + sizeof(kOverlayVersion);
 
+/**
+ * On graceful shutdown we append the next inode number to the info file,
+ * immediately after the header.  It is removed again as soon as the overlay is
+ * opened, so its presence indicates that the previous user of this overlay
+ * shut down cleanly.
+ */
+constexpr size_t kInfoFileSizeWithNextInode =
+    kInfoHeaderSize + sizeof(uint64_t);
+
+/**
+ * Relative to the localDir, the sqlite database holding directory data for
+ * overlays using OverlayDirStorage::Sqlite.  The existence of this file is
+ * what identifies an overlay as using sqlite directory storage.
+ */
+constexpr StringPiece kDirDatabase{"dirs.db"};
+/** The temporary database path used while migrating an existing overlay. */
+constexpr StringPiece kDirDatabaseTmp{"dirs.db.tmp"};
+
+/**
+ * Relative to the localDir, a marker file that exists while a checkout
+ * operation has directory writes outstanding.  See Overlay::beginCheckout().
+ */
+constexpr StringPiece kCheckoutMarker{"checkout-in-progress"};
+
 /* Relative to the localDir, the overlay tree is where we create the
  * materialized directory structure; directories and files are created
  * here. */
@@ -84,11 +117,16 @@ constexpr folly::StringPiece Overlay::kHeaderIdentifierFile;
 constexpr uint32_t Overlay::kHeaderVersion;
 constexpr size_t Overlay::kHeaderLength;
 
-Overlay::Overlay(AbsolutePathPiece localDir) : localDir_(localDir) {
-  initOverlay();
+Overlay::Overlay(AbsolutePathPiece localDir, OverlayDirStorage dirStorage)
+    : localDir_(localDir),
+      fileCache_(
+          std::make_unique<OverlayFileCache>(FLAGS_overlay_file_cache_size)) {
+  initOverlay(dirStorage);
 }
 
-void Overlay::initOverlay() {
+Overlay::~Overlay() {}
+
+void Overlay::initOverlay(OverlayDirStorage dirStorage) {
   // Read the overlay version file.  If it does not exist, create it.
   //
   // First check for an old-format overlay directory, before we wrote out
@@ -104,7 +142,8 @@ void Overlay::initOverlay() {
 
   // Read the info file.
   auto infoPath = localDir_ + PathComponentPiece{kInfoFile};
-  int fd = folly::openNoInt(infoPath.value().c_str(), O_RDONLY);
+  bool isNewOverlay = false;
+  int fd = folly::openNoInt(infoPath.value().c_str(), O_RDWR);
   if (fd >= 0) {
     // This is an existing overlay directory.
     // Read the info file and make sure we are compatible with its version.
@@ -116,12 +155,248 @@ void Overlay::initOverlay() {
   } else {
     // This is a brand new overlay directory.
     initNewOverlay();
-    infoFile_ = File{infoPath.value().c_str(), O_RDONLY};
+    infoFile_ = File{infoPath.value().c_str(), O_RDWR};
+    isNewOverlay = true;
   }
 
   if (!infoFile_.try_lock()) {
     folly::throwSystemError("failed to acquire overlay lock on ", infoPath);
   }
+
+  // Now that we hold the lock, check to see if the previous process recorded
+  // its next inode number on shutdown.
+  tryLoadNextInodeNumber();
+  checkCheckoutMarker();
+
+  initDirStorage(dirStorage, isNewOverlay);
+}
+
+void Overlay::initDirStorage(OverlayDirStorage dirStorage, bool isNewOverlay) {
+  auto dbPath = getDirDatabasePath();
+  struct stat st;
+  if (lstat(dbPath.value().c_str(), &st) == 0) {
+    dirStore_ = std::make_unique<SqliteOverlayDirStore>(dbPath);
+    return;
+  } else if (errno != ENOENT) {
+    folly::throwSystemError("error checking for overlay database ", dbPath);
+  }
+
+  if (dirStorage != OverlayDirStorage::Sqlite) {
+    return;
+  }
+  if (isNewOverlay) {
+    dirStore_ = std::make_unique<SqliteOverlayDirStore>(dbPath);
+  } else {
+    // We cannot simply switch formats here, since the existing directory
+    // data lives in per-inode files.
+    XLOG(WARNING) << "overlay at " << localDir_
+                  << " uses file-per-inode directory storage; "
+                  << "migrate it to use sqlite directory storage";
+  }
+}
+
+AbsolutePath Overlay::getDirDatabasePath() const {
+  return localDir_ + PathComponentPiece{kDirDatabase};
+}
+
+OverlayDirStorage Overlay::getDirStorage() const {
+  return dirStore_ ? OverlayDirStorage::Sqlite : OverlayDirStorage::Files;
+}
+
+size_t Overlay::migrateDirsToSqlite() {
+  if (dirStore_) {
+    return 0;
+  }
+
+  // Build the database at a temporary path, and only move it into place once
+  // all records have been committed.  The presence of the database is what
+  // marks the overlay as using sqlite storage, so we must never leave a
+  // partially populated database at the final path.
+  auto tmpPath = localDir_ + PathComponentPiece{kDirDatabaseTmp};
+  if (::unlink(tmpPath.value().c_str()) != 0 && errno != ENOENT) {
+    folly::throwSystemError("error removing stale overlay database ", tmpPath);
+  }
+
+  auto store = std::make_unique<SqliteOverlayDirStore>(tmpPath);
+  auto batch = store->beginWrite();
+  std::vector<AbsolutePath> dirFiles;
+
+  std::array<char, 2> subdir;
+  for (uint64_t n = 0; n < 256; ++n) {
+    formatSubdirPath(MutableStringPiece{subdir.data(), subdir.size()}, n);
+    auto subdirPath = localDir_ +
+        PathComponentPiece{StringPiece{subdir.data(), subdir.size()}};
+
+    auto boostPath = boost::filesystem::path{subdirPath.value().c_str()};
+    for (const auto& entry : boost::filesystem::directory_iterator(boostPath)) {
+      auto entryInodeNumber =
+          folly::tryTo<uint64_t>(entry.path().filename().string());
+      if (!entryInodeNumber.hasValue()) {
+        continue;
+      }
+
+      // Only directories are moved; file contents stay in the shards.
+      auto filePath = subdirPath +
+          PathComponentPiece{entry.path().filename().string()};
+      std::string contents;
+      if (!folly::readFile(
+              filePath.value().c_str(),
+              contents,
+              kHeaderIdentifierDir.size())) {
+        folly::throwSystemError("failed to read ", filePath);
+      }
+      if (StringPiece{contents} != kHeaderIdentifierDir) {
+        continue;
+      }
+      if (!folly::readFile(filePath.value().c_str(), contents)) {
+        folly::throwSystemError("failed to read ", filePath);
+      }
+
+      batch.save(
+          fusell::InodeNumber{entryInodeNumber.value()}, std::move(contents));
+      dirFiles.push_back(std::move(filePath));
+    }
+  }
+
+  batch.flush();
+  store->close();
+
+  auto dbPath = getDirDatabasePath();
+  folly::checkUnixError(
+      ::rename(tmpPath.value().c_str(), dbPath.value().c_str()),
+      "error installing overlay database ",
+      dbPath);
+  dirStore_ = std::make_unique<SqliteOverlayDirStore>(dbPath);
+
+  // The directory files are now redundant.
+  for (const auto& path : dirFiles) {
+    if (::unlink(path.value().c_str()) != 0 && errno != ENOENT) {
+      XLOG(WARNING) << "error removing migrated overlay file " << path << ": "
+                    << folly::errnoStr(errno);
+    }
+  }
+
+  XLOG(INFO) << "migrated " << dirFiles.size()
+             << " overlay directories to " << dbPath;
+  return dirFiles.size();
+}
+
+void Overlay::tryLoadNextInodeNumber() {
+  struct stat st;
+  folly::checkUnixError(
+      fstat(infoFile_.fd(), &st),
+      "error getting size of overlay info file in ",
+      localDir_.stringPiece());
+  auto infoFileSize = static_cast<size_t>(st.st_size);
+  if (infoFileSize == kInfoHeaderSize) {
+    // The overlay was not shut down cleanly the last time it was used
+    // (or this is a brand new overlay).
+    return;
+  }
+
+  if (infoFileSize == kInfoFileSizeWithNextInode) {
+    uint64_t nextInodeNumber;
+    auto sizeRead = folly::preadFull(
+        infoFile_.fd(),
+        &nextInodeNumber,
+        sizeof(nextInodeNumber),
+        kInfoHeaderSize);
+    folly::checkUnixError(
+        sizeRead,
+        "error reading next inode number from overlay info file in ",
+        localDir_.stringPiece());
+    nextInodeNumber = folly::Endian::big(nextInodeNumber);
+    if (sizeRead == sizeof(nextInodeNumber) &&
+        nextInodeNumber > kRootNodeId.get()) {
+      nextInodeNumber_ = fusell::InodeNumber{nextInodeNumber};
+    }
+  }
+
+  if (!nextInodeNumber_.hasValue()) {
+    XLOG(WARNING) << "ignoring malformed next inode number in overlay "
+                  << "info file for " << localDir_;
+  }
+
+  // Drop the saved number now, before any new inode numbers are allocated.
+  // If we crash before the next graceful shutdown the following startup
+  // will then correctly fall back to scanning the overlay.
+  folly::checkUnixError(
+      folly::ftruncateNoInt(infoFile_.fd(), kInfoHeaderSize),
+      "error truncating overlay info file in ",
+      localDir_.stringPiece());
+  folly::checkUnixError(
+      folly::fsyncNoInt(infoFile_.fd()),
+      "error syncing overlay info file in ",
+      localDir_.stringPiece());
+}
+
+void Overlay::saveNextInodeNumber(fusell::InodeNumber nextInodeNumber) {
+  auto value = folly::Endian::big(nextInodeNumber.get());
+  auto wrote = folly::pwriteFull(
+      infoFile_.fd(), &value, sizeof(value), kInfoHeaderSize);
+  folly::checkUnixError(
+      wrote,
+      "error writing next inode number to overlay info file in ",
+      localDir_.stringPiece());
+  folly::checkUnixError(
+      folly::fsyncNoInt(infoFile_.fd()),
+      "error syncing overlay info file in ",
+      localDir_.stringPiece());
+}
+
+bool Overlay::hadCleanShutdown() const {
+  return nextInodeNumber_.hasValue();
+}
+
+AbsolutePath Overlay::getCheckoutMarkerPath() const {
+  return localDir_ + PathComponentPiece{kCheckoutMarker};
+}
+
+void Overlay::checkCheckoutMarker() {
+  auto markerPath = getCheckoutMarkerPath();
+  struct stat st;
+  if (lstat(markerPath.value().c_str(), &st) != 0) {
+    if (errno != ENOENT) {
+      folly::throwSystemError(
+          "error checking for checkout marker ", markerPath);
+    }
+    return;
+  }
+
+  // We only report the interruption; nothing is repaired here.  The
+  // checkout writes deferred directory data children first, and no other
+  // operation writes out a directory while the checkout is holding back its
+  // data, so a directory never refers to a child directory whose data was
+  // not written.  However the directory data on disk may mix the state from
+  // before and after the checkout, and a directory that was not written yet
+  // may still refer to a file that the checkout replaced and whose data has
+  // already been removed.
+  XLOG(WARNING) << "a checkout operation was interrupted the last time the "
+                << "overlay at " << localDir_ << " was used; "
+                << "directory contents may be partially updated";
+  checkoutWasInterrupted_ = true;
+  endCheckout();
+}
+
+void Overlay::beginCheckout() {
+  auto markerPath = getCheckoutMarkerPath();
+  File marker{
+      markerPath.value().c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644};
+  folly::checkUnixError(
+      folly::fsyncNoInt(marker.fd()),
+      "error syncing checkout marker ",
+      markerPath);
+}
+
+void Overlay::endCheckout() {
+  auto markerPath = getCheckoutMarkerPath();
+  if (::unlink(markerPath.value().c_str()) != 0 && errno != ENOENT) {
+    folly::throwSystemError("error removing checkout marker ", markerPath);
+  }
+}
+
+bool Overlay::checkoutWasInterrupted() const {
+  return checkoutWasInterrupted_;
 }
 
 bool Overlay::isOldFormatOverlay() const {
@@ -235,6 +510,44 @@ Optional<TreeInode::Dir> Overlay::loadOverlayDir(
 void Overlay::saveOverlayDir(
     fusell::InodeNumber inodeNumber,
     const TreeInode::Dir& dir) const {
+  auto record = serializeOverlayDir(dir);
+  if (dirStore_) {
+    dirStore_->save(inodeNumber, record);
+    return;
+  }
+
+  // And update the file on disk
+  folly::writeFileAtomic(getFilePath(inodeNumber).stringPiece(), record);
+}
+
+OverlayDirWriteBatch Overlay::beginDirWrite() const {
+  return OverlayDirWriteBatch{this};
+}
+
+void OverlayDirWriteBatch::save(
+    fusell::InodeNumber inodeNumber,
+    const TreeInode::Dir& dir) {
+  if (!overlay_->dirStore_) {
+    overlay_->saveOverlayDir(inodeNumber, dir);
+    return;
+  }
+  records_.emplace_back(inodeNumber, overlay_->serializeOverlayDir(dir));
+}
+
+void OverlayDirWriteBatch::flush() {
+  if (records_.empty()) {
+    return;
+  }
+
+  auto batch = overlay_->dirStore_->beginWrite();
+  for (auto& record : records_) {
+    batch.save(record.first, std::move(record.second));
+  }
+  records_.clear();
+  batch.flush();
+}
+
+std::string Overlay::serializeOverlayDir(const TreeInode::Dir& dir) const {
   // TODO: T20282158 clean up access of child inode information.
   //
   // Translate the data to the thrift equivalents
@@ -269,16 +582,21 @@ void Overlay::saveOverlayDir(
   auto header =
       createHeader(kHeaderIdentifierDir, kHeaderVersion, dir.timeStamps);
 
-  auto iov = header.getIov();
-  iov.push_back(
-      {const_cast<char*>(serializedData.data()), serializedData.size()});
-
-  // And update the file on disk
-  folly::writeFileAtomic(
-      getFilePath(inodeNumber).stringPiece(), iov.data(), iov.size());
+  std::string record;
+  record.reserve(header.length() + serializedData.size());
+  record.append(reinterpret_cast<const char*>(header.data()), header.length());
+  record.append(serializedData);
+  return record;
 }
 
 void Overlay::removeOverlayData(fusell::InodeNumber inodeNumber) const {
+  if (dirStore_) {
+    // We don't know if this inode was a file or a directory, so remove both
+    // the database record and the overlay file.
+    dirStore_->remove(inodeNumber);
+  }
+
+  fileCache_->invalidate(inodeNumber);
   auto path = getFilePath(inodeNumber);
   if (::unlink(path.value().c_str()) != 0 && errno != ENOENT) {
     folly::throwSystemError("error unlinking overlay file: ", path);
@@ -286,16 +604,14 @@ void Overlay::removeOverlayData(fusell::InodeNumber inodeNumber) const {
 }
 
 fusell::InodeNumber Overlay::getMaxRecordedInode() {
-  // TODO: We should probably store the max inode number in the header file
-  // during graceful unmount.  When opening an overlay we can then simply read
-  // back the max inode number from this file if the overlay was shut down
-  // cleanly last time.
-  //
-  // We would only then need to do a scan if the overlay was not cleanly shut
-  // down.
-  //
-  // For now we always do a scan.
+  // If the overlay was shut down cleanly last time we recorded the next inode
+  // number in the info file, and can avoid scanning the overlay entirely.
+  if (nextInodeNumber_.hasValue()) {
+    return fusell::InodeNumber{nextInodeNumber_->get() - 1};
+  }
 
+  // We only need to do a scan if the overlay was not cleanly shut down.
+  //
   // Walk the root directory downwards to find all (non-unlinked) directory
   // inodes stored in the overlay.
   //
@@ -349,6 +665,14 @@ fusell::InodeNumber Overlay::getMaxRecordedInode() {
     }
   }
 
+  // Directories are not in the subdirectories when using sqlite storage.
+  if (dirStore_) {
+    auto maxDirInode = dirStore_->getMaxInodeNumber();
+    if (maxDirInode.hasValue()) {
+      maxInode = std::max(maxInode, maxDirInode.value());
+    }
+  }
+
   return maxInode;
 }
 
@@ -366,29 +690,61 @@ AbsolutePath Overlay::getFilePath(fusell::InodeNumber inodeNumber) const {
       PathComponentPiece{numberStr};
 }
 
-Optional<overlay::OverlayDir> Overlay::deserializeOverlayDir(
+OverlayFileCache::FilePtr Overlay::getCachedFile(
+    fusell::InodeNumber inodeNumber) const {
+  return fileCache_->get(inodeNumber, [&] {
+    return File(getFilePath(inodeNumber).c_str(), O_RDWR);
+  });
+}
+
+void Overlay::invalidateCachedFile(fusell::InodeNumber inodeNumber) const {
+  fileCache_->invalidate(inodeNumber);
+}
+
+OverlayFileCache::Stats Overlay::getFileCacheStats() const {
+  return fileCache_->getStats();
+}
+
+bool Overlay::readOverlayDirData(
     fusell::InodeNumber inodeNumber,
-    InodeTimestamps& timeStamps) const {
-  auto path = getFilePath(inodeNumber);
+    std::string& serializedData) const {
+  if (dirStore_) {
+    auto record = dirStore_->load(inodeNumber);
+    if (!record.hasValue()) {
+      return false;
+    }
+    serializedData = std::move(record.value());
+    return true;
+  }
 
-  // Read the file and de-serialize it into data
-  std::string serializedData;
+  auto path = getFilePath(inodeNumber);
   if (!folly::readFile(path.value().c_str(), serializedData)) {
     int err = errno;
     if (err == ENOENT) {
-      // There is no overlay here
-      return folly::none;
+      return false;
     }
     folly::throwSystemErrorExplicit(err, "failed to read ", path);
   }
+  return true;
+}
+
+Optional<overlay::OverlayDir> Overlay::deserializeOverlayDir(
+    fusell::InodeNumber inodeNumber,
+    InodeTimestamps& timeStamps) const {
+  // Read the data and de-serialize it
+  std::string serializedData;
+  if (!readOverlayDirData(inodeNumber, serializedData)) {
+    // There is no overlay here
+    return folly::none;
+  }
 
   // Removing header and deserializing the contents
   if (serializedData.size() < kHeaderLength) {
     // Something Wrong with the file(may be corrupted)
     folly::throwSystemErrorExplicit(
         EIO,
-        "Overlay file ",
-        path,
+        "Overlay data for inode ",
+        inodeNumber,
         " is too short for header: size=",
         serializedData.size());
   }
@@ -12,6 +12,8 @@
 #include <folly/Optional.h>
 #include <folly/Range.h>
 #include "TreeInode.h"
+#include "eden/fs/config/ClientConfig.h"
+#include "eden/fs/inodes/OverlayFileCache.h"
 #include "eden/fs/utils/DirType.h"
 #include "eden/fs/utils/PathFuncs.h"
 #include "eden/fs/utils/PathMap.h"
@@ -24,6 +26,8 @@ class OverlayDir;
 }
 
 class InodeMap;
+class OverlayDirWriteBatch;
+class SqliteOverlayDirStore;
 
 /** Manages the write overlay storage area.
  *
@@ -42,17 +46,50 @@ class InodeMap;
  * file "foo/bar/baz" then the Overlay records metadata about the list
  * of files in the root, the list of files in "foo", the list of files in
  * "foo/bar" and finally materializes "foo/bar/baz".
+ *
+ * Materialized file contents are always stored in one file per inode.
+ * Materialized directories are either stored the same way, or in a single
+ * sqlite database (see OverlayDirStorage).  The directory storage format is
+ * chosen when the overlay is first created, and can later be converted from
+ * files to sqlite with migrateDirsToSqlite().
  */
 class Overlay {
  public:
-  explicit Overlay(AbsolutePathPiece localDir);
+  explicit Overlay(
+      AbsolutePathPiece localDir,
+      OverlayDirStorage dirStorage = OverlayDirStorage::Files);
+  ~Overlay();
 
   /** Returns the path to the root of the Overlay storage area */
   const AbsolutePath& getLocalDir() const;
 
+  /** Returns the format currently used to store directory data. */
+  OverlayDirStorage getDirStorage() const;
+
+  /**
+   * Convert a file-per-inode overlay to store its directories in a single
+   * sqlite database.
+   *
+   * All existing directory records (including those of unlinked directories)
+   * are imported in a single transaction.  The database is only put in place
+   * once the import has been committed, and the old directory files are
+   * removed afterwards, so interrupting the migration never loses data.
+   *
+   * This must not be called while the overlay is in use by a mount.
+   * Returns the number of directory records migrated.
+   */
+  size_t migrateDirsToSqlite();
+
   void saveOverlayDir(
       fusell::InodeNumber inodeNumber,
       const TreeInode::Dir& dir) const;
+
+  /**
+   * Start saving the data for several directories at once.  See
+   * OverlayDirWriteBatch.
+   */
+  OverlayDirWriteBatch beginDirWrite() const;
+
   folly::Optional<TreeInode::Dir> loadOverlayDir(
       fusell::InodeNumber inodeNumber,
       InodeMap* inodeMap) const;
@@ -63,6 +100,32 @@ class Overlay {
    * Get the path to the overlay file for the given inode
    */
   AbsolutePath getFilePath(fusell::InodeNumber inodeNumber) const;
+
+  /**
+   * Get an open descriptor for the overlay file of a materialized file.
+   *
+   * Descriptors are kept open in a bounded LRU cache, so that repeated
+   * metadata operations on the same file do not have to reopen it by path.
+   * The returned descriptor remains valid even if it is later evicted.
+   *
+   * The file is opened O_RDWR; its header is not validated.
+   */
+  OverlayFileCache::FilePtr getCachedFile(
+      fusell::InodeNumber inodeNumber) const;
+
+  /**
+   * Drop any cached descriptor for the given inode's overlay file.
+   *
+   * This must be called by code that replaces an overlay file with a new one
+   * (for instance with folly::writeFileAtomic()).
+   */
+  void invalidateCachedFile(fusell::InodeNumber inodeNumber) const;
+
+  /**
+   * Return the hit, miss, and eviction counts of the overlay file cache.
+   */
+  OverlayFileCache::Stats getFileCacheStats() const;
+
   /**
    * Creates header for the files stored in Overlay
    */
@@ -102,9 +165,51 @@ class Overlay {
    * This is called when opening a mount point, to make sure that new inodes
    * handed out from this point forwards are always greater than any inodes
    * already tracked in the overlay.
+   *
+   * If the overlay was shut down cleanly last time this simply returns the
+   * value recorded by saveNextInodeNumber().  Otherwise it has to scan the
+   * entire overlay, which can be slow for large overlays.
    */
   fusell::InodeNumber getMaxRecordedInode();
 
+  /**
+   * Record the next inode number in the overlay info file.
+   *
+   * This should be called during graceful shutdown, once all inodes have been
+   * unloaded and no more inode numbers can be allocated.  This allows the next
+   * mount of this overlay to skip the scan done by getMaxRecordedInode().
+   */
+  void saveNextInodeNumber(fusell::InodeNumber nextInodeNumber);
+
+  /**
+   * Returns true if the previous user of this overlay shut it down cleanly
+   * and recorded its next inode number with saveNextInodeNumber().
+   */
+  bool hadCleanShutdown() const;
+
+  /**
+   * Record that a checkout operation is about to defer directory writes.
+   *
+   * While a checkout is running TreeInodes do not immediately write out their
+   * overlay data, so the on-disk directory data may lag behind the in-memory
+   * state until endCheckout() is called.  A marker file is written (and
+   * synced) so that if we crash in between, the next user of this overlay can
+   * tell that the checkout was interrupted.
+   */
+  void beginCheckout();
+
+  /**
+   * Remove the marker written by beginCheckout(), once all deferred directory
+   * data has been written.
+   */
+  void endCheckout();
+
+  /**
+   * Returns true if the previous user of this overlay crashed in the middle of
+   * a checkout operation, between beginCheckout() and endCheckout().
+   */
+  bool checkoutWasInterrupted() const;
+
   /**
    * Constants for an header in overlay file.
    */
@@ -114,13 +219,26 @@ class Overlay {
   static constexpr size_t kHeaderLength = 64;
 
  private:
-  void initOverlay();
+  void initOverlay(OverlayDirStorage dirStorage);
+  void initDirStorage(OverlayDirStorage dirStorage, bool isNewOverlay);
+  AbsolutePath getDirDatabasePath() const;
+  bool readOverlayDirData(
+      fusell::InodeNumber inodeNumber,
+      std::string& serializedData) const;
   bool isOldFormatOverlay() const;
   void readExistingOverlay(int infoFD);
   void initNewOverlay();
+  void tryLoadNextInodeNumber();
+  void checkCheckoutMarker();
+  AbsolutePath getCheckoutMarkerPath() const;
   folly::Optional<overlay::OverlayDir> deserializeOverlayDir(
       fusell::InodeNumber inodeNumber,
       InodeTimestamps& timeStamps) const;
+  /**
+   * Serialize a directory to the bytes stored for it: the overlay header
+   * followed by the serialized OverlayDir.
+   */
+  std::string serializeOverlayDir(const TreeInode::Dir& dir) const;
   /**
    * Helper function to add header to the overlay file
    */
@@ -144,6 +262,53 @@ class Overlay {
    * using it.  We want to ensure that only one eden process
    */
   folly::File infoFile_;
+
+  /**
+   * The next inode number recorded in the info file by the previous graceful
+   * shutdown, or folly::none if the overlay was not shut down cleanly.
+   */
+  folly::Optional<fusell::InodeNumber> nextInodeNumber_;
+
+  /**
+   * Whether the checkout marker was present when this overlay was opened.
+   */
+  bool checkoutWasInterrupted_{false};
+
+  /**
+   * Open descriptors for recently used overlay files.
+   */
+  std::unique_ptr<OverlayFileCache> fileCache_;
+
+  /**
+   * The database holding directory data, if this overlay uses
+   * OverlayDirStorage::Sqlite.  This is null for file-per-inode overlays.
+   */
+  std::unique_ptr<SqliteOverlayDirStore> dirStore_;
+
+  friend class OverlayDirWriteBatch;
+};
+
+/**
+ * Saves the overlay data for a group of directories.
+ *
+ * With OverlayDirStorage::Sqlite the records are buffered, and flush() writes
+ * them all in a single sqlite transaction.  With file-per-inode storage each
+ * directory is written out by save() as it would be by saveOverlayDir(), and
+ * flush() does nothing.
+ *
+ * Records that have not been flushed when the batch is destroyed are
+ * discarded.
+ */
+class OverlayDirWriteBatch {
+ public:
+  explicit OverlayDirWriteBatch(const Overlay* overlay) : overlay_(overlay) {}
+
+  void save(fusell::InodeNumber inodeNumber, const TreeInode::Dir& dir);
+  void flush();
+
+ private:
+  const Overlay* overlay_;
+  std::vector<std::pair<fusell::InodeNumber, std::string>> records_;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/OverlayFileCache.h"
+#include <algorithm>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+OverlayFileCache::OverlayFileCache(size_t maxOpenFiles)
+    : maxOpenFiles_(maxOpenFiles),
+      state_(folly::in_place, std::max<size_t>(maxOpenFiles, 1)) {}
+
+OverlayFileCache::FilePtr OverlayFileCache::get(
+    fusell::InodeNumber inodeNumber,
+    folly::FunctionRef<folly::File()> openFile) {
+  uint64_t generation;
+  {
+    auto state = state_.wlock();
+    auto it = state->files.find(inodeNumber);
+    if (it != state->files.end()) {
+      ++state->stats.hits;
+      return it->second;
+    }
+    ++state->stats.misses;
+    generation = state->generation;
+  }
+
+  auto file = std::make_shared<folly::File>(openFile());
+  if (maxOpenFiles_ == 0) {
+    return file;
+  }
+
+  // Descriptors evicted from the cache are only released here, and are
+  // actually closed once we drop the lock (or once their last user is done
+  // with them), so close(2) is never called with the lock held.
+  std::vector<FilePtr> evicted;
+  {
+    auto state = state_.wlock();
+    if (state->generation != generation) {
+      // The file may have been removed or replaced after openFile() opened
+      // it.  Let the caller use the descriptor, but don't keep it around
+      // for later lookups.
+      return file;
+    }
+    auto it = state->files.find(inodeNumber);
+    if (it != state->files.end()) {
+      // Another thread opened the same file while we were opening it.
+      // Use the descriptor that is already cached.
+      return it->second;
+    }
+    state->files.set(
+        inodeNumber,
+        file,
+        /*promote=*/true,
+        [&](fusell::InodeNumber, FilePtr&& evictedFile) {
+          evicted.push_back(std::move(evictedFile));
+        });
+    state->stats.evictions += evicted.size();
+  }
+  return file;
+}
+
+void OverlayFileCache::invalidate(fusell::InodeNumber inodeNumber) {
+  FilePtr file;
+  {
+    auto state = state_.wlock();
+    ++state->generation;
+    auto it = state->files.find(inodeNumber);
+    if (it == state->files.end()) {
+      return;
+    }
+    file = std::move(it->second);
+    state->files.erase(it);
+  }
+}
+
+void OverlayFileCache::clear() {
+  std::vector<FilePtr> files;
+  {
+    auto state = state_.wlock();
+    ++state->generation;
+    files.reserve(state->files.size());
+    for (auto& entry : state->files) {
+      files.push_back(std::move(entry.second));
+    }
+    state->files.clear();
+  }
+}
+
+size_t OverlayFileCache::size() const {
+  return state_.rlock()->files.size();
+}
+
+OverlayFileCache::Stats OverlayFileCache::getStats() const {
+  return state_.rlock()->stats;
+}
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/File.h>
+#include <folly/Function.h>
+#include <folly/Synchronized.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <memory>
+#include "eden/fs/fuse/FuseTypes.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * A bounded cache of open overlay file descriptors, keyed by inode number.
+ *
+ * Materialized files that do not have an open FileHandle would otherwise have
+ * to open their overlay file by path (and close it again) every time they are
+ * stat'ed, hashed, or have their attributes changed.  Build tools tend to stat
+ * the same outputs over and over, so keeping a limited number of these
+ * descriptors open saves a lot of open(2) and close(2) calls.
+ *
+ * Entries are evicted in least-recently-used order once the cache is full.
+ * Files are handed out as shared pointers, so a descriptor that is evicted
+ * while it is still in use is only closed once the last user releases it.
+ *
+ * OverlayFileCache is thread safe.
+ */
+class OverlayFileCache {
+ public:
+  using FilePtr = std::shared_ptr<folly::File>;
+
+  struct Stats {
+    /** The number of lookups satisfied by an already-open descriptor. */
+    uint64_t hits{0};
+    /** The number of lookups that had to open the file. */
+    uint64_t misses{0};
+    /** The number of descriptors closed to make room for newer entries. */
+    uint64_t evictions{0};
+  };
+
+  /**
+   * Create a cache that keeps at most maxOpenFiles descriptors open.
+   * A maxOpenFiles of 0 disables caching: every lookup opens the file.
+   */
+  explicit OverlayFileCache(size_t maxOpenFiles);
+
+  /**
+   * Return the cached descriptor for the specified inode, calling openFile()
+   * to open it and add it to the cache if it is not present.
+   *
+   * openFile() is called without the cache lock held.  If the cache is
+   * invalidated while it runs, the new descriptor is returned but not cached,
+   * since it may refer to a file that has since been removed or replaced.
+   */
+  FilePtr get(
+      fusell::InodeNumber inodeNumber,
+      folly::FunctionRef<folly::File()> openFile);
+
+  /**
+   * Drop the cached descriptor for the specified inode, if there is one.
+   *
+   * This must be called whenever the overlay file for an inode is removed or
+   * replaced, so that later lookups do not return a descriptor for the old
+   * file.
+   */
+  void invalidate(fusell::InodeNumber inodeNumber);
+
+  /** Close all cached descriptors. */
+  void clear();
+
+  /** Return the number of descriptors currently in the cache. */
+  size_t size() const;
+
+  Stats getStats() const;
+
+ private:
+  struct State {
+    explicit State(size_t maxOpenFiles) : files(maxOpenFiles) {}
+
+    folly::EvictingCacheMap<fusell::InodeNumber, FilePtr> files;
+    Stats stats;
+    /**
+     * Incremented by every invalidate() and clear(), so that get() can tell
+     * whether the file it opened was invalidated before it could be cached.
+     */
+    uint64_t generation{0};
+  };
+
+  const size_t maxOpenFiles_;
+  folly::Synchronized<State> state_;
+};
+} // namespace eden
+} // namespace facebook
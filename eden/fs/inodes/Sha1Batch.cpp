@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/Sha1Batch.h"
+
+#include <folly/Exception.h>
+#include <folly/futures/Future.h>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/FileInode.h"
+#include "eden/fs/inodes/InodeError.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+using folly::Future;
+using folly::makeFuture;
+using folly::StringPiece;
+using folly::Try;
+using std::string;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+/**
+ * Start the SHA-1 lookups for paths[begin, end).
+ */
+Future<vector<Try<Hash>>> getSha1Chunk(
+    EdenMount* mount,
+    const vector<string>& paths,
+    size_t begin,
+    size_t end) {
+  vector<Future<Hash>> futures;
+  futures.reserve(end - begin);
+  for (size_t n = begin; n < end; ++n) {
+    // Trap any immediate exceptions (such as an invalid path) so that they
+    // are reported for this path only.
+    futures.emplace_back(folly::makeFutureWith(
+        [&] { return getSha1ForPath(mount, paths[n]); }));
+  }
+  return folly::collectAll(std::move(futures));
+}
+} // namespace
+
+Future<Hash> getSha1ForPath(EdenMount* mount, StringPiece path) {
+  if (path.empty()) {
+    return makeFuture<Hash>(folly::makeSystemErrorExplicit(
+        EINVAL, "path cannot be the empty string"));
+  }
+
+  auto relativePath = RelativePathPiece{path};
+  return mount->getInode(relativePath).then([](const InodePtr& inode) {
+    auto fileInode = inode.asFilePtr();
+    if (!S_ISREG(fileInode->getMode())) {
+      // We intentionally want to refuse to compute the SHA1 of symlinks
+      return makeFuture<Hash>(
+          InodeError(EINVAL, fileInode, "file is a symlink"));
+    }
+    return fileInode->getSha1();
+  });
+}
+
+Future<vector<Try<Hash>>> getSha1Batch(
+    std::shared_ptr<EdenMount> mount,
+    vector<string> paths,
+    folly::Executor* executor,
+    size_t chunkSize) {
+  DCHECK_GT(chunkSize, 0);
+  if (!executor || paths.size() <= chunkSize) {
+    return getSha1Chunk(mount.get(), paths, 0, paths.size());
+  }
+
+  // The chunk tasks refer to the paths and the mount, so share ownership of
+  // them until all of the chunks have completed.
+  auto sharedPaths = std::make_shared<vector<string>>(std::move(paths));
+  vector<Future<vector<Try<Hash>>>> chunkFutures;
+  chunkFutures.reserve((sharedPaths->size() + chunkSize - 1) / chunkSize);
+  for (size_t begin = 0; begin < sharedPaths->size(); begin += chunkSize) {
+    auto end = std::min(begin + chunkSize, sharedPaths->size());
+    chunkFutures.emplace_back(
+        folly::via(executor, [mount, sharedPaths, begin, end] {
+          return getSha1Chunk(mount.get(), *sharedPaths, begin, end);
+        }));
+  }
+
+  return folly::collect(std::move(chunkFutures))
+      .then([sharedPaths](vector<vector<Try<Hash>>> chunkResults) {
+        vector<Try<Hash>> results;
+        results.reserve(sharedPaths->size());
+        for (auto& chunk : chunkResults) {
+          for (auto& result : chunk) {
+            results.push_back(std::move(result));
+          }
+        }
+        return results;
+      });
+}
+
+} // namespace eden
+} // namespace facebook
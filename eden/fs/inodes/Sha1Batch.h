@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/Try.h>
+#include <folly/futures/Future.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+
+namespace folly {
+class Executor;
+}
+
+namespace facebook {
+namespace eden {
+
+class EdenMount;
+
+/**
+ * The default number of paths processed by each task in getSha1Batch().
+ */
+constexpr size_t kDefaultSha1BatchChunkSize = 64;
+
+/**
+ * Get the SHA-1 of the regular file at the specified path in a mount.
+ *
+ * Fails with EINVAL if the path is empty or refers to a symlink.
+ */
+folly::Future<Hash> getSha1ForPath(EdenMount* mount, folly::StringPiece path);
+
+/**
+ * Get the SHA-1 of many files in a mount at once.
+ *
+ * Looking up a path resolves inodes and reads blob metadata from the
+ * LocalStore synchronously whenever that data is already cached, and hashing
+ * a modified file may need to read it from the overlay.  For large batches
+ * the paths are therefore split into chunks of chunkSize paths, which are
+ * processed in parallel on the given executor.  If executor is null, or the
+ * batch fits in a single chunk, everything is started on the calling thread.
+ *
+ * Hashing itself is done by OpenSSL, which already picks the fastest SHA-1
+ * implementation supported by the CPU (including the x86 SHA extensions).
+ *
+ * Returns one result per input path, in the same order as the input.
+ */
+folly::Future<std::vector<folly::Try<Hash>>> getSha1Batch(
+    std::shared_ptr<EdenMount> mount,
+    std::vector<std::string> paths,
+    folly::Executor* executor,
+    size_t chunkSize = kDefaultSha1BatchChunkSize);
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/SqliteOverlayDirStore.h"
+
+namespace facebook {
+namespace eden {
+
+using folly::StringPiece;
+
+namespace {
+int64_t inodeKey(fusell::InodeNumber inodeNumber) {
+  return static_cast<int64_t>(inodeNumber.get());
+}
+} // namespace
+
+SqliteOverlayDirStore::SqliteOverlayDirStore(AbsolutePathPiece pathToDb)
+    : db_(pathToDb) {
+  auto db = db_.lock();
+
+  // Write ahead log for faster perf
+  // https://www.sqlite.org/wal.html
+  SqliteStatement(db, "PRAGMA journal_mode=WAL").step();
+  // In WAL mode this only syncs at checkpoints, which is plenty for the
+  // overlay: we only need to survive a crash of the edenfs process.
+  SqliteStatement(db, "PRAGMA synchronous=NORMAL").step();
+
+  SqliteStatement(
+      db,
+      "CREATE TABLE IF NOT EXISTS dirs(",
+      "inode INTEGER NOT NULL,",
+      "value BINARY NOT NULL,",
+      "PRIMARY KEY (inode)",
+      ")")
+      .step();
+}
+
+void SqliteOverlayDirStore::close() {
+  db_.close();
+}
+
+folly::Optional<std::string> SqliteOverlayDirStore::load(
+    fusell::InodeNumber inodeNumber) {
+  auto db = db_.lock();
+  SqliteStatement stmt(db, "SELECT value FROM dirs WHERE inode = ?");
+  stmt.bind(1, inodeKey(inodeNumber));
+  if (stmt.step()) {
+    return stmt.columnBlob(0).str();
+  }
+  return folly::none;
+}
+
+void SqliteOverlayDirStore::save(
+    fusell::InodeNumber inodeNumber,
+    StringPiece data) {
+  auto db = db_.lock();
+  SqliteStatement stmt(db, "INSERT OR REPLACE INTO dirs VALUES(?, ?)");
+  stmt.bind(1, inodeKey(inodeNumber));
+  stmt.bind(2, data);
+  stmt.step();
+}
+
+void SqliteOverlayDirStore::remove(fusell::InodeNumber inodeNumber) {
+  auto db = db_.lock();
+  SqliteStatement stmt(db, "DELETE FROM dirs WHERE inode = ?");
+  stmt.bind(1, inodeKey(inodeNumber));
+  stmt.step();
+}
+
+folly::Optional<fusell::InodeNumber>
+SqliteOverlayDirStore::getMaxInodeNumber() {
+  auto db = db_.lock();
+  SqliteStatement stmt(db, "SELECT MAX(inode) FROM dirs");
+  if (stmt.step()) {
+    auto maxInode = stmt.columnInt64(0);
+    if (maxInode > 0) {
+      return fusell::InodeNumber{static_cast<uint64_t>(maxInode)};
+    }
+  }
+  return folly::none;
+}
+
+void SqliteOverlayDirStore::WriteBatch::save(
+    fusell::InodeNumber inodeNumber,
+    std::string data) {
+  buffer_.emplace_back(inodeNumber, std::move(data));
+}
+
+void SqliteOverlayDirStore::WriteBatch::flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+
+  auto db = store_->db_.lock();
+  SqliteStatement(db, "BEGIN").step();
+  try {
+    SqliteStatement stmt(db, "INSERT OR REPLACE INTO dirs VALUES(?, ?)");
+    for (const auto& item : buffer_) {
+      stmt.bind(1, inodeKey(item.first));
+      stmt.bind(2, item.second);
+      stmt.step();
+    }
+    SqliteStatement(db, "COMMIT").step();
+  } catch (const std::exception&) {
+    // Speculative rollback to make sure that we're not still in a
+    // transaction if we bail out in the error path
+    SqliteStatement(db, "ROLLBACK").step();
+    throw;
+  }
+  buffer_.clear();
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "eden/fs/fuse/FuseTypes.h"
+#include "eden/fs/sqlite/Sqlite.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Stores the overlay data for materialized directories in a single sqlite
+ * database, rather than in one file per directory inode.
+ *
+ * Each record is keyed by inode number, and holds exactly the same bytes that
+ * would otherwise be written to the overlay file for that directory (the
+ * overlay header followed by the serialized OverlayDir).
+ *
+ * SqliteOverlayDirStore is thread safe.
+ */
+class SqliteOverlayDirStore {
+ public:
+  explicit SqliteOverlayDirStore(AbsolutePathPiece pathToDb);
+
+  void close();
+
+  /**
+   * Load the record for the specified inode, or return folly::none if there
+   * is no record for it.
+   */
+  folly::Optional<std::string> load(fusell::InodeNumber inodeNumber);
+
+  /**
+   * Insert or replace the record for the specified inode.
+   */
+  void save(fusell::InodeNumber inodeNumber, folly::StringPiece data);
+
+  /**
+   * Remove the record for the specified inode, if one exists.
+   */
+  void remove(fusell::InodeNumber inodeNumber);
+
+  /**
+   * Return the largest inode number with a record in the store,
+   * or folly::none if the store is empty.
+   */
+  folly::Optional<fusell::InodeNumber> getMaxInodeNumber();
+
+  /**
+   * Accumulates records and writes them all to the database in a single
+   * transaction when flush() is called.
+   */
+  class WriteBatch {
+   public:
+    explicit WriteBatch(SqliteOverlayDirStore* store) : store_(store) {}
+
+    void save(fusell::InodeNumber inodeNumber, std::string data);
+
+    size_t size() const {
+      return buffer_.size();
+    }
+
+    void flush();
+
+   private:
+    SqliteOverlayDirStore* store_;
+    std::vector<std::pair<fusell::InodeNumber, std::string>> buffer_;
+  };
+
+  WriteBatch beginWrite() {
+    return WriteBatch{this};
+  }
+
+ private:
+  SqliteDatabase db_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/TreeDiffer.h"
+
+#include <folly/experimental/logging/xlog.h>
+#include <folly/futures/Future.h>
+#include <vector>
+
+#include "eden/fs/inodes/DiffContext.h"
+#include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/store/BlobMetadata.h"
+
+using folly::Future;
+using folly::makeFuture;
+using folly::Unit;
+using std::shared_ptr;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+
+/**
+ * The futures for the children of one directory, and the paths they are
+ * for, so that any errors can be reported against the right path.
+ */
+class ChildFutures {
+ public:
+  void add(RelativePath path, Future<Unit>&& future) {
+    paths_.emplace_back(std::move(path));
+    futures_.emplace_back(std::move(future));
+  }
+
+  Future<Unit> collect(const DiffContext* context) {
+    return folly::collectAll(futures_).then(
+        [context, paths = std::move(paths_)](vector<folly::Try<Unit>> results) {
+          for (size_t n = 0; n < results.size(); ++n) {
+            auto& result = results[n];
+            if (result.hasException()) {
+              XLOG(WARN) << "exception processing diff for " << paths[n]
+                         << ": " << folly::exceptionStr(result.exception());
+              context->callback->diffError(paths[n], result.exception());
+            }
+          }
+        });
+  }
+
+ private:
+  vector<RelativePath> paths_;
+  vector<Future<Unit>> futures_;
+};
+
+/**
+ * Check the results of the two lookups needed to compare one entry,
+ * reporting each failure against the entry's path.  Returns true if both
+ * succeeded.
+ *
+ * Callers must wait for both lookups with collectAll() rather than
+ * collect(): a fetch refers to the DiffContext without owning it, and the
+ * context may be destroyed as soon as the diff completes.
+ */
+template <typename T>
+bool checkBothSucceeded(
+    const DiffContext* context,
+    RelativePathPiece entryPath,
+    const std::tuple<folly::Try<T>, folly::Try<T>>& results) {
+  bool succeeded = true;
+  auto check = [&](const folly::Try<T>& result) {
+    if (result.hasException()) {
+      XLOG(WARN) << "exception processing diff for " << entryPath << ": "
+                 << folly::exceptionStr(result.exception());
+      context->callback->diffError(entryPath, result.exception());
+      succeeded = false;
+    }
+  };
+  check(std::get<0>(results));
+  check(std::get<1>(results));
+  return succeeded;
+}
+
+enum class Side { FROM, TO };
+
+/**
+ * Report every file in a tree that exists on only one side of the diff.
+ */
+Future<Unit> diffOneSidedTree(
+    const DiffContext* context,
+    RelativePathPiece currentPath,
+    shared_ptr<const Tree> tree,
+    Side side) {
+  ChildFutures children;
+  for (const auto& entry : tree->getTreeEntries()) {
+    auto entryPath = currentPath + entry.getName();
+    if (entry.isTree()) {
+      auto treeFuture = context->getTree(entry.getHash(), entryPath);
+      auto f = std::move(treeFuture).then(
+          [context, entryPath, side](shared_ptr<const Tree>&& subtree) {
+            return diffOneSidedTree(
+                context, entryPath, std::move(subtree), side);
+          });
+      children.add(std::move(entryPath), std::move(f));
+    } else if (side == Side::FROM) {
+      XLOG(DBG5) << "diff: added file: " << entryPath;
+      context->callback->untrackedFile(entryPath);
+    } else {
+      XLOG(DBG5) << "diff: removed file: " << entryPath;
+      context->callback->removedFile(entryPath, entry);
+    }
+  }
+  return children.collect(context).ensure([tree = std::move(tree)] {});
+}
+
+Future<Unit> diffOneSidedEntry(
+    const DiffContext* context,
+    RelativePathPiece entryPath,
+    const TreeEntry& entry,
+    Side side) {
+  if (!entry.isTree()) {
+    if (side == Side::FROM) {
+      context->callback->untrackedFile(entryPath);
+    } else {
+      context->callback->removedFile(entryPath, entry);
+    }
+    return makeFuture();
+  }
+  return context->getTree(entry.getHash(), entryPath)
+      .then([context, entryPath = RelativePath{entryPath}, side](
+                shared_ptr<const Tree>&& tree) {
+        return diffOneSidedTree(context, entryPath, std::move(tree), side);
+      });
+}
+
+/**
+ * Compare two files with different blob hashes.
+ *
+ * Different hashes do not necessarily mean different contents, since
+ * mercurial blob IDs also cover the file's history.  Use the sizes and
+ * content SHA-1s from the trees when we have them, and only look up the
+ * blob metadata when we do not.
+ */
+Future<Unit> diffBlobs(
+    const DiffContext* context,
+    RelativePathPiece entryPath,
+    const TreeEntry& fromEntry,
+    const TreeEntry& toEntry) {
+  auto reportModified = [context,
+                         entryPath = RelativePath{entryPath},
+                         toEntry] {
+    XLOG(DBG5) << "diff: modified file: " << entryPath;
+    context->callback->modifiedFile(entryPath, toEntry);
+  };
+
+  if (fromEntry.getType() != toEntry.getType()) {
+    reportModified();
+    return makeFuture();
+  }
+  if (fromEntry.getSize() && toEntry.getSize() &&
+      fromEntry.getSize().value() != toEntry.getSize().value()) {
+    reportModified();
+    return makeFuture();
+  }
+  if (fromEntry.getContentSha1() && toEntry.getContentSha1()) {
+    if (fromEntry.getContentSha1().value() !=
+        toEntry.getContentSha1().value()) {
+      reportModified();
+    }
+    return makeFuture();
+  }
+
+  auto fromFuture = context->getBlobMetadata(fromEntry.getHash(), entryPath);
+  auto toFuture = context->getBlobMetadata(toEntry.getHash(), entryPath);
+  return folly::collectAll(fromFuture, toFuture)
+      .then([context,
+             entryPath = RelativePath{entryPath},
+             reportModified = std::move(reportModified)](
+                const std::tuple<
+                    folly::Try<BlobMetadata>,
+                    folly::Try<BlobMetadata>>& metadata) {
+        if (!checkBothSucceeded(context, entryPath, metadata)) {
+          return;
+        }
+        if (std::get<0>(metadata).value().sha1 !=
+            std::get<1>(metadata).value().sha1) {
+          reportModified();
+        }
+      });
+}
+
+Future<Unit> diffBothPresent(
+    const DiffContext* context,
+    RelativePathPiece entryPath,
+    const TreeEntry& fromEntry,
+    const TreeEntry& toEntry) {
+  if (fromEntry.getHash() == toEntry.getHash() &&
+      fromEntry.getType() == toEntry.getType()) {
+    // Identical files or subtrees.  This is what keeps the walk bounded by
+    // the size of the change.
+    return makeFuture();
+  }
+
+  if (fromEntry.isTree() && toEntry.isTree()) {
+    // Fetch both sides at once.
+    auto fromFuture = context->getTree(fromEntry.getHash(), entryPath);
+    auto toFuture = context->getTree(toEntry.getHash(), entryPath);
+    return folly::collectAll(fromFuture, toFuture)
+        .then([context, entryPath = RelativePath{entryPath}](
+                  std::tuple<
+                      folly::Try<shared_ptr<const Tree>>,
+                      folly::Try<shared_ptr<const Tree>>>&& trees) {
+          if (!checkBothSucceeded(context, entryPath, trees)) {
+            return makeFuture();
+          }
+          return diffTrees(
+              context,
+              entryPath,
+              std::move(std::get<0>(trees).value()),
+              std::move(std::get<1>(trees).value()));
+        });
+  }
+
+  if (fromEntry.isTree() || toEntry.isTree()) {
+    // A file replaced by a directory, or vice versa.
+    auto f1 = diffOneSidedEntry(context, entryPath, fromEntry, Side::FROM);
+    auto f2 = diffOneSidedEntry(context, entryPath, toEntry, Side::TO);
+    return folly::collectAll(f1, f2).then(
+        [context, entryPath = RelativePath{entryPath}](
+            const std::tuple<folly::Try<Unit>, folly::Try<Unit>>& results) {
+          checkBothSucceeded(context, entryPath, results);
+        });
+  }
+
+  return diffBlobs(context, entryPath, fromEntry, toEntry);
+}
+} // namespace
+
+Future<Unit> diffTrees(
+    const DiffContext* context,
+    RelativePathPiece currentPath,
+    shared_ptr<const Tree> fromTree,
+    shared_ptr<const Tree> toTree) {
+  context->directoryCompared();
+
+  // Both entry lists are sorted by name, so walk them together.
+  const auto& fromEntries = fromTree->getTreeEntries();
+  const auto& toEntries = toTree->getTreeEntries();
+  ChildFutures children;
+  size_t fromIdx = 0;
+  size_t toIdx = 0;
+  while (fromIdx < fromEntries.size() || toIdx < toEntries.size()) {
+    if (toIdx >= toEntries.size() ||
+        (fromIdx < fromEntries.size() &&
+         fromEntries[fromIdx].getName() < toEntries[toIdx].getName())) {
+      const auto& entry = fromEntries[fromIdx++];
+      auto entryPath = currentPath + entry.getName();
+      auto f = diffOneSidedEntry(context, entryPath, entry, Side::FROM);
+      children.add(std::move(entryPath), std::move(f));
+    } else if (
+        fromIdx >= fromEntries.size() ||
+        toEntries[toIdx].getName() < fromEntries[fromIdx].getName()) {
+      const auto& entry = toEntries[toIdx++];
+      auto entryPath = currentPath + entry.getName();
+      auto f = diffOneSidedEntry(context, entryPath, entry, Side::TO);
+      children.add(std::move(entryPath), std::move(f));
+    } else {
+      const auto& fromEntry = fromEntries[fromIdx++];
+      const auto& toEntry = toEntries[toIdx++];
+      auto entryPath = currentPath + toEntry.getName();
+      auto f = diffBothPresent(context, entryPath, fromEntry, toEntry);
+      children.add(std::move(entryPath), std::move(f));
+    }
+  }
+
+  // Keep the trees alive until all of the children are done with the
+  // entries they reference.
+  return children.collect(context).ensure(
+      [fromTree = std::move(fromTree), toTree = std::move(toTree)] {});
+}
+} // namespace eden
+} // namespace facebook
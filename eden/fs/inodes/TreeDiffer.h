@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+template <typename T>
+class Future;
+class Unit;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+
+class DiffContext;
+class Tree;
+
+/**
+ * Compute the differences between two source control trees, using only the
+ * ObjectStore.
+ *
+ * Differences are reported to the context's callback as though fromTree were
+ * the working directory and toTree were the source control state, the same
+ * way TreeInode::diff() reports them: files only in fromTree are untracked,
+ * files only in toTree are removed.
+ *
+ * Unlike TreeInode::diff() this never creates inodes and does not apply
+ * ignore rules, since everything in a commit is tracked.  Subtrees with the
+ * same hash on both sides are skipped without being fetched, and the
+ * children of each changed directory are fetched together (subject to the
+ * DiffContext's limit on concurrent fetches), so the cost is proportional to
+ * the size of the change rather than the size of the trees.
+ *
+ * The caller must ensure that the DiffContext remains valid until the
+ * returned Future completes.
+ */
+folly::Future<folly::Unit> diffTrees(
+    const DiffContext* context,
+    RelativePathPiece currentPath,
+    std::shared_ptr<const Tree> fromTree,
+    std::shared_ptr<const Tree> toTree);
+} // namespace eden
+} // namespace facebook
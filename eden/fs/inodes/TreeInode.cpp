@@ -623,6 +623,10 @@ void TreeInode::materialize(const RenameLock* renameLock) {
     // says we are materialized but we don't actually have overlay data present
     // we won't have any state indicating which source control hash our
     // contents are from.
+    //
+    // If a checkout has deferred writing out our data, our parent's update is
+    // deferred along with it.
+    CheckoutContext* deferredTo = nullptr;
     {
       auto contents = contents_.wlock();
       // Double check that we still need to be materialized
@@ -630,13 +634,14 @@ void TreeInode::materialize(const RenameLock* renameLock) {
         return;
       }
       contents->setMaterialized();
-      getOverlay()->saveOverlayDir(this->getNodeId(), *contents);
+      deferredTo = saveOverlayDir(nullptr, *contents);
     }
 
     // Mark ourself materialized in our parent directory (if we have one)
     auto loc = getLocationInfo(*renameLock);
     if (loc.parent && !loc.unlinked) {
-      loc.parent->childMaterialized(*renameLock, loc.name, getNodeId());
+      loc.parent->childMaterialized(
+          *renameLock, loc.name, getNodeId(), deferredTo);
     }
   }
 }
@@ -647,7 +652,8 @@ void TreeInode::materialize(const RenameLock* renameLock) {
 void TreeInode::childMaterialized(
     const RenameLock& renameLock,
     PathComponentPiece childName,
-    fusell::InodeNumber childNodeId) {
+    fusell::InodeNumber childNodeId,
+    CheckoutContext* ctx) {
   {
     auto contents = contents_.wlock();
     auto iter = contents->entries.find(childName);
@@ -666,21 +672,23 @@ void TreeInode::childMaterialized(
 
     childEntry.setMaterialized(childNodeId);
     contents->setMaterialized();
-    getOverlay()->saveOverlayDir(this->getNodeId(), *contents);
+    ctx = saveOverlayDir(ctx, *contents);
   }
 
   // If we have a parent directory, ask our parent to materialize itself
   // and mark us materialized when it does so.
   auto location = getLocationInfo(renameLock);
   if (location.parent && !location.unlinked) {
-    location.parent->childMaterialized(renameLock, location.name, getNodeId());
+    location.parent->childMaterialized(
+        renameLock, location.name, getNodeId(), ctx);
   }
 }
 
 void TreeInode::childDematerialized(
     const RenameLock& renameLock,
     PathComponentPiece childName,
-    Hash childScmHash) {
+    Hash childScmHash,
+    CheckoutContext* ctx) {
   {
     auto contents = contents_.wlock();
     auto iter = contents->entries.find(childName);
@@ -709,7 +717,7 @@ void TreeInode::childDematerialized(
     // saveOverlayPostCheckout() on this directory, and here we will check to
     // see if we can dematerialize ourself.
     contents->setMaterialized();
-    getOverlay()->saveOverlayDir(this->getNodeId(), *contents);
+    ctx = saveOverlayDir(ctx, *contents);
   }
 
   // We are materialized now.
@@ -717,10 +725,31 @@ void TreeInode::childDematerialized(
   // and mark us materialized when it does so.
   auto location = getLocationInfo(renameLock);
   if (location.parent && !location.unlinked) {
-    location.parent->childMaterialized(renameLock, location.name, getNodeId());
+    location.parent->childMaterialized(
+        renameLock, location.name, getNodeId(), ctx);
   }
 }
 
+CheckoutContext* TreeInode::saveOverlayDir(
+    CheckoutContext* ctx,
+    const Dir& contents) {
+  if (!ctx) {
+    // A checkout may still be holding back a write of our data, in which case
+    // our contents may refer to materialized children whose data it is also
+    // holding back.  Writing our data now could leave it referring to missing
+    // child data if we crashed before the checkout finished, so leave the
+    // write to the checkout.
+    auto* checkout = getMount()->getDeferringCheckout();
+    if (checkout && checkout->isOverlayDirWriteDeferred(getNodeId())) {
+      return checkout;
+    }
+  } else if (ctx->deferOverlayDirWrite(inodePtrFromThis())) {
+    return ctx;
+  }
+  getOverlay()->saveOverlayDir(getNodeId(), contents);
+  return nullptr;
+}
+
 TreeInode::Dir TreeInode::buildDirFromTree(
     const Tree* tree,
     const struct timespec& lastCheckoutTime,
@@ -754,6 +783,12 @@ TreeInode::create(PathComponentPiece name, mode_t mode, int /*flags*/) {
   // We need to scope the write lock as the getattr call below implicitly
   // wants to acquire a read lock.
   {
+    // Hold the rename lock in shared mode while we update our overlay data.
+    // A checkout writes out the directory data it has deferred with the
+    // rename lock held in exclusive mode, and our write must not land in the
+    // middle of that.
+    auto renameLock = getMount()->acquireSharedRenameLock();
+
     // Acquire our contents lock
     auto contents = contents_.wlock();
 
@@ -812,7 +847,7 @@ TreeInode::create(PathComponentPiece name, mode_t mode, int /*flags*/) {
     auto now = getNow();
     contents->timeStamps.ctime = now;
     contents->timeStamps.mtime = now;
-    this->getOverlay()->saveOverlayDir(getNodeId(), *contents);
+    saveOverlayDir(nullptr, *contents);
   }
 
   invalidateFuseCacheIfRequired(name);
@@ -848,6 +883,9 @@ FileInodePtr TreeInode::symlink(
   // We need to scope the write lock as the getattr call below implicitly
   // wants to acquire a read lock.
   {
+    // Hold the rename lock in shared mode, as in create().
+    auto renameLock = getMount()->acquireSharedRenameLock();
+
     // Acquire our contents lock
     auto contents = contents_.wlock();
 
@@ -919,7 +957,7 @@ FileInodePtr TreeInode::symlink(
     contents->timeStamps.mtime = now;
     contents->timeStamps.ctime = now;
 
-    this->getOverlay()->saveOverlayDir(getNodeId(), *contents);
+    saveOverlayDir(nullptr, *contents);
   }
 
   invalidateFuseCacheIfRequired(name);
@@ -954,6 +992,9 @@ FileInodePtr TreeInode::mknod(PathComponentPiece name, mode_t mode, dev_t dev) {
   // We need to scope the write lock as the getattr call below implicitly
   // wants to acquire a read lock.
   {
+    // Hold the rename lock in shared mode, as in create().
+    auto renameLock = getMount()->acquireSharedRenameLock();
+
     // Acquire our contents lock
     auto contents = contents_.wlock();
 
@@ -997,7 +1038,7 @@ FileInodePtr TreeInode::mknod(PathComponentPiece name, mode_t mode, dev_t dev) {
     contents->timeStamps.mtime = currentTime;
     contents->timeStamps.ctime = currentTime;
 
-    this->getOverlay()->saveOverlayDir(getNodeId(), *contents);
+    saveOverlayDir(nullptr, *contents);
   }
 
   invalidateFuseCacheIfRequired(name);
@@ -1014,6 +1055,9 @@ TreeInodePtr TreeInode::mkdir(PathComponentPiece name, mode_t mode) {
 
   TreeInodePtr newChild;
   {
+    // Hold the rename lock in shared mode, as in create().
+    auto renameLock = getMount()->acquireSharedRenameLock();
+
     // Acquire our contents lock
     auto contents = contents_.wlock();
 
@@ -1066,7 +1110,7 @@ TreeInodePtr TreeInode::mkdir(PathComponentPiece name, mode_t mode) {
     inodeMap->inodeCreated(newChild);
 
     // Save our updated overlay data
-    overlay->saveOverlayDir(getNodeId(), *contents);
+    saveOverlayDir(nullptr, *contents);
   }
 
   invalidateFuseCacheIfRequired(name);
@@ -1110,9 +1154,34 @@ folly::Future<folly::Unit> TreeInode::removeImpl(
     return makeFuture<Unit>(InodeError(checkResult, child));
   }
 
-  // Acquire the rename lock since we need to update our child's location
-  auto renameLock = getMount()->acquireRenameLock();
+  // Set the flushKernelCache parameter to true unless this was triggered by a
+  // FUSE request, in which case the kernel will automatically update its
+  // cache correctly.  Check this now, since we may finish the remove on
+  // another thread.
+  bool flushKernelCache = !fusell::RequestData::isFuseRequest();
+
+  // Acquire the rename lock since we need to update our child's location.
+  // This waits until no checkout is updating this directory.
+  return getMount()
+      ->acquireRenameLockForDirs(getNodeId(), getNodeId())
+      .then([self = inodePtrFromThis(),
+             name = std::move(name),
+             flushKernelCache,
+             attemptNum](RenameLock&& renameLock) mutable {
+        return self->removeLocked<InodePtrType>(
+            std::move(renameLock),
+            std::move(name),
+            flushKernelCache,
+            attemptNum);
+      });
+}
 
+template <typename InodePtrType>
+folly::Future<folly::Unit> TreeInode::removeLocked(
+    RenameLock&& renameLock,
+    PathComponent name,
+    bool flushKernelCache,
+    unsigned int attemptNum) {
   // Get the path to the child, so we can update the journal later.
   // Make sure we only do this after we acquire the rename lock, so that the
   // path reported in the journal will be accurate.
@@ -1132,10 +1201,6 @@ folly::Future<folly::Unit> TreeInode::removeImpl(
   // Therefore leave the child parameter for tryRemoveChild() as null, and let
   // it remove whatever it happens to find with this name.
   const InodePtrType nullChildPtr;
-  // Set the flushKernelCache parameter to true unless this was triggered by a
-  // FUSE request, in which case the kernel will automatically update its
-  // cache correctly.
-  bool flushKernelCache = !fusell::RequestData::isFuseRequest();
   int errnoValue =
       tryRemoveChild(renameLock, name, nullChildPtr, flushKernelCache);
   if (errnoValue == 0) {
@@ -1245,8 +1310,7 @@ int TreeInode::tryRemoveChild(
     contents->timeStamps.ctime = now;
 
     // Update the on-disk overlay
-    auto overlay = this->getOverlay();
-    overlay->saveOverlayDir(getNodeId(), *contents);
+    saveOverlayDir(nullptr, *contents);
   }
   deletedInode.reset();
 
@@ -1381,10 +1445,27 @@ Future<Unit> TreeInode::rename(
     PathComponentPiece name,
     TreeInodePtr destParent,
     PathComponentPiece destName) {
+  // Wait until no checkout is updating either directory.
+  auto destParentNumber = destParent->getNodeId();
+  return getMount()
+      ->acquireRenameLockForDirs(getNodeId(), destParentNumber)
+      .then([self = inodePtrFromThis(),
+             nameCopy = name.copy(),
+             destParent = std::move(destParent),
+             destNameCopy = destName.copy()](RenameLock&& renameLock) {
+        return self->renameLocked(
+            std::move(renameLock), nameCopy, destParent, destNameCopy);
+      });
+}
+
+Future<Unit> TreeInode::renameLocked(
+    RenameLock&& renameLock,
+    PathComponentPiece name,
+    TreeInodePtr destParent,
+    PathComponentPiece destName) {
   bool needSrc = false;
   bool needDest = false;
   {
-    auto renameLock = getMount()->acquireRenameLock();
     materialize(&renameLock);
     if (destParent.get() != this) {
       destParent->materialize(&renameLock);
@@ -1564,13 +1645,12 @@ Future<Unit> TreeInode::doRename(
   locks.srcContents()->entries.erase(srcIter);
 
   // Save the overlay data
-  const auto& overlay = getOverlay();
-  overlay->saveOverlayDir(getNodeId(), *locks.srcContents());
+  saveOverlayDir(nullptr, *locks.srcContents());
   if (destParent.get() != this) {
     // We have already verified that destParent is not unlinked, and we are
     // holding the rename lock which prevents it from being renamed or unlinked
     // while we are operating, so getPath() must have a value here.
-    overlay->saveOverlayDir(destParent->getNodeId(), *locks.destContents());
+    destParent->saveOverlayDir(nullptr, *locks.destContents());
   }
 
   // Release the TreeInode locks before we write a journal entry.
@@ -1918,7 +1998,17 @@ Future<Unit> TreeInode::computeDiff(
     // their entry state.
     auto contents = std::move(contentsLock);
 
+    // When the diff is restricted to particular paths, skip the entries
+    // that are not at, above, or below any of them.
+    bool checkPaths = !context->includesAllOf(currentPath);
+    auto isIncluded = [&](PathComponentPiece name) {
+      return !checkPaths || context->includes(currentPath + name);
+    };
+
     auto processUntracked = [&](PathComponentPiece name, Entry* inodeEntry) {
+      if (!isIncluded(name)) {
+        return;
+      }
       bool entryIgnored = isIgnored;
       auto fileType = inodeEntry->isDirectory() ? GitIgnore::TYPE_DIR
                                                 : GitIgnore::TYPE_FILE;
@@ -1971,6 +2061,9 @@ Future<Unit> TreeInode::computeDiff(
     };
 
     auto processRemoved = [&](const TreeEntry& scmEntry) {
+      if (!isIncluded(scmEntry.getName())) {
+        return;
+      }
       if (scmEntry.isTree()) {
         deferredEntries.emplace_back(DeferredDiffEntry::createRemovedEntry(
             context, currentPath + scmEntry.getName(), scmEntry));
@@ -1984,6 +2077,9 @@ Future<Unit> TreeInode::computeDiff(
 
     auto processBothPresent = [&](const TreeEntry& scmEntry,
                                   Entry* inodeEntry) {
+      if (!isIncluded(scmEntry.getName())) {
+        return;
+      }
       // We only need to know the ignored status if this is a directory.
       // If this is a regular file on disk and in source control, then it
       // is always included since it is already tracked in source control.
@@ -2080,10 +2176,14 @@ Future<Unit> TreeInode::computeDiff(
           XLOG(DBG5) << "diff: file modified due to mode change: " << entryPath;
           context->callback->modifiedFile(entryPath, scmEntry);
         } else {
-          // TODO: Hopefully at some point we will track file sizes in the
-          // parent TreeInode::Entry and the TreeEntry.  Once we have file
-          // sizes, we could check for differing file sizes first, and
-          // avoid loading the blob if they are different.
+          // If the backing store supplied the size and SHA-1 of the
+          // source control blob, ModifiedBlobDiffEntry compares against
+          // those rather than fetching that blob's metadata.  The metadata
+          // for the current blob is normally already in the LocalStore,
+          // recorded when the tree that referenced it was imported.
+          //
+          // TODO: TreeInode::Entry does not record sizes, so we cannot
+          // rule out the file here without looking up its metadata.
           deferredEntries.emplace_back(DeferredDiffEntry::createModifiedEntry(
               context, entryPath, scmEntry, inodeEntry->getHash()));
         }
@@ -2136,7 +2236,12 @@ Future<Unit> TreeInode::computeDiff(
     load.finish();
   }
 
-  // Now process all of the deferred work.
+  context->directoryCompared();
+
+  // Now process all of the deferred work.  Entries that need data from the
+  // backing store get it through the DiffContext, which limits how many
+  // fetches are outstanding at once; entries that can be compared locally
+  // complete immediately.
   vector<Future<Unit>> deferredFutures;
   for (auto& entry : deferredEntries) {
     deferredFutures.push_back(entry->run());
@@ -2180,6 +2285,26 @@ Future<Unit> TreeInode::checkout(
   XLOG(DBG4) << "checkout: starting update of " << getLogPath() << ": "
              << (fromTree ? fromTree->getHash().toString() : "<none>")
              << " --> " << (toTree ? toTree->getHash().toString() : "<none>");
+  if (ctx->isCancelled()) {
+    // Leave this directory untouched.  Our parent reports this as an error
+    // for this path.
+    ctx->dirSkipped();
+    return makeFuture<Unit>(InodeError(
+        ECANCELED, InodePtr{inodePtrFromThis()}, "checkout cancelled"));
+  }
+  ctx->treeProcessed();
+
+  // Keep renames and unlinks out of this directory until we are done with its
+  // entries.  A dry run does not change anything, so it does not need to.
+  auto markBusy = !ctx->isDryRun();
+  if (markBusy) {
+    getMount()->startCheckoutDir(getNodeId());
+  }
+  SCOPE_FAIL {
+    if (markBusy) {
+      getMount()->finishCheckoutDir(getNodeId());
+    }
+  };
   vector<unique_ptr<CheckoutAction>> actions;
   vector<IncompleteInodeLoad> pendingLoads;
 
@@ -2192,17 +2317,38 @@ Future<Unit> TreeInode::checkout(
   }
 
   // Now start all of the checkout actions
+  vector<Future<Unit>> entryFutures;
   vector<Future<Unit>> actionFutures;
   for (const auto& action : actions) {
+    entryFutures.emplace_back(action->getEntryUpdatedFuture());
     actionFutures.emplace_back(action->run(ctx, getStore()));
   }
+
+  // Stop blocking renames and unlinks here as soon as every action is done
+  // with its entry in this directory, rather than once the checkout of every
+  // subdirectory has finished as well.
+  auto entriesUpdated = folly::collectAll(entryFutures)
+                            .then([markBusy, self = inodePtrFromThis()](
+                                      vector<folly::Try<Unit>>&&) {
+                              if (markBusy) {
+                                self->getMount()->finishCheckoutDir(
+                                    self->getNodeId());
+                              }
+                            });
+
   // Wait for all of the actions, and record any errors.
-  return folly::collectAll(actionFutures)
+  return folly::collectAll(
+             std::move(entriesUpdated), folly::collectAll(actionFutures))
       .then([ctx,
              self = inodePtrFromThis(),
              toTree = std::move(toTree),
-             actions =
-                 std::move(actions)](vector<folly::Try<Unit>> actionResults) {
+             actions = std::move(actions)](
+                std::tuple<
+                    folly::Try<Unit>,
+                    folly::Try<vector<folly::Try<Unit>>>>& results) {
+        // collectAll() never fails, so neither of these can hold an error.
+        auto& actionResults = std::get<1>(results).value();
+
         // Record any errors that occurred
         size_t numErrors = 0;
         for (size_t n = 0; n < actionResults.size(); ++n) {
@@ -2381,7 +2527,7 @@ unique_ptr<CheckoutAction> TreeInode::processCheckoutEntry(
             newScmEntry->getName(),
             modeFromTreeEntryType(newScmEntry->getType()),
             newScmEntry->getHash());
-        invalidateFuseCache(newScmEntry->getName());
+        invalidateFuseCacheForCheckout(ctx, newScmEntry->getName());
       }
     } else if (!newScmEntry) {
       // This file exists in the old tree, but is being removed in the new
@@ -2401,7 +2547,7 @@ unique_ptr<CheckoutAction> TreeInode::processCheckoutEntry(
             newScmEntry->getName(),
             modeFromTreeEntryType(newScmEntry->getType()),
             newScmEntry->getHash());
-        invalidateFuseCache(newScmEntry->getName());
+        invalidateFuseCacheForCheckout(ctx, newScmEntry->getName());
       }
     }
 
@@ -2497,27 +2643,29 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
 
     {
       std::unique_ptr<InodeBase> deletedInode;
+      auto renameLock = getMount()->acquireRenameLock();
       auto contents = contents_.wlock();
 
-      // The CheckoutContext should be holding the rename lock, so the entry
-      // at this name should still be the specified inode.
+      // We are marked busy for the duration of the checkout, so nobody else
+      // can have renamed or removed the entry at this name: it should still
+      // be the specified inode.
       auto it = contents->entries.find(name);
       if (it == contents->entries.end()) {
         auto bug = EDEN_BUG()
-            << "entry removed while holding rename lock during checkout: "
+            << "entry removed from busy directory during checkout: "
             << inode->getLogPath();
         return folly::makeFuture<Unit>(bug.toException());
       }
       if (it->second.getInode() != inode.get()) {
         auto bug = EDEN_BUG()
-            << "entry changed while holding rename lock during checkout: "
+            << "entry changed in busy directory during checkout: "
             << inode->getLogPath();
         return folly::makeFuture<Unit>(bug.toException());
       }
 
       // This is a file, so we can simply unlink it, and replace/remove the
       // entry as desired.
-      deletedInode = inode->markUnlinked(this, name, ctx->renameLock());
+      deletedInode = inode->markUnlinked(this, name, renameLock);
       if (newScmEntry) {
         DCHECK_EQ(newScmEntry->getName(), name);
         it->second = Entry(
@@ -2529,7 +2677,7 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
     }
 
     // Tell FUSE to invalidate its cache for this entry.
-    invalidateFuseCache(name);
+    invalidateFuseCacheForCheckout(ctx, name);
 
     // We don't save our own overlay data right now:
     // we'll wait to do that until the checkout operation finishes touching all
@@ -2592,7 +2740,7 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
           inserted = ret.second;
         }
         if (inserted) {
-          parentInode->invalidateFuseCache(name);
+          parentInode->invalidateFuseCacheForCheckout(ctx, name);
         } else {
           // Hmm.  Someone else already created a new entry in this location
           // before we had a chance to add our new entry.  We don't block new
@@ -2612,10 +2760,13 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
 }
 
 void TreeInode::invalidateFuseCache(PathComponentPiece name) {
-  auto* fuseChannel = getMount()->getFuseChannel();
-  if (fuseChannel) {
-    fuseChannel->invalidateEntry(getNodeId(), name);
-  }
+  getMount()->invalidateEntry(getNodeId(), name);
+}
+
+void TreeInode::invalidateFuseCacheForCheckout(
+    CheckoutContext* ctx,
+    PathComponentPiece name) {
+  ctx->invalidateEntry(getNodeId(), name);
 }
 
 void TreeInode::invalidateFuseCacheIfRequired(PathComponentPiece name) {
@@ -2635,6 +2786,11 @@ void TreeInode::saveOverlayPostCheckout(
     return;
   }
 
+  // Hold the rename lock while we update our materialization state and tell
+  // our parent about it, so that this cannot interleave with a concurrent
+  // materialize() call.  See the comments in materialize().
+  auto renameLock = getMount()->acquireRenameLock();
+
   bool isMaterialized;
   bool stateChanged;
   bool deleteSelf;
@@ -2710,10 +2866,12 @@ void TreeInode::saveOverlayPostCheckout(
                << " isMaterialized=" << isMaterialized;
 
     if (contents->isMaterialized()) {
-      // If we are materialized, write out our state to the overlay.
+      // If we are materialized, our state needs to be written to the overlay.
       // (It's possible our state is unchanged from what's already on disk,
       // but for now we can't detect this, and just always write it out.)
-      getOverlay()->saveOverlayDir(getNodeId(), *contents);
+      // The write is deferred until the checkout finishes, so it is shared
+      // with any updates made by our children or by our parent.
+      saveOverlayDir(ctx, *contents);
     } else {
       // If we are not materialized now, but we were before we'll need to
       // remove ourself from the overlay.  However, we wait to do this until
@@ -2723,7 +2881,7 @@ void TreeInode::saveOverlayPostCheckout(
 
   if (deleteSelf) {
     // If we should be removed entirely, delete ourself.
-    if (checkoutTryRemoveEmptyDir(ctx)) {
+    if (checkoutTryRemoveEmptyDir(renameLock)) {
       return;
     }
 
@@ -2736,42 +2894,50 @@ void TreeInode::saveOverlayPostCheckout(
   if (stateChanged) {
     // If our state changed, tell our parent.
     //
-    // TODO: Currently we end up writing out overlay data for TreeInodes pretty
-    // often during the checkout process.  Each time a child entry is processed
-    // we will likely end up rewriting data for it's parent TreeInode, and then
-    // once all children are processed we do another pass through here in
-    // saveOverlayPostCheckout() and possibly write it out again.
-    //
-    // It would be nicer if we could only save the data for each TreeInode
-    // once.  The downside of this is that the on-disk overlay state would be
-    // potentially inconsistent until the checkout completes.  There may be
-    // periods of time where a parent directory says the child is materialized
-    // when the child has decided to be dematerialized.  This would cause
-    // problems when we tried to load the overlay data later.  If we update the
-    // code to be able to handle this somehow then maybe we could avoid doing
-    // all of the intermediate updates to the parent as we process each child
-    // entry.
-    auto loc = getLocationInfo(ctx->renameLock());
+    // Neither our parent nor we write anything to disk here: the writes are
+    // all recorded in the CheckoutContext, which saves each TreeInode exactly
+    // once when the checkout completes.  It writes children before parents,
+    // and the overlay's checkout marker records that the on-disk state may be
+    // behind until then.
+    auto loc = getLocationInfo(renameLock);
     if (loc.parent && !loc.unlinked) {
       if (isMaterialized) {
-        loc.parent->childMaterialized(ctx->renameLock(), loc.name, getNodeId());
+        loc.parent->childMaterialized(renameLock, loc.name, getNodeId(), ctx);
       } else {
         loc.parent->childDematerialized(
-            ctx->renameLock(), loc.name, tree->getHash());
+            renameLock, loc.name, tree->getHash(), ctx);
       }
     }
 
-    // If we were dematerialized, remove our overlay data only after updating
-    // our parent.  This ensures that we always have overlay data on disk when
-    // our parent thinks we do.
-    if (!isMaterialized) {
+    // If we were dematerialized, remove our overlay data only after our
+    // parent's updated data has been written.  This ensures that we always
+    // have overlay data on disk when our parent thinks we do.
+    if (!isMaterialized && !ctx->deferOverlayDirRemoval(inodePtrFromThis())) {
       getOverlay()->removeOverlayData(getNodeId());
     }
   }
 }
 
-bool TreeInode::checkoutTryRemoveEmptyDir(CheckoutContext* ctx) {
-  auto location = getLocationInfo(ctx->renameLock());
+bool TreeInode::saveOverlayDirPostCheckout(OverlayDirWriteBatch& batch) {
+  auto contents = contents_.rlock();
+  if (!contents->isMaterialized()) {
+    return false;
+  }
+  batch.save(getNodeId(), *contents);
+  return true;
+}
+
+bool TreeInode::removeOverlayDirPostCheckout() {
+  auto contents = contents_.rlock();
+  if (contents->isMaterialized()) {
+    return false;
+  }
+  getOverlay()->removeOverlayData(getNodeId());
+  return true;
+}
+
+bool TreeInode::checkoutTryRemoveEmptyDir(const RenameLock& renameLock) {
+  auto location = getLocationInfo(renameLock);
   DCHECK(!location.unlinked);
   if (!location.parent) {
     // We can't ever remove the root directory.
@@ -2780,7 +2946,7 @@ bool TreeInode::checkoutTryRemoveEmptyDir(CheckoutContext* ctx) {
 
   bool flushKernelCache = true;
   auto errnoValue = location.parent->tryRemoveChild(
-      ctx->renameLock(), location.name, inodePtrFromThis(), flushKernelCache);
+      renameLock, location.name, inodePtrFromThis(), flushKernelCache);
   return (errnoValue == 0);
 }
 
@@ -30,6 +30,7 @@ class InodeDiffCallback;
 class InodeMap;
 class ObjectStore;
 class Overlay;
+class OverlayDirWriteBatch;
 class RenameLock;
 class Tree;
 class TreeEntry;
@@ -461,11 +462,16 @@ class TreeInode : public InodeBase {
    *   calling this method.  This ensures that the child always has overlay
    *   data on disk whenever its parent directory's overlay data indicates that
    *   the child is materialized.
+   * - During checkout the CheckoutContext should be passed in, in which case
+   *   the overlay write is deferred (see childDematerialized()).  The child
+   *   must also pass in the CheckoutContext its own write was deferred to, if
+   *   any, even when it is not part of the checkout (see saveOverlayDir()).
    */
   void childMaterialized(
       const RenameLock& renameLock,
       PathComponentPiece childName,
-      fusell::InodeNumber childNodeId);
+      fusell::InodeNumber childNodeId,
+      CheckoutContext* ctx = nullptr);
 
   /**
    * Update this directory when a child entry is dematerialized.
@@ -480,11 +486,17 @@ class TreeInode : public InodeBase {
    *   this method returns.  This ensures that the child always has overlay
    *   data on disk whenever its parent directory's overlay data indicates that
    *   the child is materialized.
+   *
+   * When called as part of a checkout operation the CheckoutContext should be
+   * passed in.  In that case the overlay write for this directory (and any
+   * parents that become materialized) is deferred until the checkout
+   * finishes, so that each directory is written at most once.
    */
   void childDematerialized(
       const RenameLock& renameLock,
       PathComponentPiece childName,
-      Hash childScmHash);
+      Hash childScmHash,
+      CheckoutContext* ctx = nullptr);
 
   /**
    * Internal API only for use by InodeMap.
@@ -510,6 +522,24 @@ class TreeInode : public InodeBase {
       folly::Optional<Hash> hash,
       mode_t mode);
 
+  /**
+   * Internal API only for use by CheckoutContext.
+   *
+   * Add this directory's overlay data to the given batch once a checkout
+   * operation has finished, if it is still materialized.  Returns true if
+   * data was saved.
+   */
+  bool saveOverlayDirPostCheckout(OverlayDirWriteBatch& batch);
+
+  /**
+   * Internal API only for use by CheckoutContext.
+   *
+   * Remove this directory's overlay data once a checkout operation has
+   * finished, if it is no longer materialized.  Returns true if data was
+   * removed.
+   */
+  bool removeOverlayDirPostCheckout();
+
   /**
    * Unload all unreferenced children under this tree (recursively).
    *
@@ -625,6 +655,15 @@ class TreeInode : public InodeBase {
    */
   void materialize(const RenameLock* renameLock = nullptr);
 
+  /**
+   * The rest of rename(), once it has acquired the rename lock.
+   */
+  folly::Future<folly::Unit> renameLocked(
+      RenameLock&& renameLock,
+      PathComponentPiece name,
+      TreeInodePtr destParent,
+      PathComponentPiece destName);
+
   folly::Future<folly::Unit> doRename(
       TreeRenameLocks&& locks,
       PathComponentPiece srcName,
@@ -664,6 +703,16 @@ class TreeInode : public InodeBase {
   folly::Future<folly::Unit>
   removeImpl(PathComponent name, InodePtr child, unsigned int attemptNum);
 
+  /**
+   * The rest of removeImpl(), once it has acquired the rename lock.
+   */
+  template <typename InodePtrType>
+  folly::Future<folly::Unit> removeLocked(
+      RenameLock&& renameLock,
+      PathComponent name,
+      bool flushKernelCache,
+      unsigned int attemptNum);
+
   /**
    * tryRemoveChild() actually unlinks a child from our entry list.
    *
@@ -787,6 +836,23 @@ class TreeInode : public InodeBase {
       std::vector<IncompleteInodeLoad>* pendingLoads);
   void saveOverlayPostCheckout(CheckoutContext* ctx, const Tree* tree);
 
+  /**
+   * Save this directory's overlay data, or defer saving it until the end of
+   * the checkout if ctx is non-null.
+   *
+   * Operations other than checkout pass a null ctx.  Their write is still
+   * deferred if the checkout returned by EdenMount::getDeferringCheckout()
+   * has a deferred write queued for this directory.
+   *
+   * Returns the CheckoutContext that the write was deferred to, or nullptr if
+   * the data was written out.  If the write was deferred, any resulting
+   * update to our parent's data must be deferred to the same checkout.
+   *
+   * The contents_ lock must be held, as well as the rename lock in either
+   * mode.
+   */
+  CheckoutContext* saveOverlayDir(CheckoutContext* ctx, const Dir& contents);
+
   /**
    * Send a request to the kernel to invalidate the FUSE cache for the given
    * child entry name.
@@ -797,6 +863,16 @@ class TreeInode : public InodeBase {
    */
   void invalidateFuseCache(PathComponentPiece name);
 
+  /**
+   * Invalidate the kernel FUSE cache for a child entry changed by a checkout.
+   *
+   * The invalidation is queued in the CheckoutContext and sent to the kernel
+   * later, so this may be called with the contents_ lock held.
+   */
+  void invalidateFuseCacheForCheckout(
+      CheckoutContext* ctx,
+      PathComponentPiece name);
+
   /**
    * Invalidate the kernel FUSE cache for this entry name only if we are not
    * being called from inside a FUSE request handler.
@@ -813,7 +889,7 @@ class TreeInode : public InodeBase {
    * The most likely cause of a failure is an ENOTEMPTY error if someone else
    * has already created a new file in a directory made empty by a checkout.
    */
-  FOLLY_NODISCARD bool checkoutTryRemoveEmptyDir(CheckoutContext* ctx);
+  FOLLY_NODISCARD bool checkoutTryRemoveEmptyDir(const RenameLock& renameLock);
 
   /**
    * Helper function called inside InodeBase::setattr to perform TreeInode
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <cstdio>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+DEFINE_uint64(dirs, 100, "The number of top-level directories to create");
+DEFINE_uint64(subdirs, 10, "The number of subdirectories in each directory");
+DEFINE_uint64(files, 5, "The number of files in each subdirectory");
+
+/**
+ * Overlay write counts summed over every checkout the benchmark ran, and
+ * reported once the benchmarks finish.
+ */
+static uint64_t totalCheckouts = 0;
+static uint64_t totalOverlayDirsWritten = 0;
+static uint64_t totalOverlayWritesCoalesced = 0;
+
+using namespace facebook::eden;
+using folly::to;
+using std::string;
+
+namespace {
+
+string dirName(uint64_t dir, uint64_t subdir) {
+  return to<string>("dir", dir, "/sub", subdir);
+}
+
+/**
+ * Build a mount with two commits that differ in one file in every
+ * subdirectory.
+ *
+ * A file in every subdirectory is also modified locally, so that every
+ * directory in the mount is materialized.  Each checkout then has to update
+ * the overlay data for every directory, and every changed file causes its
+ * parent directory (and all of its ancestors) to be updated again.  This is
+ * the pattern that deferring TreeInode overlay writes to the end of the
+ * checkout is designed to help with.
+ */
+std::unique_ptr<TestMount> makeCheckoutMount() {
+  FakeTreeBuilder builder1;
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      auto dirPath = dirName(dir, subdir);
+      for (uint64_t file = 0; file < FLAGS_files; ++file) {
+        builder1.setFile(
+            to<string>(dirPath, "/file", file), to<string>("contents ", file));
+      }
+      builder1.setFile(to<string>(dirPath, "/local"), "original\n");
+    }
+  }
+
+  auto builder2 = builder1.clone();
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      builder2.replaceFile(
+          to<string>(dirName(dir, subdir), "/file0"), "updated contents\n");
+    }
+  }
+
+  auto testMount = std::make_unique<TestMount>(builder1);
+  builder2.finalize(testMount->getBackingStore(), true);
+  auto commit2 = testMount->getBackingStore()->putCommit("2", builder2);
+  commit2->setReady();
+
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      testMount->overwriteFile(
+          to<string>(dirName(dir, subdir), "/local"), "modified\n");
+    }
+  }
+  return testMount;
+}
+
+} // namespace
+
+BENCHMARK(checkout_materialized_dirs, numIters) {
+  std::unique_ptr<TestMount> testMount;
+  BENCHMARK_SUSPEND {
+    testMount = makeCheckoutMount();
+  }
+
+  // Alternate between the two commits, so each iteration does the same
+  // amount of work.
+  std::array<Hash, 2> commits = {makeTestHash("2"), makeTestHash("1")};
+  for (size_t n = 0; n < numIters; ++n) {
+    auto result =
+        testMount->getEdenMount()->checkout(commits[n % commits.size()]).get();
+    folly::doNotOptimizeAway(result);
+
+    BENCHMARK_SUSPEND {
+      auto progress = testMount->getEdenMount()->getLastCheckoutProgress();
+      ++totalCheckouts;
+      totalOverlayDirsWritten += progress.overlayDirsWritten;
+      totalOverlayWritesCoalesced += progress.overlayWritesCoalesced;
+    }
+  }
+
+  BENCHMARK_SUSPEND {
+    testMount.reset();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  if (totalCheckouts > 0) {
+    printf(
+        "per checkout: %.1f overlay directories written, "
+        "%.1f overlay writes coalesced\n",
+        double(totalOverlayDirsWritten) / totalCheckouts,
+        double(totalOverlayWritesCoalesced) / totalCheckouts);
+  }
+  return 0;
+}
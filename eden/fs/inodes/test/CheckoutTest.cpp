@@ -12,13 +12,22 @@
 #include <folly/chrono/Conv.h>
 #include <folly/container/Array.h>
 #include <folly/test/TestUtils.h>
+#include <gflags/gflags.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "eden/fs/inodes/CheckoutPrefetcher.h"
+#include "eden/fs/inodes/Differ.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
+#include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/journal/Journal.h"
+#include "eden/fs/model/Tree.h"
 #include "eden/fs/service/PrettyPrinters.h"
+#include "eden/fs/service/ThriftUtil.h"
+#include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/testharness/FakeBackingStore.h"
 #include "eden/fs/testharness/FakeTreeBuilder.h"
 #include "eden/fs/testharness/TestChecks.h"
@@ -26,6 +35,8 @@
 #include "eden/fs/testharness/TestUtil.h"
 #include "eden/fs/utils/TimeUtil.h"
 
+DECLARE_uint64(checkout_prefetch_concurrency);
+
 using namespace facebook::eden;
 using namespace std::chrono_literals;
 using folly::Future;
@@ -614,6 +625,34 @@ TEST(Checkout, modifyThenCheckoutRevisionWithoutFile) {
           makeConflict(ConflictType::MODIFIED_REMOVED, "src/test.c")));
 }
 
+TEST(Checkout, modifiedLargeFileIsHashedOnThreadPool) {
+  // Modified files this large are hashed on the mount's thread pool, so
+  // status and checkout have to wait for the hash.  The contents all have the
+  // same size, so the comparison cannot be settled by the size alone.
+  constexpr size_t kSize = 1024 * 1024;
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/main.c", string(kSize, 'a'));
+  TestMount testMount{builder1};
+  testMount.startFuse();
+  auto edenMount = testMount.getEdenMount();
+
+  testMount.overwriteFile("src/main.c", string(kSize, 'b'));
+  auto status = diffMountForStatus(edenMount.get(), false).get(10s);
+  EXPECT_EQ(1, status->entries.size());
+  EXPECT_EQ(ScmFileStatus::MODIFIED, status->entries["src/main.c"]);
+
+  testMount.overwriteFile("src/main.c", string(kSize, 'c'));
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/main.c", "int main() { return 0; }\n");
+  builder2.finalize(testMount.getBackingStore(), true);
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto conflicts = edenMount->checkout(makeTestHash("2")).get(10s);
+  EXPECT_THAT(
+      conflicts,
+      UnorderedElementsAre(
+          makeConflict(ConflictType::MODIFIED_MODIFIED, "src/main.c")));
+}
+
 TEST(Checkout, createUntrackedFileAndCheckoutAsTrackedFile) {
   auto builder1 = FakeTreeBuilder();
   builder1.setFile("src/main.c", "// Some code.\n");
@@ -769,6 +808,235 @@ TEST(Checkout, removeSubdirectorySimple) {
   }
 }
 
+TEST(Checkout, deferredOverlayWritesPersistAfterCheckout) {
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/a/b/main.c", "int main() { return 0; }\n");
+  builder1.setFile("src/a/b/local.c", "original\n");
+  builder1.setFile("src/a/c/test.c", "testy tests\n");
+  builder1.setFile("src/a/c/other.c", "other\n");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/a/b/main.c", "int main() { return 1; }\n");
+  builder2.replaceFile("src/a/c/test.c", "more tests\n");
+
+  TestMount testMount{builder1};
+  builder2.finalize(testMount.getBackingStore(), true);
+  auto commit2 = testMount.getBackingStore()->putCommit("2", builder2);
+  commit2->setReady();
+
+  // Materialize src/a/b, but leave src/a/c unmaterialized.
+  testMount.overwriteFile("src/a/b/local.c", "modified\n");
+
+  auto checkoutResult = testMount.getEdenMount()->checkout(makeTestHash("2"));
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_EQ(0, checkoutResult.get().size());
+
+  // The on-disk overlay data must reflect the checkout once it completes.
+  auto overlay = testMount.getEdenMount()->getOverlay();
+  EXPECT_FALSE(overlay->checkoutWasInterrupted());
+  testMount.remount();
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/a/b/main.c"),
+      "int main() { return 1; }\n",
+      0644);
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/a/b/local.c"), "modified\n", 0644);
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/a/c/test.c"), "more tests\n", 0644);
+  EXPECT_FALSE(
+      testMount.getEdenMount()->getOverlay()->checkoutWasInterrupted());
+}
+
+TEST(Checkout, writesToDeferredDirectoriesWaitForCheckout) {
+  // Skip the prefetch, so that the checkout starts applying changes and then
+  // waits for the new src/lib tree.
+  gflags::FlagSaver flagSaver;
+  FLAGS_checkout_prefetch_concurrency = 0;
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("docs/README", "readme\n");
+  builder1.setFile("docs/local.txt", "original\n");
+  builder1.setFile("src/lib/lib.c", "int lib() { return 0; }\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  auto overlay = edenMount->getOverlay();
+  testMount.getFileInode("src/lib/lib.c");
+  testMount.overwriteFile("docs/local.txt", "modified\n");
+  auto docsInode = testMount.getTreeInode("docs");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("docs/README", "new readme\n");
+  builder2.replaceFile("src/lib/lib.c", "int lib() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  builder2.getRoot()->setReady();
+  builder2.setReady("docs");
+  builder2.setReady("src");
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_FALSE(checkoutResult.isReady());
+
+  // The checkout has finished updating docs, but is holding back writing out
+  // its overlay data.  Creating a directory inside docs writes out the new
+  // directory's data, but leaves writing docs itself to the checkout.
+  auto newDir = docsInode->mkdir(PathComponentPiece{"newdir"}, 0755);
+  EXPECT_TRUE(overlay->loadOverlayDir(newDir->getNodeId(), nullptr));
+  auto docsDir = overlay->loadOverlayDir(docsInode->getNodeId(), nullptr);
+  ASSERT_TRUE(docsDir.hasValue());
+  EXPECT_EQ(
+      docsDir->entries.end(),
+      docsDir->entries.find(PathComponentPiece{"newdir"}));
+
+  builder2.setAllReady();
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+
+  docsDir = overlay->loadOverlayDir(docsInode->getNodeId(), nullptr);
+  ASSERT_TRUE(docsDir.hasValue());
+  EXPECT_NE(
+      docsDir->entries.end(),
+      docsDir->entries.find(PathComponentPiece{"newdir"}));
+  EXPECT_FALSE(overlay->checkoutWasInterrupted());
+}
+
+TEST(Checkout, materializingInDeferredDirectoriesWaitsForCheckout) {
+  // Skip the prefetch, so that the checkout starts applying changes and then
+  // waits for the new src/lib tree.
+  gflags::FlagSaver flagSaver;
+  FLAGS_checkout_prefetch_concurrency = 0;
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("docs/README", "readme\n");
+  builder1.setFile("docs/notes.txt", "notes\n");
+  builder1.setFile("docs/local.txt", "original\n");
+  builder1.setFile("src/lib/lib.c", "int lib() { return 0; }\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  auto overlay = edenMount->getOverlay();
+  testMount.getFileInode("src/lib/lib.c");
+  testMount.overwriteFile("docs/local.txt", "modified\n");
+  auto docsInode = testMount.getTreeInode("docs");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("docs/README", "new readme\n");
+  builder2.replaceFile("src/lib/lib.c", "int lib() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  builder2.getRoot()->setReady();
+  builder2.setReady("docs");
+  builder2.setReady("src");
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_FALSE(checkoutResult.isReady());
+
+  auto isNotesMaterializedOnDisk = [&] {
+    auto docsDir = overlay->loadOverlayDir(docsInode->getNodeId(), nullptr);
+    if (!docsDir.hasValue()) {
+      ADD_FAILURE() << "no overlay data for docs";
+      return false;
+    }
+    auto it = docsDir->entries.find(PathComponentPiece{"notes.txt"});
+    if (it == docsDir->entries.end()) {
+      ADD_FAILURE() << "docs overlay data has no entry for notes.txt";
+      return false;
+    }
+    return it->second.isMaterialized();
+  };
+
+  // Modifying an existing file in docs materializes it, but docs' own data
+  // is still left for the checkout to write out.
+  testMount.overwriteFile("docs/notes.txt", "new notes\n");
+  EXPECT_FALSE(isNotesMaterializedOnDisk());
+
+  builder2.setAllReady();
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+  EXPECT_TRUE(isNotesMaterializedOnDisk());
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("docs/notes.txt"), "new notes\n", 0644);
+}
+
+TEST(Checkout, prefetchFetchesOnlyDataForLoadedInodes) {
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("a/b/loaded.txt", "loaded v1\n");
+  builder1.setFile("a/b/unloaded.txt", "unloaded v1\n");
+  builder1.setFile("c/d.txt", "d v1\n");
+  TestMount testMount{builder1};
+  testMount.getFileInode("a/b/loaded.txt");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("a/b/loaded.txt", "loaded v2\n");
+  builder2.replaceFile("a/b/unloaded.txt", "unloaded v2\n");
+  builder2.replaceFile("c/d.txt", "d v2\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  auto toTree = std::make_shared<const Tree>(builder2.getRoot()->get());
+
+  // Allow only one fetch at a time, to exercise the queueing.
+  auto edenMount = testMount.getEdenMount();
+  CheckoutPrefetcher prefetcher{edenMount->getObjectStore(), 1};
+  auto prefetchFuture = prefetcher.prefetch(
+      edenMount->getRootInode(), testMount.getRootTree(), toTree);
+  EXPECT_FALSE(prefetchFuture.isReady());
+
+  builder2.setAllReady();
+  ASSERT_TRUE(prefetchFuture.isReady());
+  prefetchFuture.get();
+
+  // The checkout only reads the loaded file's old and new blobs.  The other
+  // files just have their hashes updated, so they should not be fetched.
+  auto hasBlob = [&](StringPiece contents) {
+    return testMount.getLocalStore()->hasKey(
+        LocalStore::BlobFamily, Hash::sha1(contents));
+  };
+  EXPECT_EQ(2, prefetcher.getBlobsFetched());
+  EXPECT_TRUE(hasBlob("loaded v1\n"));
+  EXPECT_TRUE(hasBlob("loaded v2\n"));
+  EXPECT_FALSE(hasBlob("unloaded v2\n"));
+  EXPECT_FALSE(hasBlob("d v2\n"));
+
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("a/b/loaded.txt"), "loaded v2\n", 0644);
+}
+
+TEST(Checkout, journalReportsLocalChangesWhenStatusIsCached) {
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("a/x.txt", "x\n");
+  builder1.setFile("b/y.txt", "y\n");
+  builder1.setFile("c/z.txt", "z\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+
+  // One change made before the status request, and one after it.  The
+  // checkout should reuse the cached status for the first, and diff the
+  // second itself.
+  testMount.overwriteFile("a/x.txt", "local x\n");
+  auto status = diffMountForStatus(edenMount.get(), false).get();
+  EXPECT_EQ(1, status->entries.size());
+  testMount.overwriteFile("b/y.txt", "local y\n");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("c/z.txt", "new z\n");
+  builder2.finalize(testMount.getBackingStore(), true);
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+
+  auto sequence = edenMount->getJournal().getLatest()->toSequence;
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+
+  auto range = edenMount->getJournal().accumulateRange(sequence + 1);
+  ASSERT_TRUE(range);
+  EXPECT_THAT(
+      range->uncleanPaths,
+      UnorderedElementsAre(RelativePath{"a/x.txt"}, RelativePath{"b/y.txt"}));
+}
+
 // TODO:
 // - remove subdirectory
 //   - with no untracked/ignored files, it should get removed entirely
@@ -794,3 +1062,278 @@ TEST(Checkout, removeSubdirectorySimple) {
 //   - remove file, with modify conflict
 //   - remove file, with remove conflict
 //   - remove file, with a parent directory replaced with a file/symlink
+
+TEST(Checkout, reportsDeferredOverlayWrites) {
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/a.c", "a\n");
+  builder1.setFile("src/b.c", "b\n");
+  builder1.setFile("src/local.c", "local\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  // Materialize src, so that the checkout has to update its overlay data.
+  testMount.overwriteFile("src/local.c", "modified\n");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/a.c", "new a\n");
+  builder2.replaceFile("src/b.c", "new b\n");
+  builder2.finalize(testMount.getBackingStore(), true);
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto conflicts = edenMount->checkout(makeTestHash("2")).get(10s);
+  EXPECT_THAT(conflicts, UnorderedElementsAre());
+
+  // src is changed once for each file, but only written out once.
+  auto progress = edenMount->getLastCheckoutProgress();
+  EXPECT_EQ(CheckoutPhase::NONE, progress.phase);
+  EXPECT_LE(1, progress.overlayDirsWritten);
+  EXPECT_LE(1, progress.overlayWritesCoalesced);
+  EXPECT_EQ(CheckoutPhase::NONE, edenMount->getCheckoutProgress().phase);
+}
+
+TEST(Checkout, cancelBeforeApplyingChanges) {
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/main.c", "int main() { return 0; }\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  auto originalParents = edenMount->getParentCommits();
+  EXPECT_EQ(CheckoutPhase::NONE, edenMount->getCheckoutProgress().phase);
+  EXPECT_FALSE(edenMount->cancelCheckout());
+
+  // Leave the destination tree unavailable so the checkout stays in the
+  // preparing phase.
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/main.c", "int main() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_FALSE(checkoutResult.isReady());
+
+  auto progress = edenMount->getCheckoutProgress();
+  EXPECT_EQ(CheckoutPhase::PREPARING, progress.phase);
+  EXPECT_EQ(thriftHash(makeTestHash("2")), progress.toSnapshot);
+  EXPECT_FALSE(progress.cancelRequested);
+  EXPECT_TRUE(edenMount->cancelCheckout());
+  EXPECT_TRUE(edenMount->getCheckoutProgress().cancelRequested);
+
+  builder2.setAllReady();
+  ASSERT_TRUE(checkoutResult.isReady());
+  try {
+    checkoutResult.get();
+    FAIL() << "checkout should have been cancelled";
+  } catch (const std::system_error& ex) {
+    EXPECT_EQ(ECANCELED, ex.code().value());
+  }
+
+  // Nothing should have changed.
+  EXPECT_EQ(originalParents, edenMount->getParentCommits());
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/main.c"), "int main() { return 0; }\n", 0644);
+  EXPECT_EQ(CheckoutPhase::NONE, edenMount->getCheckoutProgress().phase);
+}
+
+TEST(Checkout, cancelWhileApplyingChanges) {
+  // Skip the prefetch, so that the checkout updates a and then waits for the
+  // new b tree.
+  gflags::FlagSaver flagSaver;
+  FLAGS_checkout_prefetch_concurrency = 0;
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("a/a.txt", "original a\n");
+  builder1.setFile("b/b.txt", "original b\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  testMount.getFileInode("a/a.txt");
+  testMount.getFileInode("b/b.txt");
+  auto originalParents = edenMount->getParentCommits();
+  auto sequence = edenMount->getJournal().getLatest()->toSequence;
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("a/a.txt", "new a\n");
+  builder2.replaceFile("b/b.txt", "new b\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  builder2.getRoot()->setReady();
+  builder2.setReady("a");
+  builder2.setReady("a/a.txt");
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_FALSE(checkoutResult.isReady());
+  EXPECT_EQ(CheckoutPhase::APPLYING, edenMount->getCheckoutProgress().phase);
+
+  EXPECT_TRUE(edenMount->cancelCheckout());
+  builder2.setAllReady();
+  ASSERT_TRUE(checkoutResult.isReady());
+  auto conflicts = checkoutResult.get();
+  ASSERT_EQ(1, conflicts.size());
+  EXPECT_EQ("b", conflicts[0].path);
+  EXPECT_EQ(ConflictType::ERROR, conflicts[0].type);
+
+  // Only part of the new commit was checked out, so the parent must not move.
+  EXPECT_EQ(originalParents, edenMount->getParentCommits());
+  EXPECT_FILE_INODE(testMount.getFileInode("a/a.txt"), "new a\n", 0644);
+  EXPECT_FILE_INODE(testMount.getFileInode("b/b.txt"), "original b\n", 0644);
+  EXPECT_EQ(CheckoutPhase::NONE, edenMount->getCheckoutProgress().phase);
+
+  // The file the checkout did update is reported as modified.
+  auto delta = edenMount->getJournal().accumulateRange(sequence + 1);
+  ASSERT_TRUE(delta);
+  EXPECT_EQ(originalParents.parent1(), delta->fromHash);
+  EXPECT_EQ(originalParents.parent1(), delta->toHash);
+  EXPECT_THAT(
+      delta->uncleanPaths, UnorderedElementsAre(RelativePath{"a/a.txt"}));
+}
+
+TEST(Checkout, renameOutsideBusyDirectoriesDuringCheckout) {
+  // Skip the prefetch, so that the checkout starts applying changes and then
+  // waits for the new src/lib tree.
+  gflags::FlagSaver flagSaver;
+  FLAGS_checkout_prefetch_concurrency = 0;
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/lib/lib.c", "int lib() { return 0; }\n");
+  builder1.setFile("src/util.c", "void util() {}\n");
+  builder1.setFile("docs/README", "readme\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  testMount.getFileInode("src/lib/lib.c");
+  testMount.getFileInode("src/util.c");
+  testMount.getFileInode("docs/README");
+  auto srcInode = testMount.getTreeInode("src");
+  auto docsInode = testMount.getTreeInode("docs");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/lib/lib.c", "int lib() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  builder2.getRoot()->setReady();
+  builder2.setReady("src");
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_FALSE(checkoutResult.isReady());
+  EXPECT_EQ(CheckoutPhase::APPLYING, edenMount->getCheckoutProgress().phase);
+
+  // The checkout does not touch docs, so renames inside it do not wait.
+  auto docsRename = docsInode->rename(
+      PathComponentPiece{"README"}, docsInode, PathComponentPiece{"README.md"});
+  ASSERT_TRUE(docsRename.isReady());
+  docsRename.get();
+
+  // The checkout is updating src, so renames inside it wait until it is done.
+  auto srcRename = srcInode->rename(
+      PathComponentPiece{"util.c"}, srcInode, PathComponentPiece{"util2.c"});
+  EXPECT_FALSE(srcRename.isReady());
+
+  builder2.setAllReady();
+  ASSERT_TRUE(srcRename.isReady());
+  srcRename.get();
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/lib/lib.c"),
+      "int lib() { return 1; }\n",
+      0644);
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/util2.c"), "void util() {}\n", 0644);
+  EXPECT_FILE_INODE(testMount.getFileInode("docs/README.md"), "readme\n", 0644);
+}
+
+TEST(Checkout, directoriesAreReleasedBeforeTheirSubdirectoriesFinish) {
+  // Skip the prefetch, so that the checkout updates src and src/lib and then
+  // waits for the new contents of src/lib/lib.c.
+  gflags::FlagSaver flagSaver;
+  FLAGS_checkout_prefetch_concurrency = 0;
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/lib/lib.c", "int lib() { return 0; }\n");
+  builder1.setFile("src/lib/other.c", "void other() {}\n");
+  builder1.setFile("src/util.c", "void util() {}\n");
+  builder1.setFile("docs/README", "readme\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+  testMount.getFileInode("src/lib/lib.c");
+  testMount.getFileInode("src/lib/other.c");
+  testMount.getFileInode("src/util.c");
+  auto rootInode = edenMount->getRootInode();
+  auto srcInode = testMount.getTreeInode("src");
+  auto libInode = testMount.getTreeInode("src/lib");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/lib/lib.c", "int lib() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  builder2.getRoot()->setReady();
+  builder2.setReady("src");
+  builder2.setReady("src/lib");
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL);
+  ASSERT_FALSE(checkoutResult.isReady());
+
+  // The checkout is done with the entries of the root and of src, even though
+  // it is still updating src/lib, so renames in them do not wait.
+  auto rootRename = rootInode->rename(
+      PathComponentPiece{"docs"}, rootInode, PathComponentPiece{"doc"});
+  ASSERT_TRUE(rootRename.isReady());
+  rootRename.get();
+  auto srcRename = srcInode->rename(
+      PathComponentPiece{"util.c"}, srcInode, PathComponentPiece{"util2.c"});
+  ASSERT_TRUE(srcRename.isReady());
+  srcRename.get();
+
+  // src/lib is still busy.
+  auto libRename = libInode->rename(
+      PathComponentPiece{"other.c"}, libInode, PathComponentPiece{"other2.c"});
+  EXPECT_FALSE(libRename.isReady());
+
+  builder2.setAllReady();
+  ASSERT_TRUE(libRename.isReady());
+  libRename.get();
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/lib/lib.c"),
+      "int lib() { return 1; }\n",
+      0644);
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/lib/other2.c"), "void other() {}\n", 0644);
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("src/util2.c"), "void util() {}\n", 0644);
+  EXPECT_FILE_INODE(testMount.getFileInode("doc/README"), "readme\n", 0644);
+}
+
+TEST(Checkout, dryRunDoesNotBlockRenames) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_checkout_prefetch_concurrency = 0;
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/main.c", "int main() { return 0; }\n");
+  builder1.setFile("src/util.c", "void util() {}\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+
+  // Leave src unavailable, so that the dry run waits while processing the
+  // root directory.
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/main.c", "int main() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), false);
+  builder2.getRoot()->setReady();
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  auto checkoutResult =
+      edenMount->checkout(makeTestHash("2"), CheckoutMode::DRY_RUN);
+  ASSERT_FALSE(checkoutResult.isReady());
+
+  auto rootInode = edenMount->getRootInode();
+  auto rootRename = rootInode->rename(
+      PathComponentPiece{"src"}, rootInode, PathComponentPiece{"source"});
+  ASSERT_TRUE(rootRename.isReady());
+  rootRename.get();
+
+  builder2.setAllReady();
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(checkoutResult.get(), UnorderedElementsAre());
+  EXPECT_FILE_INODE(
+      testMount.getFileInode("source/main.c"),
+      "int main() { return 0; }\n",
+      0644);
+}
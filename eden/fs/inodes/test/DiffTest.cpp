@@ -14,8 +14,11 @@
 #include <gtest/gtest.h>
 
 #include "eden/fs/inodes/DiffContext.h"
+#include "eden/fs/inodes/Differ.h"
+#include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
 #include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/inodes/TreeDiffer.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/testharness/FakeBackingStore.h"
 #include "eden/fs/testharness/FakeTreeBuilder.h"
@@ -1071,3 +1074,221 @@ TEST(DiffTest, diffRevisions) {
   EXPECT_THAT(
       result.getModified(), UnorderedElementsAre(RelativePath{"src/1.txt"}));
 }
+
+TEST(DiffTest, diffTreesSkipsUnchangedSubtrees) {
+  DiffTest test;
+
+  auto b2 = test.getBuilder().clone();
+  b2.replaceFile("src/a/b/3.txt", "New contents of 3.txt.\n");
+  b2.removeFile("src/1.txt");
+  b2.setFile("src/new.txt", "A new file.\n");
+  b2.removeFile("doc");
+  b2.setFile("doc", "doc is now a file.\n");
+  b2.finalize(test.getMount().getBackingStore(), /* setReady = */ true);
+
+  auto objectStore = test.getMount().getEdenMount()->getObjectStore();
+  auto fromTree =
+      objectStore->getTree(test.getBuilder().getRoot()->get().getHash()).get();
+  auto toTree = objectStore->getTree(b2.getRoot()->get().getHash()).get();
+
+  DiffResultsCallback callback;
+  DiffContext diffContext{&callback,
+                          /* listIgnored = */ false,
+                          objectStore,
+                          "",
+                          ""};
+  auto diffFuture =
+      diffTrees(&diffContext, RelativePathPiece{}, fromTree, toTree);
+  EXPECT_FUTURE_RESULT(diffFuture);
+  auto result = callback.extractResults();
+
+  // As with diffRevisions(), the first tree plays the role of the working
+  // copy and the second the role of the commit.
+  EXPECT_THAT(result.getErrors(), UnorderedElementsAre());
+  EXPECT_THAT(
+      result.getUntracked(),
+      UnorderedElementsAre(
+          RelativePath{"src/1.txt"}, RelativePath{"doc/readme.txt"}));
+  EXPECT_THAT(result.getIgnored(), UnorderedElementsAre());
+  EXPECT_THAT(
+      result.getRemoved(),
+      UnorderedElementsAre(RelativePath{"src/new.txt"}, RelativePath{"doc"}));
+  EXPECT_THAT(
+      result.getModified(),
+      UnorderedElementsAre(RelativePath{"src/a/b/3.txt"}));
+
+  // Only "", "src", "src/a", and "src/a/b" differ on both sides.
+  // "src/a/b/c" has the same hash in both trees and is never compared.
+  EXPECT_EQ(4, diffContext.getProgress().directoriesCompared);
+}
+
+TEST(DiffTest, diffTreesWaitsForBothSidesWhenOneFails) {
+  DiffTest test;
+  auto store = test.getMount().getBackingStore();
+
+  // Give src/1.txt different contents on each side, and leave both blobs
+  // pending in the backing store.
+  auto b2 = test.getBuilder().clone();
+  b2.replaceFile("src/1.txt", "This is the first version.\n");
+  b2.finalize(store, /* setReady = */ false);
+  b2.setReady("");
+  b2.setReady("src");
+  auto b3 = test.getBuilder().clone();
+  b3.replaceFile("src/1.txt", "This is the second version.\n");
+  b3.finalize(store, /* setReady = */ false);
+  b3.setReady("");
+  b3.setReady("src");
+
+  auto objectStore = test.getMount().getEdenMount()->getObjectStore();
+  auto fromTree = objectStore->getTree(b2.getRoot()->get().getHash()).get();
+  auto toTree = objectStore->getTree(b3.getRoot()->get().getHash()).get();
+
+  DiffResultsCallback callback;
+  DiffContext diffContext{&callback,
+                          /* listIgnored = */ false,
+                          objectStore,
+                          "",
+                          ""};
+  auto diffFuture =
+      diffTrees(&diffContext, RelativePathPiece{}, fromTree, toTree);
+  EXPECT_FALSE(diffFuture.isReady());
+
+  // A failure on one side must not complete the diff while the other
+  // side's fetch, which refers to the DiffContext, is still running.
+  b2.triggerError("src/1.txt", std::runtime_error("fetch failed"));
+  EXPECT_FALSE(diffFuture.isReady());
+
+  b3.setReady("src/1.txt");
+  EXPECT_FUTURE_RESULT(diffFuture);
+  auto result = callback.extractResults();
+  ASSERT_EQ(1, result.getErrors().size());
+  EXPECT_EQ(RelativePath{"src/1.txt"}, result.getErrors()[0].first);
+  EXPECT_THAT(result.getModified(), UnorderedElementsAre());
+  EXPECT_EQ(0, diffContext.getProgress().fetchesInFlight);
+}
+
+TEST(DiffTest, concurrentFetchesAreLimited) {
+  DiffTest test;
+  test.getMount().loadAllInodes();
+
+  // Change files in two separate subtrees, and leave the new trees pending
+  // in the backing store.
+  auto b2 = test.getBuilder().clone();
+  b2.replaceFile("src/a/b/3.txt", "New contents of 3.txt.\n");
+  b2.replaceFile("doc/readme.txt", "Someone read the docs.\n");
+  test.getMount().resetCommit(b2, /* setReady = */ false);
+
+  DiffResultsCallback callback;
+  DiffContext diffContext{&callback,
+                          /* listIgnored = */ false,
+                          test.getMount().getEdenMount()->getObjectStore(),
+                          "",
+                          "",
+                          /* maxConcurrentFetches = */ 1};
+  auto diffFuture = test.getMount().getEdenMount()->diff(&diffContext);
+  EXPECT_FALSE(diffFuture.isReady());
+
+  // Both "doc" and "src" need to be fetched, but only one may be in flight.
+  auto progress = diffContext.getProgress();
+  EXPECT_EQ(1, progress.fetchesInFlight);
+  EXPECT_EQ(1, progress.fetchesQueued);
+  EXPECT_EQ(1, progress.treesFetched);
+
+  b2.setAllReady();
+  EXPECT_FUTURE_RESULT(diffFuture);
+  auto result = callback.extractResults();
+  EXPECT_THAT(result.getErrors(), UnorderedElementsAre());
+  EXPECT_THAT(
+      result.getModified(),
+      UnorderedElementsAre(
+          RelativePath{"src/a/b/3.txt"}, RelativePath{"doc/readme.txt"}));
+
+  progress = diffContext.getProgress();
+  EXPECT_EQ(0, progress.fetchesInFlight);
+  EXPECT_EQ(0, progress.fetchesQueued);
+  // "doc", "src", "src/a", and "src/a/b"
+  EXPECT_EQ(4, progress.treesFetched);
+}
+
+TEST(DiffTest, failedFetchWaitsForTheOtherSideOfTheComparison) {
+  FakeTreeBuilder builder;
+  builder.setFile("a.txt", "one\n");
+  TestMount mount;
+  mount.initialize(builder, /* startReady = */ false);
+
+  auto b2 = builder.clone();
+  b2.replaceFile("a.txt", "two\n");
+  mount.resetCommit(b2, /* setReady = */ false);
+
+  // Comparing a.txt needs the metadata of both the old and the new blob.
+  DiffResultsCallback callback;
+  DiffContext diffContext{&callback,
+                          /* listIgnored = */ false,
+                          mount.getEdenMount()->getObjectStore(),
+                          "",
+                          ""};
+  auto diffFuture = mount.getEdenMount()->diff(&diffContext);
+  EXPECT_FALSE(diffFuture.isReady());
+
+  // The diff must not complete while the new blob is still being fetched,
+  // since that fetch refers to the DiffContext.
+  builder.triggerError("a.txt", std::runtime_error("fetch failed"));
+  EXPECT_FALSE(diffFuture.isReady());
+
+  b2.setReady("a.txt");
+  EXPECT_FUTURE_RESULT(diffFuture);
+  auto result = callback.extractResults();
+  ASSERT_EQ(1, result.getErrors().size());
+  EXPECT_EQ(RelativePath{"a.txt"}, result.getErrors()[0].first);
+  EXPECT_THAT(result.getModified(), UnorderedElementsAre());
+  EXPECT_EQ(0, diffContext.getProgress().fetchesInFlight);
+}
+
+TEST(DiffTest, cachedStatusIsUpdatedFromJournal) {
+  DiffTest test;
+  auto mount = test.getMount().getEdenMount();
+  using Entries = std::map<std::string, ScmFileStatus>;
+
+  auto status = diffMountForStatus(mount.get(), false).get();
+  EXPECT_EQ(Entries{}, status->entries);
+
+  test.getMount().overwriteFile("src/1.txt", "changed\n");
+  test.getMount().addFile("src/a/new.txt", "new\n");
+  test.getMount().deleteFile("doc/readme.txt");
+  status = diffMountForStatus(mount.get(), false).get();
+  EXPECT_EQ(
+      (Entries{{"src/1.txt", ScmFileStatus::MODIFIED},
+               {"src/a/new.txt", ScmFileStatus::ADDED},
+               {"doc/readme.txt", ScmFileStatus::REMOVED}}),
+      status->entries);
+
+  // The cached result matches the journal position it was computed at.
+  auto cached = mount->getCachedStatus();
+  ASSERT_TRUE(cached);
+  EXPECT_EQ(
+      mount->getJournal().getLatest()->toSequence, cached->journalSequence);
+  EXPECT_EQ(status->entries, cached->status.entries);
+
+  // Undoing the changes drops them from the result, while the entries for
+  // paths that did not change since the last request are kept.
+  test.getMount().overwriteFile("src/1.txt", "This is src/1.txt.\n");
+  test.getMount().deleteFile("src/a/new.txt");
+  status = diffMountForStatus(mount.get(), false).get();
+  EXPECT_EQ(
+      (Entries{{"doc/readme.txt", ScmFileStatus::REMOVED}}), status->entries);
+
+  // Changing an ignore file forces a full diff, since it changes the status
+  // of files that the journal does not mention.
+  test.getMount().addFile("src/debug.log", "log\n");
+  status = diffMountForStatus(mount.get(), false).get();
+  EXPECT_EQ(
+      (Entries{{"doc/readme.txt", ScmFileStatus::REMOVED},
+               {"src/debug.log", ScmFileStatus::ADDED}}),
+      status->entries);
+  test.getMount().addFile("src/.gitignore", "*.log\n");
+  status = diffMountForStatus(mount.get(), false).get();
+  EXPECT_EQ(
+      (Entries{{"doc/readme.txt", ScmFileStatus::REMOVED},
+               {"src/.gitignore", ScmFileStatus::ADDED}}),
+      status->entries);
+}
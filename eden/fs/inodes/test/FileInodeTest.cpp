@@ -10,17 +10,23 @@
 #include "eden/fs/inodes/FileInode.h"
 
 #include <folly/Format.h>
+#include <folly/synchronization/Baton.h>
 #include <folly/test/TestUtils.h>
 #include <gtest/gtest.h>
 #include <chrono>
 
+#include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileHandle.h"
+#include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/testharness/FakeBackingStore.h"
 #include "eden/fs/testharness/FakeTreeBuilder.h"
 #include "eden/fs/testharness/TestChecks.h"
 #include "eden/fs/testharness/TestMount.h"
 #include "eden/fs/testharness/TestUtil.h"
+#include "eden/fs/utils/UnboundedQueueThreadPool.h"
 
 using namespace facebook::eden;
 using folly::StringPiece;
@@ -427,6 +433,149 @@ TEST_F(FileInodeTest, truncatingMaterializesParent) {
   EXPECT_EQ(true, isInodeMaterialized(parent));
 }
 
+TEST_F(FileInodeTest, sha1TracksAppends) {
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto handle = inode->open(O_WRONLY | O_TRUNC).get();
+  EXPECT_EQ(Hash::sha1(StringPiece{""}), inode->getSha1().get());
+
+  handle->write("hello ", 0).get();
+  EXPECT_EQ(Hash::sha1(StringPiece{"hello "}), inode->getSha1().get());
+  handle->write("world", 6).get();
+  EXPECT_EQ(Hash::sha1(StringPiece{"hello world"}), inode->getSha1().get());
+
+  // Overwriting data that was already hashed must invalidate the hash.
+  handle->write("J", 0).get();
+  EXPECT_EQ(Hash::sha1(StringPiece{"Jello world"}), inode->getSha1().get());
+
+  fuse_setattr_in desired = {};
+  desired.size = 5;
+  desired.valid = FATTR_SIZE;
+  setFileAttr(inode, desired);
+  EXPECT_EQ(Hash::sha1(StringPiece{"Jello"}), inode->getSha1().get());
+}
+
+namespace {
+/**
+ * Returns a large file's contents, which vary enough that hashing the wrong
+ * range of them gives a different result.
+ */
+std::string makeLargeContents(size_t size) {
+  std::string contents(size, 'x');
+  for (size_t n = 0; n < contents.size(); n += 4096) {
+    contents[n] = 'a' + (n / 4096) % 26;
+  }
+  return contents;
+}
+
+/**
+ * Queue a task that keeps the mount's single-threaded thread pool busy until
+ * the returned Baton is posted.
+ */
+std::unique_ptr<folly::Baton<>> blockThreadPool(TestMount& mount) {
+  auto release = std::make_unique<folly::Baton<>>();
+  mount.getEdenMount()->getThreadPool()->add(
+      [release = release.get()] { release->wait(); });
+  return release;
+}
+} // namespace
+
+TEST_F(FileInodeTest, sha1OfLargeFile) {
+  // The hash of a large file is only computed on the thread pool once the
+  // mount has one.
+  mount_.startFuse();
+  auto contents = makeLargeContents(4 * 1024 * 1024);
+
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto handle = inode->open(O_WRONLY | O_TRUNC).get();
+  handle->write(contents, 0).get();
+
+  // Hold up the thread pool to check that the hash really is computed there.
+  auto release = blockThreadPool(mount_);
+  auto sha1Future = inode->getSha1();
+  EXPECT_FALSE(sha1Future.isReady());
+  release->post();
+  EXPECT_EQ(Hash::sha1(StringPiece{contents}), sha1Future.get(10s));
+
+  // A small append is hashed inline, picking up where the last hash left off.
+  contents.append("tail\n");
+  handle->write("tail\n", contents.size() - 5).get();
+  sha1Future = inode->getSha1();
+  ASSERT_TRUE(sha1Future.isReady());
+  EXPECT_EQ(Hash::sha1(StringPiece{contents}), sha1Future.get());
+}
+
+TEST_F(FileInodeTest, sha1OfLargeFileModifiedWhileHashing) {
+  mount_.startFuse();
+  auto contents = makeLargeContents(4 * 1024 * 1024);
+
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto handle = inode->open(O_WRONLY | O_TRUNC).get();
+  handle->write(contents, 0).get();
+  EXPECT_EQ(Hash::sha1(StringPiece{contents}), inode->getSha1().get(10s));
+
+  // Append enough that the next hash is computed in the background, starting
+  // from where the last one left off.
+  auto tail = makeLargeContents(512 * 1024);
+  handle->write(tail, contents.size()).get();
+  contents.append(tail);
+  auto release = blockThreadPool(mount_);
+  auto sha1Future = inode->getSha1();
+  ASSERT_FALSE(sha1Future.isReady());
+
+  // Change data that the background hash believes it has already covered.
+  // Its partial result is stale, so it must not be used or stored.
+  handle->write("X", 0).get();
+  contents[0] = 'X';
+  release->post();
+  EXPECT_EQ(Hash::sha1(StringPiece{contents}), sha1Future.get(10s));
+  EXPECT_EQ(Hash::sha1(StringPiece{contents}), inode->getSha1().get(10s));
+}
+
+TEST_F(FileInodeTest, isSameAsLargeModifiedFile) {
+  // Comparing a large modified file hashes it on the thread pool, so the
+  // result is only available asynchronously.
+  mount_.startFuse();
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto originalHash = inode->getBlobHash().value();
+  auto handle = inode->open(O_WRONLY | O_TRUNC).get();
+  handle->write(makeLargeContents(1024 * 1024), 0).get();
+
+  auto release = blockThreadPool(mount_);
+  auto sameAsHash = inode->isSameAs(originalHash, TreeEntryType::REGULAR_FILE);
+  release->post();
+  EXPECT_FALSE(sameAsHash.get(10s));
+
+  auto blob = mount_.getEdenMount()
+                  ->getObjectStore()
+                  ->getBlob(originalHash)
+                  .get(10s);
+  EXPECT_FALSE(inode->isSameAs(*blob, TreeEntryType::REGULAR_FILE).get(10s));
+}
+
+TEST_F(FileInodeTest, statUsesOverlayFileCache) {
+  mount_.overwriteFile("dir/a.txt", "cached\n");
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto overlay = mount_.getEdenMount()->getOverlay();
+
+  // With no file handle open, repeated stat() calls should reuse the
+  // descriptor cached by the overlay rather than reopening the file.
+  auto before = overlay->getFileCacheStats();
+  for (int n = 0; n < 5; ++n) {
+    EXPECT_EQ(7, inode->stat().get().st_size);
+  }
+  auto after = overlay->getFileCacheStats();
+  EXPECT_LE(after.misses - before.misses, 1);
+  EXPECT_GE(after.hits - before.hits, 4);
+
+  // Truncating the file must be visible through the cached descriptor.
+  fuse_setattr_in desired = {};
+  desired.size = 3;
+  desired.valid = FATTR_SIZE;
+  setFileAttr(inode, desired);
+  EXPECT_EQ(3, inode->stat().get().st_size);
+  EXPECT_EQ("cac", inode->readAll().get());
+}
+
 TEST(FileInodeTest_, truncatingDuringLoad) {
   FakeTreeBuilder builder;
   builder.setFiles({{"notready.txt", "Contents not ready.\n"}});
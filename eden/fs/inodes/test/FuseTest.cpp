@@ -7,10 +7,15 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
 #include "eden/fs/testharness/FakeFuse.h"
 #include "eden/fs/testharness/FakeTreeBuilder.h"
 #include "eden/fs/testharness/TestMount.h"
+#include "eden/fs/testharness/TestUtil.h"
 #include "eden/fs/utils/UnboundedQueueThreadPool.h"
 
 #include <folly/experimental/logging/xlog.h>
@@ -21,6 +26,25 @@ using namespace facebook::eden;
 using namespace std::literals::chrono_literals;
 using folly::ScopedEventBaseThread;
 using std::make_shared;
+using std::string;
+using testing::Contains;
+using testing::Pair;
+
+namespace {
+void sendInitRequest(FakeFuse& fuse) {
+  struct fuse_init_in initArg;
+  initArg.major = FUSE_KERNEL_VERSION;
+  initArg.minor = FUSE_KERNEL_MINOR_VERSION;
+  initArg.max_readahead = 0;
+  initArg.flags = 0;
+  auto reqID = fuse.sendRequest(FUSE_INIT, 1, initArg);
+  auto response = fuse.recvResponse();
+  EXPECT_EQ(reqID, response.header.unique);
+  EXPECT_EQ(0, response.header.error);
+  EXPECT_EQ(
+      sizeof(fuse_out_header) + sizeof(fuse_init_out), response.header.len);
+}
+} // namespace
 
 TEST(FuseTest, initMount) {
   ScopedEventBaseThread evbThread("test.main");
@@ -44,17 +68,7 @@ TEST(FuseTest, initMount) {
             ADD_FAILURE() << "startFuse() failed: " << folly::exceptionStr(ew);
           });
 
-  struct fuse_init_in initArg;
-  initArg.major = FUSE_KERNEL_VERSION;
-  initArg.minor = FUSE_KERNEL_MINOR_VERSION;
-  initArg.max_readahead = 0;
-  initArg.flags = 0;
-  auto reqID = fuse->sendRequest(FUSE_INIT, 1, initArg);
-  auto response = fuse->recvResponse();
-  EXPECT_EQ(reqID, response.header.unique);
-  EXPECT_EQ(0, response.header.error);
-  EXPECT_EQ(
-      sizeof(fuse_out_header) + sizeof(fuse_init_out), response.header.len);
+  sendInitRequest(*fuse);
 
   // TODO: EdenMount & FuseChannel currently have synchronization bugs where
   // they can cause invalid memory accesses if we do not wait for the init
@@ -66,3 +80,56 @@ TEST(FuseTest, initMount) {
   fuse->close();
   testMount.getEdenMount()->getFuseCompletionFuture().get(100ms);
 }
+
+TEST(FuseTest, checkoutSendsInvalidationsBeforeReturning) {
+  ScopedEventBaseThread evbThread("test.main");
+
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("src/main.c", "int main() { return 0; }\n");
+  TestMount testMount{builder1};
+  auto edenMount = testMount.getEdenMount();
+
+  auto fuse = make_shared<FakeFuse>();
+  testMount.registerFakeFuse(fuse);
+  auto threadPool = make_shared<UnboundedQueueThreadPool>(2, "EdenCPUThread");
+  auto initFuture =
+      edenMount->startFuse(evbThread.getEventBase(), threadPool, folly::none);
+  sendInitRequest(*fuse);
+  initFuture.get(100ms);
+
+  // Load the file, so that the checkout has to invalidate its entry.
+  auto srcInode = testMount.getTreeInode("src");
+  testMount.getFileInode("src/main.c");
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("src/main.c", "int main() { return 1; }\n");
+  builder2.finalize(testMount.getBackingStore(), true);
+  testMount.getBackingStore()->putCommit("2", builder2)->setReady();
+  edenMount->checkout(makeTestHash("2"), CheckoutMode::NORMAL).get(1s);
+
+  // Every invalidation must have been written by the time checkout returns,
+  // so read whatever is already there without waiting for more.
+  std::vector<std::pair<uint64_t, string>> invalidated;
+  while (fuse->hasPendingData()) {
+    auto response = fuse->recvResponse();
+    EXPECT_EQ(0, response.header.unique);
+    ASSERT_EQ(FUSE_NOTIFY_INVAL_ENTRY, response.header.error);
+    fuse_notify_inval_entry_out notify;
+    ASSERT_LE(sizeof(notify), response.body.size());
+    memcpy(&notify, response.body.data(), sizeof(notify));
+    ASSERT_LE(sizeof(notify) + notify.namelen, response.body.size());
+    invalidated.emplace_back(
+        notify.parent,
+        string(
+            reinterpret_cast<const char*>(response.body.data()) +
+                sizeof(notify),
+            notify.namelen));
+  }
+  EXPECT_THAT(
+      invalidated, Contains(Pair(srcInode->getNodeId().get(), "main.c")));
+
+  // Ending the session drains the invalidation thread before the channel is
+  // destroyed.
+  fuse->close();
+  edenMount->getFuseCompletionFuture().get(100ms);
+}
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <thread>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/InodeMap.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+DEFINE_uint64(num_files, 1000, "The number of loaded files to look up");
+
+using namespace facebook::eden;
+using folly::to;
+using std::string;
+using std::vector;
+
+namespace {
+
+string fileName(uint64_t n) {
+  return to<string>("dir", n % 16, "/file", n);
+}
+
+std::unique_ptr<TestMount> makeMount() {
+  FakeTreeBuilder builder;
+  for (uint64_t n = 0; n < FLAGS_num_files; ++n) {
+    builder.setFile(fileName(n), "contents\n");
+  }
+  return std::make_unique<TestMount>(builder);
+}
+
+/**
+ * Look up loaded inodes by number from numThreads threads at once, the way
+ * concurrent FUSE requests do.  The reported rate is the total number of
+ * lookups per second across all threads.
+ */
+void lookupLoadedInodes(size_t numIters, size_t numThreads) {
+  std::unique_ptr<TestMount> testMount;
+  vector<InodePtr> inodes;
+  vector<fusell::InodeNumber> numbers;
+  BENCHMARK_SUSPEND {
+    testMount = makeMount();
+    // Keep a reference to every inode so that they all stay loaded.
+    inodes.reserve(FLAGS_num_files);
+    numbers.reserve(FLAGS_num_files);
+    for (uint64_t n = 0; n < FLAGS_num_files; ++n) {
+      inodes.push_back(testMount->getInode(fileName(n)));
+      numbers.push_back(inodes.back()->getNodeId());
+    }
+  }
+
+  auto* inodeMap = testMount->getEdenMount()->getInodeMap();
+  vector<std::thread> threads;
+  threads.reserve(numThreads);
+  for (size_t t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t] {
+      // Start each thread at a different inode so that they do not all work
+      // on the same shard in lockstep.
+      size_t idx = t * numbers.size() / numThreads;
+      for (size_t iter = t; iter < numIters; iter += numThreads) {
+        auto inode = inodeMap->lookupInode(numbers[idx]).value();
+        folly::doNotOptimizeAway(inode);
+        if (++idx == numbers.size()) {
+          idx = 0;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  BENCHMARK_SUSPEND {
+    inodes.clear();
+    testMount.reset();
+  }
+}
+
+} // namespace
+
+BENCHMARK_PARAM(lookupLoadedInodes, 1)
+BENCHMARK_PARAM(lookupLoadedInodes, 2)
+BENCHMARK_PARAM(lookupLoadedInodes, 4)
+BENCHMARK_PARAM(lookupLoadedInodes, 8)
+BENCHMARK_PARAM(lookupLoadedInodes, 16)
+BENCHMARK_PARAM(lookupLoadedInodes, 32)
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
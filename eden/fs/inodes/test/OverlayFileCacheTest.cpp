@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/OverlayFileCache.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::eden;
+using fusell::InodeNumber;
+
+namespace {
+folly::File openDevNull() {
+  return folly::File("/dev/null", O_RDONLY);
+}
+} // namespace
+
+TEST(OverlayFileCache, reusesOpenFiles) {
+  OverlayFileCache cache(10);
+  size_t opens = 0;
+  auto open = [&] {
+    ++opens;
+    return openDevNull();
+  };
+
+  auto file1 = cache.get(InodeNumber{5}, open);
+  auto file2 = cache.get(InodeNumber{5}, open);
+  EXPECT_EQ(1, opens);
+  EXPECT_EQ(file1->fd(), file2->fd());
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(0, stats.evictions);
+}
+
+TEST(OverlayFileCache, evictsLeastRecentlyUsed) {
+  OverlayFileCache cache(2);
+  auto file1 = cache.get(InodeNumber{1}, openDevNull);
+  cache.get(InodeNumber{2}, openDevNull);
+  // Touch inode 1 so that inode 2 is the least recently used.
+  cache.get(InodeNumber{1}, openDevNull);
+  cache.get(InodeNumber{3}, openDevNull);
+
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(1, cache.getStats().evictions);
+
+  size_t opens = 0;
+  auto open = [&] {
+    ++opens;
+    return openDevNull();
+  };
+  EXPECT_EQ(file1->fd(), cache.get(InodeNumber{1}, open)->fd());
+  EXPECT_EQ(0, opens);
+  cache.get(InodeNumber{2}, open);
+  EXPECT_EQ(1, opens);
+}
+
+TEST(OverlayFileCache, evictedFilesStayOpenWhileReferenced) {
+  OverlayFileCache cache(1);
+  auto file1 = cache.get(InodeNumber{1}, openDevNull);
+  cache.get(InodeNumber{2}, openDevNull);
+  EXPECT_EQ(1, cache.getStats().evictions);
+
+  // The evicted descriptor must still be usable by the code that holds it.
+  EXPECT_NE(-1, fcntl(file1->fd(), F_GETFD));
+}
+
+TEST(OverlayFileCache, invalidate) {
+  OverlayFileCache cache(10);
+  size_t opens = 0;
+  auto open = [&] {
+    ++opens;
+    return openDevNull();
+  };
+
+  cache.get(InodeNumber{7}, open);
+  cache.invalidate(InodeNumber{7});
+  EXPECT_EQ(0, cache.size());
+  cache.get(InodeNumber{7}, open);
+  EXPECT_EQ(2, opens);
+
+  // Invalidating an inode that is not cached is a no-op.
+  cache.invalidate(InodeNumber{8});
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST(OverlayFileCache, invalidateWhileOpeningIsNotLost) {
+  OverlayFileCache cache(10);
+  size_t opens = 0;
+  auto open = [&] {
+    ++opens;
+    return openDevNull();
+  };
+
+  // Simulate the overlay file being replaced by another thread after
+  // openFile() opened the old one, but before get() could cache it.
+  cache.get(InodeNumber{7}, [&] {
+    auto file = open();
+    cache.invalidate(InodeNumber{7});
+    return file;
+  });
+  EXPECT_EQ(0, cache.size());
+
+  cache.get(InodeNumber{7}, open);
+  EXPECT_EQ(2, opens);
+  EXPECT_EQ(1, cache.size());
+  cache.get(InodeNumber{7}, open);
+  EXPECT_EQ(2, opens);
+}
+
+TEST(OverlayFileCache, zeroSizeDisablesCaching) {
+  OverlayFileCache cache(0);
+  size_t opens = 0;
+  auto open = [&] {
+    ++opens;
+    return openDevNull();
+  };
+
+  cache.get(InodeNumber{1}, open);
+  cache.get(InodeNumber{1}, open);
+  EXPECT_EQ(2, opens);
+  EXPECT_EQ(0, cache.size());
+}
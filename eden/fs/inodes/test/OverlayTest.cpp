@@ -9,6 +9,7 @@
  */
 #include "eden/fs/inodes/Overlay.h"
 
+#include <folly/experimental/TestUtil.h>
 #include <folly/test/TestUtils.h>
 #include <gtest/gtest.h>
 
@@ -25,6 +26,7 @@
 using namespace facebook::eden;
 using folly::Future;
 using folly::makeFuture;
+using folly::test::TemporaryDirectory;
 using folly::StringPiece;
 using std::string;
 
@@ -123,3 +125,173 @@ TEST_F(OverlayTest, testTimeStampsInOverlayOnMountAndUnmount) {
     expectTimeStampsEqual(beforeRemountDir, afterRemount);
   }
 }
+
+TEST_F(OverlayTest, nextInodeNumberIsRecordedOnCleanShutdown) {
+  mount_.addFile("dir/new.txt", "test\n");
+  auto maxInodeNumber = mount_.getFileInode("dir/new.txt")->getNodeId();
+
+  mount_.remount();
+  auto startupStats = mount_.getEdenMount()->getStartupStats();
+  EXPECT_FALSE(startupStats.scannedOverlay);
+
+  // Newly allocated inode numbers must not collide with the ones that
+  // existed before the remount.
+  mount_.addFile("dir/another.txt", "more\n");
+  auto newInodeNumber = mount_.getFileInode("dir/another.txt")->getNodeId();
+  EXPECT_LT(maxInodeNumber, newInodeNumber);
+}
+
+TEST(OverlayInfoFile, scansOverlayAfterUncleanShutdown) {
+  TemporaryDirectory testDir("eden_overlay_test");
+  auto localDir =
+      AbsolutePath{testDir.path().string()} + PathComponentPiece{"overlay"};
+
+  {
+    Overlay overlay{localDir};
+    EXPECT_FALSE(overlay.hadCleanShutdown());
+    overlay.saveNextInodeNumber(fusell::InodeNumber{100});
+  }
+
+  {
+    Overlay overlay{localDir};
+    EXPECT_TRUE(overlay.hadCleanShutdown());
+    EXPECT_EQ(fusell::InodeNumber{99}, overlay.getMaxRecordedInode());
+    // Simulate a crash by not calling saveNextInodeNumber() again.
+  }
+
+  {
+    Overlay overlay{localDir};
+    EXPECT_FALSE(overlay.hadCleanShutdown());
+    // The overlay is empty, so the scan only finds the root inode.
+    EXPECT_EQ(kRootNodeId, overlay.getMaxRecordedInode());
+  }
+}
+
+TEST(OverlayInfoFile, detectsInterruptedCheckout) {
+  TemporaryDirectory testDir("eden_overlay_test");
+  auto localDir =
+      AbsolutePath{testDir.path().string()} + PathComponentPiece{"overlay"};
+
+  {
+    Overlay overlay{localDir};
+    EXPECT_FALSE(overlay.checkoutWasInterrupted());
+    overlay.beginCheckout();
+    overlay.endCheckout();
+  }
+
+  {
+    Overlay overlay{localDir};
+    EXPECT_FALSE(overlay.checkoutWasInterrupted());
+    // Simulate a crash before the checkout's overlay writes completed.
+    overlay.beginCheckout();
+  }
+
+  {
+    Overlay overlay{localDir};
+    EXPECT_TRUE(overlay.checkoutWasInterrupted());
+  }
+
+  // The marker is only reported once.
+  Overlay overlay{localDir};
+  EXPECT_FALSE(overlay.checkoutWasInterrupted());
+}
+
+namespace {
+AbsolutePath makeOverlayPath(const TemporaryDirectory& testDir) {
+  return AbsolutePath{testDir.path().string()} + PathComponentPiece{"overlay"};
+}
+
+TreeInode::Dir makeDir(
+    std::initializer_list<std::tuple<StringPiece, mode_t, uint64_t>> children) {
+  TreeInode::Dir dir;
+  for (const auto& child : children) {
+    dir.entries.emplace(
+        PathComponentPiece{std::get<0>(child)},
+        std::get<1>(child),
+        fusell::InodeNumber{std::get<2>(child)});
+  }
+  return dir;
+}
+} // namespace
+
+TEST(OverlayDirStorage, sqliteStorageRoundTrip) {
+  TemporaryDirectory testDir("eden_overlay_test");
+  auto localDir = makeOverlayPath(testDir);
+
+  {
+    Overlay overlay{localDir, OverlayDirStorage::Sqlite};
+    EXPECT_EQ(OverlayDirStorage::Sqlite, overlay.getDirStorage());
+    overlay.saveOverlayDir(
+        kRootNodeId, makeDir({{"file.txt", S_IFREG | 0644, 5}}));
+  }
+
+  // The storage format is remembered by the overlay itself.
+  Overlay overlay{localDir};
+  EXPECT_EQ(OverlayDirStorage::Sqlite, overlay.getDirStorage());
+  auto dir = overlay.loadOverlayDir(kRootNodeId, nullptr);
+  ASSERT_TRUE(dir.hasValue());
+  ASSERT_EQ(1, dir->entries.size());
+  EXPECT_EQ(
+      fusell::InodeNumber{5},
+      dir->entries.begin()->second.getInodeNumber());
+  EXPECT_FALSE(overlay.loadOverlayDir(fusell::InodeNumber{5}, nullptr));
+  EXPECT_EQ(fusell::InodeNumber{5}, overlay.getMaxRecordedInode());
+
+  overlay.removeOverlayData(kRootNodeId);
+  EXPECT_FALSE(overlay.loadOverlayDir(kRootNodeId, nullptr));
+}
+
+TEST(OverlayDirStorage, writeBatch) {
+  for (auto storage : {OverlayDirStorage::Files, OverlayDirStorage::Sqlite}) {
+    TemporaryDirectory testDir("eden_overlay_test");
+    Overlay overlay{makeOverlayPath(testDir), storage};
+
+    auto batch = overlay.beginDirWrite();
+    batch.save(kRootNodeId, makeDir({{"sub", S_IFDIR | 0755, 2}}));
+    batch.save(
+        fusell::InodeNumber{2}, makeDir({{"a.txt", S_IFREG | 0644, 3}}));
+    if (storage == OverlayDirStorage::Sqlite) {
+      // Nothing is written until the batch is flushed.
+      EXPECT_FALSE(overlay.loadOverlayDir(kRootNodeId, nullptr));
+    }
+    batch.flush();
+
+    auto root = overlay.loadOverlayDir(kRootNodeId, nullptr);
+    ASSERT_TRUE(root.hasValue());
+    EXPECT_EQ(1, root->entries.size());
+    auto subdir = overlay.loadOverlayDir(fusell::InodeNumber{2}, nullptr);
+    ASSERT_TRUE(subdir.hasValue());
+    EXPECT_EQ(1, subdir->entries.size());
+  }
+}
+
+TEST(OverlayDirStorage, migrateFilesToSqlite) {
+  TemporaryDirectory testDir("eden_overlay_test");
+  auto localDir = makeOverlayPath(testDir);
+
+  Overlay overlay{localDir};
+  EXPECT_EQ(OverlayDirStorage::Files, overlay.getDirStorage());
+  overlay.saveOverlayDir(kRootNodeId, makeDir({{"sub", S_IFDIR | 0755, 2}}));
+  overlay.saveOverlayDir(
+      fusell::InodeNumber{2}, makeDir({{"a.txt", S_IFREG | 0644, 7}}));
+  // An unlinked directory that is not reachable from the root.
+  overlay.saveOverlayDir(fusell::InodeNumber{9}, makeDir({}));
+  // A materialized file, which must stay where it is.
+  overlay.createOverlayFile(fusell::InodeNumber{7}, timespec{});
+
+  EXPECT_EQ(3, overlay.migrateDirsToSqlite());
+  EXPECT_EQ(OverlayDirStorage::Sqlite, overlay.getDirStorage());
+
+  struct stat st;
+  EXPECT_NE(0, lstat(overlay.getFilePath(kRootNodeId).c_str(), &st));
+  EXPECT_EQ(
+      0, lstat(overlay.getFilePath(fusell::InodeNumber{7}).c_str(), &st));
+
+  auto subdir = overlay.loadOverlayDir(fusell::InodeNumber{2}, nullptr);
+  ASSERT_TRUE(subdir.hasValue());
+  EXPECT_EQ(1, subdir->entries.size());
+  EXPECT_EQ(fusell::InodeNumber{9}, overlay.getMaxRecordedInode());
+
+  // Migrating again is a no-op.
+  EXPECT_EQ(0, overlay.migrateDirsToSqlite());
+}
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/Sha1Batch.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+#include "eden/fs/utils/UnboundedQueueThreadPool.h"
+
+DEFINE_uint64(num_files, 1000, "The number of modified files to hash");
+DEFINE_uint64(file_size, 64 * 1024, "The size of each modified file");
+DEFINE_uint64(threads, 8, "The number of threads used for batched hashing");
+
+using namespace facebook::eden;
+using folly::to;
+using std::string;
+using std::vector;
+
+namespace {
+
+string fileName(uint64_t n) {
+  return to<string>("dir", n % 16, "/file", n);
+}
+
+/**
+ * Build a mount where every file has been modified locally, so that getSHA1()
+ * has to hash the file contents from the overlay rather than looking up the
+ * hash of the source control blob.
+ */
+std::unique_ptr<TestMount> makeSha1Mount() {
+  FakeTreeBuilder builder;
+  for (uint64_t n = 0; n < FLAGS_num_files; ++n) {
+    builder.setFile(fileName(n), "original\n");
+  }
+  auto testMount = std::make_unique<TestMount>(builder);
+
+  string contents(FLAGS_file_size, 'x');
+  for (uint64_t n = 0; n < FLAGS_num_files; ++n) {
+    testMount->overwriteFile(fileName(n), contents);
+  }
+  return testMount;
+}
+
+vector<string> allPaths() {
+  vector<string> paths;
+  paths.reserve(FLAGS_num_files);
+  for (uint64_t n = 0; n < FLAGS_num_files; ++n) {
+    paths.push_back(fileName(n));
+  }
+  return paths;
+}
+
+/**
+ * Modify the first byte of every file so that the next getSHA1() call cannot
+ * use a previously computed hash.
+ */
+void invalidateHashes(TestMount& testMount, uint64_t iteration) {
+  char c = 'a' + (iteration % 26);
+  for (uint64_t n = 0; n < FLAGS_num_files; ++n) {
+    auto file = testMount.getFileInode(fileName(n));
+    file->write(folly::StringPiece{&c, 1}, 0).get();
+  }
+}
+
+} // namespace
+
+BENCHMARK(getSha1_serial, numIters) {
+  std::unique_ptr<TestMount> testMount;
+  vector<string> paths;
+  BENCHMARK_SUSPEND {
+    testMount = makeSha1Mount();
+    paths = allPaths();
+  }
+
+  auto* edenMount = testMount->getEdenMount().get();
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    BENCHMARK_SUSPEND {
+      invalidateHashes(*testMount, iter);
+    }
+    vector<folly::Future<Hash>> futures;
+    futures.reserve(paths.size());
+    for (const auto& path : paths) {
+      futures.emplace_back(getSha1ForPath(edenMount, path));
+    }
+    auto results = folly::collectAll(futures).get();
+    folly::doNotOptimizeAway(results);
+  }
+
+  BENCHMARK_SUSPEND {
+    testMount.reset();
+  }
+}
+
+BENCHMARK_RELATIVE(getSha1_batch, numIters) {
+  std::unique_ptr<TestMount> testMount;
+  std::unique_ptr<UnboundedQueueThreadPool> threadPool;
+  vector<string> paths;
+  BENCHMARK_SUSPEND {
+    testMount = makeSha1Mount();
+    threadPool = std::make_unique<UnboundedQueueThreadPool>(
+        FLAGS_threads, "Sha1Bench");
+    paths = allPaths();
+  }
+
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    BENCHMARK_SUSPEND {
+      invalidateHashes(*testMount, iter);
+    }
+    auto results =
+        getSha1Batch(testMount->getEdenMount(), paths, threadPool.get()).get();
+    folly::doNotOptimizeAway(results);
+  }
+
+  BENCHMARK_SUSPEND {
+    threadPool.reset();
+    testMount.reset();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
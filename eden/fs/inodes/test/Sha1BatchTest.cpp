@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/Sha1Batch.h"
+
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+#include "eden/fs/utils/UnboundedQueueThreadPool.h"
+
+using namespace facebook::eden;
+using folly::ByteRange;
+using folly::StringPiece;
+using folly::to;
+using std::string;
+using std::vector;
+
+namespace {
+Hash sha1Of(StringPiece contents) {
+  return Hash::sha1(ByteRange{contents});
+}
+} // namespace
+
+TEST(Sha1Batch, resultsMatchInputOrder) {
+  FakeTreeBuilder builder;
+  vector<string> paths;
+  for (int n = 0; n < 20; ++n) {
+    auto path = to<string>("dir", n % 3, "/file", n);
+    builder.setFile(path, to<string>("contents ", n, "\n"));
+    paths.push_back(path);
+  }
+  builder.setSymlink("link", "dir0/file0");
+  TestMount testMount{builder};
+  testMount.overwriteFile("dir1/file1", "modified\n");
+
+  paths.push_back("link");
+  paths.push_back("does/not/exist");
+  paths.push_back("");
+
+  // Use a chunk size smaller than the batch so the work is spread across
+  // several tasks on the thread pool.
+  UnboundedQueueThreadPool threadPool(4, "Sha1Test");
+  auto results =
+      getSha1Batch(testMount.getEdenMount(), paths, &threadPool, 3).get();
+  ASSERT_EQ(paths.size(), results.size());
+
+  for (int n = 0; n < 20; ++n) {
+    ASSERT_TRUE(results[n].hasValue()) << paths[n];
+    auto expected =
+        n == 1 ? string{"modified\n"} : to<string>("contents ", n, "\n");
+    EXPECT_EQ(sha1Of(expected), results[n].value()) << paths[n];
+  }
+  EXPECT_TRUE(results[20].hasException());
+  EXPECT_TRUE(results[21].hasException());
+  EXPECT_TRUE(results[22].hasException());
+}
+
+TEST(Sha1Batch, inlineWithoutExecutor) {
+  FakeTreeBuilder builder;
+  builder.setFile("a", "apple\n");
+  builder.setFile("b", "banana\n");
+  TestMount testMount{builder};
+
+  auto results =
+      getSha1Batch(testMount.getEdenMount(), {"b", "a"}, nullptr).get();
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(sha1Of("banana\n"), results[0].value());
+  EXPECT_EQ(sha1Of("apple\n"), results[1].value());
+}
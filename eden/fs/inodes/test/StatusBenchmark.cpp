@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+
+#include "eden/fs/inodes/Differ.h"
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+DEFINE_uint64(dirs, 100, "The number of top-level directories to create");
+DEFINE_uint64(subdirs, 10, "The number of subdirectories in each directory");
+DEFINE_uint64(files, 5, "The number of files in each subdirectory");
+
+DECLARE_uint64(diff_max_concurrent_fetches);
+
+using namespace facebook::eden;
+using folly::to;
+using std::string;
+
+namespace {
+
+string dirName(uint64_t dir, uint64_t subdir) {
+  return to<string>("dir", dir, "/sub", subdir);
+}
+
+/**
+ * Build a mount whose working copy differs from its parent commit in one
+ * file in every subdirectory, and in one locally modified file in every
+ * subdirectory.
+ *
+ * The mount is reset to a commit with different file contents without
+ * changing the working copy, so status has to fetch every changed tree
+ * from the backing store and compare the materialized files against it.
+ */
+std::unique_ptr<TestMount> makeStatusMount() {
+  FakeTreeBuilder builder1;
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      auto dirPath = dirName(dir, subdir);
+      for (uint64_t file = 0; file < FLAGS_files; ++file) {
+        builder1.setFile(
+            to<string>(dirPath, "/file", file), to<string>("contents ", file));
+      }
+      builder1.setFile(to<string>(dirPath, "/local"), "original\n");
+    }
+  }
+
+  auto builder2 = builder1.clone();
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      builder2.replaceFile(
+          to<string>(dirName(dir, subdir), "/file0"), "updated contents\n");
+    }
+  }
+
+  auto testMount = std::make_unique<TestMount>(builder1);
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      testMount->overwriteFile(
+          to<string>(dirName(dir, subdir), "/local"), "modified\n");
+    }
+  }
+  testMount->resetCommit(builder2, /* setReady = */ true);
+  return testMount;
+}
+
+void runStatus(size_t numIters, bool listIgnored) {
+  std::unique_ptr<TestMount> testMount;
+  BENCHMARK_SUSPEND {
+    testMount = makeStatusMount();
+  }
+
+  auto mount = testMount->getEdenMount();
+  for (size_t n = 0; n < numIters; ++n) {
+    // Discard the previous result so that every iteration does a full diff.
+    mount->setCachedStatus(nullptr);
+    auto status = diffMountForStatus(mount.get(), listIgnored).get();
+    folly::doNotOptimizeAway(status);
+  }
+
+  BENCHMARK_SUSPEND {
+    testMount.reset();
+  }
+}
+
+} // namespace
+
+BENCHMARK(status_modified_tree, numIters) {
+  runStatus(numIters, /* listIgnored = */ false);
+}
+
+BENCHMARK(status_modified_tree_list_ignored, numIters) {
+  runStatus(numIters, /* listIgnored = */ true);
+}
+
+BENCHMARK(status_modified_tree_one_fetch_at_a_time, numIters) {
+  auto oldLimit = FLAGS_diff_max_concurrent_fetches;
+  FLAGS_diff_max_concurrent_fetches = 1;
+  runStatus(numIters, /* listIgnored = */ false);
+  FLAGS_diff_max_concurrent_fetches = oldLimit;
+}
+
+BENCHMARK(status_cached_one_file_changed, numIters) {
+  std::unique_ptr<TestMount> testMount;
+  BENCHMARK_SUSPEND {
+    testMount = makeStatusMount();
+  }
+
+  auto mount = testMount->getEdenMount();
+  (void)diffMountForStatus(mount.get(), /* listIgnored = */ false).get();
+  for (size_t n = 0; n < numIters; ++n) {
+    BENCHMARK_SUSPEND {
+      testMount->overwriteFile(
+          to<string>(dirName(n % FLAGS_dirs, 0), "/local"),
+          to<string>("modified ", n, "\n"));
+    }
+    auto status =
+        diffMountForStatus(mount.get(), /* listIgnored = */ false).get();
+    folly::doNotOptimizeAway(status);
+  }
+
+  BENCHMARK_SUSPEND {
+    testMount.reset();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -9,66 +9,471 @@
  */
 #include "JournalDelta.h"
 
+#include <folly/Conv.h>
+#include <folly/experimental/logging/xlog.h>
+#include <algorithm>
+#include <stdexcept>
+
 namespace facebook {
 namespace eden {
 
+namespace {
+[[noreturn]] void throwInvalidJournal(folly::StringPiece reason) {
+  throw std::invalid_argument(
+      folly::to<std::string>("invalid serialized journal: ", reason));
+}
+
+std::string hashToBinary(const Hash& hash) {
+  auto bytes = hash.getBytes();
+  return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+Hash binaryToHash(const std::string& binary) {
+  return Hash{folly::ByteRange{folly::StringPiece{binary}}};
+}
+} // namespace
+
+constexpr size_t Journal::kDefaultMemoryLimit;
+
 void Journal::addDelta(std::unique_ptr<JournalDelta>&& delta) {
   {
     auto deltaState = deltaState_.wlock();
+    appendDelta(*deltaState, *delta);
+    truncateIfNecessary(*deltaState);
+  }
+
+  // Careful to call the subscribers with no locks held.
+  notifySubscribers();
+}
 
-    delta->toSequence = deltaState->nextSequence++;
-    delta->fromSequence = delta->toSequence;
+size_t Journal::entryMemoryUsage(const Entry& entry) {
+  return sizeof(Entry) + entry.changes.capacity() * sizeof(PathChange);
+}
 
-    delta->toTime = std::chrono::steady_clock::now();
-    delta->fromTime = delta->toTime;
+void Journal::appendDelta(DeltaState& deltaState, const JournalDelta& delta) {
+  Entry entry;
+  entry.info.toSequence = deltaState.nextSequence++;
+  entry.info.fromSequence = entry.info.toSequence;
 
-    delta->previous = deltaState->latest;
+  entry.info.toTime = std::chrono::steady_clock::now();
+  entry.info.fromTime = entry.info.toTime;
+
+  entry.info.fromHash = delta.fromHash;
+  entry.info.toHash = delta.toHash;
+  // If the hashes were not set to anything, default to copying
+  // the value from the prior journal entry
+  if (!deltaState.entries.empty() && delta.fromHash == kZeroHash &&
+      delta.toHash == kZeroHash) {
+    entry.info.fromHash = deltaState.entries.back().info.toHash;
+    entry.info.toHash = entry.info.fromHash;
+  }
 
-    // If the hashes were not set to anything, default to copying
-    // the value from the prior journal entry
-    if (delta->previous && delta->fromHash == kZeroHash &&
-        delta->toHash == kZeroHash) {
-      delta->fromHash = delta->previous->toHash;
-      delta->toHash = delta->fromHash;
+  // accumulateRange() relies on the created paths of an entry being
+  // processed before the removed paths, and those before the changed paths.
+  entry.changes.reserve(
+      delta.createdFilesInOverlay.size() + delta.removedFilesInOverlay.size() +
+      delta.changedFilesInOverlay.size() + delta.uncleanPaths.size());
+  auto addChanges = [&](const std::unordered_set<RelativePath>& paths,
+                        ChangeType type) {
+    for (const auto& path : paths) {
+      entry.changes.push_back(PathChange{deltaState.paths.intern(path), type});
     }
+  };
+  addChanges(delta.createdFilesInOverlay, ChangeType::Created);
+  addChanges(delta.removedFilesInOverlay, ChangeType::Removed);
+  addChanges(delta.changedFilesInOverlay, ChangeType::Changed);
+  addChanges(delta.uncleanPaths, ChangeType::Unclean);
 
-    deltaState->latest = std::shared_ptr<const JournalDelta>(std::move(delta));
+  deltaState.entriesMemoryUsage += entryMemoryUsage(entry);
+  deltaState.entries.push_back(std::move(entry));
+  deltaState.latestChangedInode = fusell::InodeNumber{};
+}
+
+void Journal::truncateIfNecessary(DeltaState& deltaState) {
+  size_t numTruncated = 0;
+  // Always keep the tip, since it holds the current position and hash.
+  while (deltaState.getMemoryUsage() > deltaState.memoryLimit &&
+         deltaState.entries.size() > 1) {
+    auto& entry = deltaState.entries.front();
+    for (const auto& change : entry.changes) {
+      deltaState.paths.release(change.path);
+    }
+    deltaState.entriesMemoryUsage -= entryMemoryUsage(entry);
+    deltaState.truncatedSequence = entry.info.toSequence;
+    deltaState.entries.pop_front();
+    ++numTruncated;
   }
 
-  // Careful to call the subscribers with no locks held.
+  if (numTruncated > 0) {
+    deltaState.truncatedEntries += numTruncated;
+    XLOG(DBG2) << "discarded " << numTruncated
+               << " journal entries to stay under the memory limit of "
+               << deltaState.memoryLimit << " bytes; history now starts at "
+               << deltaState.truncatedSequence + 1;
+  }
+}
+
+void Journal::recordChangedFile(
+    fusell::InodeNumber inodeNumber,
+    folly::FunctionRef<folly::Optional<RelativePath>()> getPath) {
+  if (tryCoalesceChangedFile(inodeNumber)) {
+    notifySubscribers();
+    return;
+  }
+
+  // Computing the path acquires inode locks, so it must not be done while
+  // holding the journal lock.
+  auto path = getPath();
+  if (!path.hasValue()) {
+    return;
+  }
+
+  {
+    auto deltaState = deltaState_.wlock();
+    appendDelta(*deltaState, JournalDelta{path.value()});
+    deltaState->latestChangedInode = inodeNumber;
+    truncateIfNecessary(*deltaState);
+  }
+  notifySubscribers();
+}
+
+bool Journal::tryCoalesceChangedFile(fusell::InodeNumber inodeNumber) {
+  auto deltaState = deltaState_.wlock();
+  if (deltaState->entries.empty() ||
+      deltaState->latestChangedInode != inodeNumber) {
+    return false;
+  }
+
+  auto& tip = deltaState->entries.back();
+  tip.info.toSequence = deltaState->nextSequence++;
+  tip.info.toTime = std::chrono::steady_clock::now();
+  return true;
+}
+
+void Journal::notifySubscribers() {
   auto subscribers = subscriberState_.rlock()->subscribers;
-  for (auto& sub : subscribers) {
+  for (auto& sub : *subscribers) {
     sub.second();
   }
 }
 
-std::shared_ptr<const JournalDelta> Journal::getLatest() const {
-  return deltaState_.rlock()->latest;
+folly::Optional<JournalDeltaInfo> Journal::getLatest() const {
+  auto deltaState = deltaState_.rlock();
+  if (deltaState->entries.empty()) {
+    return folly::none;
+  }
+  return deltaState->entries.back().info;
 }
 
-void Journal::replaceJournal(std::unique_ptr<JournalDelta>&& delta) {
+std::unique_ptr<JournalDeltaRange> Journal::accumulateRange(
+    SequenceNumber limitSequence) const {
+  auto deltaState = deltaState_.rlock();
+  const auto& entries = deltaState->entries;
+  if (entries.empty() || entries.back().info.toSequence < limitSequence) {
+    return nullptr;
+  }
+
+  // Entries are ordered by sequence number, so we can find the start of the
+  // range without looking at the entries before it.
+  auto begin = std::lower_bound(
+      entries.begin(),
+      entries.end(),
+      limitSequence,
+      [](const Entry& entry, SequenceNumber sequence) {
+        return entry.info.toSequence < sequence;
+      });
+
+  auto result = std::make_unique<JournalDeltaRange>();
+  result->isTruncated = limitSequence <= deltaState->truncatedSequence;
+  result->toSequence = entries.back().info.toSequence;
+  result->toTime = entries.back().info.toTime;
+  result->toHash = entries.back().info.toHash;
+  result->fromSequence = begin->info.fromSequence;
+  result->fromTime = begin->info.fromTime;
+  result->fromHash = begin->info.fromHash;
+
+  // To help satisfy ourselves that we don't ever emit a merged
+  // result that has a given file name in more than one of
+  // the createdFilesInOverlay, removedFilesInOverlay or changedFilesInOverlay
+  // sets, we first build up a map of name -> state and then apply
+  // the state transitions to it.  Keep in mind that we are processing
+  // from the most recent event first, so the transitions are backwards.
+  // The comments in the loop below show the forwards ordering.
+  enum Disposition {
+    Created,
+    Changed,
+    Removed,
+  };
+  std::unordered_map<PathTable::Id, Disposition> overlayState;
+  std::unordered_set<PathTable::Id> uncleanPaths;
+  const auto& paths = deltaState->paths;
+
+  for (auto it = entries.end(); it != begin;) {
+    --it;
+    for (const auto& change : it->changes) {
+      auto found = overlayState.find(change.path);
+      switch (change.type) {
+        case ChangeType::Unclean:
+          uncleanPaths.insert(change.path);
+          break;
+        case ChangeType::Created:
+          if (found == overlayState.end()) {
+            overlayState.emplace(change.path, Created);
+          } else {
+            switch (found->second) {
+              case Changed:
+                // Created, Changed -> Created
+                found->second = Created;
+                break;
+              case Removed:
+                // Created, Removed -> cancel out (don't report)
+                overlayState.erase(found);
+                break;
+              case Created:
+                // Created, Created -> Created
+                XLOG(ERR) << "Journal for " << paths.getPath(change.path)
+                          << " holds invalid Created, Created sequence";
+                break;
+            }
+          }
+          break;
+        case ChangeType::Removed:
+          if (found == overlayState.end()) {
+            overlayState.emplace(change.path, Removed);
+          } else {
+            switch (found->second) {
+              case Created:
+                // Removed, Created -> cancel out to Changed
+                found->second = Changed;
+                break;
+              case Changed:
+                // Removed, Changed -> invalid
+                XLOG(ERR) << "Journal for " << paths.getPath(change.path)
+                          << " holds invalid Removed, Changed sequence";
+                break;
+              case Removed:
+                // Removed, Removed -> Removed
+                XLOG(ERR) << "Journal for " << paths.getPath(change.path)
+                          << " holds invalid Removed, Removed sequence";
+                break;
+            }
+          }
+          break;
+        case ChangeType::Changed:
+          if (found == overlayState.end()) {
+            overlayState.emplace(change.path, Changed);
+          } else {
+            switch (found->second) {
+              case Created:
+                // Changed, Created -> invalid
+                XLOG(ERR) << "Journal for " << paths.getPath(change.path)
+                          << " holds invalid Changed, Created sequence";
+                break;
+              case Changed:
+                // Changed, Changed -> Changed
+                break;
+              case Removed:
+                // Changed, Removed -> Removed
+                break;
+            }
+          }
+          break;
+      }
+    }
+  }
+
+  // Now translate the keys of the state into entries in one
+  // of the three sets for the result.
+  for (const auto& it : overlayState) {
+    auto fileName = paths.getPath(it.first);
+    switch (it.second) {
+      case Created:
+        result->createdFilesInOverlay.insert(std::move(fileName));
+        break;
+      case Changed:
+        result->changedFilesInOverlay.insert(std::move(fileName));
+        break;
+      case Removed:
+        result->removedFilesInOverlay.insert(std::move(fileName));
+        break;
+    }
+  }
+  for (auto id : uncleanPaths) {
+    result->uncleanPaths.insert(paths.getPath(id));
+  }
+
+  return result;
+}
+
+void Journal::setMemoryLimit(size_t limit) {
+  auto deltaState = deltaState_.wlock();
+  deltaState->memoryLimit = limit;
+  truncateIfNecessary(*deltaState);
+}
+
+size_t Journal::getMemoryLimit() const {
+  return deltaState_.rlock()->memoryLimit;
+}
+
+JournalStats Journal::getStats() const {
+  auto deltaState = deltaState_.rlock();
+  JournalStats stats;
+  stats.entryCount = deltaState->entries.size();
+  stats.pathCount = deltaState->paths.size();
+  stats.memoryUsage = deltaState->getMemoryUsage();
+  stats.truncatedEntries = deltaState->truncatedEntries;
+  return stats;
+}
+
+SerializedJournal Journal::serialize(size_t maxEntries) const {
+  auto deltaState = deltaState_.rlock();
+  const auto& entries = deltaState->entries;
+  auto begin = entries.end() - std::min(entries.size(), maxEntries);
+
+  SerializedJournal serialized;
+  serialized.nextSequence = deltaState->nextSequence;
+  serialized.truncatedSequence = begin == entries.begin()
+      ? deltaState->truncatedSequence
+      : std::prev(begin)->info.toSequence;
+
+  // Only the paths referenced by the saved entries are written out, so they
+  // are renumbered as they are encountered.
+  std::unordered_map<PathTable::Id, int32_t> indices;
+  auto getIndex = [&](PathTable::Id id) {
+    auto result = indices.emplace(id, serialized.paths.size());
+    if (result.second) {
+      serialized.paths.push_back(deltaState->paths.getPath(id).value());
+    }
+    return result.first->second;
+  };
+
+  serialized.entries.reserve(entries.end() - begin);
+  for (auto it = begin; it != entries.end(); ++it) {
+    SerializedJournalEntry entry;
+    entry.fromSequence = it->info.fromSequence;
+    entry.toSequence = it->info.toSequence;
+    entry.fromHash = hashToBinary(it->info.fromHash);
+    entry.toHash = hashToBinary(it->info.toHash);
+    for (const auto& change : it->changes) {
+      auto index = getIndex(change.path);
+      switch (change.type) {
+        case ChangeType::Created:
+          entry.createdFilesInOverlay.push_back(index);
+          break;
+        case ChangeType::Removed:
+          entry.removedFilesInOverlay.push_back(index);
+          break;
+        case ChangeType::Changed:
+          entry.changedFilesInOverlay.push_back(index);
+          break;
+        case ChangeType::Unclean:
+          entry.uncleanPaths.push_back(index);
+          break;
+      }
+    }
+    serialized.entries.push_back(std::move(entry));
+  }
+  return serialized;
+}
+
+void Journal::load(const SerializedJournal& serialized) {
+  DeltaState newState;
+  auto now = std::chrono::steady_clock::now();
+  SequenceNumber lastSequence = serialized.truncatedSequence;
+
+  for (const auto& saved : serialized.entries) {
+    if (static_cast<SequenceNumber>(saved.fromSequence) <= lastSequence ||
+        saved.toSequence < saved.fromSequence) {
+      throwInvalidJournal(folly::to<std::string>(
+          "entry ",
+          saved.fromSequence,
+          "-",
+          saved.toSequence,
+          " is out of order"));
+    }
+
+    Entry entry;
+    entry.info.fromSequence = saved.fromSequence;
+    entry.info.toSequence = saved.toSequence;
+    entry.info.fromTime = now;
+    entry.info.toTime = now;
+    entry.info.fromHash = binaryToHash(saved.fromHash);
+    entry.info.toHash = binaryToHash(saved.toHash);
+
+    // Keep the same order of change types as appendDelta().
+    entry.changes.reserve(
+        saved.createdFilesInOverlay.size() +
+        saved.removedFilesInOverlay.size() +
+        saved.changedFilesInOverlay.size() + saved.uncleanPaths.size());
+    auto addChanges = [&](const std::vector<int32_t>& indices,
+                          ChangeType type) {
+      for (auto index : indices) {
+        if (index < 0 ||
+            static_cast<size_t>(index) >= serialized.paths.size()) {
+          throwInvalidJournal(
+              folly::to<std::string>("path index ", index, " out of range"));
+        }
+        auto id = newState.paths.intern(
+            RelativePathPiece{serialized.paths[index]});
+        entry.changes.push_back(PathChange{id, type});
+      }
+    };
+    addChanges(saved.createdFilesInOverlay, ChangeType::Created);
+    addChanges(saved.removedFilesInOverlay, ChangeType::Removed);
+    addChanges(saved.changedFilesInOverlay, ChangeType::Changed);
+    addChanges(saved.uncleanPaths, ChangeType::Unclean);
+
+    lastSequence = entry.info.toSequence;
+    newState.entriesMemoryUsage += entryMemoryUsage(entry);
+    newState.entries.push_back(std::move(entry));
+  }
+
+  if (static_cast<SequenceNumber>(serialized.nextSequence) <= lastSequence) {
+    throwInvalidJournal(folly::to<std::string>(
+        "next sequence number ",
+        serialized.nextSequence,
+        " is not after the last entry ",
+        lastSequence));
+  }
+  newState.nextSequence = serialized.nextSequence;
+  newState.truncatedSequence = serialized.truncatedSequence;
+
   auto deltaState = deltaState_.wlock();
-  deltaState->latest = std::shared_ptr<const JournalDelta>(std::move(delta));
+  newState.memoryLimit = deltaState->memoryLimit;
+  newState.truncatedEntries = deltaState->truncatedEntries;
+  *deltaState = std::move(newState);
+  truncateIfNecessary(*deltaState);
 }
 
 uint64_t Journal::registerSubscriber(SubscriberCallback&& callback) {
   auto subscriberState = subscriberState_.wlock();
   auto id = subscriberState->nextSubscriberId++;
-  subscriberState->subscribers[id] = std::move(callback);
+  auto subscribers =
+      std::make_shared<SubscriberMap>(*subscriberState->subscribers);
+  (*subscribers)[id] = std::move(callback);
+  subscriberState->subscribers = std::move(subscribers);
   return id;
 }
 
 void Journal::cancelSubscriber(uint64_t id) {
-  subscriberState_.wlock()->subscribers.erase(id);
+  auto subscriberState = subscriberState_.wlock();
+  if (subscriberState->subscribers->count(id) == 0) {
+    return;
+  }
+  auto subscribers =
+      std::make_shared<SubscriberMap>(*subscriberState->subscribers);
+  subscribers->erase(id);
+  subscriberState->subscribers = std::move(subscribers);
 }
 
 void Journal::cancelAllSubscribers() {
-  subscriberState_.wlock()->subscribers.clear();
+  subscriberState_.wlock()->subscribers =
+      std::make_shared<const SubscriberMap>();
 }
 
 bool Journal::isSubscriberValid(uint64_t id) const {
   auto subscriberState = subscriberState_.rlock();
-  auto& subscribers = subscriberState->subscribers;
+  auto& subscribers = *subscriberState->subscribers;
   return subscribers.find(id) != subscribers.end();
 }
 
@@ -9,15 +9,54 @@
  */
 #pragma once
 #include <folly/Function.h>
+#include <folly/Optional.h>
 #include <folly/Synchronized.h>
+#include <chrono>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <unordered_map>
+#include <vector>
+#include "eden/fs/fuse/FuseTypes.h"
+#include "eden/fs/journal/gen-cpp2/journal_types.h"
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/PathTable.h"
 
 namespace facebook {
 namespace eden {
 
 class JournalDelta;
+struct JournalDeltaRange;
+
+/**
+ * The sequence numbers, times and snapshot hashes of a journal entry (or of
+ * a range of entries).
+ */
+struct JournalDeltaInfo {
+  /** The sequence range.
+   * This is a range to accommodate entries that span several changes. */
+  uint64_t fromSequence{0};
+  uint64_t toSequence{0};
+  /** The time at which the changes were recorded. */
+  std::chrono::steady_clock::time_point fromTime;
+  std::chrono::steady_clock::time_point toTime;
+  /** The snapshot hash before and after the changes. */
+  Hash fromHash;
+  Hash toHash;
+};
+
+struct JournalStats {
+  /** The number of entries currently held in the journal. */
+  size_t entryCount{0};
+  /** The number of distinct paths referenced by those entries, including
+   * their parent directories. */
+  size_t pathCount{0};
+  /** An estimate of the memory used by the journal, in bytes. */
+  size_t memoryUsage{0};
+  /** The number of entries discarded to stay under the memory limit. */
+  uint64_t truncatedEntries{0};
+};
 
 /** The Journal exists to answer questions about how files are changing
  * over time.
@@ -32,6 +71,12 @@ class JournalDelta;
  * revisions (the prior and new revision hash) from which we can derive
  * the larger list of files.
  *
+ * Entries are stored oldest first in a compact form, with each path interned
+ * in a PathTable.  To bound its memory usage the journal discards its
+ * oldest entries once their estimated size exceeds the memory limit.  Queries
+ * that reach back into the discarded history report that they are truncated,
+ * so that clients know to recompute their state from scratch.
+ *
  * The Journal class is thread-safe.  Subscribers are called on the thread
  * that called addDelta.
  */
@@ -41,20 +86,68 @@ class Journal {
   using SubscriberId = uint64_t;
   using SubscriberCallback = std::function<void()>;
 
+  /** The default value for setMemoryLimit(). */
+  static constexpr size_t kDefaultMemoryLimit = 1024 * 1024 * 1024;
+
   /** Add a delta to the journal
    * The delta will have a new sequence number and timestamp
    * applied. */
   void addDelta(std::unique_ptr<JournalDelta>&& delta);
 
-  /** Get a shared, immutable reference to the tip of the journal.
-   * May return nullptr if there have been no changes */
-  std::shared_ptr<const JournalDelta> getLatest() const;
+  /** Record that the contents or attributes of a file were modified
+   * through the given inode.
+   *
+   * Writes tend to arrive in long runs against the same file.  If the tip
+   * of the journal only records a modification made through the same inode,
+   * the tip is extended to cover this change too, rather than growing the
+   * journal by one entry per write.  The tip still gets a new sequence
+   * number and subscribers are still notified.
+   *
+   * getPath() is only called if a new entry is needed.  It is called without
+   * any journal locks held, and may return folly::none if the inode has been
+   * unlinked, in which case nothing is recorded. */
+  void recordChangedFile(
+      fusell::InodeNumber inodeNumber,
+      folly::FunctionRef<folly::Optional<RelativePath>()> getPath);
 
-  /** Replace the journal with a new delta.
-   * The new delta will typically be the result of JournalDelta::merge().
-   * No sanity checking is performed inside this function; the
-   * supplied delta is moved in and replaces current tip. */
-  void replaceJournal(std::unique_ptr<JournalDelta>&& delta);
+  /** Get the sequence numbers, times and hashes of the tip of the journal.
+   * Returns folly::none if there have been no changes. */
+  folly::Optional<JournalDeltaInfo> getLatest() const;
+
+  /** Merge all of the entries whose toSequence is >= limitSequence.
+   *
+   * The default limit value is 0 which is never assigned by the Journal
+   * and thus indicates that all entries should be merged.
+   * Returns nullptr if there are no entries in that range.
+   *
+   * The cost of this is proportional to the number of entries in the range
+   * and the paths they mention, not to the size of the whole journal. */
+  std::unique_ptr<JournalDeltaRange> accumulateRange(
+      SequenceNumber limitSequence = 0) const;
+
+  /** Set the approximate maximum amount of memory, in bytes, to be used by
+   * the journal.  The oldest entries are discarded when this is exceeded,
+   * although the most recent entry is always kept. */
+  void setMemoryLimit(size_t limit);
+  size_t getMemoryLimit() const;
+
+  JournalStats getStats() const;
+
+  /** Return the newest maxEntries entries, along with the sequence numbers
+   * needed to carry on from them, in a form that can be saved and passed to
+   * load() in a later edenfs process. */
+  SerializedJournal serialize(size_t maxEntries) const;
+
+  /** Replace the contents of the journal with data returned by serialize().
+   *
+   * New entries continue the saved sequence numbers, so positions reported
+   * before the data was saved remain valid.  Queries that reach back past
+   * the saved entries report that they are truncated.  Times do not carry
+   * over between processes, so restored entries are given the current time.
+   *
+   * Subscribers are not notified.  Throws if the data is inconsistent,
+   * leaving the journal unmodified. */
+  void load(const SerializedJournal& serialized);
 
   /** Register a subscriber.
    * A subscriber is just a callback that is called whenever the
@@ -74,18 +167,73 @@ class Journal {
   bool isSubscriberValid(SubscriberId id) const;
 
  private:
+  using SubscriberMap = std::unordered_map<SubscriberId, SubscriberCallback>;
+
+  enum class ChangeType : uint8_t {
+    Changed,
+    Created,
+    Removed,
+    Unclean,
+  };
+
+  struct PathChange {
+    PathTable::Id path;
+    ChangeType type;
+  };
+
+  struct Entry {
+    JournalDeltaInfo info;
+    std::vector<PathChange> changes;
+  };
+
   struct DeltaState {
     /** The sequence number that we'll use for the next entry
      * that we link into the chain */
     SequenceNumber nextSequence{1};
-    /** The most recently recorded entry */
-    std::shared_ptr<const JournalDelta> latest;
+    /** The recorded entries, oldest first. */
+    std::deque<Entry> entries;
+    /** The paths referenced by entries. */
+    PathTable paths;
+    /** The estimated memory used by entries, not including paths. */
+    size_t entriesMemoryUsage{0};
+    size_t memoryLimit{kDefaultMemoryLimit};
+    /** The toSequence of the most recent entry that has been discarded,
+     * or 0 if nothing has been discarded. */
+    SequenceNumber truncatedSequence{0};
+    uint64_t truncatedEntries{0};
+    /** If the tip was recorded by recordChangedFile(), and records nothing
+     * but a change to one file, the inode that file was changed through.
+     * Otherwise this is empty. */
+    fusell::InodeNumber latestChangedInode;
+
+    size_t getMemoryUsage() const {
+      return entriesMemoryUsage + paths.getMemoryUsage();
+    }
   };
   folly::Synchronized<DeltaState> deltaState_;
 
+  /** Append delta to the journal as the new tip.
+   * The caller must hold the deltaState_ lock. */
+  static void appendDelta(DeltaState& deltaState, const JournalDelta& delta);
+
+  /** Discard the oldest entries until the memory limit is satisfied. */
+  static void truncateIfNecessary(DeltaState& deltaState);
+
+  static size_t entryMemoryUsage(const Entry& entry);
+
+  /** Extend the tip to cover a new change to the same file.
+   * Returns false if the tip does not only record a change made
+   * through inodeNumber. */
+  bool tryCoalesceChangedFile(fusell::InodeNumber inodeNumber);
+
+  void notifySubscribers();
+
   struct SubscriberState {
     SubscriberId nextSubscriberId{1};
-    std::unordered_map<SubscriberId, SubscriberCallback> subscribers;
+    /** The map is copied when it is modified, so that notifying subscribers
+     * (which happens far more often) only has to copy a pointer to it. */
+    std::shared_ptr<const SubscriberMap> subscribers{
+        std::make_shared<const SubscriberMap>()};
   };
 
   folly::Synchronized<SubscriberState> subscriberState_;
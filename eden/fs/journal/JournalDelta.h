@@ -18,6 +18,9 @@
 namespace facebook {
 namespace eden {
 
+/**
+ * A change to be recorded in the Journal with Journal::addDelta().
+ */
 class JournalDelta {
  public:
   enum Created { CREATED };
@@ -33,20 +36,11 @@ class JournalDelta {
   JournalDelta(RelativePathPiece fileName, Removed);
   JournalDelta(RelativePathPiece oldName, RelativePathPiece newName, Renamed);
 
-  /** the prior delta and its chain */
-  std::shared_ptr<const JournalDelta> previous;
-  /** The current sequence range.
-   * This is a range to accommodate merging a range into a single entry. */
-  Journal::SequenceNumber fromSequence;
-  Journal::SequenceNumber toSequence;
-  /** The time at which the change was recorded.
-   * This is a range to accommodate merging a range into a single entry. */
-  std::chrono::steady_clock::time_point fromTime;
-  std::chrono::steady_clock::time_point toTime;
-
   /** The snapshot hash that we started and ended up on.
    * This will often be the same unless we perform a checkout or make
-   * a new snapshot from the snapshotable files in the overlay. */
+   * a new snapshot from the snapshotable files in the overlay.
+   * If both are left as kZeroHash the journal carries forward the hash
+   * from the previous entry. */
   Hash fromHash;
   Hash toHash;
 
@@ -59,19 +53,24 @@ class JournalDelta {
   /** The set of files that had differing status across a checkout or
    * some other operation that changes the snapshot hash */
   std::unordered_set<RelativePath> uncleanPaths;
+};
+
+/**
+ * All of the changes recorded in a range of journal entries, as returned by
+ * Journal::accumulateRange().
+ *
+ * A path appears in at most one of the created, removed, and changed sets.
+ */
+struct JournalDeltaRange : public JournalDeltaInfo {
+  std::unordered_set<RelativePath> changedFilesInOverlay;
+  std::unordered_set<RelativePath> createdFilesInOverlay;
+  std::unordered_set<RelativePath> removedFilesInOverlay;
+  std::unordered_set<RelativePath> uncleanPaths;
 
-  /** Merge the deltas running back from this delta for all deltas
-   * whose toSequence is >= limitSequence.
-   * The default limit value is 0 which is never assigned by the Journal
-   * and thus indicates that all deltas should be merged.
-   * if pruneAfterLimit is true and we stop due to hitting limitSequence,
-   * then the returned delta will have previous=nullptr rather than
-   * maintaining the chain.
-   * If the limitSequence means that no deltas will match, returns nullptr.
-   * */
-  std::unique_ptr<JournalDelta> merge(
-      Journal::SequenceNumber limitSequence = 0,
-      bool pruneAfterLimit = false) const;
+  /** True if some of the requested entries had already been discarded to
+   * keep the journal within its memory limit.  The sets above are then
+   * incomplete, and the caller must recompute its state from scratch. */
+  bool isTruncated{false};
 };
 } // namespace eden
 } // namespace facebook
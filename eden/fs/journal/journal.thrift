@@ -0,0 +1,31 @@
+namespace cpp2 facebook.eden
+
+// One journal entry.  The path lists hold indices into
+// SerializedJournal.paths.
+struct SerializedJournalEntry {
+  1: i64 fromSequence
+  2: i64 toSequence
+  3: binary fromHash
+  4: binary toHash
+  5: list<i32> createdFilesInOverlay
+  6: list<i32> removedFilesInOverlay
+  7: list<i32> changedFilesInOverlay
+  8: list<i32> uncleanPaths
+}
+
+// The most recent portion of a mount's journal, saved so that a new edenfs
+// process can keep answering getFilesChangedSince() queries made against
+// positions handed out by the old one.
+struct SerializedJournal {
+  // The mountGeneration that positions in this journal were reported with.
+  // This is filled in by EdenMount rather than by the Journal itself.
+  1: i64 mountGeneration
+  // The sequence number for the next entry.  0 means that no journal was
+  // saved, which is what older versions of edenfs send during takeover.
+  2: i64 nextSequence
+  // The toSequence of the newest entry that was not saved.
+  3: i64 truncatedSequence
+  4: list<string> paths
+  // The entries, oldest first.
+  5: list<SerializedJournalEntry> entries
+}
@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/Conv.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "eden/fs/journal/JournalDelta.h"
@@ -14,8 +15,15 @@
 using namespace facebook::eden;
 using ::testing::UnorderedElementsAre;
 
+namespace {
+const Hash kHash1{"1111111111111111111111111111111111111111"};
+const Hash kHash2{"2222222222222222222222222222222222222222"};
+} // namespace
+
 TEST(Journal, chain) {
   Journal journal;
+  EXPECT_FALSE(journal.getLatest().hasValue());
+  EXPECT_EQ(nullptr, journal.accumulateRange());
 
   // Make an initial entry.
   auto delta = std::make_unique<JournalDelta>();
@@ -24,9 +32,9 @@ TEST(Journal, chain) {
 
   // Sanity check that the latest information matches.
   auto latest = journal.getLatest();
+  ASSERT_TRUE(latest.hasValue());
   EXPECT_EQ(1, latest->toSequence);
   EXPECT_EQ(1, latest->fromSequence);
-  EXPECT_EQ(nullptr, latest->previous);
 
   // Add a second entry.
   delta = std::make_unique<JournalDelta>();
@@ -37,48 +45,34 @@ TEST(Journal, chain) {
   latest = journal.getLatest();
   EXPECT_EQ(2, latest->toSequence);
   EXPECT_EQ(2, latest->fromSequence);
-  EXPECT_EQ(1, latest->previous->toSequence);
 
   // Check basic merge implementation.
-  auto merged = latest->merge();
+  auto merged = journal.accumulateRange();
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(1, merged->fromSequence);
   EXPECT_EQ(2, merged->toSequence);
   EXPECT_EQ(2, merged->changedFilesInOverlay.size());
-  EXPECT_EQ(nullptr, merged->previous);
+  EXPECT_FALSE(merged->isTruncated);
 
   // Let's try with some limits.
 
   // First just report the most recent item.
-  merged = latest->merge(2);
-  ASSERT_NE(nullptr, merged);
-  EXPECT_EQ(2, merged->fromSequence);
-  EXPECT_EQ(2, merged->toSequence);
-  EXPECT_EQ(1, merged->changedFilesInOverlay.size());
-  EXPECT_NE(nullptr, merged->previous);
-
-  // Prune off sequence==1
-  merged = latest->merge(2, true);
+  merged = journal.accumulateRange(2);
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(2, merged->fromSequence);
   EXPECT_EQ(2, merged->toSequence);
-  EXPECT_EQ(1, merged->changedFilesInOverlay.size());
-  EXPECT_EQ(nullptr, merged->previous);
+  EXPECT_THAT(
+      merged->changedFilesInOverlay, UnorderedElementsAre(RelativePath{"baz"}));
 
   // Merge the first two entries.
-  merged = latest->merge(1);
+  merged = journal.accumulateRange(1);
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(1, merged->fromSequence);
   EXPECT_EQ(2, merged->toSequence);
   EXPECT_EQ(2, merged->changedFilesInOverlay.size());
-  EXPECT_EQ(nullptr, merged->previous);
 
-  // And replace the journal with our merged result.
-  journal.replaceJournal(std::move(merged));
-  latest = journal.getLatest();
-  EXPECT_EQ(2, latest->toSequence);
-  EXPECT_EQ(1, latest->fromSequence);
-  EXPECT_EQ(nullptr, latest->previous);
+  // Nothing has happened since the tip.
+  EXPECT_EQ(nullptr, journal.accumulateRange(3));
 }
 
 TEST(Journal, mergeRemoveCreateUpdate) {
@@ -103,7 +97,7 @@ TEST(Journal, mergeRemoveCreateUpdate) {
   EXPECT_EQ(3, latest->fromSequence);
 
   // The merged data should report test.txt as changed
-  auto merged = latest->merge();
+  auto merged = journal.accumulateRange();
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(1, merged->fromSequence);
   EXPECT_EQ(3, merged->toSequence);
@@ -114,7 +108,7 @@ TEST(Journal, mergeRemoveCreateUpdate) {
       UnorderedElementsAre(RelativePath{"test.txt"}));
 
   // Test merging only partway back
-  merged = latest->merge(3);
+  merged = journal.accumulateRange(3);
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(3, merged->fromSequence);
   EXPECT_EQ(3, merged->toSequence);
@@ -124,7 +118,7 @@ TEST(Journal, mergeRemoveCreateUpdate) {
       merged->changedFilesInOverlay,
       UnorderedElementsAre(RelativePath{"test.txt"}));
 
-  merged = latest->merge(2);
+  merged = journal.accumulateRange(2);
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(2, merged->fromSequence);
   EXPECT_EQ(3, merged->toSequence);
@@ -134,7 +128,7 @@ TEST(Journal, mergeRemoveCreateUpdate) {
   EXPECT_THAT(merged->removedFilesInOverlay, UnorderedElementsAre());
   EXPECT_THAT(merged->changedFilesInOverlay, UnorderedElementsAre());
 
-  merged = latest->merge(1);
+  merged = journal.accumulateRange(1);
   ASSERT_NE(nullptr, merged);
   EXPECT_EQ(1, merged->fromSequence);
   EXPECT_EQ(3, merged->toSequence);
@@ -144,3 +138,238 @@ TEST(Journal, mergeRemoveCreateUpdate) {
       merged->changedFilesInOverlay,
       UnorderedElementsAre(RelativePath{"test.txt"}));
 }
+
+TEST(Journal, hashesCarryForward) {
+  Journal journal;
+  auto delta = std::make_unique<JournalDelta>();
+  delta->toHash = kHash1;
+  journal.addDelta(std::move(delta));
+  journal.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"a"}, JournalDelta::CREATED));
+
+  auto latest = journal.getLatest();
+  EXPECT_EQ(kHash1, latest->fromHash);
+  EXPECT_EQ(kHash1, latest->toHash);
+
+  delta = std::make_unique<JournalDelta>();
+  delta->fromHash = kHash1;
+  delta->toHash = kHash2;
+  delta->uncleanPaths.insert(RelativePath{"a"});
+  journal.addDelta(std::move(delta));
+
+  auto merged = journal.accumulateRange(2);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_EQ(kHash1, merged->fromHash);
+  EXPECT_EQ(kHash2, merged->toHash);
+  EXPECT_THAT(merged->uncleanPaths, UnorderedElementsAre(RelativePath{"a"}));
+  EXPECT_THAT(
+      merged->createdFilesInOverlay, UnorderedElementsAre(RelativePath{"a"}));
+}
+
+TEST(Journal, memoryLimitDiscardsOldEntries) {
+  Journal journal;
+  for (int n = 0; n < 100; ++n) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        RelativePath{folly::to<std::string>("dir/file", n)},
+        JournalDelta::CREATED));
+  }
+  auto stats = journal.getStats();
+  EXPECT_EQ(100, stats.entryCount);
+  // The files, plus their shared parent directory.
+  EXPECT_EQ(101, stats.pathCount);
+  EXPECT_EQ(0, stats.truncatedEntries);
+
+  journal.setMemoryLimit(stats.memoryUsage / 2);
+  stats = journal.getStats();
+  EXPECT_LE(stats.memoryUsage, journal.getMemoryLimit());
+  EXPECT_LT(stats.entryCount, 100);
+  EXPECT_EQ(100, stats.entryCount + stats.truncatedEntries);
+  EXPECT_EQ(stats.entryCount + 1, stats.pathCount);
+
+  // Queries that only cover the retained history are complete.
+  auto merged = journal.accumulateRange(100);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_FALSE(merged->isTruncated);
+  EXPECT_THAT(
+      merged->createdFilesInOverlay,
+      UnorderedElementsAre(RelativePath{"dir/file99"}));
+
+  // Queries that reach back into the discarded history report it.
+  merged = journal.accumulateRange(1);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_TRUE(merged->isTruncated);
+  EXPECT_EQ(stats.entryCount, merged->createdFilesInOverlay.size());
+
+  // The tip is always retained.
+  journal.setMemoryLimit(0);
+  EXPECT_EQ(1, journal.getStats().entryCount);
+  EXPECT_EQ(100, journal.getLatest()->toSequence);
+}
+
+TEST(Journal, pathsAreShared) {
+  Journal journal;
+  for (int n = 0; n < 10; ++n) {
+    journal.addDelta(
+        std::make_unique<JournalDelta>(JournalDelta{RelativePath{"a/b"}}));
+  }
+  EXPECT_EQ(10, journal.getStats().entryCount);
+  EXPECT_EQ(2, journal.getStats().pathCount);
+}
+
+TEST(Journal, coalesceChangesToSameInode) {
+  Journal journal;
+  size_t notifications = 0;
+  journal.registerSubscriber([&] { ++notifications; });
+
+  size_t pathLookups = 0;
+  auto getPath = [&]() -> folly::Optional<RelativePath> {
+    ++pathLookups;
+    return RelativePath{"build/output.bin"};
+  };
+
+  fusell::InodeNumber ino{10};
+  journal.recordChangedFile(ino, getPath);
+  journal.recordChangedFile(ino, getPath);
+  journal.recordChangedFile(ino, getPath);
+
+  // Every change gets a new sequence number and a notification, but only
+  // a single entry is kept and the path is only computed once.
+  auto latest = journal.getLatest();
+  EXPECT_EQ(1, latest->fromSequence);
+  EXPECT_EQ(3, latest->toSequence);
+  EXPECT_EQ(1, journal.getStats().entryCount);
+  EXPECT_EQ(1, pathLookups);
+  EXPECT_EQ(3, notifications);
+
+  // A client that last saw sequence 2 must still see the file as changed.
+  auto merged = journal.accumulateRange(3);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_THAT(
+      merged->changedFilesInOverlay,
+      UnorderedElementsAre(RelativePath{"build/output.bin"}));
+}
+
+TEST(Journal, doNotCoalesceAcrossOtherChanges) {
+  Journal journal;
+  fusell::InodeNumber ino1{10};
+  fusell::InodeNumber ino2{11};
+  auto path1 = [] { return folly::make_optional(RelativePath{"a"}); };
+  auto path2 = [] { return folly::make_optional(RelativePath{"b"}); };
+
+  journal.recordChangedFile(ino1, path1);
+  journal.recordChangedFile(ino2, path2);
+  journal.recordChangedFile(ino1, path1);
+  EXPECT_EQ(3, journal.getLatest()->toSequence);
+  EXPECT_EQ(3, journal.getLatest()->fromSequence);
+
+  // Any other kind of entry ends the run of coalesced changes.
+  journal.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"c"}, JournalDelta::CREATED));
+  journal.recordChangedFile(ino1, path1);
+  auto latest = journal.getLatest();
+  EXPECT_EQ(5, latest->fromSequence);
+  EXPECT_EQ(5, latest->toSequence);
+  EXPECT_EQ(5, journal.getStats().entryCount);
+
+  // Changes to unlinked files are not recorded.
+  journal.recordChangedFile(
+      fusell::InodeNumber{12}, [] { return folly::Optional<RelativePath>{}; });
+  EXPECT_EQ(5, journal.getLatest()->toSequence);
+}
+
+TEST(Journal, serializeAndLoad) {
+  Journal journal;
+  auto delta = std::make_unique<JournalDelta>();
+  delta->toHash = kHash1;
+  journal.addDelta(std::move(delta));
+  journal.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"a"}, JournalDelta::CREATED));
+  journal.addDelta(
+      std::make_unique<JournalDelta>(JournalDelta{RelativePath{"a"}}));
+  journal.recordChangedFile(fusell::InodeNumber{10}, [] {
+    return folly::make_optional(RelativePath{"b"});
+  });
+  journal.recordChangedFile(fusell::InodeNumber{10}, [] {
+    return folly::make_optional(RelativePath{"b"});
+  });
+
+  Journal restored;
+  restored.load(journal.serialize(100));
+  EXPECT_EQ(journal.getStats().entryCount, restored.getStats().entryCount);
+  EXPECT_EQ(2, restored.getStats().pathCount);
+
+  auto latest = restored.getLatest();
+  ASSERT_TRUE(latest.hasValue());
+  EXPECT_EQ(4, latest->fromSequence);
+  EXPECT_EQ(5, latest->toSequence);
+  EXPECT_EQ(kHash1, latest->toHash);
+
+  auto merged = restored.accumulateRange(2);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_FALSE(merged->isTruncated);
+  EXPECT_THAT(
+      merged->createdFilesInOverlay, UnorderedElementsAre(RelativePath{"a"}));
+  EXPECT_THAT(
+      merged->changedFilesInOverlay, UnorderedElementsAre(RelativePath{"b"}));
+
+  // New entries carry on from the saved sequence numbers.
+  restored.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"c"}, JournalDelta::CREATED));
+  EXPECT_EQ(6, restored.getLatest()->toSequence);
+  EXPECT_EQ(kHash1, restored.getLatest()->toHash);
+}
+
+TEST(Journal, serializeOnlyKeepsNewestEntries) {
+  Journal journal;
+  for (int n = 0; n < 10; ++n) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        RelativePath{folly::to<std::string>("file", n)},
+        JournalDelta::CREATED));
+  }
+
+  auto serialized = journal.serialize(3);
+  EXPECT_EQ(3, serialized.entries.size());
+  EXPECT_EQ(3, serialized.paths.size());
+  EXPECT_EQ(7, serialized.truncatedSequence);
+  EXPECT_EQ(11, serialized.nextSequence);
+
+  Journal restored;
+  restored.load(serialized);
+  auto merged = restored.accumulateRange(8);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_FALSE(merged->isTruncated);
+  EXPECT_EQ(3, merged->createdFilesInOverlay.size());
+
+  // Positions from before the saved entries can no longer be answered.
+  merged = restored.accumulateRange(7);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_TRUE(merged->isTruncated);
+}
+
+TEST(Journal, loadRejectsInconsistentData) {
+  Journal journal;
+  journal.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"a"}, JournalDelta::CREATED));
+  journal.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"b"}, JournalDelta::CREATED));
+
+  auto badIndex = journal.serialize(10);
+  badIndex.entries.back().createdFilesInOverlay.push_back(5);
+  auto badOrder = journal.serialize(10);
+  std::swap(badOrder.entries.front(), badOrder.entries.back());
+  auto badNextSequence = journal.serialize(10);
+  badNextSequence.nextSequence = 2;
+
+  Journal restored;
+  restored.addDelta(
+      std::make_unique<JournalDelta>(RelativePath{"x"}, JournalDelta::CREATED));
+  EXPECT_THROW(restored.load(badIndex), std::invalid_argument);
+  EXPECT_THROW(restored.load(badOrder), std::invalid_argument);
+  EXPECT_THROW(restored.load(badNextSequence), std::invalid_argument);
+
+  // The journal is left as it was.
+  EXPECT_EQ(1, restored.getLatest()->toSequence);
+  EXPECT_THAT(
+      restored.accumulateRange()->createdFilesInOverlay,
+      UnorderedElementsAre(RelativePath{"x"}));
+}
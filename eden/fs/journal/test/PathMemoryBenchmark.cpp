@@ -0,0 +1,178 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <malloc.h>
+#include <unordered_set>
+
+#include "eden/fs/journal/Journal.h"
+#include "eden/fs/journal/JournalDelta.h"
+#include "eden/fs/utils/PathTable.h"
+
+DEFINE_uint64(dirs, 100, "The number of top-level directories");
+DEFINE_uint64(subdirs, 20, "The number of subdirectories in each directory");
+DEFINE_uint64(files, 50, "The number of files in each subdirectory");
+
+using namespace facebook::eden;
+using folly::to;
+using std::string;
+
+namespace {
+
+/**
+ * Return paths shaped like those in a large repository: deep, with long
+ * shared directory prefixes.
+ */
+std::vector<RelativePath> makePaths() {
+  std::vector<RelativePath> paths;
+  paths.reserve(FLAGS_dirs * FLAGS_subdirs * FLAGS_files);
+  for (uint64_t dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (uint64_t subdir = 0; subdir < FLAGS_subdirs; ++subdir) {
+      for (uint64_t file = 0; file < FLAGS_files; ++file) {
+        paths.emplace_back(to<string>(
+            "project",
+            dir,
+            "/src/main/java/com/example/module",
+            subdir,
+            "/SourceFile",
+            file,
+            ".java"));
+      }
+    }
+  }
+  return paths;
+}
+
+size_t getHeapInUse() {
+  return static_cast<size_t>(mallinfo().uordblks);
+}
+
+/**
+ * Report how much heap memory building a structure holding every path
+ * takes, as measured by malloc rather than estimated.
+ */
+template <typename Fn>
+void reportMemory(
+    folly::StringPiece name,
+    const std::vector<RelativePath>& paths,
+    Fn&& build) {
+  auto before = getHeapInUse();
+  auto result = build(paths);
+  auto after = getHeapInUse();
+  folly::doNotOptimizeAway(result);
+  printf(
+      "%-40s %10zu bytes (%.1f bytes per path)\n",
+      name.str().c_str(),
+      after - before,
+      static_cast<double>(after - before) / paths.size());
+}
+
+} // namespace
+
+BENCHMARK(insert_relative_path_set, numIters) {
+  std::vector<RelativePath> paths;
+  BENCHMARK_SUSPEND {
+    paths = makePaths();
+  }
+
+  std::unordered_set<RelativePath> set;
+  for (size_t n = 0; n < numIters; ++n) {
+    set.insert(paths[n % paths.size()]);
+  }
+  folly::doNotOptimizeAway(set);
+
+  BENCHMARK_SUSPEND {
+    set.clear();
+    paths.clear();
+  }
+}
+
+BENCHMARK_RELATIVE(intern_path_table, numIters) {
+  std::vector<RelativePath> paths;
+  BENCHMARK_SUSPEND {
+    paths = makePaths();
+  }
+
+  PathTable table;
+  std::unordered_set<PathTable::Id> set;
+  for (size_t n = 0; n < numIters; ++n) {
+    auto id = table.intern(paths[n % paths.size()]);
+    if (!set.insert(id).second) {
+      table.release(id);
+    }
+  }
+  folly::doNotOptimizeAway(set);
+
+  BENCHMARK_SUSPEND {
+    table = PathTable{};
+    set.clear();
+    paths.clear();
+  }
+}
+
+BENCHMARK(journal_add_delta, numIters) {
+  std::vector<RelativePath> paths;
+  BENCHMARK_SUSPEND {
+    paths = makePaths();
+  }
+
+  Journal journal;
+  for (size_t n = 0; n < numIters; ++n) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        JournalDelta{paths[n % paths.size()]}));
+  }
+
+  BENCHMARK_SUSPEND {
+    paths.clear();
+  }
+}
+
+BENCHMARK(journal_accumulate_range, numIters) {
+  Journal journal;
+  BENCHMARK_SUSPEND {
+    for (const auto& path : makePaths()) {
+      journal.addDelta(std::make_unique<JournalDelta>(JournalDelta{path}));
+    }
+  }
+
+  for (size_t n = 0; n < numIters; ++n) {
+    auto range = journal.accumulateRange();
+    folly::doNotOptimizeAway(range);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+
+  auto paths = makePaths();
+  printf("\nmemory used to hold %zu distinct paths:\n", paths.size());
+  reportMemory("std::unordered_set<RelativePath>", paths, [](const auto& ps) {
+    return std::make_unique<std::unordered_set<RelativePath>>(
+        ps.begin(), ps.end());
+  });
+  reportMemory("PathTable", paths, [](const auto& ps) {
+    auto table = std::make_unique<PathTable>();
+    for (const auto& path : ps) {
+      table->intern(path);
+    }
+    return table;
+  });
+  reportMemory("Journal with one entry per path", paths, [](const auto& ps) {
+    auto journal = std::make_unique<Journal>();
+    for (const auto& path : ps) {
+      journal->addDelta(std::make_unique<JournalDelta>(JournalDelta{path}));
+    }
+    return journal;
+  });
+  return 0;
+}
@@ -12,6 +12,7 @@
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/utils/PathFuncs.h"
 
+#include <folly/Optional.h>
 #include <folly/String.h>
 #include <iosfwd>
 
@@ -51,6 +52,22 @@ class TreeEntry {
       TreeEntryType type)
       : type_(type), hash_(hash), name_(PathComponentPiece(name)) {}
 
+  /**
+   * Create an entry that also records the size and SHA-1 of the blob's
+   * contents, for backing stores that can supply them along with the tree.
+   */
+  explicit TreeEntry(
+      const Hash& hash,
+      folly::StringPiece name,
+      TreeEntryType type,
+      folly::Optional<uint64_t> size,
+      folly::Optional<Hash> contentSha1)
+      : type_(type),
+        hash_(hash),
+        name_(PathComponentPiece(name)),
+        size_(size),
+        contentSha1_(contentSha1) {}
+
   const Hash& getHash() const {
     return hash_;
   }
@@ -67,15 +84,39 @@ class TreeEntry {
     return type_;
   }
 
+  /**
+   * The size of the blob's contents, if the backing store supplied it.
+   * This is never set for trees.
+   */
+  const folly::Optional<uint64_t>& getSize() const {
+    return size_;
+  }
+
+  /**
+   * The SHA-1 of the blob's contents, if the backing store supplied it.
+   * This is never set for trees.
+   */
+  const folly::Optional<Hash>& getContentSha1() const {
+    return contentSha1_;
+  }
+
   std::string toLogString() const;
 
  private:
   TreeEntryType type_;
   Hash hash_;
   PathComponent name_;
+  folly::Optional<uint64_t> size_;
+  folly::Optional<Hash> contentSha1_;
 };
 
 std::ostream& operator<<(std::ostream& os, TreeEntryType type);
+
+/**
+ * Entries compare equal if they have the same name, type, and hash.  The
+ * size and content SHA-1 are derived from the hash, so they are not compared;
+ * an entry that carries them is equal to one that does not.
+ */
 bool operator==(const TreeEntry& entry1, const TreeEntry& entry2);
 bool operator!=(const TreeEntry& entry1, const TreeEntry& entry2);
 } // namespace eden
@@ -63,20 +63,97 @@ void GitIgnore::loadFile(StringPiece contents) {
   // stop at the first match.
   std::reverse(newRules.begin(), newRules.end());
   std::swap(rules_, newRules);
+  buildIndex();
+}
+
+void GitIgnore::buildIndex() {
+  basenameLiterals_.clear();
+  pathLiterals_.clear();
+  basenameSuffixes_.clear();
+  suffixLengths_.clear();
+  globRules_.clear();
+
+  for (uint32_t idx = 0; idx < rules_.size(); ++idx) {
+    const auto& rule = rules_[idx];
+    switch (rule.getKind()) {
+      case GitIgnorePattern::Kind::LITERAL:
+        if (rule.isBasenameOnly()) {
+          basenameLiterals_[rule.getLiteral()].push_back(idx);
+        } else {
+          pathLiterals_[rule.getLiteral()].push_back(idx);
+        }
+        continue;
+      case GitIgnorePattern::Kind::SUFFIX:
+        basenameSuffixes_[rule.getLiteral()].push_back(idx);
+        suffixLengths_.push_back(rule.getLiteral().size());
+        continue;
+      case GitIgnorePattern::Kind::GLOB:
+        globRules_.push_back(idx);
+        continue;
+    }
+  }
+
+  std::sort(suffixLengths_.begin(), suffixLengths_.end());
+  suffixLengths_.erase(
+      std::unique(suffixLengths_.begin(), suffixLengths_.end()),
+      suffixLengths_.end());
 }
 
 GitIgnore::MatchResult GitIgnore::match(
     RelativePathPiece path,
     PathComponentPiece basename,
     FileType fileType) const {
-  for (const auto& pattern : rules_) {
-    auto result = pattern.match(path, basename, fileType);
+  // The result is that of the lowest-numbered rule that matches.  Find the
+  // best candidate from the lookup tables first.
+  size_t bestIdx = rules_.size();
+  MatchResult bestResult = NO_MATCH;
+  const auto checkRules = [&](const RuleMap& map, StringPiece key) {
+    if (map.empty()) {
+      // Most directories have no ignore file; avoid hashing for them.
+      return;
+    }
+    auto it = map.find(key);
+    if (it == map.end()) {
+      return;
+    }
+    for (auto idx : it->second) {
+      if (idx >= bestIdx) {
+        break;
+      }
+      // A rule may still fail to match if it only applies to directories.
+      auto result = rules_[idx].resultForMatchedText(fileType);
+      if (result != NO_MATCH) {
+        bestIdx = idx;
+        bestResult = result;
+        break;
+      }
+    }
+  };
+
+  const auto basenameStr = basename.stringPiece();
+  checkRules(basenameLiterals_, basenameStr);
+  checkRules(pathLiterals_, path.stringPiece());
+  for (auto length : suffixLengths_) {
+    if (length > basenameStr.size()) {
+      break;
+    }
+    checkRules(
+        basenameSuffixes_,
+        basenameStr.subpiece(basenameStr.size() - length));
+  }
+
+  // Only glob rules with higher precedence can change the answer.
+  for (auto idx : globRules_) {
+    if (idx >= bestIdx) {
+      break;
+    }
+    auto result = rules_[idx].match(path, basename, fileType);
     if (result != NO_MATCH) {
       return result;
     }
   }
 
-  return NO_MATCH;
+  return bestResult;
 }
 
 string GitIgnore::matchString(MatchResult result) {
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <unordered_map>
 #include <vector>
 #include "eden/fs/utils/PathFuncs.h"
 
@@ -167,12 +168,44 @@ class GitIgnore {
   static std::string matchString(MatchResult result);
 
  private:
+  /**
+   * Indices into rules_, in increasing order (so from highest to lowest
+   * precedence).
+   */
+  using RuleList = std::vector<uint32_t>;
+  using RuleMap =
+      std::unordered_map<folly::StringPiece, RuleList, folly::StringPieceHash>;
+
+  /**
+   * Build the lookup tables below from rules_.
+   */
+  void buildIndex();
+
   /*
    * The patterns loaded from the gitignore file.  These are sorted from
    * highest to lowest precedence (the reverse of the order they are actually
    * listed in the .gitignore file).
+   *
+   * This is never modified after buildIndex() runs: the RuleMap keys point
+   * at the patterns' literal text.  (Moving a GitIgnore moves the vector's
+   * storage without moving the patterns in it, so the keys stay valid.)
    */
   std::vector<GitIgnorePattern> rules_;
+
+  /*
+   * Rather than trying every rule in order, match() looks up the rules that
+   * can only match one exact basename, one exact path, or one basename
+   * suffix in these tables, and only runs the remaining glob rules that
+   * have higher precedence than the best rule found that way.
+   */
+  RuleMap basenameLiterals_;
+  RuleMap pathLiterals_;
+  RuleMap basenameSuffixes_;
+  /**
+   * The distinct lengths of the keys in basenameSuffixes_, sorted.
+   */
+  std::vector<size_t> suffixLengths_;
+  RuleList globRules_;
 };
 } // namespace eden
 } // namespace facebook
@@ -9,6 +9,8 @@
  */
 #include "GitIgnorePattern.h"
 
+#include <algorithm>
+
 using folly::Optional;
 using folly::StringPiece;
 using std::string;
@@ -139,11 +141,38 @@ Optional<GitIgnorePattern> GitIgnorePattern::parseLine(StringPiece line) {
     return folly::none;
   }
 
-  return GitIgnorePattern(flags, std::move(matcher).value());
+  // Check for patterns that do not need the GlobMatcher at all.  Literal
+  // names and "*.ext" make up the bulk of most ignore files.
+  auto kind = Kind::GLOB;
+  StringPiece literal;
+  const auto isLiteral = [](StringPiece text) {
+    return std::none_of(text.begin(), text.end(), [](char c) {
+      return c == '*' || c == '?' || c == '[' || c == '\\';
+    });
+  };
+  if (isLiteral(line)) {
+    kind = Kind::LITERAL;
+    literal = line;
+  } else if (
+      (flags & FLAG_BASENAME_ONLY) && line[0] == '*' &&
+      isLiteral(line.subpiece(1))) {
+    // '*' matches anything except '/', and basenames never contain '/'.
+    kind = Kind::SUFFIX;
+    literal = line.subpiece(1);
+  }
+
+  return GitIgnorePattern(flags, std::move(matcher).value(), kind, literal);
 }
 
-GitIgnorePattern::GitIgnorePattern(uint32_t flags, GlobMatcher&& matcher)
-    : flags_(flags), matcher_(std::move(matcher)) {}
+GitIgnorePattern::GitIgnorePattern(
+    uint32_t flags,
+    GlobMatcher&& matcher,
+    Kind kind,
+    StringPiece literal)
+    : flags_(flags),
+      matcher_(std::move(matcher)),
+      kind_(kind),
+      literal_(literal.str()) {}
 
 GitIgnorePattern::~GitIgnorePattern() {}
 
@@ -170,5 +199,13 @@ GitIgnore::MatchResult GitIgnorePattern::match(
 
   return GitIgnore::NO_MATCH;
 }
+
+GitIgnore::MatchResult GitIgnorePattern::resultForMatchedText(
+    GitIgnore::FileType fileType) const {
+  if ((flags_ & FLAG_MUST_BE_DIR) && (fileType != GitIgnore::TYPE_DIR)) {
+    return GitIgnore::NO_MATCH;
+  }
+  return (flags_ & FLAG_INCLUDE) ? GitIgnore::INCLUDE : GitIgnore::EXCLUDE;
+}
 } // namespace eden
 } // namespace facebook
@@ -11,6 +11,7 @@
 
 #include <folly/Optional.h>
 #include <folly/Range.h>
+#include <string>
 #include "eden/fs/model/git/GitIgnore.h"
 #include "eden/fs/model/git/GlobMatcher.h"
 
@@ -69,6 +70,59 @@ class GitIgnorePattern {
       PathComponentPiece basename,
       GitIgnore::FileType fileType) const;
 
+  /**
+   * How this pattern can be matched without running the GlobMatcher.
+   *
+   * GitIgnore uses this to put the common patterns into hash buckets, so that
+   * it does not have to try every pattern in a large ignore file one at a
+   * time.
+   */
+  enum class Kind {
+    /**
+     * The pattern contains no wildcards or escapes, and only matches text
+     * exactly equal to getLiteral().
+     */
+    LITERAL,
+    /**
+     * The pattern is "*" followed by getLiteral(), and only matches basenames
+     * ending in getLiteral().  (For example "*.o")
+     */
+    SUFFIX,
+    /**
+     * Anything else.  The pattern must be checked with match().
+     */
+    GLOB,
+  };
+
+  Kind getKind() const {
+    return kind_;
+  }
+
+  /**
+   * Get the literal text for LITERAL and SUFFIX patterns.
+   */
+  folly::StringPiece getLiteral() const {
+    return literal_;
+  }
+
+  /**
+   * Returns true if this pattern is matched against just the basename of a
+   * path, rather than the path relative to the ignore file's directory.
+   */
+  bool isBasenameOnly() const {
+    return flags_ & FLAG_BASENAME_ONLY;
+  }
+
+  /**
+   * Get the result of match() for a path of the given type that this
+   * pattern's text matches.
+   *
+   * This returns NO_MATCH for non-directories if the pattern only matches
+   * directories.
+   */
+  GitIgnore::MatchResult resultForMatchedText(
+      GitIgnore::FileType fileType) const;
+
  private:
   /**
    * Flag values that can be bitwise-ORed to create the flags_ value.
@@ -84,7 +138,11 @@ class GitIgnorePattern {
     FLAG_BASENAME_ONLY = 0x04,
   };
 
-  GitIgnorePattern(uint32_t flags, GlobMatcher&& matcher);
+  GitIgnorePattern(
+      uint32_t flags,
+      GlobMatcher&& matcher,
+      Kind kind,
+      folly::StringPiece literal);
 
   GitIgnorePattern(GitIgnorePattern const&) = delete;
   GitIgnorePattern& operator=(GitIgnorePattern const&) = delete;
@@ -97,6 +155,15 @@ class GitIgnorePattern {
    * The GlobMatcher object for performing matching.
    */
   GlobMatcher matcher_;
+  /**
+   * Whether the pattern can be matched by comparing against literal_.
+   */
+  Kind kind_{Kind::GLOB};
+  /**
+   * The literal text for LITERAL and SUFFIX patterns, or empty for GLOB
+   * patterns.
+   */
+  std::string literal_;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,156 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/model/git/GlobMatcherSet.h"
+
+#include <algorithm>
+
+using folly::Expected;
+using folly::StringPiece;
+using std::string;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+/**
+ * Returns true if the text contains no glob special characters and no
+ * slashes, so that it only matches itself within a single path component.
+ */
+bool isLiteralComponent(StringPiece text) {
+  return std::none_of(text.begin(), text.end(), [](char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\' || c == '/';
+  });
+}
+
+bool isLiteral(StringPiece text) {
+  return std::none_of(text.begin(), text.end(), [](char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+  });
+}
+} // namespace
+
+GlobMatcherSet::GlobMatcherSet() {}
+
+GlobMatcherSet::~GlobMatcherSet() {}
+
+Expected<size_t, string> GlobMatcherSet::add(StringPiece glob) {
+  // Always compile the pattern, so that invalid patterns are rejected the
+  // same way GlobMatcher::create() would reject them.
+  auto matcher = GlobMatcher::create(glob);
+  if (matcher.hasError()) {
+    return folly::makeUnexpected(std::move(matcher).error());
+  }
+
+  auto id = numPatterns_++;
+  if (isLiteral(glob)) {
+    addLiteral(exact_, nullptr, glob, id);
+  } else if (glob.startsWith("**/*") && isLiteralComponent(glob.subpiece(4))) {
+    addLiteral(basenameSuffix_, &basenameSuffixLengths_, glob.subpiece(4), id);
+  } else if (glob.startsWith("**/") && isLiteralComponent(glob.subpiece(3))) {
+    addLiteral(basename_, nullptr, glob.subpiece(3), id);
+  } else if (glob.startsWith("*") && isLiteralComponent(glob.subpiece(1))) {
+    addLiteral(suffix_, &suffixLengths_, glob.subpiece(1), id);
+  } else {
+    globs_.emplace_back(id, std::move(matcher).value());
+  }
+  return id;
+}
+
+void GlobMatcherSet::addLiteral(
+    LiteralMap& map,
+    std::vector<size_t>* lengths,
+    StringPiece literal,
+    size_t id) {
+  auto it = map.find(literal);
+  if (it == map.end()) {
+    literals_.emplace_back(literal.str());
+    it = map.emplace(StringPiece{literals_.back()}, IdList{}).first;
+  }
+  it->second.push_back(id);
+
+  if (lengths) {
+    auto pos =
+        std::lower_bound(lengths->begin(), lengths->end(), literal.size());
+    if (pos == lengths->end() || *pos != literal.size()) {
+      lengths->insert(pos, literal.size());
+    }
+  }
+}
+
+template <typename Fn>
+void GlobMatcherSet::forEachMatch(StringPiece text, Fn&& fn) const {
+  // Returns false if fn asked to stop.
+  auto checkMap = [&](const LiteralMap& map, StringPiece key) {
+    if (map.empty()) {
+      return true;
+    }
+    auto it = map.find(key);
+    if (it == map.end()) {
+      return true;
+    }
+    for (auto id : it->second) {
+      if (!fn(id)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  auto checkSuffixes = [&](const LiteralMap& map,
+                           const std::vector<size_t>& lengths,
+                           StringPiece name) {
+    for (auto length : lengths) {
+      if (length > name.size()) {
+        break;
+      }
+      if (!checkMap(map, name.subpiece(name.size() - length))) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  auto lastSlash = text.rfind('/');
+  auto basename =
+      lastSlash == StringPiece::npos ? text : text.subpiece(lastSlash + 1);
+
+  if (!checkMap(exact_, text) || !checkMap(basename_, basename) ||
+      !checkSuffixes(basenameSuffix_, basenameSuffixLengths_, basename)) {
+    return;
+  }
+  // '*' does not match '/', so these only apply to single components.
+  if (lastSlash == StringPiece::npos &&
+      !checkSuffixes(suffix_, suffixLengths_, text)) {
+    return;
+  }
+  for (const auto& glob : globs_) {
+    if (glob.second.match(text) && !fn(glob.first)) {
+      return;
+    }
+  }
+}
+
+void GlobMatcherSet::match(StringPiece text, std::vector<size_t>& matches)
+    const {
+  forEachMatch(text, [&](size_t id) {
+    matches.push_back(id);
+    return true;
+  });
+}
+
+bool GlobMatcherSet::matchAny(StringPiece text) const {
+  bool found = false;
+  forEachMatch(text, [&](size_t) {
+    found = true;
+    return false;
+  });
+  return found;
+}
+} // namespace eden
+} // namespace facebook
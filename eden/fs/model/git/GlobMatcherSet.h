@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Expected.h>
+#include <folly/Range.h>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/model/git/GlobMatcher.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * GlobMatcherSet matches text against many glob patterns at once, and
+ * reports every pattern that matches.
+ *
+ * The patterns used in practice are mostly exact names, "*.ext", "**\/name",
+ * and "**\/*.ext".  These do not need a GlobMatcher at all: GlobMatcherSet
+ * keys them by their literal text in hash tables, so checking a path costs a
+ * few hash lookups no matter how many of these patterns there are.  Only the
+ * remaining patterns are run through their own GlobMatchers.
+ *
+ * The results are identical to calling GlobMatcher::match() for each pattern.
+ */
+class GlobMatcherSet {
+ public:
+  GlobMatcherSet();
+  ~GlobMatcherSet();
+  GlobMatcherSet(GlobMatcherSet&&) = default;
+  GlobMatcherSet& operator=(GlobMatcherSet&&) = default;
+
+  /**
+   * Add a glob pattern to the set.
+   *
+   * Returns the pattern's ID, or a string describing why the glob pattern was
+   * invalid.  IDs are assigned sequentially starting from 0.
+   */
+  folly::Expected<size_t, std::string> add(folly::StringPiece glob);
+
+  /**
+   * Get the number of patterns in the set.
+   */
+  size_t size() const {
+    return numPatterns_;
+  }
+
+  /**
+   * Append the IDs of all patterns that match the text to matches.
+   *
+   * The IDs are appended in no particular order, but each appears at most
+   * once.
+   */
+  void match(folly::StringPiece text, std::vector<size_t>& matches) const;
+
+  /**
+   * Returns true if any pattern in the set matches the text.
+   */
+  bool matchAny(folly::StringPiece text) const;
+
+ private:
+  using IdList = std::vector<size_t>;
+  using LiteralMap =
+      std::unordered_map<folly::StringPiece, IdList, folly::StringPieceHash>;
+
+  /**
+   * Call fn(id) for each pattern that matches the text, stopping early if
+   * fn returns false.
+   */
+  template <typename Fn>
+  void forEachMatch(folly::StringPiece text, Fn&& fn) const;
+
+  void addLiteral(
+      LiteralMap& map,
+      std::vector<size_t>* lengths,
+      folly::StringPiece literal,
+      size_t id);
+
+  /**
+   * The literal text of the patterns in the hash tables.  The LiteralMap keys
+   * point into these strings; a deque never moves its elements as it grows.
+   */
+  std::deque<std::string> literals_;
+
+  // Patterns that match text exactly equal to the key.
+  LiteralMap exact_;
+  // "*" + key: text without a '/' that ends in the key.
+  LiteralMap suffix_;
+  // "**/" + key: text whose final component is the key.
+  LiteralMap basename_;
+  // "**/*" + key: text whose final component ends in the key.
+  LiteralMap basenameSuffix_;
+  // The distinct key lengths in suffix_ and basenameSuffix_, sorted.
+  std::vector<size_t> suffixLengths_;
+  std::vector<size_t> basenameSuffixLengths_;
+
+  // All other patterns.
+  std::vector<std::pair<size_t, GlobMatcher>> globs_;
+
+  size_t numPatterns_{0};
+};
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/Optional.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+
+#include "eden/fs/model/git/GitIgnore.h"
+#include "eden/fs/model/git/GitIgnorePattern.h"
+#include "eden/fs/model/git/GitIgnoreStack.h"
+
+DEFINE_uint64(rules, 500, "The number of rules of each kind to generate");
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using folly::to;
+using std::string;
+
+namespace {
+
+/**
+ * Generate an ignore file shaped like the large ones found in practice:
+ * mostly literal names and "*.ext" patterns, plus some real globs.
+ */
+string makeIgnoreFile() {
+  string contents;
+  for (uint64_t n = 0; n < FLAGS_rules; ++n) {
+    contents += to<string>("generated_file", n, "\n");
+    contents += to<string>("*.ext", n, "\n");
+    contents += to<string>("/build/output", n, "/\n");
+    if (n % 10 == 0) {
+      contents += to<string>("cache-", n, "-*\n");
+      contents += to<string>("**/tmp", n, "/*.log\n");
+      contents += to<string>("!keep", n, ".ext", n, "\n");
+    }
+  }
+  return contents;
+}
+
+std::vector<RelativePath> pathCorpus = {
+    RelativePath{"src/main.cpp"},
+    RelativePath{"src/lib/util.h"},
+    RelativePath{"README"},
+    RelativePath{"docs/generated_file42"},
+    RelativePath{"src/object.ext17"},
+    RelativePath{"src/keep30.ext30"},
+    RelativePath{"build/output12"},
+    RelativePath{"cache-100-xyz"},
+    RelativePath{"a/b/tmp20/debug.log"},
+    RelativePath{"third-party/project/include/header.hpp"},
+};
+
+/**
+ * Match paths the way GitIgnore did before it indexed its rules: try every
+ * pattern in precedence order until one matches.
+ */
+class SequentialIgnore {
+ public:
+  explicit SequentialIgnore(StringPiece contents) {
+    StringPiece remaining = contents;
+    while (!remaining.empty()) {
+      auto line = remaining.split_step('\n');
+      auto pattern = GitIgnorePattern::parseLine(line);
+      if (pattern.hasValue()) {
+        rules_.emplace_back(std::move(pattern).value());
+      }
+    }
+    std::reverse(rules_.begin(), rules_.end());
+  }
+
+  GitIgnore::MatchResult match(RelativePathPiece path) const {
+    auto basename = path.basename();
+    for (const auto& rule : rules_) {
+      auto result = rule.match(path, basename, GitIgnore::TYPE_FILE);
+      if (result != GitIgnore::NO_MATCH) {
+        return result;
+      }
+    }
+    return GitIgnore::NO_MATCH;
+  }
+
+ private:
+  std::vector<GitIgnorePattern> rules_;
+};
+
+template <typename Fn>
+void runMatch(size_t numIters, Fn&& match) {
+  size_t idx = 0;
+  for (size_t n = 0; n < numIters; ++n) {
+    auto result = match(pathCorpus[idx]);
+    folly::doNotOptimizeAway(result);
+    if (++idx >= pathCorpus.size()) {
+      idx = 0;
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK(match_sequential, numIters) {
+  folly::Optional<SequentialIgnore> ignore;
+  BENCHMARK_SUSPEND {
+    ignore.emplace(makeIgnoreFile());
+  }
+  runMatch(numIters, [&](RelativePathPiece path) {
+    return ignore->match(path);
+  });
+}
+
+BENCHMARK_RELATIVE(match_indexed, numIters) {
+  GitIgnore ignore;
+  BENCHMARK_SUSPEND {
+    ignore.loadFile(makeIgnoreFile());
+  }
+  runMatch(numIters, [&](RelativePathPiece path) {
+    return ignore.match(path, GitIgnore::TYPE_FILE);
+  });
+}
+
+BENCHMARK(match_stack, numIters) {
+  // A large ignore file at the repository root, with user and system rules
+  // below it on the stack.  Only the basenames of the corpus are used, since
+  // the stack only has levels for the root directory.
+  std::unique_ptr<GitIgnoreStack> system;
+  std::unique_ptr<GitIgnoreStack> user;
+  std::unique_ptr<GitIgnoreStack> root;
+  BENCHMARK_SUSPEND {
+    system = std::make_unique<GitIgnoreStack>(nullptr, "*.swp\n");
+    user = std::make_unique<GitIgnoreStack>(system.get(), ".DS_Store\n");
+    root = std::make_unique<GitIgnoreStack>(user.get(), makeIgnoreFile());
+  }
+  runMatch(numIters, [&](RelativePathPiece path) {
+    return root->match(
+        RelativePathPiece{path.basename().stringPiece()},
+        GitIgnore::TYPE_FILE);
+  });
+}
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -10,6 +10,7 @@
 #include <gtest/gtest.h>
 
 #include "eden/fs/model/git/GitIgnore.h"
+#include "eden/fs/model/git/GitIgnorePattern.h"
 
 using namespace facebook::eden;
 
@@ -668,3 +669,139 @@ TEST(GitIgnore, directory) {
   // path known to be a file.  It expects ignored directories earlier in the
   // path to have already been filtered out.
 }
+
+TEST(GitIgnore, precedenceAcrossPatternKinds) {
+  // Literal, suffix, and glob rules are looked up separately, but the last
+  // matching line in the file must still win.
+  GitIgnore ignore;
+  ignore.loadFile(
+      "*\n"
+      "*.txt\n"
+      "!keep*\n"
+      "keep.txt\n"
+      "!*.c\n"
+      "!src/*.h\n"
+      "docs/notes.txt\n"
+      "!*.old.txt\n"
+      "!*logs\n"
+      "logs/\n");
+
+  EXPECT_IGNORE(ignore, EXCLUDE, "keep.txt");
+  EXPECT_IGNORE(ignore, INCLUDE, "keep.c");
+  EXPECT_IGNORE(ignore, INCLUDE, "keep.h");
+  EXPECT_IGNORE(ignore, INCLUDE, "main.c");
+  EXPECT_IGNORE(ignore, INCLUDE, "a/b/main.c");
+  EXPECT_IGNORE(ignore, INCLUDE, "src/util.h");
+  EXPECT_IGNORE(ignore, EXCLUDE, "lib/util.h");
+  EXPECT_IGNORE(ignore, EXCLUDE, "docs/notes.txt");
+  EXPECT_IGNORE(ignore, EXCLUDE, "notes.txt");
+  EXPECT_IGNORE(ignore, INCLUDE, "docs/notes.old.txt");
+  EXPECT_IGNORE(ignore, INCLUDE, "a.old.txt");
+  EXPECT_IGNORE(ignore, INCLUDE, "logs");
+  EXPECT_IGNORE_DIR(ignore, EXCLUDE, "logs");
+  EXPECT_IGNORE_DIR(ignore, INCLUDE, "mylogs");
+}
+
+TEST(GitIgnore, lowerPrecedenceLiteralsAndSuffixes) {
+  GitIgnore ignore;
+  ignore.loadFile(
+      "!build\n"
+      "build/\n"
+      "*.o\n"
+      "!*.o/\n"
+      "*.pyc\n"
+      "!foo.pyc\n"
+      "/out/gen.txt\n"
+      "!gen.txt\n"
+      "foo*\n");
+
+  // A directory-only rule does not hide lower precedence rules for files.
+  EXPECT_IGNORE(ignore, INCLUDE, "build");
+  EXPECT_IGNORE_DIR(ignore, EXCLUDE, "build");
+  EXPECT_IGNORE(ignore, EXCLUDE, "x.o");
+  EXPECT_IGNORE_DIR(ignore, INCLUDE, "x.o");
+  EXPECT_IGNORE(ignore, EXCLUDE, ".o");
+  EXPECT_IGNORE(ignore, NO_MATCH, "o");
+
+  // The glob rule takes precedence over both the literal and suffix rules.
+  EXPECT_IGNORE(ignore, EXCLUDE, "foo.pyc");
+  EXPECT_IGNORE(ignore, EXCLUDE, "a/bar.pyc");
+  // The basename literal takes precedence over the path literal.
+  EXPECT_IGNORE(ignore, INCLUDE, "out/gen.txt");
+  EXPECT_IGNORE(ignore, INCLUDE, "gen.txt");
+  EXPECT_IGNORE(ignore, NO_MATCH, "a/out/gen.txt2");
+}
+
+TEST(GitIgnore, escapedPatternsAreNotLiterals) {
+  GitIgnore ignore;
+  ignore.loadFile(
+      "\\*.txt\n"
+      "\\#hash\n"
+      "a\\?\n");
+
+  EXPECT_IGNORE(ignore, EXCLUDE, "*.txt");
+  EXPECT_IGNORE(ignore, NO_MATCH, "test.txt");
+  EXPECT_IGNORE(ignore, EXCLUDE, "#hash");
+  EXPECT_IGNORE(ignore, EXCLUDE, "a?");
+  EXPECT_IGNORE(ignore, NO_MATCH, "ab");
+}
+
+TEST(GitIgnore, matchesSequentialPatternEvaluation) {
+  // Check the indexed lookup against trying each pattern in turn, for a mix
+  // of every pattern kind.
+  folly::StringPiece contents =
+      "*.o\n"
+      "*.tar.gz\n"
+      "!important.o\n"
+      "build/\n"
+      "/dist\n"
+      "docs/generated/\n"
+      "**/cache\n"
+      "tmp*\n"
+      "!tmp.keep\n"
+      "*~\n"
+      "src/**/*.gen.h\n"
+      "[Tt]humbs.db\n"
+      "!/dist/README\n"
+      "a?c\n"
+      "*\n"
+      "!*.*\n"
+      "!*/\n";
+  GitIgnore ignore;
+  ignore.loadFile(contents);
+
+  std::vector<GitIgnorePattern> patterns;
+  folly::StringPiece remaining = contents;
+  while (!remaining.empty()) {
+    auto pattern = GitIgnorePattern::parseLine(remaining.split_step('\n'));
+    if (pattern.hasValue()) {
+      patterns.emplace_back(std::move(pattern).value());
+    }
+  }
+
+  std::vector<std::string> paths = {
+      "a.o",         "src/a.o",        "important.o",    "x/important.o",
+      "a.tar.gz",    "tar.gz",         "a.gz",           "build",
+      "x/build",     "dist",           "x/dist",         "dist/README",
+      "docs",        "docs/generated", "cache",          "a/b/cache",
+      "tmp",         "tmpfile",        "tmp.keep",       "x/tmp.keep",
+      "file~",       "~",              "src/a/b.gen.h",  "src/b.gen.h",
+      "Thumbs.db",   "thumbs.db",      "abc",            "a/abc",
+      "abcd",        "Makefile",       "README",         "x/y/z",
+      ".hidden",     "a.b.c",          "",
+  };
+  for (const auto& path : paths) {
+    for (auto fileType : {GitIgnore::TYPE_FILE, GitIgnore::TYPE_DIR}) {
+      RelativePathPiece relPath{path};
+      auto expected = GitIgnore::NO_MATCH;
+      for (auto it = patterns.rbegin(); it != patterns.rend(); ++it) {
+        expected = it->match(relPath, fileType);
+        if (expected != GitIgnore::NO_MATCH) {
+          break;
+        }
+      }
+      EXPECT_EQ(expected, ignore.match(relPath, fileType))
+          << "path \"" << path << "\" type " << fileType;
+    }
+  }
+}
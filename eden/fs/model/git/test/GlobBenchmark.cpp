@@ -8,10 +8,13 @@
  *
  */
 #include <folly/Benchmark.h>
+#include <folly/Conv.h>
 #include <folly/init/Init.h>
 #include <re2/re2.h>
+#include <re2/set.h>
 
 #include "eden/fs/model/git/GlobMatcher.h"
+#include "eden/fs/model/git/GlobMatcherSet.h"
 #include "watchman/thirdparty/wildmatch/wildmatch.h"
 
 using namespace facebook::eden;
@@ -249,6 +252,161 @@ BENCHMARK_RELATIVE(fullpath_re2, numIters) {
   runBenchmark<RE2Impl>(numIters, ".*/[^/]io[^/]*o[^/]*", fullnameCorpus);
 }
 
+/*
+ * Benchmarks for matching a path against many patterns at once, as done for
+ * a single glob() call from a build tool containing hundreds of patterns.
+ * Each implementation counts how many patterns match.
+ */
+
+struct MultiPattern {
+  string glob;
+  string regex;
+};
+
+std::vector<MultiPattern> makeMultiPatterns() {
+  std::vector<MultiPattern> patterns;
+  for (int n = 0; n < 100; ++n) {
+    patterns.push_back({folly::to<string>("**/*.ext", n),
+                        folly::to<string>("(.*/)?[^/]*\\.ext", n)});
+    patterns.push_back({folly::to<string>("*.suffix", n),
+                        folly::to<string>("[^/]*\\.suffix", n)});
+    patterns.push_back(
+        {folly::to<string>("name", n), folly::to<string>("name", n)});
+    if (n % 10 == 0) {
+      patterns.push_back(
+          {folly::to<string>("kernel/**/gen", n, "?/*.c"),
+           folly::to<string>("kernel/(.*/)?gen", n, "[^/]/[^/]*\\.c")});
+    }
+  }
+  patterns.push_back({"**/*.c", "(.*/)?[^/]*\\.c"});
+  patterns.push_back(
+      {"Documentation/**/*.xml", "Documentation/(.*/)?[^/]*\\.xml"});
+  return patterns;
+}
+
+class MultiGlobMatcherImpl {
+ public:
+  void init(const std::vector<MultiPattern>& patterns) {
+    for (const auto& pattern : patterns) {
+      matchers_.emplace_back(GlobMatcher::create(pattern.glob).value());
+    }
+  }
+
+  size_t match(folly::StringPiece input) {
+    size_t count = 0;
+    for (const auto& matcher : matchers_) {
+      count += matcher.match(input) ? 1 : 0;
+    }
+    return count;
+  }
+
+ private:
+  std::vector<GlobMatcher> matchers_;
+};
+
+class MultiWildmatchImpl {
+ public:
+  void init(const std::vector<MultiPattern>& patterns) {
+    for (const auto& pattern : patterns) {
+      patterns_.push_back(pattern.glob);
+    }
+  }
+
+  size_t match(folly::StringPiece input) {
+    assert(input[input.size()] == '\0');
+    size_t count = 0;
+    for (const auto& pattern : patterns_) {
+      count += wildmatch(pattern.c_str(), input.data(), WM_PATHNAME, nullptr)
+          ? 1
+          : 0;
+    }
+    return count;
+  }
+
+ private:
+  std::vector<std::string> patterns_;
+};
+
+class MultiRE2Impl {
+ public:
+  void init(const std::vector<MultiPattern>& patterns) {
+    re2::RE2::Options options;
+    options.set_encoding(re2::RE2::Options::EncodingLatin1);
+    options.set_never_nl(false);
+    options.set_dot_nl(true);
+    options.set_never_capture(true);
+    options.set_case_sensitive(true);
+    set_.reset(new re2::RE2::Set(options, re2::RE2::ANCHOR_BOTH));
+    for (const auto& pattern : patterns) {
+      set_->Add(pattern.regex, nullptr);
+    }
+    set_->Compile();
+  }
+
+  size_t match(folly::StringPiece input) {
+    matches_.clear();
+    set_->Match(re2::StringPiece(input.begin(), input.size()), &matches_);
+    return matches_.size();
+  }
+
+ private:
+  std::unique_ptr<re2::RE2::Set> set_;
+  std::vector<int> matches_;
+};
+
+class GlobMatcherSetImpl {
+ public:
+  void init(const std::vector<MultiPattern>& patterns) {
+    for (const auto& pattern : patterns) {
+      set_.add(pattern.glob).value();
+    }
+  }
+
+  size_t match(folly::StringPiece input) {
+    matches_.clear();
+    set_.match(input, matches_);
+    return matches_.size();
+  }
+
+ private:
+  GlobMatcherSet set_;
+  std::vector<size_t> matches_;
+};
+
+template <typename Impl>
+void runMultiBenchmark(size_t numIters) {
+  Impl impl;
+  BENCHMARK_SUSPEND {
+    impl.init(makeMultiPatterns());
+  }
+
+  size_t idx = 0;
+  for (size_t n = 0; n < numIters; ++n) {
+    auto ret = impl.match(fullnameCorpus[idx]);
+    folly::doNotOptimizeAway(ret);
+    idx += 1;
+    if (idx >= fullnameCorpus.size()) {
+      idx = 0;
+    }
+  }
+}
+
+BENCHMARK(multiPattern_globmatch, numIters) {
+  runMultiBenchmark<MultiGlobMatcherImpl>(numIters);
+}
+
+BENCHMARK_RELATIVE(multiPattern_wildmatch, numIters) {
+  runMultiBenchmark<MultiWildmatchImpl>(numIters);
+}
+
+BENCHMARK_RELATIVE(multiPattern_re2set, numIters) {
+  runMultiBenchmark<MultiRE2Impl>(numIters);
+}
+
+BENCHMARK_RELATIVE(multiPattern_globmatcherset, numIters) {
+  runMultiBenchmark<GlobMatcherSetImpl>(numIters);
+}
+
 void initGlobBenchmark();
 
 int main(int argc, char* argv[]) {
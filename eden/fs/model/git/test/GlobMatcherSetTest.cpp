@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+
+#include "eden/fs/model/git/GlobMatcherSet.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using ::testing::UnorderedElementsAre;
+
+namespace {
+std::vector<size_t> matchIds(const GlobMatcherSet& set, StringPiece text) {
+  std::vector<size_t> matches;
+  set.match(text, matches);
+  return matches;
+}
+} // namespace
+
+TEST(GlobMatcherSet, reportsAllMatchingPatterns) {
+  GlobMatcherSet set;
+  EXPECT_EQ(0, set.add("README").value());
+  EXPECT_EQ(1, set.add("*.txt").value());
+  EXPECT_EQ(2, set.add("**/*.txt").value());
+  EXPECT_EQ(3, set.add("**/README").value());
+  EXPECT_EQ(4, set.add("doc/*.txt").value());
+  EXPECT_EQ(5, set.add("*.txt").value());
+  EXPECT_EQ(6, set.add("*").value());
+  EXPECT_EQ(7, set.size());
+
+  EXPECT_THAT(matchIds(set, "README"), UnorderedElementsAre(0, 3, 6));
+  EXPECT_THAT(matchIds(set, "doc/README"), UnorderedElementsAre(3));
+  EXPECT_THAT(matchIds(set, "a.txt"), UnorderedElementsAre(1, 2, 5, 6));
+  EXPECT_THAT(matchIds(set, "doc/a.txt"), UnorderedElementsAre(2, 4));
+  EXPECT_THAT(matchIds(set, "x/doc/a.txt"), UnorderedElementsAre(2));
+  EXPECT_THAT(matchIds(set, ".txt"), UnorderedElementsAre(1, 2, 5, 6));
+  EXPECT_THAT(matchIds(set, "doc/a.txt2"), UnorderedElementsAre());
+
+  EXPECT_TRUE(set.matchAny("doc/a.txt"));
+  EXPECT_FALSE(set.matchAny("doc/a.txt2"));
+}
+
+TEST(GlobMatcherSet, invalidPatterns) {
+  GlobMatcherSet set;
+  EXPECT_TRUE(set.add("abc[").hasError());
+  EXPECT_TRUE(set.add("foo**").hasError());
+  EXPECT_EQ(0, set.size());
+  EXPECT_EQ(0, set.add("abc").value());
+}
+
+TEST(GlobMatcherSet, matchesIndividualGlobMatchers) {
+  std::vector<StringPiece> globs = {
+      "README",     "src/main.c", "*.c",       "*",          "**/*",
+      "**/*.h",     "**/BUCK",    "*.tar.gz",  "**/*.tar.gz",
+      "src/**/*.c", "src/*/*.h",  "a?c",       "[ab]*",      "\\*.c",
+      "**/a\\*",    "*/",         "**/x/*.c",  "foo/**",     "*c",
+  };
+  std::vector<StringPiece> texts = {
+      "",          "README",   "a/README",    "src/main.c", "main.c",
+      "x/main.c",  "c",        ".c",          "a/b/c.h",    "c.h",
+      "BUCK",      "a/BUCK",   "a/BUCK2",     "a/",         "x.tar.gz",
+      "y/x.tar.gz", "tar.gz",  "src/a/b.c",   "src/a/b.h",  "abc",
+      "bc",        "*.c",      "a/a*",        "a/ab",       "x/x/y.c",
+      "foo",       "foo/bar",  "foo/bar/baz",
+  };
+
+  GlobMatcherSet set;
+  std::vector<GlobMatcher> matchers;
+  for (auto glob : globs) {
+    set.add(glob).value();
+    matchers.emplace_back(GlobMatcher::create(glob).value());
+  }
+
+  for (auto text : texts) {
+    std::vector<size_t> expected;
+    for (size_t id = 0; id < matchers.size(); ++id) {
+      if (matchers[id].match(text)) {
+        expected.push_back(id);
+      }
+    }
+    auto actual = matchIds(set, text);
+    std::sort(actual.begin(), actual.end());
+    EXPECT_EQ(expected, actual) << "for text \"" << text << "\"";
+    EXPECT_EQ(!expected.empty(), set.matchAny(text))
+        << "for text \"" << text << "\"";
+  }
+}
@@ -171,13 +171,19 @@ folly::Future<Optional<TakeoverData>> EdenServer::unmountAll(bool doTakeover) {
         if (doTakeover) {
           info.takeoverPromise.emplace();
           auto future = info.takeoverPromise->getFuture();
-          info.edenMount->getFuseChannel()->requestSessionExit();
+          info.edenMount->withFuseChannel([](fusell::FuseChannel* channel) {
+            if (!channel) {
+              throw std::runtime_error("FUSE is not running for this mount");
+            }
+            channel->requestSessionExit();
+          });
           futures.emplace_back(
               future.then([self = this, edenMount = info.edenMount](
                               TakeoverData::MountInfo takeover) {
                 self->serverState_.getPrivHelper()->fuseTakeoverShutdown(
                     edenMount->getPath().stringPiece());
                 takeover.inodeMap = edenMount->getInodeMap()->save();
+                takeover.journal = edenMount->serializeJournal();
                 return takeover;
               }));
         } else {
@@ -590,6 +596,9 @@ folly::Future<std::shared_ptr<EdenMount>> EdenServer::mount(
 
   if (optionalTakeover) {
     edenMount->getInodeMap()->load(optionalTakeover->inodeMap);
+    edenMount->restoreJournal(optionalTakeover->journal);
+  } else {
+    edenMount->restoreSavedJournal();
   }
 
   bool shouldSetMaxInodeNumber = !optionalTakeover;
@@ -18,16 +18,18 @@
 #include <folly/experimental/logging/xlog.h>
 #include <folly/futures/Future.h>
 #include <folly/stop_watch.h>
+#include <gflags/gflags.h>
 #include "eden/fs/config/ClientConfig.h"
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/inodes/Differ.h"
 #include "eden/fs/inodes/EdenDispatcher.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
-#include "eden/fs/inodes/InodeError.h"
 #include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/Overlay.h"
+#include "eden/fs/inodes/Sha1Batch.h"
 #include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/journal/JournalDelta.h"
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/Tree.h"
@@ -41,6 +43,11 @@
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
 
+DEFINE_uint64(
+    glob_stream_batch_size,
+    1000,
+    "The number of paths to send in each batch of streamGlob() results");
+
 using folly::Future;
 using folly::makeFuture;
 using folly::Optional;
@@ -160,6 +167,77 @@ class ThriftLogHelper {
 namespace facebook {
 namespace eden {
 
+namespace {
+/**
+ * The state of one streamGlob() request, which lives until the glob has been
+ * completely evaluated.
+ */
+class GlobStream {
+ public:
+  using Callback = apache::thrift::StreamingHandlerCallback<
+      std::unique_ptr<GlobResultBatch>>;
+
+  GlobStream(
+      std::unique_ptr<Callback> callback,
+      const ObjectStore* store,
+      folly::Executor* executor)
+      : callback_(std::move(callback)),
+        batcher_(
+            FLAGS_glob_stream_batch_size,
+            [this](std::vector<std::string>&& paths) {
+              send(std::move(paths));
+            }),
+        context_(
+            store,
+            executor,
+            GlobContext::getDefaultMaxParallelism(),
+            [this](std::vector<RelativePath>&& matches) {
+              batcher_.add(std::move(matches));
+            }) {}
+
+  GlobContext* getContext() {
+    return &context_;
+  }
+
+  /**
+   * Send any remaining results, followed by the end of the stream or the
+   * error that ended it.
+   */
+  static void finish(
+      std::shared_ptr<GlobStream> self,
+      folly::Try<folly::Unit>&& result) {
+    auto evb = self->callback_->getEventBase();
+    if (result.hasException()) {
+      evb->runInEventBaseThread([self, ew = std::move(result.exception())]() {
+        self->callback_->exception(
+            folly::make_exception_wrapper<EdenError>(newEdenError(ew)));
+      });
+      return;
+    }
+    self->batcher_.flush();
+    evb->runInEventBaseThread([self]() { self->callback_->done(); });
+  }
+
+ private:
+  void send(std::vector<std::string>&& paths) {
+    GlobResultBatch batch;
+    batch.matchingFiles = std::move(paths);
+    // The callback may only be used on its EventBase thread.  Batches and
+    // the end of the stream are queued there in the order they are sent.
+    callback_->getEventBase()->runInEventBaseThread(
+        [this, batch = std::move(batch)]() mutable {
+          if (callback_->isRequestActive()) {
+            callback_->write(std::move(batch));
+          }
+        });
+  }
+
+  std::unique_ptr<Callback> callback_;
+  GlobBatcher batcher_;
+  GlobContext context_;
+};
+} // namespace
+
 EdenServiceHandler::EdenServiceHandler(EdenServer* server)
     : FacebookBase2("Eden"), server_(server) {}
 
@@ -224,6 +302,21 @@ void EdenServiceHandler::checkOutRevision(
   results = checkoutFuture.get();
 }
 
+void EdenServiceHandler::getCheckoutProgress(
+    CheckoutProgress& out,
+    std::unique_ptr<std::string> mountPoint) {
+  auto helper = INSTRUMENT_THRIFT_CALL(folly::LogLevel::DBG3, *mountPoint);
+  auto edenMount = server_->getMount(*mountPoint);
+  out = edenMount->getCheckoutProgress();
+}
+
+bool EdenServiceHandler::cancelCheckout(
+    std::unique_ptr<std::string> mountPoint) {
+  auto helper = INSTRUMENT_THRIFT_CALL(folly::LogLevel::DBG1, *mountPoint);
+  auto edenMount = server_->getMount(*mountPoint);
+  return edenMount->cancelCheckout();
+}
+
 void EdenServiceHandler::resetParentCommits(
     std::unique_ptr<std::string> mountPoint,
     std::unique_ptr<WorkingDirectoryParents> parents) {
@@ -249,12 +342,13 @@ void EdenServiceHandler::getSHA1(
       *mountPoint,
       "[" + folly::join(", ", *paths.get()) + "]");
 
-  vector<Future<Hash>> futures;
-  for (const auto& path : *paths) {
-    futures.emplace_back(getSHA1ForPathDefensively(*mountPoint, path));
-  }
-
-  auto results = folly::collectAll(std::move(futures)).get();
+  folly::stop_watch<std::chrono::microseconds> batchTimer;
+  auto edenMount = server_->getMount(*mountPoint);
+  auto numPaths = paths->size();
+  auto results =
+      getSha1Batch(
+          edenMount, std::move(*paths), edenMount->getThreadPool().get())
+          .get();
   for (auto& result : results) {
     out.emplace_back();
     SHA1Result& sha1Result = out.back();
@@ -264,39 +358,14 @@ void EdenServiceHandler::getSHA1(
       sha1Result.set_error(newEdenError(result.exception()));
     }
   }
-}
 
-Future<Hash> EdenServiceHandler::getSHA1ForPathDefensively(
-    StringPiece mountPoint,
-    StringPiece path) noexcept {
-  // Calls getSHA1ForPath() and traps all immediate exceptions and converts
-  // them in to a Future result.
-  try {
-    return getSHA1ForPath(mountPoint, path);
-  } catch (const std::system_error& e) {
-    return makeFuture<Hash>(newEdenError(e));
-  }
-}
-
-Future<Hash> EdenServiceHandler::getSHA1ForPath(
-    StringPiece mountPoint,
-    StringPiece path) {
-  if (path.empty()) {
-    return makeFuture<Hash>(
-        newEdenError(EINVAL, "path cannot be the empty string"));
-  }
-
-  auto edenMount = server_->getMount(mountPoint);
-  auto relativePath = RelativePathPiece{path};
-  return edenMount->getInode(relativePath).then([](const InodePtr& inode) {
-    auto fileInode = inode.asFilePtr();
-    if (!S_ISREG(fileInode->getMode())) {
-      // We intentionally want to refuse to compute the SHA1 of symlinks
-      return makeFuture<Hash>(
-          InodeError(EINVAL, fileInode, "file is a symlink"));
-    }
-    return fileInode->getSha1();
-  });
+  auto elapsed = batchTimer.elapsed();
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now().time_since_epoch());
+  server_->getStats()->get()->recordLatency(
+      &fusell::EdenStats::getSha1Batch, elapsed, now);
+  XLOG(DBG3) << "getSHA1() computed " << numPaths << " hashes in "
+             << elapsed.count() << "us";
 }
 
 void EdenServiceHandler::getBindMounts(
@@ -337,13 +406,23 @@ void EdenServiceHandler::async_tm_subscribe(
   StreamingSubscriber::subscribe(std::move(callback), std::move(edenMount));
 }
 
+void EdenServiceHandler::async_tm_subscribeFileDeltas(
+    std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+        std::unique_ptr<FileDelta>>> callback,
+    std::unique_ptr<SubscribeParams> params) {
+  auto edenMount = server_->getMount(params->mountPoint);
+  StreamingSubscriber::subscribe(
+      std::move(callback), std::move(edenMount), *params);
+}
+
 void EdenServiceHandler::getFilesChangedSince(
     FileDelta& out,
     std::unique_ptr<std::string> mountPoint,
     std::unique_ptr<JournalPosition> fromPosition) {
   auto helper = INSTRUMENT_THRIFT_CALL(folly::LogLevel::DBG2, *mountPoint);
   auto edenMount = server_->getMount(*mountPoint);
-  auto delta = edenMount->getJournal().getLatest();
+  auto& journal = edenMount->getJournal();
+  auto delta = journal.getLatest();
 
   if (fromPosition->mountGeneration != edenMount->getMountGeneration()) {
     throw newEdenError(
@@ -362,8 +441,15 @@ void EdenServiceHandler::getFilesChangedSince(
   // The +1 is because the core merge stops at the item prior to
   // its limitSequence parameter and we want the changes *since*
   // the provided sequence number.
-  auto merged = delta->merge(fromPosition->sequenceNumber + 1, true);
+  auto merged = journal.accumulateRange(fromPosition->sequenceNumber + 1);
   if (merged) {
+    if (merged->isTruncated) {
+      throw newEdenError(
+          ERANGE,
+          "the journal no longer holds the changes since fromPosition.  "
+          "You need to compute a new basis for delta queries.");
+    }
+
     out.fromPosition.sequenceNumber = merged->fromSequence;
     out.fromPosition.snapshotHash = thriftHash(merged->fromHash);
     out.fromPosition.mountGeneration = out.toPosition.mountGeneration;
@@ -440,10 +526,50 @@ void EdenServiceHandler::glob(
   }
 
   // and evaluate it against the root
-  auto matches = globRoot.evaluate(RelativePathPiece(), rootInode).get();
-  for (auto& fileName : matches) {
-    out.emplace_back(fileName.stringPiece().toString());
+  GlobContext context(
+      edenMount->getObjectStore(),
+      edenMount->getThreadPool().get(),
+      GlobContext::getDefaultMaxParallelism(),
+      [&out](vector<RelativePath>&& matches) {
+        for (auto& fileName : matches) {
+          out.emplace_back(fileName.stringPiece().toString());
+        }
+      });
+  globRoot.evaluate(&context, RelativePathPiece(), rootInode).get();
+}
+
+void EdenServiceHandler::async_tm_streamGlob(
+    std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+        std::unique_ptr<GlobResultBatch>>> callback,
+    std::unique_ptr<GlobParams> params) {
+  // The GlobNode tree and the stream must outlive the evaluation, which
+  // continues after this function returns.
+  std::shared_ptr<GlobNode> globRoot;
+  std::shared_ptr<GlobStream> stream;
+  TreeInodePtr rootInode;
+  try {
+    auto edenMount = server_->getMount(params->mountPoint);
+    rootInode = edenMount->getRootInode();
+    globRoot = std::make_shared<GlobNode>();
+    for (auto& globString : params->globs) {
+      globRoot->parse(globString);
+    }
+    stream = std::make_shared<GlobStream>(
+        std::move(callback),
+        edenMount->getObjectStore(),
+        edenMount->getThreadPool().get());
+  } catch (const std::exception& ex) {
+    callback->exception(
+        folly::make_exception_wrapper<EdenError>(newEdenError(ex)));
+    return;
   }
+
+  folly::makeFutureWith([&] {
+    return globRoot->evaluate(
+        stream->getContext(), RelativePathPiece(), rootInode);
+  }).then([globRoot, stream](folly::Try<folly::Unit>&& result) {
+    GlobStream::finish(stream, std::move(result));
+  });
 }
 
 void EdenServiceHandler::getManifestEntry(
@@ -686,6 +812,22 @@ void EdenServiceHandler::getStatInfo(InternalStats& result) {
     mountInodeInfo.loadedFileCount = counts.fileCount;
     mountInodeInfo.loadedTreeCount = counts.treeCount;
 
+    auto startupStats = mount->getStartupStats();
+    mountInodeInfo.startupScannedOverlay = startupStats.scannedOverlay;
+    mountInodeInfo.startupInodeNumberInitMicros =
+        startupStats.inodeNumberInitTime.count();
+    mountInodeInfo.startupTotalInitMicros = startupStats.totalInitTime.count();
+
+    auto fileCacheStats = mount->getOverlay()->getFileCacheStats();
+    mountInodeInfo.overlayFileCacheHits = fileCacheStats.hits;
+    mountInodeInfo.overlayFileCacheMisses = fileCacheStats.misses;
+    mountInodeInfo.overlayFileCacheEvictions = fileCacheStats.evictions;
+
+    auto journalStats = mount->getJournal().getStats();
+    mountInodeInfo.journalEntryCount = journalStats.entryCount;
+    mountInodeInfo.journalMemoryUsage = journalStats.memoryUsage;
+    mountInodeInfo.journalTruncatedEntries = journalStats.truncatedEntries;
+
     // TODO: Currently getting Materialization status of an inode using
     // getDebugStatus which walks through entire Tree of inodes, in future we
     // can add some mechanism to get materialized inode count without walking
@@ -730,20 +872,25 @@ void EdenServiceHandler::invalidateKernelInodeCache(
   } else {
     inode = edenMount->getInode(RelativePathPiece{*path}).get();
   }
-  auto* fuseChannel = edenMount->getFuseChannel();
+  edenMount->withFuseChannel([&](fusell::FuseChannel* fuseChannel) {
+    if (!fuseChannel) {
+      throw newEdenError(
+          ENOTCONN, "FUSE is not running for mount {}", *mountPoint);
+    }
 
-  // Invalidate cached pages and attributes
-  fuseChannel->invalidateInode(inode->getNodeId(), 0, 0);
+    // Invalidate cached pages and attributes
+    fuseChannel->invalidateInode(inode->getNodeId(), 0, 0);
 
-  const auto treePtr = inode.asTreePtrOrNull();
+    const auto treePtr = inode.asTreePtrOrNull();
 
-  // invalidate all parent/child relationships potentially cached.
-  if (treePtr != nullptr) {
-    const auto& dir = treePtr->getContents().rlock();
-    for (const auto& entry : dir->entries) {
-      fuseChannel->invalidateEntry(inode->getNodeId(), entry.first);
+    // invalidate all parent/child relationships potentially cached.
+    if (treePtr != nullptr) {
+      const auto& dir = treePtr->getContents().rlock();
+      for (const auto& entry : dir->entries) {
+        fuseChannel->invalidateEntry(inode->getNodeId(), entry.first);
+      }
     }
-  }
+  });
 }
 
 void EdenServiceHandler::shutdown() {
@@ -51,6 +51,12 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       std::unique_ptr<std::string> hash,
       CheckoutMode checkoutMode) override;
 
+  void getCheckoutProgress(
+      CheckoutProgress& out,
+      std::unique_ptr<std::string> mountPoint) override;
+
+  bool cancelCheckout(std::unique_ptr<std::string> mountPoint) override;
+
   void resetParentCommits(
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<WorkingDirectoryParents> parents) override;
@@ -88,6 +94,16 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
           std::unique_ptr<JournalPosition>>> callback,
       std::unique_ptr<std::string> mountPoint) override;
 
+  void async_tm_subscribeFileDeltas(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<FileDelta>>> callback,
+      std::unique_ptr<SubscribeParams> params) override;
+
+  void async_tm_streamGlob(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<GlobResultBatch>>> callback,
+      std::unique_ptr<GlobParams> params) override;
+
   void getManifestEntry(
       ManifestEntry& out,
       std::unique_ptr<std::string> mountPoint,
@@ -155,14 +171,6 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
   void shutdown() override;
 
  private:
-  folly::Future<Hash> getSHA1ForPath(
-      folly::StringPiece mountPoint,
-      folly::StringPiece path);
-
-  folly::Future<Hash> getSHA1ForPathDefensively(
-      folly::StringPiece mountPoint,
-      folly::StringPiece path) noexcept;
-
   /**
    * If `filename` exists in the manifest as a file (not a directory), returns
    * the mode of the file as recorded in the manifest.
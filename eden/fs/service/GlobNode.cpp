@@ -8,35 +8,106 @@
  *
  */
 #include "GlobNode.h"
+#include <folly/ScopeGuard.h>
+#include <gflags/gflags.h>
+#include <algorithm>
 #include "EdenError.h"
 #include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/ObjectStore.h"
+
+DEFINE_uint64(
+    glob_max_parallelism,
+    64,
+    "The maximum number of directories that a single glob request will "
+    "evaluate concurrently on the CPU thread pool");
 
 using folly::Future;
 using folly::makeFuture;
+using folly::Optional;
 using folly::StringPiece;
+using folly::Unit;
 using std::make_unique;
 using std::string;
 using std::unique_ptr;
-using std::unordered_set;
 using std::vector;
 
 namespace facebook {
 namespace eden {
 
+GlobContext::GlobContext(
+    const ObjectStore* store,
+    folly::Executor* executor,
+    size_t maxParallelism,
+    MatchCallback callback)
+    : store_(store), executor_(executor), maxParallelism_(maxParallelism) {
+  results_.wlock()->callback = std::move(callback);
+}
+
+size_t GlobContext::getDefaultMaxParallelism() {
+  return FLAGS_glob_max_parallelism;
+}
+
+void GlobContext::addMatches(vector<RelativePath>&& matches) {
+  if (matches.empty()) {
+    return;
+  }
+
+  auto results = results_.wlock();
+  auto end = std::remove_if(
+      matches.begin(), matches.end(), [&](const RelativePath& path) {
+        return !results->seen.insert(path).second;
+      });
+  matches.erase(end, matches.end());
+  if (!matches.empty()) {
+    results->callback(std::move(matches));
+  }
+}
+
+Future<Unit> GlobContext::run(folly::Function<Future<Unit>()> fn) {
+  if (executor_) {
+    // Reserve a slot on the executor.  The slot is released as soon as fn
+    // returns, rather than when its Future completes, so that directories
+    // waiting on source control fetches do not hold up the CPU pool.
+    auto numTasks = tasksOnExecutor_.fetch_add(1, std::memory_order_acq_rel);
+    if (numTasks < maxParallelism_) {
+      return folly::via(executor_).then([this, fn = std::move(fn)]() mutable {
+        SCOPE_EXIT {
+          tasksOnExecutor_.fetch_sub(1, std::memory_order_acq_rel);
+        };
+        return fn();
+      });
+    }
+    tasksOnExecutor_.fetch_sub(1, std::memory_order_acq_rel);
+  }
+  return folly::makeFutureWith(std::move(fn));
+}
+
+GlobBatcher::GlobBatcher(size_t batchSize, SendCallback send)
+    : batchSize_(std::max<size_t>(batchSize, 1)), send_(std::move(send)) {}
+
+void GlobBatcher::add(vector<RelativePath>&& matches) {
+  for (auto& path : matches) {
+    batch_.emplace_back(path.stringPiece().str());
+    if (batch_.size() == batchSize_) {
+      flush();
+    }
+  }
+}
+
+void GlobBatcher::flush() {
+  if (batch_.empty()) {
+    return;
+  }
+  vector<string> batch;
+  batch.swap(batch_);
+  send_(std::move(batch));
+}
+
 GlobNode::GlobNode(StringPiece pattern, bool hasSpecials)
     : pattern_(pattern), hasSpecials_(hasSpecials) {
   if (pattern_ == "**" || pattern_ == "*") {
     alwaysMatch_ = true;
-  } else {
-    auto compiled = GlobMatcher::create(pattern);
-    if (compiled.hasError()) {
-      throw newEdenError(
-          EINVAL,
-          "failed to compile pattern `{}` to GlobMatcher: {}",
-          pattern,
-          compiled.error());
-    }
-    matcher_ = std::move(compiled.value());
   }
 }
 
@@ -61,7 +132,10 @@ void GlobNode::parse(StringPiece pattern) {
 
     auto node = lookupToken(container, token);
     if (!node) {
-      container->emplace_back(std::make_unique<GlobNode>(token, hasSpecials));
+      auto newNode = std::make_unique<GlobNode>(token, hasSpecials);
+      parent->addChildMatcher(
+          newNode.get(), container == &parent->recursiveChildren_);
+      container->emplace_back(std::move(newNode));
       node = container->back().get();
     }
 
@@ -79,70 +153,251 @@ void GlobNode::parse(StringPiece pattern) {
   }
 }
 
-Future<unordered_set<RelativePath>> GlobNode::evaluate(
+namespace {
+
+// The helpers below present TreeInode contents and source control Trees in
+// the same shape, so that the same matching code can be used for both.
+
+class InodeContents {
+ public:
+  using Entry = TreeInode::Entry;
+
+  explicit InodeContents(const TreeInode::Dir& dir) : dir_(dir) {}
+
+  const Entry* find(PathComponentPiece name) const {
+    auto it = dir_.entries.find(name);
+    return it == dir_.entries.end() ? nullptr : &it->second;
+  }
+
+  template <typename Fn>
+  void forEach(Fn&& fn) const {
+    for (const auto& entry : dir_.entries) {
+      fn(entry.first, entry.second);
+    }
+  }
+
+  static bool isDirectory(const Entry& entry) {
+    return entry.isDirectory();
+  }
+
+  // A loaded inode is the authoritative source of its contents, and reading
+  // it is free, so only use the source control Tree for directories that
+  // are unmaterialized and not loaded.
+  static Optional<Hash> getTreeHash(const Entry& entry) {
+    if (entry.getInode()) {
+      return folly::none;
+    }
+    return entry.getOptionalHash();
+  }
+
+ private:
+  const TreeInode::Dir& dir_;
+};
+
+class TreeContents {
+ public:
+  using Entry = TreeEntry;
+
+  explicit TreeContents(const Tree& tree) : tree_(tree) {}
+
+  const Entry* find(PathComponentPiece name) const {
+    return tree_.getEntryPtr(name);
+  }
+
+  template <typename Fn>
+  void forEach(Fn&& fn) const {
+    for (const auto& entry : tree_.getTreeEntries()) {
+      fn(entry.getName(), entry);
+    }
+  }
+
+  static bool isDirectory(const Entry& entry) {
+    return entry.isTree();
+  }
+
+  static Optional<Hash> getTreeHash(const Entry& entry) {
+    return entry.getHash();
+  }
+
+ private:
+  const Tree& tree_;
+};
+
+template <typename Fn>
+void withContents(const TreeInodePtr& root, Fn&& fn) {
+  auto contents = root->getContents().rlock();
+  fn(InodeContents{*contents});
+}
+
+template <typename Fn>
+void withContents(const std::shared_ptr<const Tree>& root, Fn&& fn) {
+  fn(TreeContents{*root});
+}
+
+// The TreeInode to load unmaterialized children from, if any.
+TreeInodePtr getParentInode(const TreeInodePtr& root) {
+  return root;
+}
+
+TreeInodePtr getParentInode(const std::shared_ptr<const Tree>&) {
+  return TreeInodePtr{};
+}
+} // namespace
+
+Future<Unit> GlobNode::evaluate(
+    GlobContext* context,
     RelativePathPiece rootPath,
     TreeInodePtr root) {
-  unordered_set<RelativePath> results =
-      evaluateRecursiveComponent(rootPath, root).get();
-  vector<std::pair<PathComponent, GlobNode*>> recurse;
+  return evaluateImpl(context, rootPath, root);
+}
+
+Future<Unit> GlobNode::evaluate(
+    GlobContext* context,
+    RelativePathPiece rootPath,
+    std::shared_ptr<const Tree> root) {
+  return evaluateImpl(context, rootPath, root);
+}
+
+template <typename ROOT>
+Future<Unit> GlobNode::evaluateImpl(
+    GlobContext* context,
+    RelativePathPiece rootPath,
+    const ROOT& root) {
+  vector<RelativePath> results;
+  vector<ChildDir> recurse;
+  auto parent = getParentInode(root);
+
+  withContents(root, [&](const auto& contents) {
+    using Contents = std::decay_t<decltype(contents)>;
+    auto addChildDir = [&](PathComponentPiece name,
+                           const typename Contents::Entry& entry,
+                           GlobNode* node) {
+      recurse.push_back(ChildDir{
+          rootPath + name, node, Contents::getTreeHash(entry), parent});
+    };
 
-  {
-    auto contents = root->getContents().rlock();
     for (auto& node : children_) {
       if (!node->hasSpecials_) {
         // We can try a lookup for the exact name
-        auto it = contents->entries.find(PathComponentPiece(node->pattern_));
-        if (it != contents->entries.end()) {
+        auto name = PathComponentPiece(node->pattern_);
+        auto* entry = contents.find(name);
+        if (entry) {
           // Matched!
           if (node->isLeaf_) {
-            results.emplace((rootPath + it->first));
+            results.emplace_back(rootPath + name);
             continue;
           }
 
           // Not the leaf of a pattern; if this is a dir, we need to recurse
-          if (it->second.isDirectory()) {
-            recurse.emplace_back(std::make_pair(it->first, node.get()));
+          if (Contents::isDirectory(*entry)) {
+            addChildDir(name, *entry, node.get());
           }
         }
-      } else {
-        // We need to match it out of the entries in this inode
-        for (auto& entry : contents->entries) {
-          if (node->alwaysMatch_ ||
-              node->matcher_.match(entry.first.stringPiece())) {
-            if (node->isLeaf_) {
-              results.emplace((rootPath + entry.first));
-              continue;
-            }
-            // Not the leaf of a pattern; if this is a dir, we need to
-            // recurse
-            if (entry.second.isDirectory()) {
-              recurse.emplace_back(std::make_pair(entry.first, node.get()));
-            }
-          }
+      }
+    }
+
+    if (childMatcherNodes_.empty() && alwaysMatchChildren_.empty()) {
+      return;
+    }
+
+    // We need to match the remaining patterns against the entries in this
+    // directory.  Check each entry against all of them in one pass.
+    vector<size_t> matches;
+    contents.forEach([&](PathComponentPiece name, const auto& entry) {
+      auto processMatch = [&](GlobNode* node) {
+        if (node->isLeaf_) {
+          results.emplace_back(rootPath + name);
+          return;
+        }
+        // Not the leaf of a pattern; if this is a dir, we need to recurse
+        if (Contents::isDirectory(entry)) {
+          addChildDir(name, entry, node);
         }
+      };
+
+      matches.clear();
+      childMatchers_.match(name.stringPiece(), matches);
+      for (auto id : matches) {
+        processMatch(childMatcherNodes_[id]);
       }
+      for (auto* node : alwaysMatchChildren_) {
+        processMatch(node);
+      }
+    });
+  });
+
+  // Report this directory's matches right away, rather than holding them
+  // until the subdirectories are done.
+  context->addMatches(std::move(results));
+
+  // Evaluate the recursive globs and the matching subdirectories
+  // concurrently.
+  auto recursiveFuture = evaluateRecursiveComponent(context, rootPath, root);
+  auto childrenFuture = evaluateChildren(
+      context, std::move(recurse), /* recursive = */ false);
+  return folly::collect(recursiveFuture, childrenFuture).unit();
+}
+
+Future<Unit> GlobNode::evaluateChildren(
+    GlobContext* context,
+    vector<ChildDir>&& dirs,
+    bool recursive) {
+  vector<Future<Unit>> futures;
+  for (auto& dir : dirs) {
+    auto* node = dir.node;
+    auto evaluateDir = [context, node, recursive, path = dir.path](
+                           const auto& root) {
+      return context->run([context, node, recursive, path, root]() {
+        return recursive
+            ? node->evaluateRecursiveComponent(context, path, root)
+            : node->evaluate(context, path, root);
+      });
+    };
+    if (dir.treeHash.hasValue()) {
+      futures.emplace_back(
+          context->getObjectStore()
+              ->getTree(dir.treeHash.value())
+              .then([evaluateDir](std::shared_ptr<const Tree> tree) {
+                return evaluateDir(tree);
+              }));
+    } else {
+      futures.emplace_back(
+          dir.parent->getOrLoadChildTree(dir.path.basename())
+              .then([evaluateDir](TreeInodePtr inode) {
+                return evaluateDir(inode);
+              }));
     }
   }
+  return folly::collect(futures).unit();
+}
 
-  // Recursively load child inodes and evaluate matches
+void GlobNode::addChildMatcher(GlobNode* node, bool recursive) {
+  if (node->alwaysMatch_) {
+    if (recursive) {
+      recursiveAlwaysMatch_ = true;
+    } else {
+      alwaysMatchChildren_.push_back(node);
+    }
+    return;
+  }
+  if (!node->hasSpecials_) {
+    // Looked up by name rather than matched
+    return;
+  }
 
-  std::vector<Future<unordered_set<RelativePath>>> futures;
-  for (auto& item : recurse) {
-    auto candidateName = rootPath + item.first;
-    futures.emplace_back(
-        root->getOrLoadChildTree(item.first)
-            .then([candidateName, node = item.second](TreeInodePtr dir) {
-              return node->evaluate(candidateName, dir);
-            }));
+  auto& matchers = recursive ? recursiveMatchers_ : childMatchers_;
+  auto added = matchers.add(node->pattern_);
+  if (added.hasError()) {
+    throw newEdenError(
+        EINVAL,
+        "failed to compile pattern `{}` to GlobMatcher: {}",
+        node->pattern_,
+        added.error());
+  }
+  if (!recursive) {
+    DCHECK_EQ(added.value(), childMatcherNodes_.size());
+    childMatcherNodes_.push_back(node);
   }
-  return folly::collect(futures).then(
-      [results = std::move(results)](
-          std::vector<std::unordered_set<RelativePath>>&& matchVector) mutable {
-        for (auto& matches : matchVector) {
-          results.insert(matches.begin(), matches.end());
-        }
-        return results;
-      });
 }
 
 StringPiece GlobNode::tokenize(StringPiece& pattern, bool* hasSpecials) {
@@ -183,56 +438,41 @@ GlobNode* GlobNode::lookupToken(
   return nullptr;
 }
 
-Future<unordered_set<RelativePath>> GlobNode::evaluateRecursiveComponent(
+template <typename ROOT>
+Future<Unit> GlobNode::evaluateRecursiveComponent(
+    GlobContext* context,
     RelativePathPiece rootPath,
-    TreeInodePtr root) {
-  unordered_set<RelativePath> results;
+    const ROOT& root) {
   if (recursiveChildren_.empty()) {
-    return results;
+    return makeFuture();
   }
 
-  vector<RelativePath> subDirNames;
-  {
-    auto contents = root->getContents().rlock();
-    for (auto& entry : contents->entries) {
-      auto candidateName = rootPath + entry.first;
+  vector<RelativePath> results;
+  vector<ChildDir> subDirs;
+  auto parent = getParentInode(root);
+  withContents(root, [&](const auto& contents) {
+    using Contents = std::decay_t<decltype(contents)>;
+    contents.forEach([&](PathComponentPiece name, const auto& entry) {
+      auto candidateName = rootPath + name;
 
-      for (auto& node : recursiveChildren_) {
-        if (node->alwaysMatch_ ||
-            node->matcher_.match(candidateName.stringPiece())) {
-          results.emplace(candidateName);
-          // No sense running multiple matches for this same file.
-          break;
-        }
+      if (recursiveAlwaysMatch_ ||
+          recursiveMatchers_.matchAny(candidateName.stringPiece())) {
+        results.emplace_back(candidateName);
       }
 
       // Remember to recurse through child dirs after we've released
       // the lock on the contents.
-      if (entry.second.isDirectory()) {
-        subDirNames.emplace_back(candidateName);
+      if (Contents::isDirectory(entry)) {
+        subDirs.push_back(ChildDir{std::move(candidateName),
+                                   this,
+                                   Contents::getTreeHash(entry),
+                                   parent});
       }
-    }
-  }
-
-  // Recursively load child inodes and evaluate matches
-  std::vector<Future<unordered_set<RelativePath>>> futures;
-
-  for (auto& candidateName : subDirNames) {
-    futures.emplace_back(root->getOrLoadChildTree(candidateName.basename())
-                             .then([candidateName, this](TreeInodePtr dir) {
-                               return evaluateRecursiveComponent(
-                                   candidateName, dir);
-                             }));
-  }
+    });
+  });
 
-  return folly::collect(futures).then(
-      [results = std::move(results)](
-          std::vector<std::unordered_set<RelativePath>>&& matchVector) mutable {
-        for (auto& matches : matchVector) {
-          results.insert(matches.begin(), matches.end());
-        }
-        return results;
-      });
+  context->addMatches(std::move(results));
+  return evaluateChildren(context, std::move(subDirs), /* recursive = */ true);
 }
 } // namespace eden
 } // namespace facebook
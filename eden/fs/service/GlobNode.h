@@ -8,14 +8,116 @@
  *
  */
 #pragma once
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
-#include "eden/fs/inodes/InodePtrFwd.h"
-#include "eden/fs/model/git/GlobMatcher.h"
+#include <atomic>
+#include <string>
+#include <unordered_set>
+#include "eden/fs/inodes/InodePtr.h"
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/model/git/GlobMatcherSet.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 namespace facebook {
 namespace eden {
 
+class ObjectStore;
+class Tree;
+
+/**
+ * State shared by all of the directories evaluated for one glob request.
+ *
+ * Matches are handed to a callback in batches as each directory is
+ * evaluated, rather than being accumulated and merged up the tree, so
+ * callers can stream them out as they are found.
+ */
+class GlobContext {
+ public:
+  /**
+   * Receives a batch of matching paths.  Calls are serialized, but may come
+   * from any thread.
+   */
+  using MatchCallback = folly::Function<void(std::vector<RelativePath>&&)>;
+
+  /**
+   * Subdirectories are evaluated on the executor, with at most
+   * maxParallelism of them queued or running there at once.  Beyond that,
+   * or if executor is null, they are evaluated on the calling thread.
+   */
+  GlobContext(
+      const ObjectStore* store,
+      folly::Executor* executor,
+      size_t maxParallelism,
+      MatchCallback callback);
+
+  const ObjectStore* getObjectStore() const {
+    return store_;
+  }
+
+  /**
+   * Report the matches found in one directory.
+   *
+   * A path can match more than one pattern, so paths that were already
+   * reported are dropped; each path is passed to the callback only once.
+   */
+  void addMatches(std::vector<RelativePath>&& matches);
+
+  /**
+   * Run fn, either on the executor or inline, subject to maxParallelism.
+   */
+  folly::Future<folly::Unit> run(
+      folly::Function<folly::Future<folly::Unit>()> fn);
+
+  /**
+   * Get the default maxParallelism, from the --glob_max_parallelism flag.
+   */
+  static size_t getDefaultMaxParallelism();
+
+ private:
+  struct Results {
+    std::unordered_set<RelativePath> seen;
+    MatchCallback callback;
+  };
+
+  const ObjectStore* const store_;
+  folly::Executor* const executor_;
+  const size_t maxParallelism_;
+  std::atomic<size_t> tasksOnExecutor_{0};
+  folly::Synchronized<Results> results_;
+};
+
+/**
+ * Groups the matches reported to a GlobContext into batches of exactly
+ * batchSize paths, except for the last one, so that they can be streamed to
+ * a client while the glob is still being evaluated.
+ *
+ * GlobBatcher is not thread safe.  GlobContext serializes the calls to its
+ * callback, and flush() should only be called once evaluation is complete.
+ */
+class GlobBatcher {
+ public:
+  using SendCallback = folly::Function<void(std::vector<std::string>&&)>;
+
+  GlobBatcher(size_t batchSize, SendCallback send);
+
+  /**
+   * Add paths to the current batch, sending it each time it fills up.
+   */
+  void add(std::vector<RelativePath>&& matches);
+
+  /**
+   * Send the current batch, if it is not empty.
+   */
+  void flush();
+
+ private:
+  const size_t batchSize_;
+  SendCallback send_;
+  std::vector<std::string> batch_;
+};
+
 /** Represents the compiled state of a tree-walking glob operation.
  * We split the glob into path components and build a tree of name
  * matching operations.
@@ -39,14 +141,41 @@ class GlobNode {
   void parse(folly::StringPiece pattern);
   // This is a recursive function to evaluate the compiled glob against
   // the provided input path and inode.
-  // It returns the set of matching file names.
+  // Matching file names are reported to the context as each directory is
+  // evaluated, and the returned Future completes once all of them have
+  // been reported.
+  // Subdirectories that are neither materialized nor loaded are read
+  // from the ObjectStore as source control Trees, rather than by loading
+  // inodes for them.
   // Note: the caller is responsible for ensuring that this
-  // GlobNode exists until the returned Future is resolved.
-  folly::Future<std::unordered_set<RelativePath>> evaluate(
+  // GlobNode and the GlobContext exist until the returned Future is
+  // resolved.
+  folly::Future<folly::Unit> evaluate(
+      GlobContext* context,
       RelativePathPiece rootPath,
       TreeInodePtr root);
+  // Evaluate the compiled glob against a source control Tree.
+  // Everything below an unmaterialized directory is identical to source
+  // control, so this never needs to consult inodes.
+  folly::Future<folly::Unit> evaluate(
+      GlobContext* context,
+      RelativePathPiece rootPath,
+      std::shared_ptr<const Tree> root);
 
  private:
+  // A subdirectory that matched and needs to be evaluated.
+  struct ChildDir {
+    RelativePath path;
+    // The node to evaluate against the subdirectory.
+    GlobNode* node;
+    // The source control Tree with the subdirectory's contents, if it can
+    // be read from the ObjectStore.
+    folly::Optional<Hash> treeHash;
+    // Otherwise the TreeInode containing the subdirectory, which is used to
+    // load it.
+    TreeInodePtr parent;
+  };
+
   // Returns the next glob node token.
   // This is the text from the start of pattern up to the first
   // slash, or the end of the string is there was no slash.
@@ -56,6 +185,9 @@ class GlobNode {
   static folly::StringPiece tokenize(
       folly::StringPiece& pattern,
       bool* hasSpecials);
+  // Register a newly created child node with the matchers for its
+  // container.
+  void addChildMatcher(GlobNode* node, bool recursive);
   // Look up the child corresponding to a token.
   // Returns nullptr if it does not exist.
   // This is a simple brute force walk of the vector; the cardinality
@@ -70,18 +202,44 @@ class GlobNode {
   // inode children.
   // The difference is because a pattern like "**/foo" must be recursively
   // matched against all the children of the inode.
-  folly::Future<std::unordered_set<RelativePath>> evaluateRecursiveComponent(
+  template <typename ROOT>
+  folly::Future<folly::Unit> evaluateRecursiveComponent(
+      GlobContext* context,
       RelativePathPiece rootPath,
-      TreeInodePtr root);
+      const ROOT& root);
+  // The body of evaluate(), for either a TreeInodePtr or a Tree.
+  template <typename ROOT>
+  folly::Future<folly::Unit> evaluateImpl(
+      GlobContext* context,
+      RelativePathPiece rootPath,
+      const ROOT& root);
+  // Evaluate the given subdirectories.
+  // If recursive is true this evaluates the recursive children of each
+  // ChildDir's node, otherwise its regular children.
+  static folly::Future<folly::Unit> evaluateChildren(
+      GlobContext* context,
+      std::vector<ChildDir>&& dirs,
+      bool recursive);
   // The pattern fragment for this node
   folly::StringPiece pattern_;
-  // The compiled pattern
-  GlobMatcher matcher_;
   // List of non-** child rules
   std::vector<std::unique_ptr<GlobNode>> children_;
   // List of ** child rules
   std::vector<std::unique_ptr<GlobNode>> recursiveChildren_;
 
+  // The patterns of all children_ that need matching (those with special
+  // characters, other than "*"), compiled together so that each name is
+  // checked against all of them at once.  childMatcherNodes_ maps the
+  // pattern IDs back to the nodes.
+  GlobMatcherSet childMatchers_;
+  std::vector<GlobNode*> childMatcherNodes_;
+  // The children_ whose pattern is "*"
+  std::vector<GlobNode*> alwaysMatchChildren_;
+  // The patterns of all recursiveChildren_ other than "**"
+  GlobMatcherSet recursiveMatchers_;
+  // True if one of the recursiveChildren_ is "**"
+  bool recursiveAlwaysMatch_{false};
+
   // If true, generate results for matches.  Only applies
   // to non-recursive glob patterns.
   bool isLeaf_{false};
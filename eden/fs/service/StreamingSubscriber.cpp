@@ -9,14 +9,81 @@
  */
 #include "StreamingSubscriber.h"
 
+#include <folly/Chrono.h>
 #include <folly/experimental/logging/xlog.h>
+#include <gflags/gflags.h>
 
-using folly::StringPiece;
+#include "eden/fs/service/EdenError.h"
+#include "eden/fs/service/ThriftUtil.h"
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+DEFINE_int64(
+    streaming_subscriber_throttle_ms,
+    10,
+    "The minimum interval between journal updates sent to subscribers that "
+    "do not request their own");
 
 namespace facebook {
 namespace eden {
 
-StreamingSubscriber::State::State(StreamingSubscriber::Callback callback)
+namespace {
+template <typename T>
+class CallbackSink : public StreamingSubscriber::Sink {
+ public:
+  using Callback = std::unique_ptr<
+      apache::thrift::StreamingHandlerCallback<std::unique_ptr<T>>>;
+
+  explicit CallbackSink(Callback callback) : callback_(std::move(callback)) {}
+
+  folly::EventBase* getEventBase() override {
+    return callback_->getEventBase();
+  }
+
+  bool isRequestActive() override {
+    return callback_->isRequestActive();
+  }
+
+  void exception(folly::exception_wrapper&& ew) override {
+    callback_->exception(std::move(ew));
+  }
+
+  void done() override {
+    callback_->done();
+  }
+
+ protected:
+  Callback callback_;
+};
+
+/** Sends just the position at the end of each update. */
+class PositionSink : public CallbackSink<JournalPosition> {
+ public:
+  using CallbackSink::CallbackSink;
+
+  void write(FileDelta&& delta) override {
+    callback_->write(delta.toPosition);
+  }
+};
+
+class FileDeltaSink : public CallbackSink<FileDelta> {
+ public:
+  using CallbackSink::CallbackSink;
+
+  void write(FileDelta&& delta) override {
+    callback_->write(delta);
+  }
+};
+} // namespace
+
+StreamingSubscriber::Options StreamingSubscriber::Options::getDefault() {
+  Options options;
+  options.throttle = milliseconds(FLAGS_streaming_subscriber_throttle_ms);
+  return options;
+}
+
+StreamingSubscriber::State::State(std::unique_ptr<Sink> callback)
     : callback(std::move(callback)) {}
 
 void StreamingSubscriber::runLoopCallback() noexcept {
@@ -36,8 +103,33 @@ void StreamingSubscriber::runLoopCallback() noexcept {
 void StreamingSubscriber::subscribe(
     Callback callback,
     std::shared_ptr<EdenMount> edenMount) {
-  auto self =
-      std::make_shared<StreamingSubscriber>(std::move(callback), edenMount);
+  subscribeImpl(
+      std::make_unique<PositionSink>(std::move(callback)),
+      std::move(edenMount),
+      Options::getDefault());
+}
+
+void StreamingSubscriber::subscribe(
+    FileDeltaCallback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    const SubscribeParams& params) {
+  auto options = Options::getDefault();
+  if (params.throttleMs > 0) {
+    options.throttle = milliseconds(params.throttleMs);
+  }
+  options.includePaths = params.includePaths;
+  subscribeImpl(
+      std::make_unique<FileDeltaSink>(std::move(callback)),
+      std::move(edenMount),
+      options);
+}
+
+void StreamingSubscriber::subscribeImpl(
+    std::unique_ptr<Sink> sink,
+    std::shared_ptr<EdenMount> edenMount,
+    Options options) {
+  auto self = std::make_shared<StreamingSubscriber>(
+      std::move(sink), edenMount, options);
 
   // Separately scope the lock as the schedule() below will attempt to acquire
   // it for itself.
@@ -56,10 +148,12 @@ void StreamingSubscriber::subscribe(
 }
 
 StreamingSubscriber::StreamingSubscriber(
-    Callback callback,
-    std::shared_ptr<EdenMount> edenMount)
+    std::unique_ptr<Sink> sink,
+    std::shared_ptr<EdenMount> edenMount,
+    Options options)
     : edenMount_(std::move(edenMount)),
-      state_(folly::in_place, std::move(callback)) {}
+      options_(options),
+      state_(folly::in_place, std::move(sink)) {}
 
 StreamingSubscriber::~StreamingSubscriber() {
   auto state = state_.wlock();
@@ -79,10 +173,24 @@ StreamingSubscriber::~StreamingSubscriber() {
 }
 
 void StreamingSubscriber::schedule(std::shared_ptr<StreamingSubscriber> self) {
-  auto state = self->state_.rlock();
-  if (state->callback) {
-    state->callback->getEventBase()->runInEventBaseThread(
-        [self] { self->journalUpdated(); });
+  auto state = self->state_.wlock();
+  if (!state->callback || state->updateScheduled) {
+    // The pending update will pick up this change too.
+    return;
+  }
+  state->updateScheduled = true;
+
+  auto evb = state->callback->getEventBase();
+  auto nextUpdateTime = state->lastUpdateTime + self->options_.throttle;
+  auto now = steady_clock::now();
+  if (nextUpdateTime <= now) {
+    evb->runInEventBaseThread([self] { self->journalUpdated(); });
+  } else {
+    auto delay = folly::chrono::ceil<milliseconds>(nextUpdateTime - now);
+    evb->runInEventBaseThread([self, evb, delay] {
+      evb->timer().scheduleTimeoutFn(
+          [self] { self->journalUpdated(); }, delay);
+    });
   }
 }
 
@@ -91,12 +199,15 @@ void StreamingSubscriber::journalUpdated() {
   if (!edenMount) {
     XLOG(DBG1) << "Mount is released: subscription is no longer active";
     auto state = state_.wlock();
-    state->callback->done();
-    state->callback.reset();
+    if (state->callback) {
+      state->callback->done();
+      state->callback.reset();
+    }
     return;
   }
 
   auto state = state_.wlock();
+  state->updateScheduled = false;
   if (!state->callback) {
     // We were cancelled while this callback was queued up.
     // There's nothing for us to do now.
@@ -113,19 +224,69 @@ void StreamingSubscriber::journalUpdated() {
     return;
   }
 
-  JournalPosition pos;
+  auto latest = journal.getLatest();
+  if (!latest.hasValue() ||
+      (state->lastPosition.hasValue() &&
+       state->lastPosition->sequenceNumber == latest->toSequence)) {
+    // Nothing has changed since the previous update.
+    return;
+  }
 
-  auto delta = journal.getLatest();
-  pos.sequenceNumber = delta->toSequence;
-  pos.snapshotHash = StringPiece(delta->toHash.getBytes()).str();
-  pos.mountGeneration = edenMount->getMountGeneration();
+  FileDelta delta;
+  delta.toPosition.sequenceNumber = latest->toSequence;
+  delta.toPosition.snapshotHash = thriftHash(latest->toHash);
+  delta.toPosition.mountGeneration = edenMount->getMountGeneration();
+  delta.fromPosition = state->lastPosition.value_or(delta.toPosition);
+
+  if (options_.includePaths && state->lastPosition.hasValue() &&
+      !addChangedPaths(journal, state->lastPosition->sequenceNumber, delta)) {
+    XLOG(DBG1) << "Subscriber fell behind the journal: ending subscription";
+    journal.cancelSubscriber(state->subscriberId);
+    state->callback->exception(folly::make_exception_wrapper<EdenError>(
+        newEdenError(
+            ERANGE,
+            "the journal no longer holds the changes since the previous "
+            "update.  You need to compute a new basis for delta queries.")));
+    state->callback.reset();
+    return;
+  }
+
+  state->lastPosition = delta.toPosition;
+  state->lastUpdateTime = steady_clock::now();
 
   try {
     // And send it
-    state->callback->write(pos);
+    state->callback->write(std::move(delta));
   } catch (const std::exception& exc) {
     XLOG(ERR) << "Error while sending subscription update: " << exc.what();
   }
 }
+
+bool StreamingSubscriber::addChangedPaths(
+    const Journal& journal,
+    Journal::SequenceNumber since,
+    FileDelta& delta) {
+  auto merged = journal.accumulateRange(since + 1);
+  if (!merged) {
+    return true;
+  }
+  if (merged->isTruncated) {
+    return false;
+  }
+
+  for (auto& path : merged->changedFilesInOverlay) {
+    delta.changedPaths.emplace_back(path.stringPiece().str());
+  }
+  for (auto& path : merged->createdFilesInOverlay) {
+    delta.createdPaths.emplace_back(path.stringPiece().str());
+  }
+  for (auto& path : merged->removedFilesInOverlay) {
+    delta.removedPaths.emplace_back(path.stringPiece().str());
+  }
+  for (auto& path : merged->uncleanPaths) {
+    delta.uncleanPaths.emplace_back(path.stringPiece().str());
+  }
+  return true;
+}
 } // namespace eden
 } // namespace facebook
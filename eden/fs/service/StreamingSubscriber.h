@@ -8,6 +8,7 @@
  *
  */
 #pragma once
+#include <chrono>
 #include <memory>
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/service/gen-cpp2/StreamingEdenService.h"
@@ -19,19 +20,47 @@ namespace eden {
  * connected subscribers so that they can take action as files
  * are modified in the eden mount.
  *
- * This initial implementation is relatively dumb in that it
- * will immediately try to send a notification to the subscriber.
+ * Journal notifications are coalesced: while a call to journalUpdated() is
+ * scheduled further notifications are dropped, and updates are sent no more
+ * often than once per throttle interval.  The update that is eventually
+ * sent describes the state of the journal at the time it is computed, so
+ * nothing is lost by dropping notifications.  Updates that have been
+ * written to the client's stream but not yet read are not taken into
+ * account.
  *
- * Future iterations will add the ability to rate control these
- * updates (no more than 1 update per specified time interval)
- * and potentially also add a predicate so that we only notify
- * for updates that match certain criteria.
+ * Subscribers either receive just the latest JournalPosition, or a
+ * FileDelta covering everything that changed since the previous update.
  */
 
 class StreamingSubscriber : private folly::EventBase::LoopCallback {
  public:
   using Callback = std::unique_ptr<apache::thrift::StreamingHandlerCallback<
       std::unique_ptr<JournalPosition>>>;
+  using FileDeltaCallback =
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<FileDelta>>>;
+
+  /** The destination of the updates.  This hides the differences
+   * between the callback types of the different streaming methods. */
+  class Sink {
+   public:
+    virtual ~Sink() = default;
+    virtual folly::EventBase* getEventBase() = 0;
+    virtual bool isRequestActive() = 0;
+    virtual void write(FileDelta&& delta) = 0;
+    virtual void exception(folly::exception_wrapper&& ew) = 0;
+    virtual void done() = 0;
+  };
+
+  struct Options {
+    /** The minimum time between updates. */
+    std::chrono::milliseconds throttle;
+    /** Whether updates should list the changed paths. */
+    bool includePaths{false};
+
+    /** The options used by subscribe(Callback, ...). */
+    static Options getDefault();
+  };
 
   /** Establishes a subscription with the journal in the edenMount
    * that was passed in during construction.
@@ -44,15 +73,31 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
       Callback callback,
       std::shared_ptr<EdenMount> edenMount);
 
+  /** Like subscribe() above, but sends FileDeltas, with the throttle
+   * interval and level of detail requested by the client. */
+  static void subscribe(
+      FileDeltaCallback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      const SubscribeParams& params);
+
   // Not really public. Exposed publicly so std::make_shared can instantiate
   // this class.
-  StreamingSubscriber(Callback callback, std::shared_ptr<EdenMount> edenMount);
+  StreamingSubscriber(
+      std::unique_ptr<Sink> sink,
+      std::shared_ptr<EdenMount> edenMount,
+      Options options);
   ~StreamingSubscriber();
 
  private:
-  /** Schedule a call to journalUpdated.
+  static void subscribeImpl(
+      std::unique_ptr<Sink> sink,
+      std::shared_ptr<EdenMount> edenMount,
+      Options options);
+
+  /** Schedule a call to journalUpdated, unless one is already scheduled.
    * The journalUpdated method will be called in the context of the
-   * eventBase thread that is associated with the connected client */
+   * eventBase thread that is associated with the connected client,
+   * no sooner than the throttle interval after the previous update. */
   static void schedule(std::shared_ptr<StreamingSubscriber> self);
 
   /** Compute information to send to the connected subscriber.
@@ -60,6 +105,14 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
    * This is ensured by only ever calling it via the schedule() method. */
   void journalUpdated();
 
+  /** Fill in the paths of delta with the changes made after sequence
+   * number since.  Returns false if the journal no longer holds all of
+   * them. */
+  static bool addChangedPaths(
+      const Journal& journal,
+      Journal::SequenceNumber since,
+      FileDelta& delta);
+
   /** We implement LoopCallback so that we can get notified when the
    * eventBase is about to be destroyed.  The other option for lifetime
    * management is KeepAlive tokens but those are not suitable for us
@@ -70,11 +123,17 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
   void runLoopCallback() noexcept override;
 
   struct State {
-    Callback callback;
+    std::unique_ptr<Sink> callback;
     uint64_t subscriberId{0};
     bool eventBaseAlive{true};
+    /** Whether a call to journalUpdated() is pending. */
+    bool updateScheduled{false};
+    /** When the previous update was sent. */
+    std::chrono::steady_clock::time_point lastUpdateTime;
+    /** The position sent in the previous update, if any. */
+    folly::Optional<JournalPosition> lastPosition;
 
-    explicit State(Callback callback);
+    explicit State(std::unique_ptr<Sink> callback);
   };
 
   // There is a lock hierarchy here.  Writes to Eden update the Journal which
@@ -88,6 +147,7 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
   // its callbacks outside of its lock.  Alternatively, Journal::addDelta
   // could simply schedule the subscriber calls onto the subscriber's thread.
   const std::weak_ptr<EdenMount> edenMount_;
+  const Options options_;
   folly::Synchronized<State> state_;
 };
 } // namespace eden
@@ -70,7 +70,9 @@ union FileInformationOrError {
  */
 struct JournalPosition {
   /** An opaque but unique number within the scope of a given mount point.
-   * This is used to determine when sequenceNumber has been invalidated. */
+   * This is used to determine when sequenceNumber has been invalidated.
+   * It is preserved across graceful restarts and clean unmounts of edenfs,
+   * but changes if the journal could not be carried over. */
   1: i64 mountGeneration
 
   /** Monotonically incrementing number
@@ -205,6 +207,56 @@ struct CheckoutConflict {
   3: string message
 }
 
+/** The phases of a checkout operation, as reported by getCheckoutProgress(). */
+enum CheckoutPhase {
+  /** No checkout is in progress. */
+  NONE = 0,
+  /**
+   * Fetching the data the checkout needs, and finding the locally modified
+   * files to report in the journal.  Nothing has been changed yet.
+   */
+  PREPARING = 1,
+  /** Updating inodes to the new snapshot. */
+  APPLYING = 2,
+}
+
+/**
+ * The progress of the checkout operation in progress on a mount.
+ *
+ * The counters only ever increase while a checkout runs.  Since the checkout
+ * only visits the parts of the tree that changed, there is no total to
+ * compare them against.
+ */
+struct CheckoutProgress {
+  1: CheckoutPhase phase
+  2: BinaryHash fromSnapshot
+  3: BinaryHash toSnapshot
+  4: CheckoutMode checkoutMode
+  /** Milliseconds since the checkout started. */
+  5: i64 elapsedMs
+  /** Trees and blobs fetched ahead of the APPLYING phase. */
+  6: i64 treesPrefetched
+  7: i64 blobsPrefetched
+  /** Directories whose entries have been compared and updated. */
+  8: i64 treesProcessed
+  /** Trees and blobs loaded to update inodes, and the blobs' total size. */
+  9: i64 treesLoaded
+  10: i64 blobsLoaded
+  11: i64 blobBytesLoaded
+  /** Directory entries whose kernel cache entries have been invalidated. */
+  12: i64 inodesInvalidated
+  /** Conflicts and errors found so far. */
+  13: i64 conflicts
+  /** True if cancelCheckout() has been called for this checkout. */
+  14: bool cancelRequested
+  /**
+   * Directories whose overlay data was written when the checkout finished,
+   * and the overlay writes avoided by deferring them until then.
+   */
+  15: i64 overlayDirsWritten
+  16: i64 overlayWritesCoalesced
+}
+
 struct ScmBlobMetadata {
   1: i64 size
   2: BinaryHash contentsSha1
@@ -278,6 +330,35 @@ struct MountInodeInfo {
   3: i64 materializedInodeCount
   4: i64 loadedFileCount
   5: i64 loadedTreeCount
+  /**
+   * Whether the last startup of this mount had to scan the overlay to find
+   * the maximum inode number (because it was not shut down cleanly).
+   */
+  6: bool startupScannedOverlay
+  /**
+   * Time spent initializing the inode number allocator during startup.
+   */
+  7: i64 startupInodeNumberInitMicros
+  /**
+   * Total time spent initializing the mount during startup.
+   */
+  8: i64 startupTotalInitMicros
+  /**
+   * Lookups in the cache of open overlay files that found an open file,
+   * lookups that had to open the file, and files closed to make room for
+   * others.
+   */
+  9: i64 overlayFileCacheHits
+  10: i64 overlayFileCacheMisses
+  11: i64 overlayFileCacheEvictions
+  /**
+   * The number of entries in the journal, its estimated memory usage in
+   * bytes, and the number of old entries discarded to stay under the
+   * journal memory limit.
+   */
+  12: i64 journalEntryCount
+  13: i64 journalMemoryUsage
+  14: i64 journalTruncatedEntries
 }
 
 /**
@@ -341,6 +422,30 @@ service EdenService extends fb303.FacebookService {
     3: CheckoutMode checkoutMode)
       throws (1: EdenError ex)
 
+  /**
+   * Get the progress of the checkOutRevision() call currently running on the
+   * mount.  The phase is NONE if there is none.
+   */
+  CheckoutProgress getCheckoutProgress(1: string mountPoint)
+    throws (1: EdenError ex)
+
+  /**
+   * Ask the checkOutRevision() call currently running on the mount to stop.
+   *
+   * Cancellation is cooperative, and this returns without waiting for it.
+   * Returns false if there is no checkout in progress.
+   *
+   * If the checkout has not started changing inodes yet, it fails with an
+   * EdenError whose errorCode is ECANCELED, and nothing is changed.
+   * Otherwise it stops descending into directories it has not started yet,
+   * and finishes the ones it has.  It then completes, reporting each skipped
+   * directory as an ERROR conflict, but the mount keeps the original
+   * snapshot as its parent, so the files that were updated show up as
+   * modified.  A forced checkout of the new snapshot completes the update,
+   * and a forced checkout of the original snapshot undoes it.
+   */
+  bool cancelCheckout(1: string mountPoint) throws (1: EdenError ex)
+
   /**
    * Reset the working directory's parent commits, without changing the working
    * directory contents.
@@ -5,6 +5,28 @@ namespace cpp2 facebook.eden
  * This is only available to cpp2 clients and won't compile for other
  * language/runtimes. */
 
+/** Parameters for subscribeFileDeltas() */
+struct SubscribeParams {
+  1: string mountPoint
+  /** Changes are coalesced so that at most one update is sent per this many
+   * milliseconds.  If this is 0 the server's default is used. */
+  2: i64 throttleMs
+  /** If true, each update lists the paths that changed since the previous
+   * update, so that clients do not need to call getFilesChangedSince(). */
+  3: bool includePaths
+}
+
+/** Parameters for streamGlob() */
+struct GlobParams {
+  1: string mountPoint
+  2: list<string> globs
+}
+
+/** A batch of the paths matched by streamGlob() */
+struct GlobResultBatch {
+  1: list<string> matchingFiles
+}
+
 service StreamingEdenService extends eden.EdenService {
   /** Request notification about changes to the journal for
    * the specified mountPoint.
@@ -16,4 +38,29 @@ service StreamingEdenService extends eden.EdenService {
    */
   stream<eden.JournalPosition> subscribe(
     1: string mountPoint)
+
+  /** Like subscribe(), but each update is a FileDelta whose fromPosition is
+   * the toPosition of the previous update.  The first update has matching
+   * fromPosition and toPosition, and lists no paths.
+   *
+   * Updates are coalesced: at most one is sent per throttle interval, and
+   * each one covers every change made since the previous update, so busy
+   * mounts produce fewer, larger updates rather than one per change.  This
+   * only limits how often updates are sent; there is no flow control, so a
+   * client that reads slowly still has updates queued up for it.
+   * If includePaths is set and the journal no longer
+   * holds all of the changes since the previous update, the stream ends
+   * with an EdenError with errorCode = ERANGE, just as
+   * getFilesChangedSince() would.
+   */
+  stream<eden.FileDelta> subscribeFileDeltas(
+    1: SubscribeParams params)
+
+  /** Like glob(), but the matching paths are sent in batches as they are
+   * found, instead of in a single response once every directory has been
+   * searched.  Each path is sent exactly once, in no particular order.
+   * The stream ends once the whole glob has been evaluated.
+   */
+  stream<GlobResultBatch> streamGlob(
+    1: GlobParams params)
 }
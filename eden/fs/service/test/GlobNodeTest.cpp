@@ -0,0 +1,149 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/service/GlobNode.h"
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/synchronization/Baton.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using folly::makeFuture;
+using std::string;
+using std::vector;
+using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAreArray;
+
+namespace {
+vector<string> evaluateGlobs(
+    TestMount& mount,
+    const vector<string>& globs,
+    folly::Executor* executor,
+    size_t maxParallelism) {
+  GlobNode root;
+  for (const auto& glob : globs) {
+    root.parse(glob);
+  }
+
+  vector<string> matches;
+  GlobContext context(
+      mount.getEdenMount()->getObjectStore(),
+      executor,
+      maxParallelism,
+      [&matches](vector<RelativePath>&& paths) {
+        for (auto& path : paths) {
+          matches.emplace_back(path.stringPiece().str());
+        }
+      });
+  root.evaluate(
+          &context, RelativePathPiece(), mount.getEdenMount()->getRootInode())
+      .get();
+  return matches;
+}
+} // namespace
+
+TEST(GlobContext, reportsEachPathOnce) {
+  vector<vector<RelativePath>> batches;
+  GlobContext context(
+      nullptr, nullptr, 0, [&batches](vector<RelativePath>&& paths) {
+        batches.push_back(std::move(paths));
+      });
+
+  context.addMatches({RelativePath{"a"}, RelativePath{"b"}});
+  context.addMatches(
+      {RelativePath{"b"}, RelativePath{"c"}, RelativePath{"c"}});
+  // Batches with nothing new are not passed on at all.
+  context.addMatches({RelativePath{"a"}});
+
+  ASSERT_EQ(2, batches.size());
+  EXPECT_THAT(batches[0], ElementsAre(RelativePath{"a"}, RelativePath{"b"}));
+  EXPECT_THAT(batches[1], ElementsAre(RelativePath{"c"}));
+}
+
+TEST(GlobContext, runsInlineOnceParallelismLimitIsReached) {
+  folly::CPUThreadPoolExecutor executor(1);
+  GlobContext context(nullptr, &executor, 1, [](vector<RelativePath>&&) {});
+
+  folly::Baton<> started;
+  folly::Baton<> release;
+  auto first = context.run([&] {
+    started.post();
+    release.wait();
+    return makeFuture();
+  });
+  started.wait();
+
+  // The only slot is taken, so this runs on the calling thread.
+  std::thread::id ranOn;
+  auto second = context.run([&] {
+    ranOn = std::this_thread::get_id();
+    return makeFuture();
+  });
+  EXPECT_TRUE(second.isReady());
+  EXPECT_EQ(std::this_thread::get_id(), ranOn);
+
+  release.post();
+  std::move(first).get();
+}
+
+TEST(GlobNode, parallelEvaluationReportsEachMatchOnce) {
+  FakeTreeBuilder builder;
+  for (int dir = 0; dir < 8; ++dir) {
+    for (int file = 0; file < 8; ++file) {
+      builder.setFile(
+          folly::to<string>("src/dir", dir, "/sub/file", file, ".txt"),
+          "contents\n");
+    }
+  }
+  builder.setFile("README.txt", "readme\n");
+  TestMount mount{builder};
+  // Materialize some directories so that both inodes and source control
+  // Trees are evaluated.
+  mount.overwriteFile("src/dir3/sub/file1.txt", "changed\n");
+  mount.addFile("src/dir5/sub/new.txt", "new\n");
+
+  // Most paths match more than one of these patterns.
+  vector<string> globs{"**/*.txt", "src/**/file1.txt", "src/*/sub/*"};
+  auto expected = evaluateGlobs(mount, globs, nullptr, 0);
+  EXPECT_EQ(66, expected.size());
+
+  folly::CPUThreadPoolExecutor executor(4);
+  for (size_t maxParallelism : {1, 2, 64}) {
+    auto matches = evaluateGlobs(mount, globs, &executor, maxParallelism);
+    EXPECT_THAT(matches, UnorderedElementsAreArray(expected))
+        << "maxParallelism=" << maxParallelism;
+  }
+}
+
+TEST(GlobBatcher, sendsFullBatchesThenTheRemainder) {
+  vector<vector<string>> batches;
+  GlobBatcher batcher(2, [&batches](vector<string>&& paths) {
+    batches.push_back(std::move(paths));
+  });
+
+  batcher.add({RelativePath{"a"}, RelativePath{"b"}, RelativePath{"c"}});
+  EXPECT_EQ(1, batches.size());
+  batcher.add({RelativePath{"d"}, RelativePath{"e"}});
+  EXPECT_EQ(2, batches.size());
+  batcher.flush();
+  // Flushing an empty batch sends nothing.
+  batcher.flush();
+
+  EXPECT_THAT(
+      batches,
+      ElementsAre(
+          ElementsAre("a", "b"), ElementsAre("c", "d"), ElementsAre("e")));
+}
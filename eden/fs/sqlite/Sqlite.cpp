@@ -92,12 +92,20 @@ void SqliteStatement::bind(
           stmt_, paramNo, blob.data(), sqlite3_uint64(blob.size()), bindType));
 }
 
+void SqliteStatement::bind(size_t paramNo, int64_t value) {
+  checkSqliteResult(db_, sqlite3_bind_int64(stmt_, paramNo, value));
+}
+
 StringPiece SqliteStatement::columnBlob(size_t colNo) const {
   return StringPiece(
       reinterpret_cast<const char*>(sqlite3_column_blob(stmt_, colNo)),
       sqlite3_column_bytes(stmt_, colNo));
 }
 
+int64_t SqliteStatement::columnInt64(size_t colNo) const {
+  return sqlite3_column_int64(stmt_, colNo);
+}
+
 SqliteStatement::~SqliteStatement() {
   sqlite3_finalize(stmt_);
 }
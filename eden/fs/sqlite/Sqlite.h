@@ -120,6 +120,11 @@ class SqliteStatement {
     bind(paramNo, folly::StringPiece(blob), bindType);
   }
 
+  /** Bind an integer parameter to a prepared statement placeholder.
+   * Parameters are 1-based, with the first parameter having paramNo==1.
+   * Throws an exception on error. */
+  void bind(size_t paramNo, int64_t value);
+
   /** Reference a blob column in the current row returned by the statement.
    * This is only valid to call once `step()` has returned true.  The
    * return value is invalidated by a subsequent `step()` call or by the
@@ -129,6 +134,11 @@ class SqliteStatement {
    * */
   folly::StringPiece columnBlob(size_t colNo) const;
 
+  /** Return an integer column in the current row returned by the statement.
+   * This is only valid to call once `step()` has returned true.
+   * Column indices are 0-based.  A NULL column value is returned as 0. */
+  int64_t columnInt64(size_t colNo) const;
+
   ~SqliteStatement();
 
  private:
@@ -9,6 +9,7 @@
  */
 #include "LocalStore.h"
 
+#include <folly/Conv.h>
 #include <folly/Format.h>
 #include <folly/Optional.h>
 #include <folly/String.h>
@@ -16,6 +17,7 @@
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/lang/Bits.h>
+#include <algorithm>
 #include <array>
 
 #include "eden/fs/model/Blob.h"
@@ -83,6 +85,114 @@ class SerializedBlobMetadata {
    */
   std::array<uint8_t, SIZE> data_;
 };
+
+/*
+ * Trees are stored in git's tree format, optionally followed by the blob
+ * sizes and content SHA-1s that the backing store supplied for the entries.
+ * Git's format does not have room for these, so they are appended after the
+ * end of the git object, whose length is given by its header.  The trailer
+ * is only written when at least one entry has metadata, so trees without it
+ * are stored exactly as before.
+ *
+ * The trailer is a version byte followed by, for each entry in order, a byte
+ * of flags, then the size (8 bytes, big endian) if kHasSize is set and the
+ * SHA-1 (20 bytes) if kHasContentSha1 is set.
+ */
+constexpr uint8_t kTreeMetadataVersion = 1;
+constexpr uint8_t kHasSize = 0x01;
+constexpr uint8_t kHasContentSha1 = 0x02;
+
+void appendTreeMetadata(const Tree* tree, IOBuf& treeBuf) {
+  const auto& entries = tree->getTreeEntries();
+  auto hasMetadata = [](const TreeEntry& entry) {
+    return entry.getSize().hasValue() || entry.getContentSha1().hasValue();
+  };
+  if (std::none_of(entries.begin(), entries.end(), hasMetadata)) {
+    return;
+  }
+
+  string trailer;
+  trailer.reserve(
+      1 + entries.size() * (1 + sizeof(uint64_t) + Hash::RAW_SIZE));
+  trailer.push_back(static_cast<char>(kTreeMetadataVersion));
+  for (const auto& entry : entries) {
+    uint8_t flags = (entry.getSize() ? kHasSize : 0) |
+        (entry.getContentSha1() ? kHasContentSha1 : 0);
+    trailer.push_back(static_cast<char>(flags));
+    if (entry.getSize()) {
+      uint64_t sizeBE = folly::Endian::big(entry.getSize().value());
+      trailer.append(reinterpret_cast<const char*>(&sizeBE), sizeof(sizeBE));
+    }
+    if (entry.getContentSha1()) {
+      auto bytes = entry.getContentSha1()->getBytes();
+      trailer.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+  }
+  treeBuf.prependChain(IOBuf::copyBuffer(trailer));
+}
+
+/**
+ * Return the length of the git tree object at the start of bytes, or
+ * bytes.size() if the header cannot be parsed, in which case
+ * deserializeGitTree() will report the problem.
+ */
+size_t getGitTreeLength(ByteRange bytes) {
+  StringPiece data{bytes};
+  auto nul = data.find('\0');
+  if (nul == StringPiece::npos || !data.startsWith("tree ")) {
+    return bytes.size();
+  }
+  auto contentSize =
+      folly::tryTo<size_t>(data.subpiece(5, nul - 5)).value_or(bytes.size());
+  return std::min(nul + 1 + contentSize, bytes.size());
+}
+
+std::unique_ptr<Tree> deserializeTree(const Hash& id, ByteRange bytes) {
+  auto gitLength = getGitTreeLength(bytes);
+  auto tree = deserializeGitTree(id, bytes.subpiece(0, gitLength));
+  if (gitLength == bytes.size()) {
+    return tree;
+  }
+
+  IOBuf trailer{IOBuf::WRAP_BUFFER, bytes.subpiece(gitLength)};
+  Cursor cursor{&trailer};
+  auto version = cursor.read<uint8_t>();
+  if (version != kTreeMetadataVersion) {
+    // Written by a newer version of edenfs; the metadata is only an
+    // optimization, so just ignore it.
+    XLOG(DBG3) << "ignoring tree metadata with unknown version " << int(version)
+               << " for tree " << id;
+    return tree;
+  }
+
+  std::vector<TreeEntry> entries;
+  entries.reserve(tree->getTreeEntries().size());
+  for (const auto& entry : tree->getTreeEntries()) {
+    auto flags = cursor.read<uint8_t>();
+    Optional<uint64_t> size;
+    if (flags & kHasSize) {
+      size = cursor.readBE<uint64_t>();
+    }
+    Optional<Hash> contentSha1;
+    if (flags & kHasContentSha1) {
+      Hash::Storage sha1Bytes;
+      cursor.pull(sha1Bytes.data(), sha1Bytes.size());
+      contentSha1 = Hash{sha1Bytes};
+    }
+    entries.emplace_back(
+        entry.getHash(),
+        entry.getName().stringPiece(),
+        entry.getType(),
+        size,
+        contentSha1);
+  }
+  if (!cursor.isAtEnd()) {
+    throw std::invalid_argument(folly::sformat(
+        "unexpected data after the entry metadata for tree {}",
+        id.toString()));
+  }
+  return std::make_unique<Tree>(std::move(entries), id);
+}
 } // namespace
 
 namespace facebook {
@@ -103,7 +213,7 @@ std::unique_ptr<Tree> LocalStore::getTree(const Hash& id) const {
   if (!result.isValid()) {
     return nullptr;
   }
-  return deserializeGitTree(id, result.bytes());
+  return deserializeTree(id, result.bytes());
 }
 
 std::unique_ptr<Blob> LocalStore::getBlob(const Hash& id) const {
@@ -132,10 +242,13 @@ std::pair<Hash, folly::IOBuf> LocalStore::serializeTree(const Tree* tree) {
   }
   IOBuf treeBuf = serializer.finalize();
 
+  // The ID only covers the git object, so that it matches the ID git itself
+  // would compute whether or not the entries have metadata.
   auto id = tree->getHash();
   if (id == Hash()) {
     id = Hash::sha1(&treeBuf);
   }
+  appendTreeMetadata(tree, treeBuf);
   return std::make_pair(id, treeBuf);
 }
 
@@ -144,11 +257,9 @@ bool LocalStore::hasKey(KeySpace keySpace, const Hash& id) const {
 }
 
 Hash LocalStore::putTree(const Tree* tree) {
-  auto serialized = LocalStore::serializeTree(tree);
-  ByteRange treeData = serialized.second.coalesce();
-
-  auto& id = serialized.first;
-  put(KeySpace::TreeFamily, id, treeData);
+  auto batch = beginWrite();
+  auto id = batch->putTree(tree);
+  batch->flush();
   return id;
 }
 
@@ -158,6 +269,19 @@ Hash LocalStore::WriteBatch::putTree(const Tree* tree) {
 
   auto& id = serialized.first;
   put(KeySpace::TreeFamily, id.getBytes(), treeData);
+
+  // When the backing store told us the size and SHA-1 of a blob, record it
+  // as that blob's metadata too, so that getBlobMetadata() does not need to
+  // fetch the blob itself.
+  for (const auto& entry : tree->getTreeEntries()) {
+    if (entry.getSize() && entry.getContentSha1()) {
+      SerializedBlobMetadata metadataBytes(
+          entry.getContentSha1().value(), entry.getSize().value());
+      put(KeySpace::BlobMetaDataFamily,
+          entry.getHash().getBytes(),
+          metadataBytes.slice());
+    }
+  }
   return id;
 }
 
@@ -115,7 +115,10 @@ class LocalStore {
    * This does not modify the contents of the store; it is the method
    * used by the putTree method to compute the data that it stores.
    * This is useful when computing the overall set of data during a
-   * two phase import. */
+   * two phase import.
+   *
+   * The data is a git tree object, followed by the size and SHA-1 of any
+   * entries that have them.  The key only covers the git object. */
   static std::pair<Hash, folly::IOBuf> serializeTree(const Tree* tree);
 
   /**
@@ -127,6 +130,9 @@ class LocalStore {
   /**
    * Store a Tree into the TreeFamily KeySpace.
    *
+   * Entries that carry both a size and a content SHA-1 are also recorded in
+   * the BlobMetaDataFamily KeySpace.
+   *
    * Returns the Hash that can be used to look up the tree later.
    */
   Hash putTree(const Tree* tree);
@@ -182,7 +182,22 @@ std::unique_ptr<Tree> convertBufToTree(
     } else {
       throw std::runtime_error("unknown file type");
     }
-    entries.push_back(TreeEntry(hash, path_elem, file_type));
+    // Newer servers also report the size and SHA-1 of each file's contents,
+    // which lets diff decide whether a file changed without fetching it.
+    folly::Optional<uint64_t> size;
+    folly::Optional<Hash> contentSha1;
+    if (file_type != TreeEntryType::TREE) {
+      auto sizeElem = i->get_ptr("size");
+      if (sizeElem && sizeElem->isInt()) {
+        size = static_cast<uint64_t>(sizeElem->asInt());
+      }
+      auto sha1Elem = i->get_ptr("content_sha1");
+      if (sha1Elem && sha1Elem->isString()) {
+        contentSha1 = Hash(sha1Elem->asString());
+      }
+    }
+    entries.push_back(
+        TreeEntry(hash, path_elem, file_type, size, contentSha1));
   }
   return std::make_unique<Tree>(std::move(entries), id);
 }
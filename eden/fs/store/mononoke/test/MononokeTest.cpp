@@ -148,7 +148,7 @@ class MononokeBackingStoreTest : public ::testing::Test {
         std::make_pair(
             treehash.toString(),
             R"([{"hash": "b80de5d138758541c5f05265ad144ab9fa86d1db", "path": "a", "size": 0, "type": "File"},
-                {"hash": "b8e02f6433738021a065f94175c7cd23db5f05be", "path": "b", "size": 2, "type": "File"},
+                {"hash": "b8e02f6433738021a065f94175c7cd23db5f05be", "path": "b", "size": 2, "type": "File", "content_sha1": "0123456789abcdef0123456789abcdef01234567"},
                 {"hash": "3333333333333333333333333333333333333333", "path": "dir", "size": 2, "type": "Tree"},
                 {"hash": "4444444444444444444444444444444444444444", "path": "exec", "size": 2, "type": "Executable"},
                 {"hash": "5555555555555555555555555555555555555555", "path": "link", "size": 2, "type": "Symlink"}
@@ -258,6 +258,16 @@ TEST_F(MononokeBackingStoreTest, testGetTree) {
 
     Tree expected_tree(std::move(expected_entries), treehash);
     EXPECT_TRUE(expected_tree == *tree);
+
+    // Sizes and content SHA-1s are passed through for files when the
+    // server sends them.
+    EXPECT_EQ(0, tree_entries[0].getSize());
+    EXPECT_FALSE(tree_entries[0].getContentSha1().hasValue());
+    EXPECT_EQ(2, tree_entries[1].getSize());
+    EXPECT_EQ(
+        Hash("0123456789abcdef0123456789abcdef01234567"),
+        tree_entries[1].getContentSha1());
+    EXPECT_FALSE(tree_entries[2].getSize().hasValue());
     server->stop();
   });
 }
@@ -148,6 +148,47 @@ TEST_P(LocalStoreTest, testReadsAndWriteTree) {
   EXPECT_EQ(TreeEntryType::REGULAR_FILE, readmeEntry.getType());
 }
 
+TEST_P(LocalStoreTest, testTreeEntryMetadata) {
+  Hash fileHash("3a8f8eb91101860fd8484154885838bf322964d0");
+  Hash fileSha1("0123456789abcdef0123456789abcdef01234567");
+  Hash sizeOnlyHash("3610882f48696cc7ca0835929511c9db70acbec6");
+  Hash dirHash("e95798e17f694c227b7a8441cc5c7dae50a187d0");
+  std::vector<TreeEntry> entries;
+  entries.emplace_back(dirHash, "dir", TreeEntryType::TREE);
+  entries.emplace_back(
+      fileHash, "file", TreeEntryType::REGULAR_FILE, 1234, fileSha1);
+  entries.emplace_back(
+      sizeOnlyHash, "sizeOnly", TreeEntryType::REGULAR_FILE, 5, folly::none);
+  Tree inTree{std::move(entries)};
+
+  // The tree ID only covers the git object, so it is the same as for a tree
+  // without metadata.
+  std::vector<TreeEntry> plainEntries;
+  plainEntries.emplace_back(dirHash, "dir", TreeEntryType::TREE);
+  plainEntries.emplace_back(fileHash, "file", TreeEntryType::REGULAR_FILE);
+  plainEntries.emplace_back(
+      sizeOnlyHash, "sizeOnly", TreeEntryType::REGULAR_FILE);
+  Tree plainTree{std::move(plainEntries)};
+  auto id = store_->putTree(&inTree);
+  EXPECT_EQ(LocalStore::serializeTree(&plainTree).first, id);
+
+  auto outTree = store_->getTree(id);
+  ASSERT_TRUE(outTree);
+  EXPECT_EQ(plainTree.getTreeEntries(), outTree->getTreeEntries());
+  EXPECT_FALSE(outTree->getEntryAt(0).getSize().hasValue());
+  EXPECT_EQ(1234, outTree->getEntryAt(1).getSize());
+  EXPECT_EQ(fileSha1, outTree->getEntryAt(1).getContentSha1());
+  EXPECT_EQ(5, outTree->getEntryAt(2).getSize());
+  EXPECT_FALSE(outTree->getEntryAt(2).getContentSha1().hasValue());
+
+  // Entries with both a size and a SHA-1 also provide the blob metadata.
+  auto metadata = store_->getBlobMetadata(fileHash);
+  ASSERT_TRUE(metadata.hasValue());
+  EXPECT_EQ(fileSha1, metadata->sha1);
+  EXPECT_EQ(1234, metadata->size);
+  EXPECT_FALSE(store_->getBlobMetadata(sizeOnlyHash).hasValue());
+}
+
 TEST_P(LocalStoreTest, testGetResult) {
   StringPiece key1 = "foo";
   StringPiece key2 = "bar";
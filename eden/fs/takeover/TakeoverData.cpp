@@ -304,6 +304,7 @@ IOBuf TakeoverData::serializeVersion3() {
 
     serializedMount.fileHandleMap = mount.fileHandleMap;
     serializedMount.inodeMap = mount.inodeMap;
+    serializedMount.journal = mount.journal;
 
     serializedMounts.emplace_back(std::move(serializedMount));
   }
@@ -358,6 +359,7 @@ TakeoverData TakeoverData::deserializeVersion3(IOBuf* buf) {
             *connInfo,
             std::move(serializedMount.fileHandleMap),
             std::move(serializedMount.inodeMap));
+        data.mountPoints.back().journal = std::move(serializedMount.journal);
       }
       return data;
     }
@@ -95,6 +95,12 @@ class TakeoverData {
     fuse_init_out connInfo;
     SerializedFileHandleMap fileHandleMap;
     SerializedInodeMap inodeMap;
+    /**
+     * The mount's journal, which lets clients keep using journal positions
+     * obtained from the old process.  This is only sent with protocol
+     * version 3 and later, and is left default-constructed otherwise.
+     */
+    SerializedJournal journal;
   };
 
   /**
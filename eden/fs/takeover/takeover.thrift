@@ -1,4 +1,5 @@
 include "eden/fs/fuse/handlemap.thrift"
+include "eden/fs/journal/journal.thrift"
 namespace cpp2 facebook.eden
 
 // A list of takeover data serialization versions that the client supports
@@ -36,6 +37,9 @@ struct SerializedMountInfo {
   4: binary connInfo, // fuse_init_out
   5: handlemap.SerializedFileHandleMap fileHandleMap,
   6: SerializedInodeMap inodeMap,
+  // Older versions of edenfs do not send this, in which case it is left
+  // default-constructed, with a nextSequence of 0.
+  7: journal.SerializedJournal journal,
 }
 
 union SerializedTakeoverData {
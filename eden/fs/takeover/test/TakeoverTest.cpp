@@ -222,6 +222,61 @@ TEST(Takeover, simple) {
   checkExpectedFile(clientData.mountPoints.at(1).fuseFD.fd(), mount2FusePath);
 }
 
+TEST(Takeover, journal) {
+  TemporaryDirectory tmpDir("eden_takeover_test");
+  AbsolutePathPiece tmpDirPath{tmpDir.path().string()};
+
+  TakeoverData serverData;
+  auto lockFilePath = tmpDirPath + PathComponentPiece{"lock"};
+  serverData.lockFile =
+      folly::File{lockFilePath.stringPiece(), O_RDWR | O_CREAT};
+  auto thriftSocketPath = tmpDirPath + PathComponentPiece{"thrift"};
+  serverData.thriftSocket =
+      folly::File{thriftSocketPath.stringPiece(), O_RDWR | O_CREAT};
+
+  auto mountPath = tmpDirPath + PathComponentPiece{"mount"};
+  auto clientPath = tmpDirPath + PathComponentPiece{"client"};
+  auto fusePath = tmpDirPath + PathComponentPiece{"fuse"};
+  serverData.mountPoints.emplace_back(
+      mountPath,
+      clientPath,
+      std::vector<AbsolutePath>{},
+      folly::File{fusePath.stringPiece(), O_RDWR | O_CREAT},
+      fuse_init_out{},
+      SerializedFileHandleMap{},
+      SerializedInodeMap{});
+
+  SerializedJournalEntry entry;
+  entry.fromSequence = 41;
+  entry.toSequence = 42;
+  entry.changedFilesInOverlay.push_back(0);
+  auto& journal = serverData.mountPoints.back().journal;
+  journal.mountGeneration = 1234;
+  journal.nextSequence = 43;
+  journal.truncatedSequence = 40;
+  journal.paths.push_back("foo/bar.txt");
+  journal.entries.push_back(entry);
+
+  auto serverSendFuture = serverData.takeoverComplete.getFuture();
+  TestHandler handler{std::move(serverData)};
+  auto result = runTakeover(tmpDir, &handler);
+  ASSERT_TRUE(serverSendFuture.hasValue());
+  ASSERT_TRUE(result.hasValue());
+  const auto& clientData = result.value();
+
+  ASSERT_EQ(1, clientData.mountPoints.size());
+  const auto& clientJournal = clientData.mountPoints.at(0).journal;
+  EXPECT_EQ(1234, clientJournal.mountGeneration);
+  EXPECT_EQ(43, clientJournal.nextSequence);
+  EXPECT_EQ(40, clientJournal.truncatedSequence);
+  EXPECT_THAT(clientJournal.paths, ElementsAre("foo/bar.txt"));
+  ASSERT_EQ(1, clientJournal.entries.size());
+  EXPECT_EQ(41, clientJournal.entries.at(0).fromSequence);
+  EXPECT_EQ(42, clientJournal.entries.at(0).toSequence);
+  EXPECT_THAT(
+      clientJournal.entries.at(0).changedFilesInOverlay, ElementsAre(0));
+}
+
 TEST(Takeover, noMounts) {
   TemporaryDirectory tmpDir("eden_takeover_test");
   AbsolutePathPiece tmpDirPath{tmpDir.path().string()};
@@ -13,6 +13,7 @@
 #include <folly/FileUtil.h>
 #include <folly/chrono/Conv.h>
 #include <folly/experimental/logging/xlog.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include "eden/third-party/fuse_kernel_linux.h"
@@ -119,5 +120,14 @@ FakeFuse::Response FakeFuse::recvResponse() {
   return response;
 }
 
+bool FakeFuse::hasPendingData() const {
+  struct pollfd pfd = {};
+  pfd.fd = conn_.fd();
+  pfd.events = POLLIN;
+  auto result = poll(&pfd, 1, /* timeout */ 0);
+  folly::checkUnixError(result, "poll() failed on fake FUSE connection");
+  return (pfd.revents & POLLIN) != 0;
+}
+
 } // namespace eden
 } // namespace facebook
@@ -76,6 +76,12 @@ class FakeFuse {
 
   Response recvResponse();
 
+  /**
+   * Return true if the FUSE implementation has sent data that we have not
+   * received yet.  Unlike recvResponse() this never waits for data to arrive.
+   */
+  bool hasPendingData() const;
+
  private:
   FakeFuse(FakeFuse const&) = delete;
   FakeFuse& operator=(FakeFuse const&) = delete;
@@ -9,9 +9,13 @@
  */
 #include "TestMount.h"
 
+#include <folly/Conv.h>
+#include <folly/ExceptionString.h>
 #include <folly/FileUtil.h>
 #include <folly/experimental/TestUtil.h>
+#include <folly/experimental/logging/xlog.h>
 #include <folly/io/IOBuf.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
 #include <sys/types.h>
 #include "eden/fs/config/ClientConfig.h"
 #include "eden/fs/fuse/privhelper/UserInfo.h"
@@ -33,6 +37,7 @@
 #include "eden/fs/testharness/FakePrivHelper.h"
 #include "eden/fs/testharness/FakeTreeBuilder.h"
 #include "eden/fs/testharness/TestUtil.h"
+#include "eden/fs/utils/UnboundedQueueThreadPool.h"
 
 using folly::ByteRange;
 using folly::Future;
@@ -77,7 +82,18 @@ TestMount::TestMount(
   initialize(initialCommitHash, rootBuilder, startReady);
 }
 
-TestMount::~TestMount() {}
+TestMount::~TestMount() {
+  if (fuse_) {
+    // The FuseChannel must not be destroyed until the FUSE session is over.
+    fuse_->close();
+    try {
+      edenMount_->getFuseCompletionFuture().get(std::chrono::seconds(1));
+    } catch (const std::exception& ex) {
+      XLOG(ERR) << "error ending FUSE session for test mount: "
+                << folly::exceptionStr(ex);
+    }
+  }
+}
 
 void TestMount::initialize(
     Hash initialCommitHash,
@@ -132,6 +148,27 @@ void TestMount::registerFakeFuse(std::shared_ptr<FakeFuse> fuse) {
   privHelper_->registerMount(edenMount_->getPath(), std::move(fuse));
 }
 
+void TestMount::startFuse() {
+  fuse_ = make_shared<FakeFuse>();
+  registerFakeFuse(fuse_);
+  fuseEventBaseThread_ =
+      make_unique<folly::ScopedEventBaseThread>("TestMountFuse");
+  threadPool_ = make_shared<UnboundedQueueThreadPool>(1, "TestMountThread");
+  auto initFuture = edenMount_->startFuse(
+      fuseEventBaseThread_->getEventBase(), threadPool_, folly::none);
+
+  struct fuse_init_in initArg = {};
+  initArg.major = FUSE_KERNEL_VERSION;
+  initArg.minor = FUSE_KERNEL_MINOR_VERSION;
+  auto requestID = fuse_->sendRequest(FUSE_INIT, 1, initArg);
+  auto response = fuse_->recvResponse();
+  if (response.header.unique != requestID || response.header.error != 0) {
+    throw std::runtime_error(folly::to<string>(
+        "FUSE_INIT failed for test mount: error ", response.header.error));
+  }
+  initFuture.get(std::chrono::seconds(1));
+}
+
 Hash TestMount::nextCommitHash() {
   auto number = commitNumber_.fetch_add(1);
   return makeTestHash(folly::to<string>(number));
@@ -25,6 +25,7 @@
 namespace folly {
 template <typename T>
 class Future;
+class ScopedEventBaseThread;
 class Unit;
 } // namespace folly
 
@@ -38,6 +39,7 @@ class FakeTreeBuilder;
 class FileInode;
 class LocalStore;
 class TreeInode;
+class UnboundedQueueThreadPool;
 template <typename T>
 class StoredObject;
 using StoredHash = StoredObject<Hash>;
@@ -237,6 +239,20 @@ class TestMount {
 
   void registerFakeFuse(std::shared_ptr<FakeFuse> fuse);
 
+  /**
+   * Start FUSE for the mount on a FakeFuse device, and complete the
+   * FUSE_INIT handshake.
+   *
+   * This gives the EdenMount a thread pool, as in a real mount, so that
+   * code which hands work to EdenMount::getThreadPool() can be tested.  The
+   * pool has a single thread, so a test can hold it up by queueing a task
+   * that blocks.
+   *
+   * The FUSE session is ended when the TestMount is destroyed.  The mount
+   * must not be remounted after FUSE has been started.
+   */
+  void startFuse();
+
   /**
    * Get a hash to use for the next commit.
    *
@@ -272,6 +288,15 @@ class TestMount {
    */
   std::unique_ptr<folly::test::TemporaryDirectory> testDir_;
 
+  /**
+   * The FUSE device, the EventBase thread, and the thread pool set up by
+   * startFuse().  These are listed before edenMount_ so that they outlive
+   * it.
+   */
+  std::shared_ptr<FakeFuse> fuse_;
+  std::unique_ptr<folly::ScopedEventBaseThread> fuseEventBaseThread_;
+  std::shared_ptr<UnboundedQueueThreadPool> threadPool_;
+
   std::shared_ptr<EdenMount> edenMount_;
   std::shared_ptr<LocalStore> localStore_;
   std::shared_ptr<FakeBackingStore> backingStore_;
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/BoundedFetchQueue.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace facebook {
+namespace eden {
+
+BoundedFetchQueue::BoundedFetchQueue(size_t maxConcurrentFetches)
+    : maxConcurrentFetches_(std::max<size_t>(maxConcurrentFetches, 1)) {}
+
+BoundedFetchQueue::~BoundedFetchQueue() {
+  auto state = state_.rlock();
+  DCHECK_EQ(0, state->inFlight);
+  DCHECK(state->pending.empty());
+}
+
+size_t BoundedFetchQueue::getInFlight() const {
+  return state_.rlock()->inFlight;
+}
+
+size_t BoundedFetchQueue::getQueued() const {
+  return state_.rlock()->queued;
+}
+
+bool BoundedFetchQueue::tryStart(
+    size_t priority,
+    folly::Function<void()>& start) {
+  auto state = state_.wlock();
+  if (state->inFlight >= maxConcurrentFetches_) {
+    state->pending[priority].push_back(std::move(start));
+    ++state->queued;
+    return false;
+  }
+  ++state->inFlight;
+  return true;
+}
+
+void BoundedFetchQueue::fetchFinished() {
+  folly::Function<void()> next;
+  {
+    auto state = state_.wlock();
+    if (state->pending.empty()) {
+      --state->inFlight;
+      return;
+    }
+    auto first = state->pending.begin();
+    next = std::move(first->second.front());
+    first->second.pop_front();
+    if (first->second.empty()) {
+      state->pending.erase(first);
+    }
+    --state->queued;
+  }
+  // The slot passes directly to the next fetch, so inFlight is unchanged.
+  next();
+}
+} // namespace eden
+} // namespace facebook
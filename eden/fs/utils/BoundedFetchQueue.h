@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Function.h>
+#include <folly/Synchronized.h>
+#include <folly/futures/Future.h>
+#include <deque>
+#include <map>
+#include <memory>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Limits how many fetches are in flight at once, queueing the rest until an
+ * earlier fetch finishes.
+ *
+ * Queued fetches are started lowest priority value first, and in the order
+ * they were scheduled within a priority.  When a fetch finishes its slot
+ * passes straight to the next queued fetch, before the finished fetch's
+ * Future is fulfilled.
+ *
+ * Fetches refer to the BoundedFetchQueue without owning it, so callers must
+ * wait for every Future returned by schedule() to complete before destroying
+ * it, even when some other part of their operation has already failed.
+ *
+ * BoundedFetchQueue is thread safe.
+ */
+class BoundedFetchQueue {
+ public:
+  explicit BoundedFetchQueue(size_t maxConcurrentFetches);
+  ~BoundedFetchQueue();
+
+  /**
+   * Call fetch() now if fewer than maxConcurrentFetches fetches are in
+   * flight, or once enough of them have finished otherwise.
+   */
+  template <typename T>
+  folly::Future<T> schedule(
+      size_t priority,
+      folly::Function<folly::Future<T>()> fetch) {
+    auto promise = std::make_shared<folly::Promise<T>>();
+    auto future = promise->getFuture();
+    folly::Function<void()> start = [this,
+                                     promise,
+                                     fetch = std::move(fetch)]() mutable {
+      folly::makeFutureWith(std::move(fetch))
+          .then([this, promise](folly::Try<T>&& result) {
+            // Hand our slot on before fulfilling the promise, since the
+            // caller's callbacks will usually want to fetch more objects.
+            fetchFinished();
+            promise->setTry(std::move(result));
+          });
+    };
+
+    if (!tryStart(priority, start)) {
+      return future;
+    }
+    start();
+    return future;
+  }
+
+  /** The number of fetches that have been started but not finished. */
+  size_t getInFlight() const;
+
+  /** The number of fetches waiting for one of the in-flight ones. */
+  size_t getQueued() const;
+
+ private:
+  struct State {
+    size_t inFlight{0};
+    size_t queued{0};
+    std::map<size_t, std::deque<folly::Function<void()>>> pending;
+  };
+
+  /**
+   * Take a slot and return true, or queue start and return false if all of
+   * the slots are in use.
+   */
+  bool tryStart(size_t priority, folly::Function<void()>& start);
+  void fetchFinished();
+
+  const size_t maxConcurrentFetches_;
+  folly::Synchronized<State> state_;
+};
+} // namespace eden
+} // namespace facebook
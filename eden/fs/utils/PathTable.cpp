@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PathTable.h"
+
+#include <folly/hash/Hash.h>
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace facebook {
+namespace eden {
+
+constexpr PathTable::Id PathTable::kRoot;
+
+PathTable::PathTable() {
+  nodes_.push_back(Node{std::string{}, kRoot, 0});
+}
+
+size_t PathTable::KeyHash::operator()(const Key& key) const {
+  return folly::hash::hash_combine(key.first, key.second);
+}
+
+size_t PathTable::nodeMemoryUsage(PathComponentPiece name) {
+  // The node itself, the name data, and roughly one node and one bucket of
+  // the hash table.
+  return sizeof(Node) + name.stringPiece().size() +
+      sizeof(std::pair<Key, Id>) + 3 * sizeof(void*);
+}
+
+PathTable::Id PathTable::intern(RelativePathPiece path) {
+  auto id = kRoot;
+  for (auto name : path.components()) {
+    auto child = intern(id, name);
+    // The child holds its own reference to its parent, so we can drop the
+    // one we took on the previous iteration.
+    release(id);
+    id = child;
+  }
+  return id;
+}
+
+PathTable::Id PathTable::intern(Id parent, PathComponentPiece name) {
+  auto it = ids_.find(Key{parent, name});
+  if (it != ids_.end()) {
+    ++nodes_[it->second].refCount;
+    return it->second;
+  }
+
+  Id id;
+  if (!freeIds_.empty()) {
+    id = freeIds_.back();
+    freeIds_.pop_back();
+    auto& node = nodes_[id];
+    node.name = name.stringPiece().str();
+    node.parent = parent;
+  } else {
+    id = nodes_.size();
+    nodes_.push_back(Node{name.stringPiece().str(), parent, 0});
+  }
+  nodes_[id].refCount = 1;
+  addRef(parent);
+  ids_.emplace(Key{parent, getName(id)}, id);
+  memoryUsage_ += nodeMemoryUsage(name);
+  return id;
+}
+
+void PathTable::addRef(Id id) {
+  if (id != kRoot) {
+    DCHECK_GT(nodes_[id].refCount, 0);
+    ++nodes_[id].refCount;
+  }
+}
+
+void PathTable::release(Id id) {
+  // Releasing the last reference to a path releases its reference to its
+  // parent, and so on up the tree.
+  while (id != kRoot) {
+    auto& node = nodes_[id];
+    DCHECK_GT(node.refCount, 0);
+    if (--node.refCount > 0) {
+      return;
+    }
+
+    auto parent = node.parent;
+    memoryUsage_ -= nodeMemoryUsage(getName(id));
+    ids_.erase(Key{parent, getName(id)});
+    node.name = std::string{};
+    freeIds_.push_back(id);
+    id = parent;
+  }
+}
+
+RelativePath PathTable::getPath(Id id) const {
+  std::vector<Id> ids;
+  size_t length = 0;
+  for (; id != kRoot; id = nodes_[id].parent) {
+    ids.push_back(id);
+    length += nodes_[id].name.size() + 1;
+  }
+  if (ids.empty()) {
+    return RelativePath{};
+  }
+
+  std::string path;
+  path.reserve(length - 1);
+  for (auto it = ids.rbegin(); it != ids.rend(); ++it) {
+    if (!path.empty()) {
+      path.push_back(kDirSeparator);
+    }
+    path.append(nodes_[*it].name);
+  }
+  return RelativePath{std::move(path), detail::SkipPathSanityCheck{}};
+}
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Interns relative paths as a tree of (parent, PathComponent) nodes.
+ *
+ * Each distinct path is referred to by a small integer ID.  Only the final
+ * component of each path is stored, so paths that share a directory share
+ * the storage for it, and interning a path only hashes an integer and a
+ * single component at each level.  This makes the table much cheaper than a
+ * set of RelativePaths for the large, deep sets of paths produced by the
+ * journal and by diff operations.
+ *
+ * IDs are reference counted: every intern() or addRef() must be balanced by
+ * a release(), after which the ID may be reused for a different path.  A
+ * path also holds a reference to its parent, so a directory stays in the
+ * table as long as any path below it does.
+ *
+ * PathTable is not thread safe; callers must provide their own locking.
+ */
+class PathTable {
+ public:
+  using Id = uint32_t;
+
+  /**
+   * The ID of the empty path, which is the parent of all top-level paths.
+   * It is always present, and is not reference counted.
+   */
+  static constexpr Id kRoot = 0;
+
+  PathTable();
+
+  /**
+   * Return the ID for the given path, adding it (and its parent directories)
+   * to the table if necessary, and take a reference to it.
+   */
+  Id intern(RelativePathPiece path);
+
+  /**
+   * Return the ID for the child of the given path with the given name,
+   * adding it to the table if necessary, and take a reference to it.
+   *
+   * The caller must hold a reference to parent for the duration of the call.
+   */
+  Id intern(Id parent, PathComponentPiece name);
+
+  /**
+   * Take an additional reference to an ID the caller already holds.
+   */
+  void addRef(Id id);
+
+  /**
+   * Release a reference taken by intern() or addRef().
+   */
+  void release(Id id);
+
+  Id getParent(Id id) const {
+    return nodes_[id].parent;
+  }
+
+  /**
+   * Return the final component of the path.  This must not be called with
+   * kRoot.
+   */
+  PathComponentPiece getName(Id id) const {
+    return PathComponentPiece{nodes_[id].name, detail::SkipPathSanityCheck{}};
+  }
+
+  /**
+   * Return the full path with the given ID.
+   */
+  RelativePath getPath(Id id) const;
+
+  /**
+   * Return the number of paths currently in the table, including parent
+   * directories that were only added implicitly, but not including kRoot.
+   */
+  size_t size() const {
+    return ids_.size();
+  }
+
+  /**
+   * Return an estimate of the memory used by the table, in bytes.
+   */
+  size_t getMemoryUsage() const {
+    return memoryUsage_;
+  }
+
+ private:
+  struct Node {
+    /** Already validated when the node was added.  This is a plain string
+     * so that it can be emptied when the node is released. */
+    std::string name;
+    Id parent;
+    /** References held by users of the table, plus one for each child. */
+    uint32_t refCount;
+  };
+
+  using Key = std::pair<Id, PathComponentPiece>;
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  static size_t nodeMemoryUsage(PathComponentPiece name);
+
+  // A deque, since ids_ holds pieces pointing into the names of the nodes
+  // and those must not move when the table grows.  nodes_[kRoot] is a
+  // placeholder for the empty path.
+  std::deque<Node> nodes_;
+  std::vector<Id> freeIds_;
+  std::unordered_map<Key, Id, KeyHash> ids_;
+  size_t memoryUsage_{0};
+};
+} // namespace eden
+} // namespace facebook
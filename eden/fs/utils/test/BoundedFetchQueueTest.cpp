@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/BoundedFetchQueue.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace facebook::eden;
+using folly::Future;
+using folly::Promise;
+using std::vector;
+using ::testing::ElementsAre;
+
+TEST(BoundedFetchQueue, limitsFetchesInFlight) {
+  BoundedFetchQueue queue(2);
+  vector<Promise<int>> promises(3);
+  vector<Future<int>> futures;
+  vector<size_t> started;
+  for (size_t n = 0; n < promises.size(); ++n) {
+    futures.push_back(queue.schedule<int>(0, [&, n] {
+      started.push_back(n);
+      return promises[n].getFuture();
+    }));
+  }
+  EXPECT_THAT(started, ElementsAre(0, 1));
+  EXPECT_EQ(2, queue.getInFlight());
+  EXPECT_EQ(1, queue.getQueued());
+
+  // The finished fetch's slot goes straight to the queued one.
+  promises[1].setValue(1);
+  EXPECT_EQ(1, futures[1].value());
+  EXPECT_THAT(started, ElementsAre(0, 1, 2));
+  EXPECT_EQ(2, queue.getInFlight());
+  EXPECT_EQ(0, queue.getQueued());
+
+  promises[0].setValue(0);
+  promises[2].setException(std::runtime_error("fetch failed"));
+  EXPECT_EQ(0, futures[0].value());
+  EXPECT_THROW(futures[2].value(), std::runtime_error);
+  EXPECT_EQ(0, queue.getInFlight());
+}
+
+TEST(BoundedFetchQueue, startsLowestPriorityFirst) {
+  BoundedFetchQueue queue(1);
+  Promise<folly::Unit> first;
+  vector<size_t> started;
+  auto schedule = [&](size_t priority) {
+    return queue.schedule<folly::Unit>(priority, [&started, priority] {
+      started.push_back(priority);
+      return folly::makeFuture();
+    });
+  };
+
+  auto f0 = queue.schedule<folly::Unit>(0, [&] { return first.getFuture(); });
+  auto f3 = schedule(3);
+  auto f1 = schedule(1);
+  auto f2 = schedule(2);
+  auto f1b = schedule(1);
+  EXPECT_EQ(4, queue.getQueued());
+
+  first.setValue();
+  EXPECT_THAT(started, ElementsAre(1, 1, 2, 3));
+  EXPECT_TRUE(f3.isReady());
+  EXPECT_EQ(0, queue.getInFlight());
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PathTable.h"
+#include <gtest/gtest.h>
+
+using facebook::eden::PathComponentPiece;
+using facebook::eden::PathTable;
+using facebook::eden::RelativePath;
+using facebook::eden::RelativePathPiece;
+
+TEST(PathTable, internReturnsSameIdForSamePath) {
+  PathTable table;
+  auto id1 = table.intern(RelativePathPiece{"foo/bar/baz.txt"});
+  auto id2 = table.intern(RelativePathPiece{"foo/bar/baz.txt"});
+  EXPECT_EQ(id1, id2);
+  EXPECT_EQ(RelativePath{"foo/bar/baz.txt"}, table.getPath(id1));
+  EXPECT_EQ(PathComponentPiece{"baz.txt"}, table.getName(id1));
+
+  // Each directory is stored once.
+  EXPECT_EQ(3, table.size());
+  auto id3 = table.intern(RelativePathPiece{"foo/bar/other.txt"});
+  EXPECT_NE(id1, id3);
+  EXPECT_EQ(4, table.size());
+  EXPECT_EQ(table.getParent(id1), table.getParent(id3));
+  EXPECT_EQ(RelativePath{"foo/bar"}, table.getPath(table.getParent(id1)));
+}
+
+TEST(PathTable, internChild) {
+  PathTable table;
+  auto dir = table.intern(RelativePathPiece{"a/b"});
+  auto child = table.intern(dir, PathComponentPiece{"c"});
+  EXPECT_EQ(child, table.intern(RelativePathPiece{"a/b/c"}));
+  EXPECT_EQ(RelativePath{"a/b/c"}, table.getPath(child));
+
+  auto top = table.intern(PathTable::kRoot, PathComponentPiece{"a"});
+  EXPECT_EQ(table.getParent(dir), top);
+}
+
+TEST(PathTable, emptyPathIsRoot) {
+  PathTable table;
+  EXPECT_EQ(PathTable::kRoot, table.intern(RelativePathPiece{}));
+  EXPECT_EQ(RelativePath{}, table.getPath(PathTable::kRoot));
+  table.release(PathTable::kRoot);
+  EXPECT_EQ(0, table.size());
+}
+
+TEST(PathTable, releaseRemovesUnreferencedPaths) {
+  PathTable table;
+  EXPECT_EQ(0, table.getMemoryUsage());
+
+  auto file1 = table.intern(RelativePathPiece{"dir/sub/file1"});
+  auto file2 = table.intern(RelativePathPiece{"dir/sub/file2"});
+  auto dir = table.intern(RelativePathPiece{"dir"});
+  EXPECT_EQ(4, table.size());
+
+  // Releasing a file keeps the directories its sibling needs.
+  table.release(file1);
+  EXPECT_EQ(3, table.size());
+  EXPECT_EQ(RelativePath{"dir/sub/file2"}, table.getPath(file2));
+
+  // Releasing the last file below "dir/sub" removes "dir/sub" too, but
+  // "dir" is still referenced directly.
+  table.release(file2);
+  EXPECT_EQ(1, table.size());
+  EXPECT_EQ(RelativePath{"dir"}, table.getPath(dir));
+
+  table.release(dir);
+  EXPECT_EQ(0, table.size());
+  EXPECT_EQ(0, table.getMemoryUsage());
+}
+
+TEST(PathTable, idsAreReused) {
+  PathTable table;
+  auto id = table.intern(RelativePathPiece{"x"});
+  table.release(id);
+  auto newId = table.intern(RelativePathPiece{"y"});
+  EXPECT_EQ(id, newId);
+  EXPECT_EQ(RelativePath{"y"}, table.getPath(newId));
+}
+
+TEST(PathTable, addRef) {
+  PathTable table;
+  auto id = table.intern(RelativePathPiece{"a/b"});
+  table.addRef(id);
+  table.release(id);
+  EXPECT_EQ(2, table.size());
+  table.release(id);
+  EXPECT_EQ(0, table.size());
+}
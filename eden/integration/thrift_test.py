@@ -132,6 +132,43 @@ class ThriftTest:
         self.assertIn('unterminated bracket sequence',
                       str(ctx.exception))
 
+    def test_glob_does_not_load_unmodified_directories(self):
+        loaded_before = self.get_loaded_inodes_count('')
+        self.assertCountEqual(
+            ['adir/file', 'bdir/file'], self.client.glob(self.mount, ['**/file']))
+        self.assertCountEqual(
+            ['adir/file', 'bdir/file'], self.client.glob(self.mount, ['*/file']))
+        self.assertEqual(
+            loaded_before, self.get_loaded_inodes_count(''),
+            msg='Unmodified directories are read from source control trees')
+
+    def test_glob_sees_local_changes(self):
+        self.write_file('adir/newfile', 'new!\n')
+        self.write_file('cdir/file', 'baz!\n')
+        self.assertCountEqual(
+            ['adir/file', 'bdir/file', 'cdir/file'],
+            self.client.glob(self.mount, ['**/file']))
+        self.assertCountEqual(
+            ['adir/file', 'adir/newfile'],
+            self.client.glob(self.mount, ['adir/*']))
+
+    def test_glob_reports_each_match_once(self):
+        # Enough directories that they are evaluated in parallel, with most
+        # files matched by more than one pattern.
+        expected = []
+        for i in range(20):
+            for j in range(5):
+                path = 'many/dir%d/file%d.txt' % (i, j)
+                self.write_file(path, 'contents\n')
+                expected.append(path)
+        expected.append('adir/file')
+        expected.append('bdir/file')
+
+        result = self.client.glob(
+            self.mount, ['many/**/*.txt', 'many/*/file1.txt', '**/file*'])
+        self.assertEqual(len(set(result)), len(result))
+        self.assertCountEqual(expected, result)
+
     def test_unload_free_inodes(self):
         for i in range(100):
             self.write_file('testfile%d.txt' % i, 'unload test case')